@@ -0,0 +1,172 @@
+//
+//  bloomfilterbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of the lookup filter of RMDatabaseCache: fills an RMBloomFilter sized for
+// a number of tiles with the key hashes of that many stored tiles, then measures how
+// many tiles that were never stored it reports, and how long a lookup takes, then
+// removes half the tiles and measures again, as purges do.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o bloomfilterbench bloomfilterbench.c ../Map/RMBloomFilter.c ../Map/RMCacheKey.c
+//   ./bloomfilterbench -n 16384,100000,1000000 -p 0.01
+//
+// Writes one CSV row per number of tiles and phase.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMBloomFilter.h"
+#include "RMCacheKey.h"
+
+// Lookups of tiles that were never stored, per measurement
+#define kBenchLookups 1000000
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Tiles of zoom 16 along rows, stored ones first and then never stored ones, all with
+// the cache key of a typical tile source
+static uint64_t BenchKeyHash(size_t i)
+{
+    uint64_t x = i % 65536, y = 20000 + i / 65536, zoom = 16;
+
+    return RMCacheKeyHash(zoom << 56 | x << 28 | y, "OpenStreetMap");
+}
+
+static void BenchMeasure(FILE *output, RMBloomFilter *filter, const char *phase, size_t count, double rate, size_t firstAbsent)
+{
+    size_t falsePositives = 0;
+    double start = BenchNow();
+
+    for (size_t i = 0; i < kBenchLookups; i++)
+        falsePositives += RMBloomFilterMayContain(filter, BenchKeyHash(firstAbsent + i));
+
+    double seconds = BenchNow() - start;
+
+    fprintf(output, "%lu,%g,%s,%lu,%.4f,%.1f\n",
+            (unsigned long)count,
+            rate,
+            phase,
+            (unsigned long)kBenchLookups,
+            100.0 * falsePositives / kBenchLookups,
+            seconds * 1e9 / kBenchLookups);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n tiles,... ] [ -p false positive rate ] [ -o file ]\n"
+            "\n"
+            "Fills a filter sized for each number of tiles with that many, and looks up\n"
+            "%d tiles that were never stored.\n",
+            program, kBenchLookups);
+}
+
+int main(int argc, char **argv)
+{
+    const char *counts = "16384,100000,1000000";
+    const char *outputPath = NULL;
+    double rate = 0.01;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:p:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': counts = optarg; break;
+            case 'p': rate = atof(optarg); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "tiles,target_rate,phase,lookups,false_positive_percent,ns_per_lookup\n");
+
+    char *list = strdup(counts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t count = strtoul(item, NULL, 10);
+        RMBloomFilter *filter = RMBloomFilterCreate(count, rate);
+
+        if ( ! filter)
+        {
+            fprintf(stderr, "could not allocate a filter for %lu tiles\n", (unsigned long)count);
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            RMBloomFilterAdd(filter, BenchKeyHash(i));
+
+        BenchMeasure(output, filter, "full", count, rate, count);
+
+        for (size_t i = 0; i < count; i += 2)
+            RMBloomFilterRemove(filter, BenchKeyHash(i));
+
+        BenchMeasure(output, filter, "half_removed", count, rate, count);
+
+        // Removing never gives a false negative for the tiles left
+        for (size_t i = 1; i < count; i += 2)
+        {
+            if ( ! RMBloomFilterMayContain(filter, BenchKeyHash(i)))
+            {
+                fprintf(stderr, "tile %lu missing after removals\n", (unsigned long)i);
+                return 1;
+            }
+        }
+
+        RMBloomFilterDestroy(filter);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,474 @@
+//
+//  cachetracereplay.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Replays tile request traces against the tile cache policies and reports the
+// hit ratio of each, for choosing a purge strategy and capacity.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o cachetracereplay cachetracereplay.c ../Map/RMLRUCache.c ../Map/RMFrequencySketch.c ../Map/RMCacheKey.c
+//   ./cachetracereplay -c 64,256,1024 access.log
+//   ./cachetracereplay -g pan-scan
+//
+// A trace has one request per line, either "zoom x y [cache key]" or any line
+// containing "zoom/x/y", such as a tile server access log. Other lines are skipped.
+//
+// Policies:
+//   lru         RMMemoryCache with RMCachePurgeStrategyLRU (RMLRUCacheGet)
+//   clock       the same with the sharded cache's CLOCK hits (RMLRUCacheGetShared)
+//   fifo        RMDatabaseCache with RMCachePurgeStrategyFIFO
+//   w-tinylfu   RMMemoryCache with RMCachePurgeStrategyTinyLFU
+//   tinylfu     RMDatabaseCache with RMCachePurgeStrategyTinyLFU: LRU, admitting a
+//               new tile into a full cache only if it is more frequent than the victim
+//
+// The database cache's minimal purge and expiry period are not modelled.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "RMLRUCache.h"
+#include "RMCacheKey.h"
+#include "RMFrequencySketch.h"
+
+typedef struct {
+    uint64_t tileKey;
+    int cacheKey; // index into BenchTrace.cacheKeys
+} BenchRequest;
+
+typedef struct {
+    const char *name;
+    BenchRequest *requests;
+    long count, capacity;
+    char **cacheKeys;
+    int cacheKeyCount;
+} BenchTrace;
+
+typedef enum {
+    BenchPolicyLRU,
+    BenchPolicyClock,
+    BenchPolicyFIFO,
+    BenchPolicyWTinyLFU,
+    BenchPolicyTinyLFU,
+    BenchPolicyCount,
+} BenchPolicy;
+
+static const char *kBenchPolicyNames[BenchPolicyCount] = { "lru", "clock", "fifo", "w-tinylfu", "tinylfu" };
+
+static unsigned long benchSeed = 1;
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    return (unsigned long)(benchSeed >> 33);
+}
+
+// Same layout as RMTileKey() in RMTile.c, which needs CoreGraphics to include.
+static uint64_t BenchTileKey(uint32_t x, uint32_t y, short zoom)
+{
+    return ((uint64_t)(zoom & 0xFF) << 56) | ((uint64_t)(x & 0xFFFFFFF) << 28) | (uint64_t)(y & 0xFFFFFFF);
+}
+
+static int BenchTraceCacheKey(BenchTrace *trace, const char *cacheKey)
+{
+    for (int i = 0; i < trace->cacheKeyCount; i++)
+    {
+        if (strcmp(trace->cacheKeys[i], cacheKey) == 0)
+            return i;
+    }
+
+    trace->cacheKeys = realloc(trace->cacheKeys, (trace->cacheKeyCount + 1) * sizeof(char *));
+    trace->cacheKeys[trace->cacheKeyCount] = strdup(cacheKey);
+
+    return trace->cacheKeyCount++;
+}
+
+static void BenchTraceAdd(BenchTrace *trace, uint32_t x, uint32_t y, short zoom, const char *cacheKey)
+{
+    if (trace->count == trace->capacity)
+    {
+        trace->capacity = (trace->capacity ? trace->capacity * 2 : 4096);
+        trace->requests = realloc(trace->requests, trace->capacity * sizeof(BenchRequest));
+    }
+
+    trace->requests[trace->count].tileKey = BenchTileKey(x, y, zoom);
+    trace->requests[trace->count].cacheKey = BenchTraceCacheKey(trace, cacheKey);
+    trace->count++;
+}
+
+#pragma mark -
+
+// Parse "zoom x y [cache key]", or the last "zoom/x/y" in the line.
+static int BenchParseLine(const char *line, unsigned long *zoom, unsigned long *x, unsigned long *y, char *cacheKey, size_t cacheKeySize)
+{
+    const char *found = NULL;
+
+    cacheKey[0] = '\0';
+
+    for (const char *c = line; *c; c++)
+    {
+        unsigned long a, b, d;
+        int length = 0;
+
+        if (isdigit((unsigned char)*c) && (c == line || ! isdigit((unsigned char)c[-1])) &&
+            sscanf(c, "%lu/%lu/%lu%n", &a, &b, &d, &length) == 3 && length > 0)
+        {
+            found = c;
+            *zoom = a; *x = b; *y = d;
+        }
+    }
+
+    if (found)
+        return 1;
+
+    int consumed = 0;
+
+    if (sscanf(line, "%lu %lu %lu %n", zoom, x, y, &consumed) != 3)
+        return 0;
+
+    size_t length = strcspn(line + consumed, "\r\n");
+
+    if (length >= cacheKeySize)
+        length = cacheKeySize - 1;
+
+    memcpy(cacheKey, line + consumed, length);
+    cacheKey[length] = '\0';
+
+    return 1;
+}
+
+static void BenchTracesFree(BenchTrace *traces, int count)
+{
+    for (int t = 0; t < count; t++)
+    {
+        for (int i = 0; i < traces[t].cacheKeyCount; i++)
+            free(traces[t].cacheKeys[i]);
+
+        free(traces[t].cacheKeys);
+        free(traces[t].requests);
+    }
+
+    free(traces);
+}
+
+static int BenchTraceRead(BenchTrace *trace, const char *path)
+{
+    FILE *input = (strcmp(path, "-") == 0 ? stdin : fopen(path, "r"));
+    char line[4096], cacheKey[256];
+
+    if ( ! input)
+    {
+        perror(path);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), input))
+    {
+        unsigned long zoom, x, y;
+
+        if (BenchParseLine(line, &zoom, &x, &y, cacheKey, sizeof(cacheKey)) && zoom < 32)
+            BenchTraceAdd(trace, (uint32_t)x, (uint32_t)y, (short)zoom, cacheKey);
+    }
+
+    if (input != stdin)
+        fclose(input);
+
+    return 1;
+}
+
+// Request the tiles of a 5x4 tile viewport at (x, y) that were not visible at the
+// previous position, the way a tiled layer only asks for newly exposed tiles.
+static void BenchTraceView(BenchTrace *trace, uint32_t x, uint32_t y, uint32_t *previous)
+{
+    for (int i = 0; i < 20; i++)
+    {
+        uint32_t tileX = x + i % 5, tileY = y + i / 5;
+
+        if (previous && tileX - previous[0] < 5 && tileY - previous[1] < 4)
+            continue;
+
+        BenchTraceAdd(trace, tileX, tileY, 14, "");
+    }
+}
+
+// Synthetic traces:
+//   pan-scan   browsing around a few favourite places, with now and then a fast pan
+//              across a continent at zoom 14 whose tiles are never seen again
+//   browse     the same without the long pans
+static int BenchTraceGenerate(BenchTrace *trace, const char *scenario, long requests)
+{
+    int scans = (strcmp(scenario, "pan-scan") == 0);
+
+    if ( ! scans && strcmp(scenario, "browse") != 0)
+        return 0;
+
+    uint32_t places[8][2];
+
+    for (int i = 0; i < 8; i++)
+    {
+        places[i][0] = 8000 + BenchRandom() % 400;
+        places[i][1] = 5000 + BenchRandom() % 400;
+    }
+
+    while (trace->count < requests)
+    {
+        uint32_t position[2], previous[2];
+
+        if (scans && BenchRandom() % 10 == 0)
+        {
+            // A pan of 1000 steps of two tiles, all new tiles.
+            position[0] = 2000 + BenchRandom() % 8000;
+            position[1] = 6000 + BenchRandom() % 2000;
+
+            BenchTraceView(trace, position[0], position[1], NULL);
+
+            for (int step = 0; step < 1000 && trace->count < requests; step++)
+            {
+                memcpy(previous, position, sizeof(position));
+                position[0] += 2;
+                BenchTraceView(trace, position[0], position[1], previous);
+            }
+
+            continue;
+        }
+
+        // A visit to a favourite place, the first ones more often, with some panning around.
+        int place = 0;
+
+        while (place < 7 && BenchRandom() % 2)
+            place++;
+
+        memcpy(position, places[place], sizeof(position));
+        BenchTraceView(trace, position[0], position[1], NULL);
+
+        for (int step = 0; step < 20 && trace->count < requests; step++)
+        {
+            memcpy(previous, position, sizeof(position));
+
+            switch (BenchRandom() % 4)
+            {
+                case 0: position[0]++; break;
+                case 1: position[0]--; break;
+                case 2: position[1]++; break;
+                case 3: position[1]--; break;
+            }
+
+            BenchTraceView(trace, position[0], position[1], previous);
+        }
+    }
+
+    return 1;
+}
+
+#pragma mark -
+
+static long BenchReplay(BenchTrace *trace, BenchPolicy policy, size_t capacity)
+{
+    RMLRUCache *cache = RMLRUCacheCreate(0, capacity, NULL);
+    RMFrequencySketch *sketch = NULL;
+    long hits = 0;
+
+    if (policy == BenchPolicyWTinyLFU)
+        RMLRUCacheSetAdmission(cache, RMLRUCacheAdmissionTinyLFU, capacity);
+
+    if (policy == BenchPolicyTinyLFU)
+        sketch = RMFrequencySketchCreate(capacity * 16); // as RMDatabaseCache does
+
+    for (long i = 0; i < trace->count; i++)
+    {
+        uint64_t tileKey = trace->requests[i].tileKey;
+        const char *cacheKey = trace->cacheKeys[trace->requests[i].cacheKey];
+        void *value;
+
+        switch (policy)
+        {
+            case BenchPolicyClock: value = RMLRUCacheGetShared(cache, tileKey, cacheKey); break;
+            case BenchPolicyFIFO: value = RMLRUCachePeek(cache, tileKey, cacheKey); break;
+            default: value = RMLRUCacheGet(cache, tileKey, cacheKey); break;
+        }
+
+        if (sketch)
+            RMFrequencySketchIncrement(sketch, RMCacheKeyHash(tileKey, cacheKey));
+
+        if (value)
+        {
+            hits++;
+            continue;
+        }
+
+        uint64_t victimTileKey;
+        const char *victimCacheKey;
+
+        if (sketch && RMLRUCacheCount(cache) >= capacity && RMLRUCachePeekOldest(cache, &victimTileKey, &victimCacheKey) &&
+            RMFrequencySketchEstimate(sketch, RMCacheKeyHash(tileKey, cacheKey)) <= RMFrequencySketchEstimate(sketch, RMCacheKeyHash(victimTileKey, victimCacheKey)))
+            continue;
+
+        RMLRUCachePut(cache, tileKey, cacheKey, cache, 1);
+    }
+
+    RMFrequencySketchDestroy(sketch);
+    RMLRUCacheDestroy(cache);
+
+    return hits;
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -c capacity,... ] [ -p policy,... ] [ -o file ] trace ...\n"
+            "       %s [ -c capacity,... ] [ -p policy,... ] [ -o file ] -g pan-scan|browse [ -n requests ] [ -s seed ]\n"
+            "\n"
+            "Replays tile request traces (\"-\" for stdin) against each cache policy\n"
+            "(lru, clock, fifo, w-tinylfu, tinylfu) and capacity in tiles.\n",
+            program, program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *capacities = "256,1024,4096";
+    const char *policies = NULL;
+    const char *generate = NULL;
+    const char *outputPath = NULL;
+    long requests = 1000000;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:p:g:n:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'c': capacities = optarg; break;
+            case 'p': policies = optarg; break;
+            case 'g': generate = optarg; break;
+            case 'n': requests = atol(optarg); break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if ((generate == NULL) == (optind == argc) || requests <= 0)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    int traceCount = (generate ? 1 : argc - optind);
+    BenchTrace *traces = calloc(traceCount, sizeof(BenchTrace));
+
+    for (int i = 0; i < traceCount; i++)
+    {
+        traces[i].name = (generate ? generate : argv[optind + i]);
+
+        if ( ! (generate ? BenchTraceGenerate(&traces[i], generate, requests) : BenchTraceRead(&traces[i], traces[i].name)))
+        {
+            if (generate)
+                fprintf(stderr, "unknown scenario %s\n", generate);
+
+            BenchTracesFree(traces, traceCount);
+            return 1;
+        }
+    }
+
+    int enabled[BenchPolicyCount];
+
+    for (int p = 0; p < BenchPolicyCount; p++)
+        enabled[p] = (policies == NULL);
+
+    if (policies)
+    {
+        char *list = strdup(policies);
+
+        for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+        {
+            int p;
+
+            for (p = 0; p < BenchPolicyCount && strcmp(item, kBenchPolicyNames[p]) != 0; p++)
+                ;
+
+            if (p == BenchPolicyCount)
+            {
+                fprintf(stderr, "unknown policy %s\n", item);
+                free(list);
+                BenchTracesFree(traces, traceCount);
+                return 1;
+            }
+
+            enabled[p] = 1;
+        }
+
+        free(list);
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        BenchTracesFree(traces, traceCount);
+        return 1;
+    }
+
+    fprintf(output, "trace,policy,capacity_tiles,requests,hits,hit_ratio\n");
+
+    for (int t = 0; t < traceCount; t++)
+    {
+        char *list = strdup(capacities);
+
+        for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+        {
+            size_t capacity = strtoul(item, NULL, 10);
+
+            if (capacity < 1)
+                continue;
+
+            for (int p = 0; p < BenchPolicyCount; p++)
+            {
+                if ( ! enabled[p])
+                    continue;
+
+                long hits = BenchReplay(&traces[t], p, capacity);
+
+                fprintf(output, "%s,%s,%lu,%ld,%ld,%.4f\n", traces[t].name, kBenchPolicyNames[p], (unsigned long)capacity,
+                        traces[t].count, hits, (traces[t].count ? (double)hits / traces[t].count : 0.0));
+            }
+        }
+
+        free(list);
+    }
+
+    if (output != stdout)
+        fclose(output);
+
+    BenchTracesFree(traces, traceCount);
+
+    return 0;
+}
@@ -0,0 +1,377 @@
+//
+//  clusterindexbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of the precomputed cluster index (RMClusterIndex) against clustering the
+// visible points again every frame, on a simulated session of panning and zooming
+// over points spread on the spherical mercator plane, mostly around a few hundred
+// "cities". The per frame clustering finds the visible points with RMSpatialIndex
+// and builds a cluster index of them for the zoom level of the frame only.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o clusterindexbench clusterindexbench.c ../Map/RMClusterIndex.c ../Map/RMSpatialIndex.c ../Map/RMFoundation.c -lm
+//   ./clusterindexbench -n 100000,1000000 -f 1000
+//
+// Writes one CSV row per method and point count.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMClusterIndex.h"
+#include "RMSpatialIndex.h"
+
+// Half the width of the spherical mercator plane, as in +[RMProjection googleProjection]
+#define kBenchPlanetHalfWidth 20037508.34
+
+// Screen size in pixels
+#define kBenchScreenWidth 1024.0
+#define kBenchScreenHeight 768.0
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+// As in spatialindexbench.c
+static void BenchMakePoints(RMProjectedPoint *points, size_t count)
+{
+    RMProjectedPoint cities[256];
+
+    for (int i = 0; i < 256; i++)
+    {
+        cities[i].x = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth * 0.9;
+        cities[i].y = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth * 0.6;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (BenchRandom() % 10 < 8)
+        {
+            RMProjectedPoint city = cities[BenchRandom() % 256];
+            double radius = 50000.0 * pow(BenchUniform(), 2.0), angle = BenchUniform() * 2.0 * M_PI;
+
+            points[i].x = city.x + radius * cos(angle);
+            points[i].y = city.y + radius * sin(angle);
+        }
+        else
+        {
+            points[i].x = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth;
+            points[i].y = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth;
+        }
+    }
+}
+
+// A user session: pan a few pixels every frame, zoom in and out smoothly between
+// zoom 3 and 16, and now and then jump to another point.
+typedef struct {
+    RMProjectedPoint center;
+    double zoom;
+    double panX, panY, zoomSpeed;
+} BenchCamera;
+
+static void BenchCameraStep(BenchCamera *camera, const RMProjectedPoint *points, size_t count, double metersPerPixelAtZoomZero)
+{
+    double metersPerPixel = metersPerPixelAtZoomZero / pow(2.0, camera->zoom);
+
+    if (BenchRandom() % 200 == 0)
+    {
+        camera->center = points[(BenchRandom() << 15 | BenchRandom()) % count];
+        camera->zoom = 3.0 + BenchUniform() * 13.0;
+    }
+
+    if (BenchRandom() % 30 == 0)
+    {
+        camera->panX = (BenchUniform() * 2.0 - 1.0) * 20.0;
+        camera->panY = (BenchUniform() * 2.0 - 1.0) * 20.0;
+        camera->zoomSpeed = (BenchUniform() * 2.0 - 1.0) * 0.05;
+    }
+
+    camera->center.x += camera->panX * metersPerPixel;
+    camera->center.y += camera->panY * metersPerPixel;
+    camera->zoom += camera->zoomSpeed;
+
+    if (camera->zoom < 3.0 || camera->zoom > 16.0)
+    {
+        camera->zoomSpeed = -camera->zoomSpeed;
+        camera->zoom = fmin(16.0, fmax(3.0, camera->zoom));
+    }
+}
+
+static RMProjectedRect BenchCameraViewport(const BenchCamera *camera, double metersPerPixelAtZoomZero)
+{
+    double metersPerPixel = metersPerPixelAtZoomZero / pow(2.0, camera->zoom);
+    double width = kBenchScreenWidth * metersPerPixel, height = kBenchScreenHeight * metersPerPixel;
+
+    return RMProjectedRectMake(camera->center.x - width / 2.0, camera->center.y - height / 2.0, width, height);
+}
+
+#pragma mark -
+
+typedef struct {
+    const char *name;
+    size_t points;
+    double buildSeconds;
+    size_t frames;
+    double frameSeconds;
+    double maxFrameSeconds;
+    size_t clusters;
+} BenchResult;
+
+static bool BenchCountCluster(const RMCluster *cluster, void *context)
+{
+    (void)cluster;
+
+    (*(size_t *)context)++;
+
+    return true;
+}
+
+static void BenchRunClusterIndex(BenchResult *result, const RMProjectedPoint *points, const uintptr_t *items, size_t count, size_t frames)
+{
+    RMClusterIndexOptions options = RMClusterIndexDefaultOptions();
+    double start = BenchNow();
+    RMClusterIndex *index = RMClusterIndexCreate(&options, items, points, count);
+
+    result->buildSeconds = BenchNow() - start;
+    result->clusters = 0;
+    result->frameSeconds = result->maxFrameSeconds = 0.0;
+
+    BenchCamera camera = { points[0], 10.0, 5.0, 0.0, 0.02 };
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        BenchCameraStep(&camera, points, count, options.metersPerPixelAtZoomZero);
+
+        start = BenchNow();
+        RMClusterIndexQuery(index, BenchCameraViewport(&camera, options.metersPerPixelAtZoomZero), camera.zoom, BenchCountCluster, &result->clusters);
+
+        double seconds = BenchNow() - start;
+
+        result->frameSeconds += seconds;
+        result->maxFrameSeconds = fmax(result->maxFrameSeconds, seconds);
+    }
+
+    result->name = "cluster-index";
+
+    RMClusterIndexDestroy(index);
+}
+
+typedef struct {
+    const RMProjectedPoint *points;
+    uintptr_t *items;
+    RMProjectedPoint *visible;
+    size_t count;
+} BenchVisibleContext;
+
+static bool BenchCollectVisible(uintptr_t item, void *context)
+{
+    BenchVisibleContext *visible = context;
+
+    visible->items[visible->count] = item;
+    visible->visible[visible->count++] = visible->points[item - 1];
+
+    return true;
+}
+
+static void BenchRunPerFrame(BenchResult *result, const RMProjectedPoint *points, const uintptr_t *items, size_t count, size_t frames)
+{
+    RMClusterIndexOptions options = RMClusterIndexDefaultOptions();
+    RMProjectedRect *boxes = malloc(count * sizeof(RMProjectedRect));
+    BenchVisibleContext visible = { points, malloc(count * sizeof(uintptr_t)), malloc(count * sizeof(RMProjectedPoint)), 0 };
+
+    for (size_t i = 0; i < count; i++)
+        boxes[i] = RMProjectedRectMake(points[i].x, points[i].y, 0.0, 0.0);
+
+    double start = BenchNow();
+    RMSpatialIndex *index = RMSpatialIndexCreate(RMSpatialIndexOrderMorton);
+
+    RMSpatialIndexInsertMany(index, items, boxes, count);
+
+    result->buildSeconds = BenchNow() - start;
+    result->clusters = 0;
+    result->frameSeconds = result->maxFrameSeconds = 0.0;
+
+    BenchCamera camera = { points[0], 10.0, 5.0, 0.0, 0.02 };
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        BenchCameraStep(&camera, points, count, options.metersPerPixelAtZoomZero);
+
+        start = BenchNow();
+
+        RMProjectedRect viewport = BenchCameraViewport(&camera, options.metersPerPixelAtZoomZero);
+        RMClusterIndexOptions frameOptions = options;
+
+        visible.count = 0;
+        RMSpatialIndexQuery(index, viewport, BenchCollectVisible, &visible);
+
+        frameOptions.minZoom = frameOptions.maxZoom = (int)floor(camera.zoom);
+
+        RMClusterIndex *frameIndex = RMClusterIndexCreate(&frameOptions, visible.items, visible.visible, visible.count);
+
+        if (frameIndex)
+            RMClusterIndexQuery(frameIndex, viewport, camera.zoom, BenchCountCluster, &result->clusters);
+
+        RMClusterIndexDestroy(frameIndex);
+
+        double seconds = BenchNow() - start;
+
+        result->frameSeconds += seconds;
+        result->maxFrameSeconds = fmax(result->maxFrameSeconds, seconds);
+    }
+
+    result->name = "per-frame";
+
+    RMSpatialIndexDestroy(index);
+    free(boxes);
+    free(visible.items);
+    free(visible.visible);
+}
+
+static void BenchReport(FILE *output, BenchResult *result)
+{
+    fprintf(output, "%s,%lu,%.3f,%lu,%.1f,%.1f,%.1f\n",
+            result->name,
+            (unsigned long)result->points,
+            result->buildSeconds,
+            (unsigned long)result->frames,
+            result->frameSeconds * 1e6 / result->frames,
+            result->maxFrameSeconds * 1e6,
+            (double)result->clusters / result->frames);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n points,... ] [ -f frames ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Builds the cluster index over the points and replays the frames of a panning\n"
+            "and zooming session against it, then against clustering every frame.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *counts = "100000,1000000";
+    size_t frames = 1000;
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:f:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': counts = optarg; break;
+            case 'f': frames = strtoul(optarg, NULL, 10); break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (frames < 1)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "method,points,build_seconds,frames,us_per_frame,max_frame_us,clusters_per_frame\n");
+
+    char *list = strdup(counts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t count = strtoul(item, NULL, 10);
+
+        if (count < 1)
+            continue;
+
+        RMProjectedPoint *points = malloc(count * sizeof(RMProjectedPoint));
+        uintptr_t *items = malloc(count * sizeof(uintptr_t));
+        unsigned long seed;
+        BenchResult result;
+
+        BenchMakePoints(points, count);
+
+        for (size_t i = 0; i < count; i++)
+            items[i] = i + 1;
+
+        result.points = count;
+        result.frames = frames;
+        seed = benchSeed;
+
+        BenchRunClusterIndex(&result, points, items, count, frames);
+        BenchReport(output, &result);
+
+        benchSeed = seed;
+        BenchRunPerFrame(&result, points, items, count, frames);
+        BenchReport(output, &result);
+
+        free(points);
+        free(items);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
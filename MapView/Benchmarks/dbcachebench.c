@@ -0,0 +1,294 @@
+//
+//  dbcachebench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of sustained tile inserts into the RMDatabaseCache table, one implicit
+// transaction per INSERT as the cache used to do, against batches committed through
+// RMTileWriteBuffer. The database is set up like RMDatabaseCache does on first use.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -pthread -I../Map -o dbcachebench dbcachebench.c ../Map/RMTileWriteBuffer.c -lsqlite3
+//   ./dbcachebench -n 20000 -b 1,16,64,256 -d /tmp/dbcachebench.db
+//
+// Writes one CSV row per batch size; a batch size of 1 is the unbatched baseline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "RMTileWriteBuffer.h"
+
+static const char *kBenchCacheKey = "benchmark-tile-source";
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+// Same layout as RMTileKey() in RMTile.c, which needs CoreGraphics to include.
+static uint64_t BenchTileKey(uint32_t x, uint32_t y, short zoom)
+{
+    return ((uint64_t)(zoom & 0xFF) << 56) | ((uint64_t)(x & 0xFFFFFFF) << 28) | (uint64_t)(y & 0xFFFFFFF);
+}
+
+static sqlite3 *BenchOpenDatabase(const char *path)
+{
+    sqlite3 *db = NULL;
+
+    unlink(path);
+
+    if (sqlite3_open(path, &db) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    // As in -[RMDatabaseCache configureDBForFirstUse] and the table it creates.
+    sqlite3_exec(db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
+    sqlite3_exec(db, "PRAGMA journal_mode=OFF", NULL, NULL, NULL);
+    sqlite3_exec(db, "PRAGMA cache-size=100", NULL, NULL, NULL);
+    sqlite3_exec(db, "PRAGMA count_changes=OFF", NULL, NULL, NULL);
+    sqlite3_exec(db, "PRAGMA auto_vacuum=INCREMENTAL", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS ZCACHE (tile_hash INTEGER NOT NULL, cache_key VARCHAR(25) NOT NULL, last_used DOUBLE NOT NULL, data BLOB NOT NULL)", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE UNIQUE INDEX IF NOT EXISTS main_index ON ZCACHE(tile_hash, cache_key)", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE INDEX IF NOT EXISTS last_used_index ON ZCACHE(last_used)", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS ZCACHE_COUNT (count INTEGER NOT NULL)", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE TRIGGER IF NOT EXISTS zcache_count_insert AFTER INSERT ON ZCACHE BEGIN UPDATE ZCACHE_COUNT SET count = count + 1; END", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE TRIGGER IF NOT EXISTS zcache_count_delete AFTER DELETE ON ZCACHE BEGIN UPDATE ZCACHE_COUNT SET count = count - 1; END", NULL, NULL, NULL);
+    sqlite3_exec(db, "INSERT INTO ZCACHE_COUNT (count) VALUES (0)", NULL, NULL, NULL);
+
+    return db;
+}
+
+typedef struct {
+    size_t batchSize;
+    long tiles;
+    long inserted;
+    long transactions;
+    double seconds;
+} BenchResult;
+
+// Every tile is new; every fourth one is also touched, as a map redraw would.
+static void BenchRun(BenchResult *result, sqlite3 *db, long tiles, size_t batchSize, const void *data, size_t length)
+{
+    result->inserted = 0;
+    result->transactions = 0;
+
+    if (batchSize <= 1)
+    {
+        sqlite3_stmt *insert = NULL, *touch = NULL;
+
+        sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO ZCACHE (tile_hash, cache_key, last_used, data) VALUES (?, ?, ?, ?)", -1, &insert, NULL);
+        sqlite3_prepare_v2(db, "UPDATE ZCACHE SET last_used = ? WHERE tile_hash = ? AND cache_key = ?", -1, &touch, NULL);
+
+        double start = BenchNow();
+
+        for (long i = 0; i < tiles; i++)
+        {
+            int64_t tileHash = (int64_t)BenchTileKey(32768 + BenchRandom(), 32768 + BenchRandom(), 16);
+
+            sqlite3_bind_int64(insert, 1, tileHash);
+            sqlite3_bind_text(insert, 2, kBenchCacheKey, -1, SQLITE_STATIC);
+            sqlite3_bind_double(insert, 3, start + i);
+            sqlite3_bind_blob(insert, 4, data, (int)length, SQLITE_STATIC);
+
+            if (sqlite3_step(insert) == SQLITE_DONE)
+                result->inserted += sqlite3_changes(db);
+
+            sqlite3_reset(insert);
+            result->transactions++;
+
+            if (i % 4 == 0)
+            {
+                sqlite3_bind_double(touch, 1, start + i + 0.5);
+                sqlite3_bind_int64(touch, 2, tileHash);
+                sqlite3_bind_text(touch, 3, kBenchCacheKey, -1, SQLITE_STATIC);
+                sqlite3_step(touch);
+                sqlite3_reset(touch);
+                result->transactions++;
+            }
+        }
+
+        result->seconds = BenchNow() - start;
+
+        sqlite3_finalize(insert);
+        sqlite3_finalize(touch);
+    }
+    else
+    {
+        RMTileWriteBuffer *buffer = RMTileWriteBufferCreate(batchSize, 0);
+        double start = BenchNow();
+
+        for (long i = 0; i < tiles; i++)
+        {
+            int64_t tileHash = (int64_t)BenchTileKey(32768 + BenchRandom(), 32768 + BenchRandom(), 16);
+            RMTileWriteBufferState state = RMTileWriteBufferAddTile(buffer, tileHash, kBenchCacheKey, start + i, data, length);
+
+            if (i % 4 == 0)
+                state = RMTileWriteBufferTouchTile(buffer, tileHash, kBenchCacheKey, start + i + 0.5);
+
+            if (state != RMTileWriteBufferQueued)
+            {
+                long inserted = RMTileWriteBufferFlush(buffer, db, NULL);
+
+                if (inserted > 0)
+                    result->inserted += inserted;
+
+                result->transactions++;
+            }
+        }
+
+        long inserted = RMTileWriteBufferFlush(buffer, db, NULL);
+
+        if (inserted > 0)
+            result->inserted += inserted;
+
+        result->transactions++;
+        result->seconds = BenchNow() - start;
+
+        RMTileWriteBufferDestroy(buffer);
+    }
+}
+
+static void BenchReport(FILE *output, BenchResult *result)
+{
+    fprintf(output, "%s,%lu,%ld,%ld,%ld,%.6f,%.0f\n",
+            (result->batchSize <= 1 ? "per-statement" : "batched"),
+            (unsigned long)result->batchSize,
+            result->tiles,
+            result->inserted,
+            result->transactions,
+            result->seconds,
+            result->tiles / result->seconds);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n tiles ] [ -b batch,... ] [ -k tile_bytes ] [ -d database ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Inserts tiles into a fresh tile cache database for each batch size, 1\n"
+            "meaning one statement per transaction, and reports sustained inserts/sec.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    long tiles = 20000;
+    const char *batchSizes = "1,16,64,256";
+    size_t tileBytes = 16 * 1024;
+    const char *databasePath = "dbcachebench.db";
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:b:k:d:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': tiles = atol(optarg); break;
+            case 'b': batchSizes = optarg; break;
+            case 'k': tileBytes = strtoul(optarg, NULL, 10); break;
+            case 'd': databasePath = optarg; break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (tiles <= 0 || tileBytes < 1)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    // Stand-in for an encoded PNG tile; the content does not matter to SQLite.
+    unsigned char *data = malloc(tileBytes);
+
+    for (size_t i = 0; i < tileBytes; i++)
+        data[i] = (unsigned char)BenchRandom();
+
+    fprintf(output, "writes,batch_size,tiles,inserted,transactions,seconds,inserts_per_sec\n");
+
+    unsigned long seed = benchSeed;
+    char *list = strdup(batchSizes);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        BenchResult result;
+        sqlite3 *db = BenchOpenDatabase(databasePath);
+
+        if ( ! db)
+            break;
+
+        result.batchSize = strtoul(item, NULL, 10);
+        result.tiles = tiles;
+
+        benchSeed = seed;
+        BenchRun(&result, db, tiles, result.batchSize, data, tileBytes);
+        BenchReport(output, &result);
+
+        sqlite3_close(db);
+        unlink(databasePath);
+    }
+
+    free(list);
+    free(data);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+//
+//  gridbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of drawing coordinate grid tiles with RMCoordinateGrid: every tile of a
+// region at each zoom level, with the spacings of RMCoordinateGridSource, first when
+// the parallels of a spacing are worked out and then again, as RMCoordinateGridSource
+// does every time a tile is shown.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o gridbench gridbench.c ../Map/RMCoordinateGrid.c ../Map/RMRasterizer.c ../Map/RMPathClipper.c ../Map/RMFoundation.c -lm
+//   ./gridbench -z 6,10,14,18 -t graticule,utm
+//
+// Add -DRM_RASTERIZER_VECTORS=0 to compare with the scalar code of RMRasterizer.
+//
+// Writes one CSV row per grid type and zoom level.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMCoordinateGrid.h"
+
+#define kBenchTileSideLength 256
+
+// As RMCoordinateGridSource
+#define kBenchLineWidth 2.0
+
+// At most this many tiles across the region at each zoom level, around Oslo, which is
+// in one of the wider UTM zones
+#define kBenchTilesAcross 16
+#define kBenchLatitude 59.91
+#define kBenchLongitude 10.75
+
+// The spacings of GridModeGeographicDecimal and GridModeUTM in RMCoordinateGridSource
+static const double benchGraticuleSpacing[19] = {
+    45.0, 45.0, 45.0, 10.0, 5.0, 5.0, 2.0, 1.0, 1.0, 0.5,
+    0.25, 0.10, 0.05, 0.05, 0.01, 0.01, 0.01, 0.01, 0.01,
+};
+
+static const double benchUTMSpacing[19] = {
+    0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 100000.0, 100000.0, 100000.0, 10000.0,
+    10000.0, 10000.0, 10000.0, 1000.0, 1000.0, 1000.0, 1000.0, 100.0, 100.0,
+};
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void BenchRun(FILE *output, RMCoordinateGridType type, int zoom, int repeat)
+{
+    RMCoordinateGrid *grid = RMCoordinateGridCreate(kBenchTileSideLength);
+    double spacing = (type == RMCoordinateGridUTM ? benchUTMSpacing[zoom] : benchGraticuleSpacing[zoom]);
+    double scale = ldexp(1.0, zoom);
+    uint32_t tilesAcross = (scale < kBenchTilesAcross ? (uint32_t)scale : kBenchTilesAcross);
+    uint32_t centerX = (uint32_t)((kBenchLongitude + 180.0) / 360.0 * scale);
+    uint32_t centerY = (uint32_t)((0.5 - asinh(tan(kBenchLatitude * M_PI / 180.0)) / (2.0 * M_PI)) * scale);
+    uint32_t firstX = (centerX >= tilesAcross / 2 ? centerX - tilesAcross / 2 : 0);
+    uint32_t firstY = (centerY >= tilesAcross / 2 ? centerY - tilesAcross / 2 : 0);
+    RMRasterizerColor color = { 0.1f, 0.1f, 0.1f, 0.6f };
+    uint8_t *pixels = malloc(kBenchTileSideLength * kBenchTileSideLength * 4);
+    double firstSeconds = 0.0, seconds = 0.0;
+    size_t tiles = 0, blank = 0;
+
+    // The first pass works out the parallels; the others are timed together
+    for (int pass = 0; pass <= repeat; pass++)
+    {
+        double start = BenchNow();
+
+        for (uint32_t y = firstY; y < firstY + tilesAcross; y++)
+        {
+            for (uint32_t x = firstX; x < firstX + tilesAcross; x++)
+            {
+                memset(pixels, 0, kBenchTileSideLength * kBenchTileSideLength * 4);
+
+                bool drawn = RMCoordinateGridDrawTile(grid, type, spacing, x, y, zoom, color, kBenchLineWidth, pixels, kBenchTileSideLength * 4);
+
+                if (pass == 0)
+                {
+                    tiles++;
+                    blank += ! drawn;
+                }
+            }
+        }
+
+        if (pass == 0)
+            firstSeconds = BenchNow() - start;
+        else
+            seconds += BenchNow() - start;
+    }
+
+    fprintf(output, "%s,%d,%g,%lu,%lu,%.6f,%.6f,%.1f\n",
+            (type == RMCoordinateGridUTM ? "utm" : "graticule"),
+            zoom,
+            spacing,
+            (unsigned long)tiles,
+            (unsigned long)blank,
+            firstSeconds,
+            seconds,
+            seconds * 1e6 / (tiles * repeat));
+
+    free(pixels);
+    RMCoordinateGridDestroy(grid);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -z zoom,... ] [ -t graticule|utm,... ] [ -r repeat ] [ -o file ]\n"
+            "\n"
+            "Draws the grid into up to %d by %d tiles around Oslo at each zoom level, from\n"
+            "0 to 18.\n",
+            program, kBenchTilesAcross, kBenchTilesAcross);
+}
+
+int main(int argc, char **argv)
+{
+    const char *zooms = "6,10,14,18";
+    const char *types = "graticule,utm";
+    const char *outputPath = NULL;
+    int repeat = 10;
+    int option;
+
+    while ((option = getopt(argc, argv, "z:t:r:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'z': zooms = optarg; break;
+            case 't': types = optarg; break;
+            case 'r': repeat = atoi(optarg); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (repeat < 1)
+        repeat = 1;
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "type,zoom,spacing,tiles,blank_tiles,first_seconds,seconds,us_per_tile\n");
+
+    char *typeList = strdup(types);
+    char *typeState = NULL;
+
+    for (char *type = strtok_r(typeList, ",", &typeState); type; type = strtok_r(NULL, ",", &typeState))
+    {
+        char *zoomList = strdup(zooms);
+        char *zoomState = NULL;
+
+        for (char *zoom = strtok_r(zoomList, ",", &zoomState); zoom; zoom = strtok_r(NULL, ",", &zoomState))
+        {
+            int level = atoi(zoom);
+
+            if (level < 0 || level > 18)
+                continue;
+
+            BenchRun(output, (strcmp(type, "utm") == 0 ? RMCoordinateGridUTM : RMCoordinateGridGraticule), level, repeat);
+        }
+
+        free(zoomList);
+    }
+
+    free(typeList);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+//
+//  heatbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of drawing heatmap tiles with RMHeatmap: points in clusters over a region,
+// drawn into every tile of the region at each zoom level, first when the bins of the
+// level are made from those of the deepest one and then again, as RMHeatmapSource
+// does when its tiles are not cached; then points added and removed a few at a time,
+// with the tiles they change listed to be removed from a cache.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o heatbench heatbench.c ../Map/RMHeatmap.c ../Map/RMFoundation.c -lm
+//   ./heatbench -n 10000,100000,1000000 -z 10,12,14,16
+//
+// Add -DRM_HEATMAP_VECTORS=0 to compare with the scalar code of RMHeatmap.
+//
+// Writes one CSV row per point count and zoom level, and one per point count for the
+// updates.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMHeatmap.h"
+
+// Spherical mercator, as the planetBounds of RMProjection
+#define kBenchPlanetHalfWidth 20037508.342789244
+
+#define kBenchTileSideLength 256
+
+// A region 40 km across, with points around 50 centers
+#define kBenchRegionSize 40000.0
+#define kBenchClusterCount 50
+
+// Points added then removed by each update, and updates
+#define kBenchUpdateSize 100
+#define kBenchUpdateCount 200
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+static double BenchGaussian(void)
+{
+    double u = 1.0 - BenchUniform(), v = BenchUniform();
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+// A point of one of the clusters, of 200 meters to 2 km, or anywhere in the region for
+// one point in ten
+static RMProjectedPoint BenchMakePoint(const RMProjectedPoint *centers, const double *spreads)
+{
+    if (BenchRandom() % 10 == 0)
+        return RMProjectedPointMake(BenchUniform() * kBenchRegionSize, BenchUniform() * kBenchRegionSize);
+
+    size_t cluster = BenchRandom() % kBenchClusterCount;
+
+    return RMProjectedPointMake(centers[cluster].x + BenchGaussian() * spreads[cluster],
+                                centers[cluster].y + BenchGaussian() * spreads[cluster]);
+}
+
+static void BenchDrawZoom(FILE *output, RMHeatmap *heatmap, int zoom)
+{
+    double tileSize = 2.0 * kBenchPlanetHalfWidth / (1 << zoom);
+    uint32_t firstX = (uint32_t)(kBenchPlanetHalfWidth / tileSize);
+    uint32_t lastX = (uint32_t)((kBenchPlanetHalfWidth + kBenchRegionSize) / tileSize);
+    uint32_t firstY = (uint32_t)((kBenchPlanetHalfWidth - kBenchRegionSize) / tileSize);
+    uint32_t lastY = (uint32_t)(kBenchPlanetHalfWidth / tileSize);
+    uint8_t *pixels = malloc(kBenchTileSideLength * kBenchTileSideLength * 4);
+    double firstSeconds = 0.0, seconds = 0.0;
+    size_t tiles = 0, blank = 0;
+
+    // The first pass makes the bins of the level; the last one is timed alone
+    for (int pass = 0; pass < 3; pass++)
+    {
+        double start = BenchNow();
+
+        tiles = blank = 0;
+
+        for (uint32_t y = firstY; y <= lastY; y++)
+        {
+            for (uint32_t x = firstX; x <= lastX; x++)
+            {
+                tiles++;
+                blank += ! RMHeatmapDrawTile(heatmap, x, y, zoom, pixels, kBenchTileSideLength * 4);
+            }
+        }
+
+        seconds = BenchNow() - start;
+
+        if (pass == 0)
+            firstSeconds = seconds;
+    }
+
+    fprintf(output, "draw,%lu,%d,%lu,%lu,%.6f,%.6f,%.1f\n",
+            (unsigned long)RMHeatmapPointCount(heatmap),
+            zoom,
+            (unsigned long)tiles,
+            (unsigned long)blank,
+            firstSeconds,
+            seconds,
+            seconds * 1e6 / tiles);
+
+    free(pixels);
+}
+
+// Every drawn tile is counted as removed from a cache and drawn again after each update
+static void BenchCountTile(uint32_t x, uint32_t y, int zoom, void *context)
+{
+    (void)x;
+    (void)y;
+    (void)zoom;
+
+    (*(size_t *)context)++;
+}
+
+static void BenchUpdate(FILE *output, RMHeatmap *heatmap, const RMProjectedPoint *centers, const double *spreads)
+{
+    RMProjectedPoint points[kBenchUpdateSize];
+    size_t invalidated = 0;
+
+    RMHeatmapTakeInvalidatedTiles(heatmap, BenchCountTile, &invalidated);
+    invalidated = 0;
+
+    double start = BenchNow();
+
+    for (int update = 0; update < kBenchUpdateCount; update++)
+    {
+        for (int i = 0; i < kBenchUpdateSize; i++)
+            points[i] = BenchMakePoint(centers, spreads);
+
+        RMHeatmapAddPoints(heatmap, points, kBenchUpdateSize);
+        RMHeatmapTakeInvalidatedTiles(heatmap, BenchCountTile, &invalidated);
+        RMHeatmapRemovePoints(heatmap, points, kBenchUpdateSize);
+        RMHeatmapTakeInvalidatedTiles(heatmap, BenchCountTile, &invalidated);
+    }
+
+    double seconds = BenchNow() - start;
+
+    // Tiles are only listed once until drawn again, so this is the tiles the first
+    // updates reach more than the tiles each of them changes
+    fprintf(output, "update,%lu,,%lu,,,%.6f,%.1f\n",
+            (unsigned long)RMHeatmapPointCount(heatmap),
+            (unsigned long)invalidated,
+            seconds,
+            seconds * 1e6 / (2 * kBenchUpdateCount));
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n points,... ] [ -z zoom,... ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Draws each number of points in clusters over a region into every tile of the\n"
+            "region at each zoom level, then adds and removes %d points at a time.\n",
+            program, kBenchUpdateSize);
+}
+
+int main(int argc, char **argv)
+{
+    const char *counts = "10000,100000,1000000";
+    const char *zooms = "10,12,14,16";
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:z:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': counts = optarg; break;
+            case 'z': zooms = optarg; break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "kind,points,zoom,tiles,blank_tiles,first_seconds,seconds,us_per_tile\n");
+
+    RMProjectedPoint centers[kBenchClusterCount];
+    double spreads[kBenchClusterCount];
+
+    for (int i = 0; i < kBenchClusterCount; i++)
+    {
+        centers[i] = RMProjectedPointMake(BenchUniform() * kBenchRegionSize, BenchUniform() * kBenchRegionSize);
+        spreads[i] = 200.0 + BenchUniform() * 1800.0;
+    }
+
+    RMHeatmapOptions options = RMHeatmapDefaultOptions();
+    char *list = strdup(counts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t count = strtoul(item, NULL, 10);
+        RMHeatmap *heatmap = RMHeatmapCreate(&options);
+        RMProjectedPoint *points = malloc(count * sizeof(RMProjectedPoint));
+
+        for (size_t i = 0; i < count; i++)
+            points[i] = BenchMakePoint(centers, spreads);
+
+        double start = BenchNow();
+
+        RMHeatmapAddPoints(heatmap, points, count);
+
+        fprintf(output, "add,%lu,,,,,%.6f,\n", (unsigned long)count, BenchNow() - start);
+
+        free(points);
+
+        char *zoomList = strdup(zooms);
+        char *zoomState = NULL;
+
+        for (char *zoom = strtok_r(zoomList, ",", &zoomState); zoom; zoom = strtok_r(NULL, ",", &zoomState))
+            BenchDrawZoom(output, heatmap, atoi(zoom));
+
+        BenchUpdate(output, heatmap, centers, spreads);
+
+        free(zoomList);
+        RMHeatmapDestroy(heatmap);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
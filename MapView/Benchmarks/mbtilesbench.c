@@ -0,0 +1,446 @@
+//
+//  mbtilesbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of random tile reads from an MBTiles file by several threads at once,
+// through one connection shared under a lock as FMDatabaseQueue does, and through
+// the read-only connection pool RMMBTilesSource and RMDBMapSource now use. With -v,
+// also of viewport fills read a tile at a time and with an index range scan per
+// column, as -[RMMBTilesSource tileDataInRect:] does.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -pthread -I../Map -o mbtilesbench mbtilesbench.c ../Map/RMSQLiteReaderPool.c -lsqlite3
+//   ./mbtilesbench -f /tmp/bench.mbtiles -z 8 -n 200000 -t 1,2,4,8 -v 5x4
+//
+// The MBTiles file is generated first unless it exists. Writes one CSV row per
+// reading mode and thread count.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "RMSQLiteReaderPool.h"
+
+// As in RMMBTilesSource.m.
+#define kBenchMemoryMapSize (128 * 1024 * 1024)
+
+static const char kBenchTileQuery[] = "select tile_data from tiles where zoom_level = ? and tile_column = ? and tile_row = ?";
+static const char kBenchTileRangeQuery[] = "select tile_row, tile_data from tiles where zoom_level = ? and tile_column = ? and tile_row between ? and ? order by tile_row";
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+
+    return (*seed >> 16) & 0x7fff;
+}
+
+// Every tile of zoom levels 0 to maxZoom, with tileBytes of noise each.
+static int BenchGenerate(const char *path, int maxZoom, size_t tileBytes)
+{
+    sqlite3 *db = NULL;
+    sqlite3_stmt *insert = NULL;
+    unsigned long seed = 1;
+
+    if (sqlite3_open(path, &db) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", path, sqlite3_errmsg(db));
+        return 0;
+    }
+
+    sqlite3_exec(db, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF; BEGIN", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE TABLE metadata (name text, value text)", NULL, NULL, NULL);
+    sqlite3_exec(db, "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob)", NULL, NULL, NULL);
+    sqlite3_exec(db, "INSERT INTO metadata VALUES ('name', 'mbtilesbench'), ('format', 'png'), ('bounds', '-180,-85,180,85')", NULL, NULL, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO tiles VALUES (?, ?, ?, ?)", -1, &insert, NULL);
+
+    unsigned char *data = malloc(tileBytes);
+
+    for (int zoom = 0; zoom <= maxZoom; zoom++)
+    {
+        for (int x = 0; x < (1 << zoom); x++)
+        {
+            for (int y = 0; y < (1 << zoom); y++)
+            {
+                size_t length = tileBytes / 2 + BenchRandom(&seed) % (tileBytes / 2);
+
+                for (size_t i = 0; i < length; i += 64)
+                    data[i] = (unsigned char)BenchRandom(&seed);
+
+                sqlite3_bind_int(insert, 1, zoom);
+                sqlite3_bind_int(insert, 2, x);
+                sqlite3_bind_int(insert, 3, y);
+                sqlite3_bind_blob(insert, 4, data, (int)length, SQLITE_STATIC);
+                sqlite3_step(insert);
+                sqlite3_reset(insert);
+            }
+        }
+    }
+
+    sqlite3_finalize(insert);
+    sqlite3_exec(db, "CREATE UNIQUE INDEX tile_index ON tiles (zoom_level, tile_column, tile_row); COMMIT", NULL, NULL, NULL);
+    sqlite3_close(db);
+    free(data);
+
+    return 1;
+}
+
+#pragma mark -
+
+typedef struct {
+    // Shared connection, used under lock
+    sqlite3 *db;
+    sqlite3_stmt *select;
+    pthread_mutex_t lock;
+
+    // Or the pool
+    RMSQLiteReaderPool *pool;
+
+    int maxZoom;
+    long readsPerThread;
+
+    // Viewport fills instead of single tiles, by range scan or not
+    int viewportWidth, viewportHeight;
+    int rangeScan;
+} BenchShared;
+
+typedef struct {
+    BenchShared *shared;
+    unsigned long seed;
+    long tiles;
+} BenchThread;
+
+static void *BenchReadShared(BenchShared *shared, int64_t zoom, int64_t x, int64_t y, size_t *length)
+{
+    void *data = NULL;
+
+    pthread_mutex_lock(&shared->lock);
+
+    sqlite3_bind_int64(shared->select, 1, zoom);
+    sqlite3_bind_int64(shared->select, 2, x);
+    sqlite3_bind_int64(shared->select, 3, y);
+
+    if (sqlite3_step(shared->select) == SQLITE_ROW)
+    {
+        *length = sqlite3_column_bytes(shared->select, 0);
+        data = malloc(*length);
+        memcpy(data, sqlite3_column_blob(shared->select, 0), *length);
+    }
+
+    sqlite3_reset(shared->select);
+
+    pthread_mutex_unlock(&shared->lock);
+
+    return data;
+}
+
+// Reads every tile of a viewport on one pooled connection, like
+// -[RMMBTilesSource tileDataInRect:], and returns the number found.
+static long BenchReadViewport(BenchShared *shared, int64_t zoom, int64_t x, int64_t y)
+{
+    RMSQLiteReader *reader = RMSQLiteReaderPoolAcquire(shared->pool);
+    int64_t lastRow = ((int64_t)1 << zoom) - 1;
+    long tiles = 0;
+
+    if ( ! reader)
+        return 0;
+
+    if (shared->rangeScan)
+    {
+        for (int64_t column = x; column < x + shared->viewportWidth; column++)
+        {
+            sqlite3_stmt *statement = RMSQLiteReaderStatement(reader, kBenchTileRangeQuery);
+
+            sqlite3_bind_int64(statement, 1, zoom);
+            sqlite3_bind_int64(statement, 2, column);
+            sqlite3_bind_int64(statement, 3, lastRow - (y + shared->viewportHeight - 1));
+            sqlite3_bind_int64(statement, 4, lastRow - y);
+
+            while (sqlite3_step(statement) == SQLITE_ROW)
+            {
+                void *data = malloc(sqlite3_column_bytes(statement, 1));
+
+                memcpy(data, sqlite3_column_blob(statement, 1), sqlite3_column_bytes(statement, 1));
+                free(data);
+                tiles++;
+            }
+
+            sqlite3_reset(statement);
+        }
+    }
+    else
+    {
+        for (int64_t column = x; column < x + shared->viewportWidth; column++)
+        {
+            for (int64_t row = y; row < y + shared->viewportHeight; row++)
+            {
+                sqlite3_stmt *statement = RMSQLiteReaderStatement(reader, kBenchTileQuery);
+
+                sqlite3_bind_int64(statement, 1, zoom);
+                sqlite3_bind_int64(statement, 2, column);
+                sqlite3_bind_int64(statement, 3, lastRow - row);
+
+                if (sqlite3_step(statement) == SQLITE_ROW)
+                {
+                    void *data = malloc(sqlite3_column_bytes(statement, 0));
+
+                    memcpy(data, sqlite3_column_blob(statement, 0), sqlite3_column_bytes(statement, 0));
+                    free(data);
+                    tiles++;
+                }
+
+                sqlite3_reset(statement);
+            }
+        }
+    }
+
+    RMSQLiteReaderPoolRelease(shared->pool, reader);
+
+    return tiles;
+}
+
+static void *BenchThreadMain(void *argument)
+{
+    BenchThread *thread = argument;
+    BenchShared *shared = thread->shared;
+
+    if (shared->viewportWidth > 0)
+    {
+        int64_t zoom = shared->maxZoom;
+        int64_t columns = ((int64_t)1 << zoom) - shared->viewportWidth + 1;
+        int64_t rows = ((int64_t)1 << zoom) - shared->viewportHeight + 1;
+        long viewportTiles = shared->viewportWidth * shared->viewportHeight;
+
+        for (long i = 0; i < shared->readsPerThread; i += viewportTiles)
+        {
+            int64_t x = (int64_t)((BenchRandom(&thread->seed) << 15 | BenchRandom(&thread->seed)) % columns);
+            int64_t y = (int64_t)((BenchRandom(&thread->seed) << 15 | BenchRandom(&thread->seed)) % rows);
+
+            thread->tiles += BenchReadViewport(shared, zoom, x, y);
+        }
+
+        return NULL;
+    }
+
+    for (long i = 0; i < shared->readsPerThread; i++)
+    {
+        // Mostly the deepest zoom levels, as when browsing a map.
+        int64_t zoom = shared->maxZoom - (int64_t)(BenchRandom(&thread->seed) % 3);
+        int64_t x, y;
+        size_t length = 0;
+        void *data;
+
+        if (zoom < 0)
+            zoom = 0;
+
+        x = (int64_t)((BenchRandom(&thread->seed) << 15 | BenchRandom(&thread->seed)) % (1 << zoom));
+        y = (int64_t)((BenchRandom(&thread->seed) << 15 | BenchRandom(&thread->seed)) % (1 << zoom));
+
+        if (shared->pool)
+        {
+            int64_t arguments[3] = { zoom, x, y };
+
+            data = RMSQLiteReaderPoolCopyBlob(shared->pool, kBenchTileQuery, arguments, 3, &length);
+        }
+        else
+        {
+            data = BenchReadShared(shared, zoom, x, y, &length);
+        }
+
+        if (data)
+            thread->tiles++;
+
+        free(data);
+    }
+
+    return NULL;
+}
+
+static void BenchRun(FILE *output, const char *mode, BenchShared *shared, int threadCount)
+{
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    BenchThread *contexts = calloc(threadCount, sizeof(BenchThread));
+    long tiles = 0;
+
+    double start = BenchNow();
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        contexts[i].shared = shared;
+        contexts[i].seed = 1 + i;
+        pthread_create(&threads[i], NULL, BenchThreadMain, &contexts[i]);
+    }
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+        tiles += contexts[i].tiles;
+    }
+
+    double seconds = BenchNow() - start;
+    long reads = shared->readsPerThread * threadCount;
+
+    if (shared->viewportWidth > 0)
+    {
+        long viewportTiles = shared->viewportWidth * shared->viewportHeight;
+
+        reads = (shared->readsPerThread + viewportTiles - 1) / viewportTiles * viewportTiles * threadCount;
+    }
+
+    fprintf(output, "%s,%d,%ld,%ld,%.3f,%.0f,%.2f\n", mode, threadCount, reads, tiles, seconds, reads / seconds, seconds * 1e6 / reads);
+
+    free(threads);
+    free(contexts);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -f file ] [ -z max_zoom ] [ -k tile_bytes ] [ -n reads ] [ -t threads,... ] [ -v WxH ] [ -o file ]\n"
+            "\n"
+            "Reads random tiles from an MBTiles file, generated with every tile up to\n"
+            "max_zoom if it does not exist, with each number of threads sharing the reads.\n"
+            "With -v, also reads viewports of W by H tiles at max_zoom, by single tile\n"
+            "queries and by range scan.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "mbtilesbench.mbtiles";
+    const char *threadCounts = "1,2,4,8";
+    const char *outputPath = NULL;
+    int maxZoom = 8;
+    size_t tileBytes = 4096;
+    long reads = 200000;
+    int viewportWidth = 0, viewportHeight = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "f:z:k:n:t:v:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'f': path = optarg; break;
+            case 'z': maxZoom = atoi(optarg); break;
+            case 'k': tileBytes = strtoul(optarg, NULL, 10); break;
+            case 'n': reads = atol(optarg); break;
+            case 't': threadCounts = optarg; break;
+            case 'v': sscanf(optarg, "%dx%d", &viewportWidth, &viewportHeight); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (maxZoom < 0 || maxZoom > 14 || tileBytes < 128 || reads <= 0 ||
+        viewportWidth < 0 || viewportHeight < 0 || viewportWidth > (1 << maxZoom) || viewportHeight > (1 << maxZoom))
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    if (access(path, R_OK) != 0 && ! BenchGenerate(path, maxZoom, tileBytes))
+        return 1;
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "mode,threads,reads,tiles_found,seconds,reads_per_sec,us_per_read\n");
+
+    char *list = strdup(threadCounts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        int threadCount = atoi(item);
+        BenchShared shared;
+
+        if (threadCount < 1)
+            continue;
+
+        memset(&shared, 0, sizeof(shared));
+        shared.maxZoom = maxZoom;
+        shared.readsPerThread = reads / threadCount;
+
+        sqlite3_open_v2(path, &shared.db, SQLITE_OPEN_READONLY, NULL);
+        sqlite3_prepare_v2(shared.db, kBenchTileQuery, -1, &shared.select, NULL);
+        pthread_mutex_init(&shared.lock, NULL);
+
+        BenchRun(output, "shared-connection", &shared, threadCount);
+
+        sqlite3_finalize(shared.select);
+        sqlite3_close(shared.db);
+        pthread_mutex_destroy(&shared.lock);
+
+        memset(&shared, 0, sizeof(shared));
+        shared.maxZoom = maxZoom;
+        shared.readsPerThread = reads / threadCount;
+        shared.pool = RMSQLiteReaderPoolCreate(path, (unsigned int)threadCount, kBenchMemoryMapSize);
+
+        BenchRun(output, "reader-pool", &shared, threadCount);
+
+        if (viewportWidth > 0 && viewportHeight > 0)
+        {
+            shared.viewportWidth = viewportWidth;
+            shared.viewportHeight = viewportHeight;
+
+            BenchRun(output, "viewport-single-tiles", &shared, threadCount);
+
+            shared.rangeScan = 1;
+
+            BenchRun(output, "viewport-range-scan", &shared, threadCount);
+        }
+
+        RMSQLiteReaderPoolDestroy(shared.pool);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
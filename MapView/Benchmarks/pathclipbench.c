@@ -0,0 +1,299 @@
+//
+//  pathclipbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of drawing a long GPS track near the screen only, clipping it with
+// RMPathClipper after leaving out what is far from the screen with the bounding box
+// trees of RMPathPyramid, against clipping all of it and against not clipping it, as
+// RMShape and RMPath did before.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o pathclipbench pathclipbench.c ../Map/RMPathClipper.c ../Map/RMPathPyramid.c ../Map/RMFoundation.c -lm
+//   ./pathclipbench -n 10000,100000,1000000 -z 12,16
+//
+// Writes one CSV row per method, stroke or fill, track length and zoom level.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMPathClipper.h"
+#include "RMPathPyramid.h"
+
+// Spherical mercator width in meters over a 256 pixel tile
+#define kBenchMetersPerPixelAtZoomZero (2.0 * 20037508.342789244 / 256.0)
+
+// As kPathSimplificationTolerance in RMShape.m
+#define kBenchPixelTolerance 0.25
+
+// An iPhone screen with the outset of RMShape around it twice, as it clips paths
+#define kBenchScreenWidth (320.0 + 4 * 150.0)
+#define kBenchScreenHeight (480.0 + 4 * 150.0)
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+// As in pathpyramidbench.c: 10 meter steps with smooth turns and a little noise
+static void BenchMakeTrack(RMProjectedPoint *points, size_t count)
+{
+    double x = 0.0, y = 0.0, heading = 0.0, turn = 0.0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (BenchRandom() % 50 == 0)
+            turn = (BenchUniform() - 0.5) * 0.2;
+
+        heading += turn;
+        x += 10.0 * cos(heading);
+        y += 10.0 * sin(heading);
+
+        points[i].x = x + (BenchUniform() - 0.5) * 2.0;
+        points[i].y = y + (BenchUniform() - 0.5) * 2.0;
+    }
+}
+
+#pragma mark -
+
+// Stands in for the UIBezierPath being built: the scaled points in screen pixels
+typedef struct {
+    float *coordinates;
+    size_t count, capacity;
+    double scale;
+} BenchScaledPath;
+
+static void BenchAddElement(RMPathElementType type, RMProjectedPoint point, void *context)
+{
+    BenchScaledPath *path = context;
+
+    if (type == RMPathElementCloseSubpath)
+        return;
+
+    if (path->count == path->capacity)
+    {
+        path->capacity = (path->capacity ? 2 * path->capacity : 1024);
+        path->coordinates = realloc(path->coordinates, 2 * path->capacity * sizeof(float));
+    }
+
+    path->coordinates[2 * path->count] = point.x * path->scale;
+    path->coordinates[2 * path->count + 1] = point.y * path->scale;
+    path->count++;
+}
+
+typedef enum {
+    BenchMethodAll,
+    BenchMethodClipped,
+    BenchMethodCulled,
+} BenchMethod;
+
+static const char *kBenchMethodNames[] = { "all-points", "clipped", "culled-and-clipped" };
+
+static void BenchRun(FILE *output, RMPathPyramid *pyramid, const RMProjectedPoint *points, size_t count, int zoom, bool filled, long frames)
+{
+    RMPathClipper *clipper = RMPathClipperCreate();
+    BenchScaledPath path = { NULL, 0, 0, 0.0 };
+    double metersPerPixel = kBenchMetersPerPixelAtZoomZero / pow(2.0, zoom);
+    RMProjectedRect *viewports = malloc(frames * sizeof(RMProjectedRect));
+
+    path.scale = 1.0 / metersPerPixel;
+
+    // Screens centered on points of the track, as when following it
+    for (long f = 0; f < frames; f++)
+    {
+        RMProjectedPoint center = points[(size_t)(BenchUniform() * count) % count];
+
+        viewports[f] = RMProjectedRectMake(center.x - kBenchScreenWidth * metersPerPixel / 2.0,
+                                           center.y - kBenchScreenHeight * metersPerPixel / 2.0,
+                                           kBenchScreenWidth * metersPerPixel,
+                                           kBenchScreenHeight * metersPerPixel);
+    }
+
+    // The path is simplified, and the level and its tree made, before timing
+    RMPathPyramidEnumerateInRect(pyramid, metersPerPixel, viewports[0], filled, BenchAddElement, &path);
+    RMPathPyramidEnumerateInRect(pyramid, metersPerPixel, viewports[0], filled, BenchAddElement, &path);
+
+    for (BenchMethod method = BenchMethodAll; method <= BenchMethodCulled; method++)
+    {
+        double drawn = 0.0;
+        double start = BenchNow();
+
+        for (long f = 0; f < frames; f++)
+        {
+            RMPathClipperMode mode = (filled ? RMPathClipperModeFill : RMPathClipperModeStroke);
+
+            path.count = 0;
+
+            if (method == BenchMethodAll)
+            {
+                RMPathPyramidEnumerate(pyramid, metersPerPixel, BenchAddElement, &path);
+            }
+            else if (method == BenchMethodClipped)
+            {
+                RMPathClipperBegin(clipper, viewports[f], mode, BenchAddElement, &path);
+                RMPathPyramidEnumerate(pyramid, metersPerPixel, RMPathClipperAddElement, clipper);
+                RMPathClipperEnd(clipper);
+            }
+            else
+            {
+                RMPathClipperBegin(clipper, viewports[f], mode, BenchAddElement, &path);
+                RMPathPyramidEnumerateInRect(pyramid, metersPerPixel, viewports[f], filled, RMPathClipperAddElement, clipper);
+                RMPathClipperEnd(clipper);
+            }
+
+            drawn += path.count;
+        }
+
+        double seconds = BenchNow() - start;
+
+        fprintf(output, "%s,%s,%lu,%d,%.0f,%.6f,%.1f\n",
+                kBenchMethodNames[method],
+                (filled ? "fill" : "stroke"),
+                (unsigned long)count,
+                zoom,
+                drawn / frames,
+                seconds,
+                seconds * 1e6 / frames);
+    }
+
+    free(viewports);
+    free(path.coordinates);
+    RMPathClipperDestroy(clipper);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n points,... ] [ -z zoom,... ] [ -f frames ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Draws a GPS track of each length at each zoom level on screens centered on\n"
+            "random points of it, stroked and filled: all of the simplified track, the track\n"
+            "clipped to the screen, and the track culled by bounding boxes then clipped.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *counts = "10000,100000,1000000";
+    const char *zooms = "12,16";
+    const char *outputPath = NULL;
+    long frames = 200;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:z:f:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': counts = optarg; break;
+            case 'z': zooms = optarg; break;
+            case 'f': frames = atol(optarg); break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (frames < 1)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "method,mode,points,zoom,points_drawn,seconds,us_per_frame\n");
+
+    char *list = strdup(counts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t count = strtoul(item, NULL, 10);
+
+        if (count < 2)
+            continue;
+
+        RMProjectedPoint *points = malloc(count * sizeof(RMProjectedPoint));
+        RMPathPyramid *pyramid = RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, kBenchPixelTolerance);
+
+        BenchMakeTrack(points, count);
+
+        RMPathPyramidMoveToPoint(pyramid, points[0]);
+
+        for (size_t i = 1; i < count; i++)
+            RMPathPyramidAddLineToPoint(pyramid, points[i]);
+
+        char *zoomList = strdup(zooms);
+        char *zoomState = NULL;
+
+        for (char *zoom = strtok_r(zoomList, ",", &zoomState); zoom; zoom = strtok_r(NULL, ",", &zoomState))
+        {
+            BenchRun(output, pyramid, points, count, atoi(zoom), false, frames);
+            BenchRun(output, pyramid, points, count, atoi(zoom), true, frames);
+        }
+
+        free(zoomList);
+        RMPathPyramidDestroy(pyramid);
+        free(points);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,279 @@
+//
+//  pathpyramidbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of the path simplification pyramid (RMPathPyramid) used by RMShape and
+// RMPath, against scaling every vertex of the path as they did before it, on a long
+// GPS track: a random walk of 10 meter steps with smooth turns and a little noise.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o pathpyramidbench pathpyramidbench.c ../Map/RMPathPyramid.c ../Map/RMFoundation.c -lm
+//   ./pathpyramidbench -n 50000,1000000 -z 4,8,12,16,20
+//
+// Writes one CSV row per method, track length and zoom level.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMPathPyramid.h"
+
+// Spherical mercator width in meters over a 256 pixel tile
+#define kBenchMetersPerPixelAtZoomZero (2.0 * 20037508.342789244 / 256.0)
+
+// As kPathSimplificationTolerance in RMShape.m
+#define kBenchPixelTolerance 0.25
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+static void BenchMakeTrack(RMProjectedPoint *points, size_t count)
+{
+    double x = 0.0, y = 0.0, heading = 0.0, turn = 0.0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (BenchRandom() % 50 == 0)
+            turn = (BenchUniform() - 0.5) * 0.2;
+
+        heading += turn;
+        x += 10.0 * cos(heading);
+        y += 10.0 * sin(heading);
+
+        points[i].x = x + (BenchUniform() - 0.5) * 2.0;
+        points[i].y = y + (BenchUniform() - 0.5) * 2.0;
+    }
+}
+
+#pragma mark -
+
+// Stands in for the UIBezierPath being built: the scaled points in screen pixels
+typedef struct {
+    float *coordinates;
+    size_t count;
+    double scale;
+} BenchScaledPath;
+
+static void BenchAddElement(RMPathElementType type, RMProjectedPoint point, void *context)
+{
+    BenchScaledPath *path = context;
+
+    (void)type;
+
+    path->coordinates[2 * path->count] = point.x * path->scale;
+    path->coordinates[2 * path->count + 1] = point.y * path->scale;
+    path->count++;
+}
+
+static void BenchReport(FILE *output, const char *name, size_t count, int zoom, size_t drawn, double seconds, long repeats)
+{
+    fprintf(output, "%s,%lu,%d,%lu,%.1f,%.6f,%.1f\n",
+            name,
+            (unsigned long)count,
+            zoom,
+            (unsigned long)drawn,
+            100.0 * drawn / count,
+            seconds,
+            seconds * 1e6 / repeats);
+}
+
+static void BenchRun(FILE *output, const RMProjectedPoint *points, size_t count, const char *zooms, long repeats)
+{
+    BenchScaledPath path = { malloc(2 * count * sizeof(float)), 0, 0.0 };
+    RMPathPyramid *pyramids[2] = {
+        RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, kBenchPixelTolerance),
+        RMPathPyramidCreate(RMPathSimplificationVisvalingam, kBenchPixelTolerance),
+    };
+    const char *names[2] = { "douglas-peucker", "visvalingam" };
+
+    // Before: every point drawn, through the same visitor; a zero tolerance never simplifies
+    RMPathPyramid *unsimplified = RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, 0.0);
+
+    RMPathPyramidMoveToPoint(unsimplified, points[0]);
+
+    for (size_t i = 1; i < count; i++)
+        RMPathPyramidAddLineToPoint(unsimplified, points[i]);
+
+    for (int p = 0; p < 2; p++)
+    {
+        RMPathPyramidMoveToPoint(pyramids[p], points[0]);
+
+        for (size_t i = 1; i < count; i++)
+            RMPathPyramidAddLineToPoint(pyramids[p], points[i]);
+
+        // The first drawing after a change is not simplified; the second computes the
+        // tolerances of the points, timed as a build at zoom -1
+        RMPathPyramidEnumerate(pyramids[p], 1.0, BenchAddElement, (path.count = 0, &path));
+
+        double start = BenchNow();
+
+        RMPathPyramidEnumerate(pyramids[p], kBenchMetersPerPixelAtZoomZero, BenchAddElement, (path.count = 0, &path));
+        BenchReport(output, names[p], count, -1, count, BenchNow() - start, 1);
+    }
+
+    char *list = strdup(zooms);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        int zoom = atoi(item);
+        double metersPerPixel = kBenchMetersPerPixelAtZoomZero / pow(2.0, zoom);
+        double start;
+
+        path.scale = 1.0 / metersPerPixel;
+
+        start = BenchNow();
+
+        for (long r = 0; r < repeats; r++)
+        {
+            path.count = 0;
+            RMPathPyramidEnumerate(unsimplified, metersPerPixel, BenchAddElement, &path);
+        }
+
+        BenchReport(output, "all-points", count, zoom, path.count, BenchNow() - start, repeats);
+
+        for (int p = 0; p < 2; p++)
+        {
+            // The level is made by the first drawing at this zoom, then reused
+            RMPathPyramidEnumerate(pyramids[p], metersPerPixel, BenchAddElement, (path.count = 0, &path));
+
+            start = BenchNow();
+
+            for (long r = 0; r < repeats; r++)
+            {
+                path.count = 0;
+                RMPathPyramidEnumerate(pyramids[p], metersPerPixel, BenchAddElement, &path);
+            }
+
+            BenchReport(output, names[p], count, zoom, path.count, BenchNow() - start, repeats);
+        }
+    }
+
+    free(list);
+    RMPathPyramidDestroy(unsimplified);
+    RMPathPyramidDestroy(pyramids[0]);
+    RMPathPyramidDestroy(pyramids[1]);
+    free(path.coordinates);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n points,... ] [ -z zoom,... ] [ -r repeats ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Scales a GPS track of each length for drawing at each zoom level, all of it\n"
+            "and simplified by Douglas-Peucker and by Visvalingam-Whyatt. Zoom -1 rows\n"
+            "time computing the simplification.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *counts = "50000,1000000";
+    const char *zooms = "4,8,12,16,20";
+    const char *outputPath = NULL;
+    long repeats = 20;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:z:r:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': counts = optarg; break;
+            case 'z': zooms = optarg; break;
+            case 'r': repeats = atol(optarg); break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (repeats < 1)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "method,points,zoom,points_drawn,percent_drawn,seconds,us_per_drawing\n");
+
+    char *list = strdup(counts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t count = strtoul(item, NULL, 10);
+
+        if (count < 2)
+            continue;
+
+        RMProjectedPoint *points = malloc(count * sizeof(RMProjectedPoint));
+
+        BenchMakeTrack(points, count);
+        BenchRun(output, points, count, zooms, repeats);
+
+        free(points);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,298 @@
+//
+//  rasterbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of drawing shapes into tiles with RMShapeRenderer: city blocks filled and
+// outlined, and GPS tracks stroked, scattered over a city, drawn into every tile of
+// the city at each zoom level, as RMShapeTileSource does when its tiles are not cached.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o rasterbench rasterbench.c ../Map/RMShapeRenderer.c ../Map/RMRasterizer.c ../Map/RMPathClipper.c ../Map/RMPathPyramid.c ../Map/RMSpatialIndex.c ../Map/RMFoundation.c -lm
+//   ./rasterbench -n 100,1000,10000 -z 12,14,16
+//
+// Add -DRM_RASTERIZER_VECTORS=0 to compare with the scalar code of RMRasterizer, and
+// -w with a directory to write the tiles there as PAM images to look at them.
+//
+// Writes one CSV row per shape count and zoom level.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMShapeRenderer.h"
+
+// Spherical mercator, as the planetBounds of RMProjection
+#define kBenchPlanetHalfWidth 20037508.342789244
+
+#define kBenchTileSideLength 256
+
+// A city 10 km across
+#define kBenchCitySize 10000.0
+
+// As kPathSimplificationTolerance in RMShape.m
+#define kBenchPixelTolerance 0.25
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+static RMRasterizerColor BenchColor(float alpha)
+{
+    RMRasterizerColor color = { BenchUniform(), BenchUniform(), BenchUniform(), alpha };
+
+    return color;
+}
+
+// A block of 50 to 300 meters with a dozen vertices, or a track of a thousand 10 meter
+// steps with smooth turns, every tenth shape
+static RMPathPyramid *BenchMakeShape(size_t i, RMShapeRendererStyle *style)
+{
+    RMPathPyramid *path = RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, kBenchPixelTolerance);
+    double x = BenchUniform() * kBenchCitySize, y = BenchUniform() * kBenchCitySize;
+
+    memset(style, 0, sizeof(RMShapeRendererStyle));
+
+    style->line.lineCap = RMRasterizerLineCapRound;
+    style->line.lineJoin = RMRasterizerLineJoinRound;
+    style->line.miterLimit = 10.0;
+
+    if (i % 10 == 9)
+    {
+        double heading = BenchUniform() * 2.0 * M_PI, turn = 0.0;
+
+        RMPathPyramidMoveToPoint(path, RMProjectedPointMake(x, y));
+
+        for (int step = 0; step < 1000; step++)
+        {
+            if (BenchRandom() % 50 == 0)
+                turn = (BenchUniform() - 0.5) * 0.2;
+
+            heading += turn;
+            x += 10.0 * cos(heading);
+            y += 10.0 * sin(heading);
+
+            RMPathPyramidAddLineToPoint(path, RMProjectedPointMake(x, y));
+        }
+
+        style->lineColor = BenchColor(0.8f);
+        style->line.lineWidth = 4.0;
+    }
+    else
+    {
+        double radius = 25.0 + BenchUniform() * 125.0;
+
+        for (int vertex = 0; vertex < 12; vertex++)
+        {
+            double angle = 2.0 * M_PI * vertex / 12.0;
+            double distance = radius * (0.7 + 0.3 * BenchUniform());
+            RMProjectedPoint point = RMProjectedPointMake(x + distance * cos(angle), y + distance * sin(angle));
+
+            if (vertex == 0)
+                RMPathPyramidMoveToPoint(path, point);
+            else
+                RMPathPyramidAddLineToPoint(path, point);
+        }
+
+        RMPathPyramidCloseSubpath(path);
+
+        style->fillColor = BenchColor(0.5f);
+        style->lineColor = BenchColor(1.0f);
+        style->line.lineWidth = 1.0;
+    }
+
+    return path;
+}
+
+static void BenchWriteTile(const char *directory, int zoom, uint32_t x, uint32_t y, const uint8_t *pixels)
+{
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/%d-%u-%u.pam", directory, zoom, x, y);
+
+    FILE *file = fopen(path, "wb");
+
+    if ( ! file)
+    {
+        perror(path);
+        return;
+    }
+
+    fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", kBenchTileSideLength, kBenchTileSideLength);
+    fwrite(pixels, 4, kBenchTileSideLength * kBenchTileSideLength, file);
+    fclose(file);
+}
+
+static void BenchRun(FILE *output, RMShapeRenderer *renderer, int zoom, const char *directory)
+{
+    double tileSize = 2.0 * kBenchPlanetHalfWidth / (1 << zoom);
+    uint32_t firstX = (uint32_t)(kBenchPlanetHalfWidth / tileSize);
+    uint32_t lastX = (uint32_t)((kBenchPlanetHalfWidth + kBenchCitySize) / tileSize);
+    uint32_t firstY = (uint32_t)((kBenchPlanetHalfWidth - kBenchCitySize) / tileSize);
+    uint32_t lastY = (uint32_t)(kBenchPlanetHalfWidth / tileSize);
+    uint8_t *pixels = malloc(kBenchTileSideLength * kBenchTileSideLength * 4);
+    size_t tiles = 0, shapes = 0, blank = 0;
+
+    // Draw once first, as the paths are simplified for the zoom the first times they
+    // are drawn at it
+    for (int pass = 0; pass < 3; pass++)
+    {
+        double start = BenchNow();
+
+        tiles = shapes = blank = 0;
+
+        for (uint32_t y = firstY; y <= lastY; y++)
+        {
+            for (uint32_t x = firstX; x <= lastX; x++)
+            {
+                memset(pixels, 0, kBenchTileSideLength * kBenchTileSideLength * 4);
+
+                size_t drawn = RMShapeRendererDrawTile(renderer, x, y, zoom, pixels, kBenchTileSideLength * 4);
+
+                tiles++;
+                shapes += drawn;
+                blank += (drawn == 0);
+
+                if (pass == 2 && directory)
+                    BenchWriteTile(directory, zoom, x, y, pixels);
+            }
+        }
+
+        double seconds = BenchNow() - start;
+
+        if (pass == 2)
+            fprintf(output, "%lu,%d,%lu,%lu,%.1f,%.6f,%.1f\n",
+                    (unsigned long)RMShapeRendererShapeCount(renderer),
+                    zoom,
+                    (unsigned long)tiles,
+                    (unsigned long)blank,
+                    (double)shapes / tiles,
+                    seconds,
+                    seconds * 1e6 / tiles);
+    }
+
+    free(pixels);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n shapes,... ] [ -z zoom,... ] [ -s seed ] [ -o file ] [ -w directory ]\n"
+            "\n"
+            "Draws each number of blocks and tracks scattered over a city into every tile\n"
+            "of the city at each zoom level.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *counts = "100,1000,10000";
+    const char *zooms = "12,14,16";
+    const char *outputPath = NULL;
+    const char *directory = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:z:s:o:w:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': counts = optarg; break;
+            case 'z': zooms = optarg; break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            case 'w': directory = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "shapes,zoom,tiles,blank_tiles,shapes_per_tile,seconds,us_per_tile\n");
+
+    RMProjectedRect planetBounds = RMProjectedRectMake(-kBenchPlanetHalfWidth, -kBenchPlanetHalfWidth, 2.0 * kBenchPlanetHalfWidth, 2.0 * kBenchPlanetHalfWidth);
+    char *list = strdup(counts);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t count = strtoul(item, NULL, 10);
+        RMShapeRenderer *renderer = RMShapeRendererCreate(planetBounds, kBenchTileSideLength);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            RMShapeRendererStyle style;
+            RMPathPyramid *path = BenchMakeShape(i, &style);
+
+            RMShapeRendererAddShape(renderer, path, &style);
+        }
+
+        char *zoomList = strdup(zooms);
+        char *zoomState = NULL;
+
+        for (char *zoom = strtok_r(zoomList, ",", &zoomState); zoom; zoom = strtok_r(NULL, ",", &zoomState))
+            BenchRun(output, renderer, atoi(zoom), directory);
+
+        free(zoomList);
+        RMShapeRendererDestroy(renderer);
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
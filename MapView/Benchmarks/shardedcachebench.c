@@ -0,0 +1,283 @@
+//
+//  shardedcachebench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Multi-threaded throughput of RMShardedCache, the locking memory tile cache core,
+// for shard counts, policies and thread counts. With one shard and the LRU policy it
+// behaves like a single lock around an RMLRUCache, which is the baseline.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -pthread -I../Map -o shardedcachebench shardedcachebench.c ../Map/RMShardedCache.c ../Map/RMLRUCache.c ../Map/RMFrequencySketch.c ../Map/RMCacheKey.c
+//   ./shardedcachebench -t 32 -s 1,16,64
+//
+// Writes one CSV row per policy, shard count and thread count. Scaling can only be
+// judged on a machine with at least as many cores as threads.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMShardedCache.h"
+
+#define kBenchTileCost (256 * 256 * 4)
+
+static const char *kBenchCacheKey = "benchmark-tile-source";
+
+// Stands in for a UIImage: retain and release are atomic like CFRetain().
+typedef struct {
+    long retainCount;
+} BenchImage;
+
+typedef struct {
+    RMShardedCache *cache;
+    uint64_t *tileKeys;
+    long tileCount;
+    long operations;
+    int writePercent;
+    unsigned int seed;
+    long lookups;
+    long hits;
+    pthread_barrier_t *barrier;
+} BenchThread;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void *BenchRetain(void *value)
+{
+    __atomic_fetch_add(&((BenchImage *)value)->retainCount, 1, __ATOMIC_RELAXED);
+
+    return value;
+}
+
+static void BenchRelease(void *value)
+{
+    __atomic_fetch_sub(&((BenchImage *)value)->retainCount, 1, __ATOMIC_RELEASE);
+}
+
+static void *BenchThreadMain(void *argument)
+{
+    BenchThread *thread = argument;
+    unsigned int seed = thread->seed;
+
+    pthread_barrier_wait(thread->barrier);
+
+    for (long i = 0; i < thread->operations; i++)
+    {
+        uint64_t tileKey = thread->tileKeys[rand_r(&seed) % thread->tileCount];
+
+        if (thread->writePercent && rand_r(&seed) % 100 < thread->writePercent)
+        {
+            static BenchImage replacement;
+
+            RMShardedCachePut(thread->cache, tileKey, kBenchCacheKey, &replacement, kBenchTileCost);
+            continue;
+        }
+
+        void *image = RMShardedCacheCopy(thread->cache, tileKey, kBenchCacheKey);
+
+        thread->lookups++;
+
+        if (image)
+        {
+            thread->hits++;
+            BenchRelease(image);
+        }
+    }
+
+    return NULL;
+}
+
+static double BenchRun(RMShardedCache *cache, uint64_t *tileKeys, long tileCount, int threadCount, long operations, int writePercent, long *lookups, long *hits)
+{
+    pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+    BenchThread *arguments = calloc(threadCount, sizeof(BenchThread));
+    pthread_barrier_t barrier;
+    double start, seconds;
+
+    pthread_barrier_init(&barrier, NULL, threadCount + 1);
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        arguments[i].cache = cache;
+        arguments[i].tileKeys = tileKeys;
+        arguments[i].tileCount = tileCount;
+        arguments[i].operations = operations;
+        arguments[i].writePercent = writePercent;
+        arguments[i].seed = 12345 + i * 7919;
+        arguments[i].barrier = &barrier;
+
+        pthread_create(&threads[i], NULL, BenchThreadMain, &arguments[i]);
+    }
+
+    pthread_barrier_wait(&barrier);
+    start = BenchNow();
+
+    *lookups = 0;
+    *hits = 0;
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+        *lookups += arguments[i].lookups;
+        *hits += arguments[i].hits;
+    }
+
+    seconds = BenchNow() - start;
+
+    pthread_barrier_destroy(&barrier);
+    free(arguments);
+    free(threads);
+
+    return seconds;
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n operations per thread ] [ -t max threads ] [ -s shards,... ]\n"
+            "          [ -w write percent ] [ -c tiles ] [ -o file ]\n"
+            "\n"
+            "Looks up tiles from a pre-filled RMShardedCache from 1, 2, 4 .. max threads\n"
+            "with both policies and every shard count.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    long operations = 1000000;
+    long tileCount = 4096;
+    int maxThreads = 16;
+    int writePercent = 0;
+    const char *shardCounts = "1,16,64";
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:t:s:w:c:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': operations = atol(optarg); break;
+            case 't': maxThreads = atoi(optarg); break;
+            case 's': shardCounts = optarg; break;
+            case 'w': writePercent = atoi(optarg); break;
+            case 'c': tileCount = atol(optarg); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (operations <= 0 || maxThreads < 1 || tileCount < 1 || writePercent < 0 || writePercent > 100)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    // A square block of zoom 16 tiles, all of which fit in the cache.
+    uint64_t *tileKeys = calloc(tileCount, sizeof(uint64_t));
+    long side = 1;
+
+    while (side * side < tileCount)
+        side++;
+
+    for (long i = 0; i < tileCount; i++)
+        tileKeys[i] = (16ULL << 56) | ((uint64_t)(32768 + i % side) << 28) | (uint64_t)(32768 + i / side);
+
+    BenchImage *images = calloc(tileCount, sizeof(BenchImage));
+    RMLRUCacheCallbacks callbacks = { BenchRetain, BenchRelease };
+    const char *policyNames[] = { "lru", "clock" };
+
+    fprintf(output, "policy,shards,threads,operations,hit_ratio,seconds,ops_per_sec,speedup\n");
+
+    for (int policy = RMShardedCachePolicyLRU; policy <= RMShardedCachePolicyClock; policy++)
+    {
+        char *list = strdup(shardCounts);
+
+        for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+        {
+            unsigned int shards = (unsigned int)strtoul(item, NULL, 10);
+            double baseline = 0;
+
+            // Room for four times the working set, so that the uneven spread of tiles
+            // over the shards does not evict any of them.
+            RMShardedCache *cache = RMShardedCacheCreate(shards, 0, tileCount * 4, policy, &callbacks);
+
+            for (long i = 0; i < tileCount; i++)
+                RMShardedCachePut(cache, tileKeys[i], kBenchCacheKey, &images[i], kBenchTileCost);
+
+            for (int threads = 1; threads <= maxThreads; threads = (threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2))
+            {
+                long lookups, hits;
+                double seconds = BenchRun(cache, tileKeys, tileCount, threads, operations, writePercent, &lookups, &hits);
+                double rate = threads * operations / seconds;
+
+                if (threads == 1)
+                    baseline = rate;
+
+                fprintf(output, "%s,%u,%d,%ld,%.4f,%.6f,%.0f,%.2f\n",
+                        policyNames[policy], shards, threads, threads * operations,
+                        (lookups ? (double)hits / lookups : 0.0),
+                        seconds, rate, rate / baseline);
+                fflush(output);
+
+                if (threads == maxThreads)
+                    break;
+            }
+
+            RMShardedCacheDestroy(cache);
+        }
+
+        free(list);
+    }
+
+    free(images);
+    free(tileKeys);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,427 @@
+//
+//  spatialindexbench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of the annotation spatial index core (RMSpatialIndex), bulk loaded in
+// Morton or STR order or filled one insert at a time, against a pointer quadtree
+// built the way RMQuadTree builds its nodes: inserting and querying points spread
+// over the spherical mercator plane, mostly around a few hundred "cities".
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o spatialindexbench spatialindexbench.c ../Map/RMSpatialIndex.c ../Map/RMFoundation.c -lm
+//   ./spatialindexbench -n 1000000 -q 10000
+//
+// Writes one CSV row per structure.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMSpatialIndex.h"
+
+// Half the width of the spherical mercator plane, as in +[RMProjection googleProjection]
+#define kBenchPlanetHalfWidth 20037508.34
+
+// As in RMQuadTree.m
+#define kBenchMinimumQuadTreeElementWidth 200.0
+#define kBenchMaxAnnotationsPerLeaf 4
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+// Points as RMAnnotation gives them without a bounding box: 1 x 1 projected meters
+static void BenchMakePoints(RMProjectedRect *points, size_t count)
+{
+    RMProjectedPoint cities[256];
+
+    for (int i = 0; i < 256; i++)
+    {
+        cities[i].x = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth * 0.9;
+        cities[i].y = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth * 0.6;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double x, y;
+
+        if (BenchRandom() % 10 < 8)
+        {
+            RMProjectedPoint city = cities[BenchRandom() % 256];
+            double radius = 50000.0 * pow(BenchUniform(), 2.0), angle = BenchUniform() * 2.0 * M_PI;
+
+            x = city.x + radius * cos(angle);
+            y = city.y + radius * sin(angle);
+        }
+        else
+        {
+            x = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth;
+            y = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth;
+        }
+
+        points[i] = RMProjectedRectMake(x, y, 1.0, 1.0);
+    }
+}
+
+// Viewports 20 to 2000 km wide, centered on the points
+static void BenchMakeQueries(RMProjectedRect *queries, size_t count, const RMProjectedRect *points, size_t pointCount)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        RMProjectedRect point = points[(BenchRandom() << 15 | BenchRandom()) % pointCount];
+        double width = 20000.0 * pow(100.0, BenchUniform()), height = width * 1.5;
+
+        queries[i] = RMProjectedRectMake(point.origin.x - width / 2.0, point.origin.y - height / 2.0, width, height);
+    }
+}
+
+static bool BenchIntersects(RMProjectedRect a, RMProjectedRect b)
+{
+    return (a.origin.x <= b.origin.x + b.size.width && b.origin.x <= a.origin.x + a.size.width &&
+            a.origin.y <= b.origin.y + b.size.height && b.origin.y <= a.origin.y + a.size.height);
+}
+
+static bool BenchContains(RMProjectedRect a, RMProjectedRect b)
+{
+    return (b.origin.x >= a.origin.x && b.origin.x + b.size.width <= a.origin.x + a.size.width &&
+            b.origin.y >= a.origin.y && b.origin.y + b.size.height <= a.origin.y + a.size.height);
+}
+
+#pragma mark -
+
+// RMQuadTreeNode without the Objective-C: a node per allocation with four child
+// pointers, a growing array of annotations, and a split into quadrants whenever a
+// leaf holds more than kBenchMaxAnnotationsPerLeaf.
+
+typedef struct BenchQuadNode {
+    RMProjectedRect boundingBox;
+    RMProjectedRect quadrants[4];
+    struct BenchQuadNode *parent;
+    struct BenchQuadNode *children[4];
+    size_t *annotations;
+    size_t count, capacity;
+    bool isLeaf;
+} BenchQuadNode;
+
+static BenchQuadNode *BenchQuadNodeCreate(BenchQuadNode *parent, RMProjectedRect boundingBox)
+{
+    BenchQuadNode *node = calloc(1, sizeof(BenchQuadNode));
+    double halfWidth = boundingBox.size.width / 2.0, halfHeight = boundingBox.size.height / 2.0;
+
+    node->parent = parent;
+    node->boundingBox = boundingBox;
+    node->quadrants[0] = RMProjectedRectMake(boundingBox.origin.x, boundingBox.origin.y + halfHeight, halfWidth, halfHeight);
+    node->quadrants[1] = RMProjectedRectMake(boundingBox.origin.x + halfWidth, boundingBox.origin.y + halfHeight, halfWidth, halfHeight);
+    node->quadrants[2] = RMProjectedRectMake(boundingBox.origin.x, boundingBox.origin.y, halfWidth, halfHeight);
+    node->quadrants[3] = RMProjectedRectMake(boundingBox.origin.x + halfWidth, boundingBox.origin.y, halfWidth, halfHeight);
+    node->isLeaf = true;
+
+    return node;
+}
+
+static void BenchQuadNodeDestroy(BenchQuadNode *node)
+{
+    if ( ! node)
+        return;
+
+    for (int i = 0; i < 4; i++)
+        BenchQuadNodeDestroy(node->children[i]);
+
+    free(node->annotations);
+    free(node);
+}
+
+static void BenchQuadNodeAppend(BenchQuadNode *node, size_t annotation)
+{
+    if (node->count == node->capacity)
+    {
+        node->capacity = (node->capacity ? 2 * node->capacity : 4);
+        node->annotations = realloc(node->annotations, node->capacity * sizeof(size_t));
+    }
+
+    node->annotations[node->count++] = annotation;
+}
+
+static void BenchQuadNodeAdd(BenchQuadNode *node, size_t annotation, const RMProjectedRect *points);
+
+static void BenchQuadNodeAddToChildren(BenchQuadNode *node, size_t annotation, const RMProjectedRect *points)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (BenchContains(node->quadrants[i], points[annotation]))
+        {
+            if ( ! node->children[i])
+                node->children[i] = BenchQuadNodeCreate(node, node->quadrants[i]);
+
+            BenchQuadNodeAdd(node->children[i], annotation, points);
+            return;
+        }
+    }
+
+    BenchQuadNodeAppend(node, annotation);
+}
+
+static void BenchQuadNodeAdd(BenchQuadNode *node, size_t annotation, const RMProjectedRect *points)
+{
+    if ( ! node->isLeaf)
+    {
+        BenchQuadNodeAddToChildren(node, annotation, points);
+        return;
+    }
+
+    BenchQuadNodeAppend(node, annotation);
+
+    if (node->count <= kBenchMaxAnnotationsPerLeaf || node->boundingBox.size.width < kBenchMinimumQuadTreeElementWidth * 2.0)
+        return;
+
+    size_t count = node->count;
+    size_t *annotations = node->annotations;
+
+    node->isLeaf = false;
+    node->annotations = NULL;
+    node->count = node->capacity = 0;
+
+    for (size_t i = 0; i < count; i++)
+        BenchQuadNodeAddToChildren(node, annotations[i], points);
+
+    free(annotations);
+}
+
+// As the unclustered path of -addAnnotationsInBoundingBox:..., leaves included whole
+static size_t BenchQuadNodeQuery(BenchQuadNode *node, RMProjectedRect rect, const RMProjectedRect *points)
+{
+    size_t found = 0;
+
+    if ( ! node)
+        return 0;
+
+    if (node->isLeaf)
+        return node->count;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (BenchIntersects(rect, node->quadrants[i]))
+            found += BenchQuadNodeQuery(node->children[i], rect, points);
+    }
+
+    for (size_t i = 0; i < node->count; i++)
+    {
+        if (BenchIntersects(rect, points[node->annotations[i]]))
+            found++;
+    }
+
+    return found;
+}
+
+#pragma mark -
+
+typedef struct {
+    const char *name;
+    size_t points;
+    double buildSeconds;
+    size_t queries;
+    double querySeconds;
+    size_t results;
+} BenchResult;
+
+static bool BenchCount(uintptr_t item, void *context)
+{
+    (void)item;
+
+    (*(size_t *)context)++;
+
+    return true;
+}
+
+static void BenchRunQuadTree(BenchResult *result, const RMProjectedRect *points, size_t count, const RMProjectedRect *queries, size_t queryCount)
+{
+    RMProjectedRect planet = RMProjectedRectMake(-kBenchPlanetHalfWidth, -kBenchPlanetHalfWidth, 2.0 * kBenchPlanetHalfWidth, 2.0 * kBenchPlanetHalfWidth);
+    double start = BenchNow();
+    BenchQuadNode *root = BenchQuadNodeCreate(NULL, planet);
+
+    for (size_t i = 0; i < count; i++)
+        BenchQuadNodeAdd(root, i, points);
+
+    result->buildSeconds = BenchNow() - start;
+
+    start = BenchNow();
+    result->results = 0;
+
+    for (size_t i = 0; i < queryCount; i++)
+        result->results += BenchQuadNodeQuery(root, queries[i], points);
+
+    result->querySeconds = BenchNow() - start;
+    result->name = "pointer-quadtree";
+
+    BenchQuadNodeDestroy(root);
+}
+
+static void BenchRunIndex(BenchResult *result, const char *name, RMSpatialIndexOrder order, bool bulk, const RMProjectedRect *points, size_t count, const RMProjectedRect *queries, size_t queryCount)
+{
+    uintptr_t *items = malloc(count * sizeof(uintptr_t));
+
+    for (size_t i = 0; i < count; i++)
+        items[i] = i + 1;
+
+    double start = BenchNow();
+    RMSpatialIndex *index = RMSpatialIndexCreate(order);
+
+    if (bulk)
+    {
+        RMSpatialIndexInsertMany(index, items, points, count);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            RMSpatialIndexInsert(index, items[i], points[i]);
+    }
+
+    result->buildSeconds = BenchNow() - start;
+
+    start = BenchNow();
+    result->results = 0;
+
+    for (size_t i = 0; i < queryCount; i++)
+        RMSpatialIndexQuery(index, queries[i], BenchCount, &result->results);
+
+    result->querySeconds = BenchNow() - start;
+    result->name = name;
+
+    RMSpatialIndexDestroy(index);
+    free(items);
+}
+
+static void BenchReport(FILE *output, BenchResult *result)
+{
+    fprintf(output, "%s,%lu,%.3f,%.0f,%lu,%.3f,%.1f,%.1f\n",
+            result->name,
+            (unsigned long)result->points,
+            result->buildSeconds,
+            result->points / result->buildSeconds,
+            (unsigned long)result->queries,
+            result->querySeconds,
+            result->querySeconds * 1e6 / result->queries,
+            (double)result->results / result->queries);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n points ] [ -q queries ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Builds each structure over the points and runs viewport queries against it.\n"
+            "The quadtree returns whole leaves, as RMQuadTree does, so it finds more.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = 1000000, queryCount = 10000;
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:q:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'q': queryCount = strtoul(optarg, NULL, 10); break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (count < 1 || queryCount < 1)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    RMProjectedRect *points = malloc(count * sizeof(RMProjectedRect));
+    RMProjectedRect *queries = malloc(queryCount * sizeof(RMProjectedRect));
+
+    BenchMakePoints(points, count);
+    BenchMakeQueries(queries, queryCount, points, count);
+
+    fprintf(output, "structure,points,build_seconds,inserts_per_sec,queries,query_seconds,us_per_query,results_per_query\n");
+
+    BenchResult result = { NULL, count, 0.0, queryCount, 0.0, 0 };
+
+    BenchRunQuadTree(&result, points, count, queries, queryCount);
+    BenchReport(output, &result);
+
+    BenchRunIndex(&result, "index-insert", RMSpatialIndexOrderMorton, false, points, count, queries, queryCount);
+    BenchReport(output, &result);
+
+    BenchRunIndex(&result, "index-bulk-morton", RMSpatialIndexOrderMorton, true, points, count, queries, queryCount);
+    BenchReport(output, &result);
+
+    BenchRunIndex(&result, "index-bulk-str", RMSpatialIndexOrderSTR, true, points, count, queries, queryCount);
+    BenchReport(output, &result);
+
+    free(points);
+    free(queries);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,346 @@
+//
+//  tilecachebench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmark of the in-memory tile cache core (RMLRUCache) against the timestamp
+// scan eviction RMMemoryCache used before it, on a simulated panning workload.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o tilecachebench tilecachebench.c ../Map/RMLRUCache.c ../Map/RMFrequencySketch.c ../Map/RMCacheKey.c
+//   ./tilecachebench -n 2000000 -c 32,128,512,2048
+//
+// Writes one CSV row per cache implementation and capacity.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMLRUCache.h"
+
+// Size of a decoded 256x256 RGBA tile, the cost of every simulated image.
+#define kBenchTileCost (256 * 256 * 4)
+
+static const char *kBenchCacheKey = "benchmark-tile-source";
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+// Same layout as RMTileKey() in RMTile.c, which needs CoreGraphics to include.
+static uint64_t BenchTileKey(uint32_t x, uint32_t y, short zoom)
+{
+    return ((uint64_t)(zoom & 0xFF) << 56) | ((uint64_t)(x & 0xFFFFFFF) << 28) | (uint64_t)(y & 0xFFFFFFF);
+}
+
+// A viewport of width x height tiles at zoom 16 that mostly pans a tile at a time
+// and now and then jumps elsewhere, the way RMMapTiledLayerView asks for tiles.
+typedef struct {
+    uint32_t x, y;
+    int width, height;
+    int index;
+} BenchViewport;
+
+static uint64_t BenchNextKey(BenchViewport *viewport)
+{
+    if (viewport->index == viewport->width * viewport->height)
+    {
+        unsigned long r = BenchRandom() % 100;
+
+        viewport->index = 0;
+
+        if (r < 40)
+            viewport->x++;
+        else if (r < 80)
+            viewport->x--;
+        else if (r < 90)
+            viewport->y++;
+        else if (r < 99)
+            viewport->y--;
+        else
+        {
+            viewport->x = 32768 + BenchRandom() % 256;
+            viewport->y = 32768 + BenchRandom() % 256;
+        }
+    }
+
+    uint32_t x = viewport->x + viewport->index % viewport->width;
+    uint32_t y = viewport->y + viewport->index / viewport->width;
+
+    viewport->index++;
+
+    return BenchTileKey(x, y, 16);
+}
+
+#pragma mark -
+
+// The previous RMMemoryCache: a hash lookup plus a full scan for the oldest
+// timestamp whenever an insert finds the cache at capacity.
+
+typedef struct {
+    uint64_t tileKey;
+    unsigned long timestamp;
+    size_t index;
+} BenchScanEntry;
+
+typedef struct {
+    RMLRUCache *table;
+    BenchScanEntry **entries;
+    size_t count, capacity;
+    unsigned long clock;
+} BenchScanCache;
+
+static void BenchScanFree(void *value)
+{
+    free(value);
+}
+
+static void BenchScanInit(BenchScanCache *cache, size_t capacity)
+{
+    RMLRUCacheCallbacks callbacks = { NULL, BenchScanFree };
+
+    cache->table = RMLRUCacheCreate(0, 0, &callbacks);
+    cache->entries = calloc(capacity, sizeof(BenchScanEntry *));
+    cache->count = 0;
+    cache->capacity = capacity;
+    cache->clock = 0;
+}
+
+static void BenchScanDestroy(BenchScanCache *cache)
+{
+    RMLRUCacheDestroy(cache->table);
+    free(cache->entries);
+}
+
+static int BenchScanGet(BenchScanCache *cache, uint64_t tileKey)
+{
+    BenchScanEntry *entry = RMLRUCachePeek(cache->table, tileKey, kBenchCacheKey);
+
+    if ( ! entry)
+        return 0;
+
+    entry->timestamp = ++cache->clock;
+
+    return 1;
+}
+
+static void BenchScanPut(BenchScanCache *cache, uint64_t tileKey)
+{
+    while (cache->count >= cache->capacity)
+    {
+        BenchScanEntry *oldest = NULL;
+
+        for (size_t i = 0; i < cache->count; i++)
+        {
+            if ( ! oldest || cache->entries[i]->timestamp < oldest->timestamp)
+                oldest = cache->entries[i];
+        }
+
+        cache->entries[oldest->index] = cache->entries[--cache->count];
+        cache->entries[oldest->index]->index = oldest->index;
+        RMLRUCacheRemove(cache->table, oldest->tileKey, kBenchCacheKey);
+    }
+
+    BenchScanEntry *entry = malloc(sizeof(BenchScanEntry));
+
+    entry->tileKey = tileKey;
+    entry->timestamp = ++cache->clock;
+    entry->index = cache->count;
+
+    cache->entries[cache->count++] = entry;
+    RMLRUCachePut(cache->table, tileKey, kBenchCacheKey, entry, 0);
+}
+
+#pragma mark -
+
+typedef struct {
+    const char *name;
+    size_t capacity;
+    long operations;
+    long hits;
+    double seconds;
+} BenchResult;
+
+static void BenchRunLRU(BenchResult *result, long operations, size_t capacity, BenchViewport viewport)
+{
+    RMLRUCache *cache = RMLRUCacheCreate(capacity * kBenchTileCost, 0, NULL);
+    double start = BenchNow();
+
+    result->hits = 0;
+
+    for (long i = 0; i < operations; i++)
+    {
+        uint64_t tileKey = BenchNextKey(&viewport);
+
+        if (RMLRUCacheGet(cache, tileKey, kBenchCacheKey))
+            result->hits++;
+        else
+            RMLRUCachePut(cache, tileKey, kBenchCacheKey, cache, kBenchTileCost);
+    }
+
+    result->seconds = BenchNow() - start;
+    result->name = "lru";
+
+    RMLRUCacheDestroy(cache);
+}
+
+static void BenchRunScan(BenchResult *result, long operations, size_t capacity, BenchViewport viewport)
+{
+    BenchScanCache cache;
+    double start;
+
+    BenchScanInit(&cache, capacity);
+    start = BenchNow();
+
+    result->hits = 0;
+
+    for (long i = 0; i < operations; i++)
+    {
+        uint64_t tileKey = BenchNextKey(&viewport);
+
+        if (BenchScanGet(&cache, tileKey))
+            result->hits++;
+        else
+            BenchScanPut(&cache, tileKey);
+    }
+
+    result->seconds = BenchNow() - start;
+    result->name = "timestamp-scan";
+
+    BenchScanDestroy(&cache);
+}
+
+static void BenchReport(FILE *output, BenchResult *result)
+{
+    fprintf(output, "%s,%lu,%ld,%.4f,%.6f,%.0f,%.1f\n",
+            result->name,
+            (unsigned long)result->capacity,
+            result->operations,
+            (double)result->hits / result->operations,
+            result->seconds,
+            result->operations / result->seconds,
+            result->seconds * 1e9 / result->operations);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n operations ] [ -c capacity,... ] [ -s seed ] [ -o file ] [ -l ]\n"
+            "\n"
+            "Replays a simulated panning workload against the LRU tile cache and the\n"
+            "timestamp scan it replaced (skipped with -l) for each capacity in tiles.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    long operations = 1000000;
+    const char *capacities = "32,128,512,2048";
+    const char *outputPath = NULL;
+    int lruOnly = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:c:s:o:lh")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': operations = atol(optarg); break;
+            case 'c': capacities = optarg; break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            case 'l': lruOnly = 1; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (operations <= 0)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    fprintf(output, "cache,capacity_tiles,operations,hit_ratio,seconds,ops_per_sec,ns_per_op\n");
+
+    unsigned long seed = benchSeed;
+    char *list = strdup(capacities);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        size_t capacity = strtoul(item, NULL, 10);
+        BenchViewport viewport = { 32768, 32768, 5, 4, 0 };
+        BenchResult result;
+
+        if (capacity < 1)
+            continue;
+
+        result.capacity = capacity;
+        result.operations = operations;
+
+        benchSeed = seed;
+        BenchRunLRU(&result, operations, capacity, viewport);
+        BenchReport(output, &result);
+
+        if ( ! lruOnly)
+        {
+            benchSeed = seed;
+            BenchRunScan(&result, operations, capacity, viewport);
+            BenchReport(output, &result);
+        }
+    }
+
+    free(list);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,402 @@
+//
+//  tilestorebench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of the two persistent tile cache backends: the SQLite table of
+// RMDatabaseCache, written in batches through RMTileWriteBuffer as the cache does,
+// and the append-only RMTileStore behind RMTileStoreCache. Measures sustained write
+// throughput, then the latency of reading stored tiles and of missing ones.
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -pthread -I../Map -o tilestorebench tilestorebench.c ../Map/RMTileStore.c ../Map/RMTileWriteBuffer.c ../Map/RMCacheKey.c -lsqlite3
+//   ./tilestorebench -n 20000 -r 100000 -d /tmp/tilestorebench
+//
+// Writes one CSV row per backend.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "RMTileStore.h"
+#include "RMTileWriteBuffer.h"
+
+// As RMDatabaseCache flushes its write buffer.
+#define kBenchWriteBatchSize 64
+
+// RMTileStoreCache's segment size.
+#define kBenchSegmentSize (4 * 1024 * 1024)
+
+static const char *kBenchCacheKey = "benchmark-tile-source";
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+// Same layout as RMTileKey() in RMTile.c, which needs CoreGraphics to include.
+static uint64_t BenchTileKey(uint32_t x, uint32_t y, short zoom)
+{
+    return ((uint64_t)(zoom & 0xFF) << 56) | ((uint64_t)(x & 0xFFFFFFF) << 28) | (uint64_t)(y & 0xFFFFFFF);
+}
+
+// The i-th stored tile, on a square of tiles at zoom 16; i >= count gives tiles never stored.
+static uint64_t BenchStoredTile(long i, long count)
+{
+    long side = 1;
+
+    while (side * side < count)
+        side++;
+
+    return BenchTileKey(32768 + (uint32_t)(i % side), 32768 + (uint32_t)(i / side), 16);
+}
+
+static int BenchCompareDoubles(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+
+    return (da < db ? -1 : da > db);
+}
+
+typedef struct {
+    const char *name;
+    long tiles;
+    double writeSeconds;
+    long reads;
+    long hits;
+    double hitMedian, hitP99;   // microseconds
+    double missMedian;          // microseconds
+} BenchResult;
+
+typedef struct {
+    void *(*open)(const char *path);
+    void (*close)(void *backend);
+    void (*put)(void *backend, uint64_t tileKey, const void *data, size_t length);
+    void (*flush)(void *backend);
+    void *(*copy)(void *backend, uint64_t tileKey, size_t *length);
+} BenchBackend;
+
+#pragma mark -
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *select;
+    RMTileWriteBuffer *buffer;
+} BenchDatabase;
+
+static void *BenchDatabaseOpen(const char *path)
+{
+    BenchDatabase *database = calloc(1, sizeof(BenchDatabase));
+    char file[1024];
+
+    snprintf(file, sizeof(file), "%s/RMTileCache.db", path);
+    unlink(file);
+
+    if (sqlite3_open(file, &database->db) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", file, sqlite3_errmsg(database->db));
+        exit(1);
+    }
+
+    // As in -[RMDatabaseCache configureDBForFirstUse].
+    sqlite3_exec(database->db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "PRAGMA journal_mode=OFF", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "PRAGMA cache-size=100", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "PRAGMA count_changes=OFF", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "PRAGMA auto_vacuum=INCREMENTAL", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "CREATE TABLE IF NOT EXISTS ZCACHE (tile_hash INTEGER NOT NULL, cache_key VARCHAR(25) NOT NULL, last_used DOUBLE NOT NULL, data BLOB NOT NULL)", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "CREATE UNIQUE INDEX IF NOT EXISTS main_index ON ZCACHE(tile_hash, cache_key)", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "CREATE INDEX IF NOT EXISTS last_used_index ON ZCACHE(last_used)", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "CREATE TABLE IF NOT EXISTS ZCACHE_COUNT (count INTEGER NOT NULL)", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "CREATE TRIGGER IF NOT EXISTS zcache_count_insert AFTER INSERT ON ZCACHE BEGIN UPDATE ZCACHE_COUNT SET count = count + 1; END", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "CREATE TRIGGER IF NOT EXISTS zcache_count_delete AFTER DELETE ON ZCACHE BEGIN UPDATE ZCACHE_COUNT SET count = count - 1; END", NULL, NULL, NULL);
+    sqlite3_exec(database->db, "INSERT INTO ZCACHE_COUNT (count) VALUES (0)", NULL, NULL, NULL);
+
+    sqlite3_prepare_v2(database->db, "SELECT data FROM ZCACHE WHERE tile_hash = ? AND cache_key = ?", -1, &database->select, NULL);
+
+    database->buffer = RMTileWriteBufferCreate(kBenchWriteBatchSize, 0);
+
+    return database;
+}
+
+static void BenchDatabaseClose(void *backend)
+{
+    BenchDatabase *database = backend;
+
+    RMTileWriteBufferDestroy(database->buffer);
+    sqlite3_finalize(database->select);
+    sqlite3_close(database->db);
+    free(database);
+}
+
+static void BenchDatabaseFlush(void *backend)
+{
+    BenchDatabase *database = backend;
+
+    RMTileWriteBufferFlush(database->buffer, database->db, NULL);
+}
+
+static void BenchDatabasePut(void *backend, uint64_t tileKey, const void *data, size_t length)
+{
+    BenchDatabase *database = backend;
+
+    if (RMTileWriteBufferAddTile(database->buffer, (int64_t)tileKey, kBenchCacheKey, BenchNow(), data, length) != RMTileWriteBufferQueued)
+        BenchDatabaseFlush(backend);
+}
+
+// Like FMResultSet -dataForColumnIndex:, which copies the blob.
+static void *BenchDatabaseCopy(void *backend, uint64_t tileKey, size_t *length)
+{
+    BenchDatabase *database = backend;
+    void *data = NULL;
+
+    sqlite3_bind_int64(database->select, 1, (int64_t)tileKey);
+    sqlite3_bind_text(database->select, 2, kBenchCacheKey, -1, SQLITE_STATIC);
+
+    if (sqlite3_step(database->select) == SQLITE_ROW)
+    {
+        *length = sqlite3_column_bytes(database->select, 0);
+        data = malloc(*length);
+        memcpy(data, sqlite3_column_blob(database->select, 0), *length);
+    }
+
+    sqlite3_reset(database->select);
+
+    return data;
+}
+
+#pragma mark -
+
+static void *BenchStoreOpen(const char *path)
+{
+    char directory[1024];
+
+    snprintf(directory, sizeof(directory), "%s/RMTileStore", path);
+
+    RMTileStore *store = RMTileStoreOpen(directory, kBenchSegmentSize, 0);
+
+    if ( ! store)
+    {
+        fprintf(stderr, "%s: could not open the tile store\n", directory);
+        exit(1);
+    }
+
+    RMTileStoreRemoveAll(store);
+
+    return store;
+}
+
+static void BenchStoreClose(void *backend)
+{
+    RMTileStoreClose(backend);
+}
+
+static void BenchStorePut(void *backend, uint64_t tileKey, const void *data, size_t length)
+{
+    RMTileStorePut(backend, tileKey, kBenchCacheKey, data, length);
+}
+
+static void BenchStoreFlush(void *backend)
+{
+    (void)backend;
+}
+
+static void *BenchStoreCopy(void *backend, uint64_t tileKey, size_t *length)
+{
+    return RMTileStoreCopy(backend, tileKey, kBenchCacheKey, length);
+}
+
+#pragma mark -
+
+static void BenchRun(BenchResult *result, const BenchBackend *backend, const char *path, long tiles, long reads, const void *data, size_t tileBytes)
+{
+    void *cache = backend->open(path);
+    double *latencies = malloc(reads * sizeof(double));
+    long misses = reads / 10;
+    size_t length;
+
+    result->tiles = tiles;
+    result->reads = reads;
+    result->hits = 0;
+
+    double start = BenchNow();
+
+    for (long i = 0; i < tiles; i++)
+        backend->put(cache, BenchStoredTile(i, tiles), data, tileBytes - (i % 1024));
+
+    backend->flush(cache);
+
+    result->writeSeconds = BenchNow() - start;
+
+    for (long i = 0; i < reads; i++)
+    {
+        uint64_t tileKey = BenchStoredTile((long)((BenchRandom() << 15 | BenchRandom()) % tiles), tiles);
+        double readStart = BenchNow();
+        void *tile = backend->copy(cache, tileKey, &length);
+
+        latencies[i] = (BenchNow() - readStart) * 1e6;
+
+        if (tile)
+            result->hits++;
+
+        free(tile);
+    }
+
+    qsort(latencies, reads, sizeof(double), BenchCompareDoubles);
+    result->hitMedian = latencies[reads / 2];
+    result->hitP99 = latencies[reads * 99 / 100];
+
+    for (long i = 0; i < misses; i++)
+    {
+        double readStart = BenchNow();
+        void *tile = backend->copy(cache, BenchStoredTile(tiles + 1 + i, tiles), &length);
+
+        latencies[i] = (BenchNow() - readStart) * 1e6;
+
+        free(tile);
+    }
+
+    qsort(latencies, misses, sizeof(double), BenchCompareDoubles);
+    result->missMedian = latencies[misses / 2];
+
+    free(latencies);
+    backend->close(cache);
+}
+
+static void BenchReport(FILE *output, BenchResult *result)
+{
+    fprintf(output, "%s,%ld,%.3f,%.0f,%ld,%ld,%.2f,%.2f,%.2f\n",
+            result->name,
+            result->tiles,
+            result->writeSeconds,
+            result->tiles / result->writeSeconds,
+            result->reads,
+            result->hits,
+            result->hitMedian,
+            result->hitP99,
+            result->missMedian);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n tiles ] [ -r reads ] [ -k tile_bytes ] [ -d directory ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Writes tiles to a fresh SQLite tile cache and tile store in directory, then\n"
+            "reads random stored tiles and missing ones back, reporting latencies in us.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    long tiles = 20000, reads = 100000;
+    size_t tileBytes = 16 * 1024;
+    const char *directory = "tilestorebench";
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:r:k:d:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': tiles = atol(optarg); break;
+            case 'r': reads = atol(optarg); break;
+            case 'k': tileBytes = strtoul(optarg, NULL, 10); break;
+            case 'd': directory = optarg; break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (tiles <= 0 || reads < 10 || tileBytes < 1024)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    mkdir(directory, 0755);
+
+    // Stand-in for encoded tiles; their sizes vary by up to 1 KB.
+    unsigned char *data = malloc(tileBytes);
+
+    for (size_t i = 0; i < tileBytes; i++)
+        data[i] = (unsigned char)BenchRandom();
+
+    static const BenchBackend database = { BenchDatabaseOpen, BenchDatabaseClose, BenchDatabasePut, BenchDatabaseFlush, BenchDatabaseCopy };
+    static const BenchBackend store = { BenchStoreOpen, BenchStoreClose, BenchStorePut, BenchStoreFlush, BenchStoreCopy };
+
+    fprintf(output, "backend,tiles,write_seconds,writes_per_sec,reads,hits,hit_median_us,hit_p99_us,miss_median_us\n");
+
+    unsigned long seed = benchSeed;
+    BenchResult result;
+
+    benchSeed = seed;
+    result.name = "sqlite";
+    BenchRun(&result, &database, directory, tiles, reads, data, tileBytes);
+    BenchReport(output, &result);
+
+    benchSeed = seed;
+    result.name = "tile-store";
+    BenchRun(&result, &store, directory, tiles, reads, data, tileBytes);
+    BenchReport(output, &result);
+
+    free(data);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,516 @@
+//
+//  visibilitybench.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmark of the visible annotation tracking core (RMVisibleSet) against what
+// -correctPositionOfAllAnnotationsIncludingInvisibles:animated: did before it on every
+// correction: query the whole viewport, copy the set of visible annotations, look up
+// and remove every annotation found, and hide the ones left over. Both then move every
+// visible annotation to its new screen position, in one pass.
+//
+// The viewport is a 1024 x 768 screen plus the 150 pixel buffer of RMMapView, panning
+// 20 to 150 pixels between corrections over points spread on the spherical mercator
+// plane, mostly around a few hundred "cities".
+//
+// Builds and runs on Linux or OS X without any Apple framework:
+//
+//   cc -O2 -std=gnu99 -I../Map -o visibilitybench visibilitybench.c ../Map/RMVisibleSet.c ../Map/RMSpatialIndex.c ../Map/RMFoundation.c -lm
+//   ./visibilitybench -n 1000000 -z 8,10,12,14 -f 2000
+//
+// Writes one CSV row per method and zoom level.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "RMSpatialIndex.h"
+#include "RMVisibleSet.h"
+
+// Half the width of the spherical mercator plane, as in +[RMProjection googleProjection]
+#define kBenchPlanetHalfWidth 20037508.34
+
+// Screen size and buffer in pixels, as kZoomRectPixelBuffer in RMMapView.m
+#define kBenchScreenWidth 1024.0
+#define kBenchScreenHeight 768.0
+#define kBenchPixelBuffer 150.0
+
+static unsigned long benchSeed = 1;
+
+static double BenchNow(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned long BenchRandom(void)
+{
+    benchSeed = benchSeed * 1103515245UL + 12345UL;
+
+    return (benchSeed >> 16) & 0x7fff;
+}
+
+static double BenchUniform(void)
+{
+    return (double)(BenchRandom() << 15 | BenchRandom()) / (double)(1 << 30);
+}
+
+// As in spatialindexbench.c
+static void BenchMakePoints(RMProjectedRect *points, size_t count)
+{
+    RMProjectedPoint cities[256];
+
+    for (int i = 0; i < 256; i++)
+    {
+        cities[i].x = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth * 0.9;
+        cities[i].y = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth * 0.6;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double x, y;
+
+        if (BenchRandom() % 10 < 8)
+        {
+            RMProjectedPoint city = cities[BenchRandom() % 256];
+            double radius = 50000.0 * pow(BenchUniform(), 2.0), angle = BenchUniform() * 2.0 * M_PI;
+
+            x = city.x + radius * cos(angle);
+            y = city.y + radius * sin(angle);
+        }
+        else
+        {
+            x = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth;
+            y = (BenchUniform() * 2.0 - 1.0) * kBenchPlanetHalfWidth;
+        }
+
+        points[i] = RMProjectedRectMake(x, y, 1.0, 1.0);
+    }
+}
+
+// Pan in one direction for a while, now and then turning, and back towards the city
+// it started in once 40 km away
+typedef struct {
+    RMProjectedPoint home, center;
+    double metersPerPixel;
+    double angle;
+} BenchViewport;
+
+static RMProjectedRect BenchViewportNext(BenchViewport *viewport)
+{
+    double distance = (20.0 + BenchUniform() * 130.0) * viewport->metersPerPixel;
+    double homeX = viewport->home.x - viewport->center.x, homeY = viewport->home.y - viewport->center.y;
+
+    if (BenchRandom() % 20 == 0)
+        viewport->angle = BenchUniform() * 2.0 * M_PI;
+    else if (homeX * homeX + homeY * homeY > 40000.0 * 40000.0)
+        viewport->angle = atan2(homeY, homeX) + (BenchUniform() - 0.5);
+
+    viewport->center.x += distance * cos(viewport->angle);
+    viewport->center.y += distance * sin(viewport->angle);
+
+    double width = (kBenchScreenWidth + 2.0 * kBenchPixelBuffer) * viewport->metersPerPixel;
+    double height = (kBenchScreenHeight + 2.0 * kBenchPixelBuffer) * viewport->metersPerPixel;
+
+    return RMProjectedRectMake(viewport->center.x - width / 2.0, viewport->center.y - height / 2.0, width, height);
+}
+
+#pragma mark -
+
+// The NSMutableSet of visible annotations, as an open addressing table
+
+typedef struct {
+    uintptr_t *slots;
+    size_t mask, count;
+} BenchSet;
+
+static size_t BenchSetFind(const BenchSet *set, uintptr_t item)
+{
+    size_t slot = (size_t)(((uint64_t)item * 0x9E3779B97F4A7C15ULL) >> 20) & set->mask;
+
+    while (set->slots[slot] && set->slots[slot] != item)
+        slot = (slot + 1) & set->mask;
+
+    return slot;
+}
+
+static void BenchSetInit(BenchSet *set, size_t capacity)
+{
+    size_t slotCount = 64;
+
+    while (slotCount < 2 * capacity)
+        slotCount *= 2;
+
+    set->slots = calloc(slotCount, sizeof(uintptr_t));
+    set->mask = slotCount - 1;
+    set->count = 0;
+}
+
+static void BenchSetCopy(BenchSet *to, const BenchSet *from)
+{
+    to->slots = malloc((from->mask + 1) * sizeof(uintptr_t));
+    memcpy(to->slots, from->slots, (from->mask + 1) * sizeof(uintptr_t));
+    to->mask = from->mask;
+    to->count = from->count;
+}
+
+static bool BenchSetContains(const BenchSet *set, uintptr_t item)
+{
+    return (set->slots[BenchSetFind(set, item)] != 0);
+}
+
+static void BenchSetAdd(BenchSet *set, uintptr_t item)
+{
+    if (2 * (set->count + 1) > set->mask + 1)
+    {
+        BenchSet grown;
+
+        BenchSetInit(&grown, 2 * set->count);
+
+        for (size_t i = 0; i <= set->mask; i++)
+        {
+            if (set->slots[i])
+                grown.slots[BenchSetFind(&grown, set->slots[i])] = set->slots[i];
+        }
+
+        grown.count = set->count;
+        free(set->slots);
+        *set = grown;
+    }
+
+    size_t slot = BenchSetFind(set, item);
+
+    if ( ! set->slots[slot])
+    {
+        set->slots[slot] = item;
+        set->count++;
+    }
+}
+
+static void BenchSetRemove(BenchSet *set, uintptr_t item)
+{
+    size_t slot = BenchSetFind(set, item);
+
+    if ( ! set->slots[slot])
+        return;
+
+    set->slots[slot] = 0;
+    set->count--;
+
+    // Reinsert the rest of the cluster
+    for (size_t next = (slot + 1) & set->mask; set->slots[next]; next = (next + 1) & set->mask)
+    {
+        uintptr_t moved = set->slots[next];
+
+        set->slots[next] = 0;
+        set->slots[BenchSetFind(set, moved)] = moved;
+    }
+}
+
+#pragma mark -
+
+typedef struct {
+    const char *name;
+    size_t points;
+    int zoom;
+    size_t frames;
+    size_t visible;
+    size_t changes;
+    double seconds;
+} BenchResult;
+
+typedef struct {
+    const RMProjectedRect *points;
+    BenchSet *visible, *previous;
+    size_t changes;
+} BenchRequeryContext;
+
+static bool BenchRequeryVisit(uintptr_t item, void *context)
+{
+    BenchRequeryContext *requery = context;
+
+    if ( ! BenchSetContains(requery->visible, item))
+    {
+        BenchSetAdd(requery->visible, item);
+        requery->changes++;
+    }
+
+    BenchSetRemove(requery->previous, item);
+
+    return true;
+}
+
+// Screen positions of every visible annotation, as -correctScreenPositionOfAnnotations:animated:
+static double BenchReposition(const RMProjectedRect *points, const uintptr_t *visible, size_t count, RMProjectedRect viewport, double metersPerPixel)
+{
+    double checksum = 0.0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const RMProjectedRect *point = &points[visible[i] - 1];
+
+        checksum += (point->origin.x - viewport.origin.x) / metersPerPixel;
+        checksum += (viewport.origin.y + viewport.size.height - point->origin.y) / metersPerPixel;
+    }
+
+    return checksum;
+}
+
+static size_t BenchSetItems(const BenchSet *set, uintptr_t *items)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i <= set->mask; i++)
+    {
+        if (set->slots[i])
+            items[count++] = set->slots[i];
+    }
+
+    return count;
+}
+
+static void BenchRunRequery(BenchResult *result, RMSpatialIndex *index, const RMProjectedRect *points, size_t count, BenchViewport viewport, double *checksum)
+{
+    uintptr_t *items = malloc(count * sizeof(uintptr_t));
+    BenchSet visible;
+    double start = BenchNow();
+
+    BenchSetInit(&visible, 0);
+    result->visible = result->changes = 0;
+
+    for (size_t frame = 0; frame < result->frames; frame++)
+    {
+        RMProjectedRect rect = BenchViewportNext(&viewport);
+        BenchRequeryContext requery = { points, &visible, NULL, 0 };
+        BenchSet previous;
+
+        BenchSetCopy(&previous, &visible);
+        requery.previous = &previous;
+
+        RMSpatialIndexQuery(index, rect, BenchRequeryVisit, &requery);
+
+        for (size_t i = 0; i <= previous.mask; i++)
+        {
+            if (previous.slots[i])
+            {
+                BenchSetRemove(&visible, previous.slots[i]);
+                requery.changes++;
+            }
+        }
+
+        free(previous.slots);
+
+        size_t visibleCount = BenchSetItems(&visible, items);
+
+        *checksum += BenchReposition(points, items, visibleCount, rect, viewport.metersPerPixel);
+
+        result->visible += visibleCount;
+        result->changes += requery.changes;
+    }
+
+    result->seconds = BenchNow() - start;
+    result->name = "full-requery";
+
+    free(visible.slots);
+    free(items);
+}
+
+typedef struct {
+    uintptr_t *items;
+    size_t count;
+    size_t *positions;
+    size_t changes;
+} BenchVisibleList;
+
+// Entering items are appended, leaving ones swapped with the last, as the layers of
+// the overlay are added and removed
+static void BenchVisibleEntered(uintptr_t item, void *context)
+{
+    BenchVisibleList *list = context;
+
+    list->positions[item - 1] = list->count;
+    list->items[list->count++] = item;
+    list->changes++;
+}
+
+static void BenchVisibleExited(uintptr_t item, void *context)
+{
+    BenchVisibleList *list = context;
+    size_t position = list->positions[item - 1];
+    uintptr_t last = list->items[--list->count];
+
+    list->items[position] = last;
+    list->positions[last - 1] = position;
+    list->changes++;
+}
+
+static void BenchRunVisibleSet(BenchResult *result, RMSpatialIndex *index, const RMProjectedRect *points, size_t count, BenchViewport viewport, bool reposition, double *checksum)
+{
+    BenchVisibleList list = { malloc(count * sizeof(uintptr_t)), 0, malloc(count * sizeof(size_t)), 0 };
+    RMVisibleSet *set = RMVisibleSetCreate();
+    double start = BenchNow();
+
+    result->visible = 0;
+
+    for (size_t frame = 0; frame < result->frames; frame++)
+    {
+        RMProjectedRect rect = BenchViewportNext(&viewport);
+
+        RMVisibleSetUpdate(set, index, rect, BenchVisibleEntered, BenchVisibleExited, NULL, &list);
+
+        if (reposition)
+            *checksum += BenchReposition(points, list.items, list.count, rect, viewport.metersPerPixel);
+
+        result->visible += list.count;
+    }
+
+    result->seconds = BenchNow() - start;
+    result->changes = list.changes;
+    result->name = (reposition ? "visible-set" : "visible-set-changes-only");
+
+    RMVisibleSetDestroy(set);
+    free(list.items);
+    free(list.positions);
+}
+
+static void BenchReport(FILE *output, BenchResult *result)
+{
+    fprintf(output, "%s,%lu,%d,%lu,%.0f,%.1f,%.6f,%.2f\n",
+            result->name,
+            (unsigned long)result->points,
+            result->zoom,
+            (unsigned long)result->frames,
+            (double)result->visible / result->frames,
+            (double)result->changes / result->frames,
+            result->seconds,
+            result->seconds * 1e6 / result->frames);
+}
+
+static void BenchUsage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [ -n points ] [ -z zoom,... ] [ -f frames ] [ -s seed ] [ -o file ]\n"
+            "\n"
+            "Pans a viewport over the points at each zoom level, finding the visible ones\n"
+            "after every move with a full query and with the visible set.\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = 1000000, frames = 2000;
+    const char *zooms = "8,10,12,14";
+    const char *outputPath = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:z:f:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'z': zooms = optarg; break;
+            case 'f': frames = strtoul(optarg, NULL, 10); break;
+            case 's': benchSeed = strtoul(optarg, NULL, 10); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                BenchUsage(argv[0]);
+                return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (count < 1 || frames < 1)
+    {
+        BenchUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = (outputPath ? fopen(outputPath, "w") : stdout);
+
+    if ( ! output)
+    {
+        perror(outputPath);
+        return 1;
+    }
+
+    RMProjectedRect *points = malloc(count * sizeof(RMProjectedRect));
+    uintptr_t *items = malloc(count * sizeof(uintptr_t));
+    RMSpatialIndex *index = RMSpatialIndexCreate(RMSpatialIndexOrderMorton);
+
+    BenchMakePoints(points, count);
+
+    for (size_t i = 0; i < count; i++)
+        items[i] = i + 1;
+
+    RMSpatialIndexInsertMany(index, items, points, count);
+
+    fprintf(output, "method,points,zoom,frames,visible_per_frame,changes_per_frame,seconds,us_per_frame\n");
+
+    double checksum = 0.0;
+    char *list = strdup(zooms);
+
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        int zoom = atoi(item);
+        RMProjectedPoint home = { points[0].origin.x, points[0].origin.y };
+        BenchViewport viewport = { home, home, 2.0 * kBenchPlanetHalfWidth / (256.0 * pow(2.0, zoom)), 0.3 };
+        BenchResult result;
+
+        result.points = count;
+        result.zoom = zoom;
+        result.frames = frames;
+
+        unsigned long seed = benchSeed;
+
+        BenchRunRequery(&result, index, points, count, viewport, &checksum);
+        BenchReport(output, &result);
+
+        benchSeed = seed;
+        BenchRunVisibleSet(&result, index, points, count, viewport, true, &checksum);
+        BenchReport(output, &result);
+
+        benchSeed = seed;
+        BenchRunVisibleSet(&result, index, points, count, viewport, false, &checksum);
+        BenchReport(output, &result);
+    }
+
+    fprintf(stderr, "checksum %g\n", checksum);
+
+    free(list);
+    RMSpatialIndexDestroy(index);
+    free(points);
+    free(items);
+
+    if (output != stdout)
+        fclose(output);
+
+    return 0;
+}
@@ -60,6 +60,7 @@
 - (UIImage *)imageForTile:(RMTile)tile inCache:(RMTileCache *)tileCache
 {
     __block UIImage *image = nil;
+    NSData *imageData = nil; // the encoded tile as received, if the image was not composited
 
 	tile = [[self mercatorToTileProjection] normaliseTile:tile];
     image = [tileCache cachedImage:tile withCacheKey:[self uniqueTilecacheKey]];
@@ -133,10 +134,13 @@
 
                     image = UIGraphicsGetImageFromCurrentImageContext();
                     UIGraphicsEndImageContext();
+
+                    imageData = nil;
                 }
                 else
                 {
                     image = [UIImage imageWithData:tileData];
+                    imageData = tileData;
                 }
             }
         }
@@ -148,7 +152,8 @@
             NSHTTPURLResponse *response = nil;
             NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[URLs objectAtIndex:0]];
             [request setTimeoutInterval:(self.requestTimeoutSeconds / (CGFloat)self.retryCount)];
-            image = [UIImage imageWithData:[NSURLConnection sendSynchronousRequest:request returningResponse:&response error:nil]];
+            imageData = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:nil];
+            image = [UIImage imageWithData:imageData];
 
             if (response.statusCode == HTTP_404_NOT_FOUND)
                 break;
@@ -156,7 +161,7 @@
     }
 
     if (image)
-        [tileCache addImage:image forTile:tile withCacheKey:[self uniqueTilecacheKey]];
+        [tileCache addImage:image withData:imageData forTile:tile withCacheKey:[self uniqueTilecacheKey]];
 
     [tileCache release];
 
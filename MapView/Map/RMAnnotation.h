@@ -28,7 +28,7 @@
 
 #import "RMFoundation.h"
 
-@class RMMapView, RMMapLayer, RMQuadTreeNode;
+@class RMMapView, RMMapLayer;
 
 /** An RMAnnotation defines a container for annotation data to be placed on a map. At a future point in time, depending on map use, a visible layer may be requested and displayed for the annotation. The layer can be set ahead of time using the annotation's layer property, or, in the recommended approach, can be provided by an RMMapView's delegate when first needed for display. */
 @interface RMAnnotation : NSObject
@@ -43,7 +43,6 @@
     BOOL enabled, clusteringEnabled;
 
     RMMapLayer *layer;
-    RMQuadTreeNode *quadTreeNode;
 
     // provided for storage of arbitrary user data
     id userInfo;
@@ -92,9 +91,6 @@
 *   @see RMCircle */
 @property (nonatomic, retain) RMMapLayer *layer;
 
-// This is for the QuadTree. Don't mess this up.
-@property (nonatomic, assign) RMQuadTreeNode *quadTreeNode;
-
 /** @name Filtering Types of Annotations */
 
 /** Whether the annotation is related to display of the user's location. Useful for filtering purposes when providing annotation layers in the delegate. */
@@ -49,7 +49,6 @@
 @synthesize hasBoundingBox;
 @synthesize enabled, clusteringEnabled;
 @synthesize position;
-@synthesize quadTreeNode;
 @synthesize isUserLocationAnnotation;
 
 + (id)annotationWithMapView:(RMMapView *)aMapView coordinate:(CLLocationCoordinate2D)aCoordinate andTitle:(NSString *)aTitle
@@ -66,7 +65,6 @@
     self.coordinate   = aCoordinate;
     self.title        = aTitle;
     self.userInfo     = nil;
-    self.quadTreeNode = nil;
 
     self.annotationType    = nil;
     self.annotationIcon    = nil;
@@ -89,7 +87,6 @@
     self.userInfo     = nil;
     self.layer        = nil;
     [[self.mapView quadTree] removeAnnotation:self];
-    self.quadTreeNode = nil;
     self.mapView      = nil;
 
     self.annotationType = nil;
@@ -108,7 +105,7 @@
     if (!self.hasBoundingBox)
         self.projectedBoundingBox = RMProjectedRectMake(self.projectedLocation.x, self.projectedLocation.y, 1.0, 1.0);
 
-    [self.quadTreeNode performSelector:@selector(annotationDidChangeBoundingBox:) withObject:self];
+    [[mapView quadTree] annotationDidChangeBoundingBox:self];
 }
 
 - (void)setMapView:(RMMapView *)aMapView
@@ -0,0 +1,143 @@
+//
+//  RMBloomFilter.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMBloomFilter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define kRMBloomFilterMaximumHashes 16
+#define kRMBloomFilterMinimumCounters 1024
+#define kRMBloomFilterSaturated 255
+
+struct RMBloomFilter {
+    uint8_t *counters;
+    size_t counterMask;
+    unsigned int hashCount;
+};
+
+// Double hashing: the i-th position is h1 + i * h2, both taken from the 64-bit hash.
+static size_t RMBloomFilterIndex(RMBloomFilter *filter, uint64_t hash, unsigned int i)
+{
+    uint64_t h1 = hash * 0x9e3779b97f4a7c15ULL;
+    uint64_t h2 = ((hash >> 32) | (hash << 32)) * 0xc2b2ae3d27d4eb4fULL | 1;
+
+    return (size_t)((h1 + i * h2) >> 16) & filter->counterMask;
+}
+
+#pragma mark -
+
+RMBloomFilter *RMBloomFilterCreate(size_t expectedEntries, double falsePositiveRate)
+{
+    RMBloomFilter *filter = calloc(1, sizeof(RMBloomFilter));
+
+    if ( ! filter)
+        return NULL;
+
+    // The optimal filter uses log2(1 / rate) hashes and 1.44 counters per hash and entry.
+    unsigned int hashCount = 1;
+    double rate = 0.5;
+
+    while (rate > falsePositiveRate && hashCount < kRMBloomFilterMaximumHashes)
+    {
+        rate /= 2;
+        hashCount++;
+    }
+
+    size_t wanted = (size_t)(expectedEntries * hashCount * 1.44);
+    size_t counters = kRMBloomFilterMinimumCounters;
+
+    while (counters < wanted && counters < ((size_t)1 << 30))
+        counters <<= 1;
+
+    filter->counters = calloc(counters, sizeof(uint8_t));
+
+    if ( ! filter->counters)
+    {
+        free(filter);
+        return NULL;
+    }
+
+    filter->counterMask = counters - 1;
+    filter->hashCount = hashCount;
+
+    return filter;
+}
+
+void RMBloomFilterDestroy(RMBloomFilter *filter)
+{
+    if ( ! filter)
+        return;
+
+    free(filter->counters);
+    free(filter);
+}
+
+void RMBloomFilterAdd(RMBloomFilter *filter, uint64_t hash)
+{
+    for (unsigned int i = 0; i < filter->hashCount; i++)
+    {
+        uint8_t *counter = &filter->counters[RMBloomFilterIndex(filter, hash, i)];
+        uint8_t count = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+        // Unlike the frequency sketch, no update may be lost, or a removal would
+        // bring a counter of another key down to zero.
+        while (count < kRMBloomFilterSaturated && ! __atomic_compare_exchange_n(counter, &count, count + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+void RMBloomFilterRemove(RMBloomFilter *filter, uint64_t hash)
+{
+    for (unsigned int i = 0; i < filter->hashCount; i++)
+    {
+        uint8_t *counter = &filter->counters[RMBloomFilterIndex(filter, hash, i)];
+        uint8_t count = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+        // A saturated counter has lost track of how many keys share it.
+        while (count > 0 && count < kRMBloomFilterSaturated && ! __atomic_compare_exchange_n(counter, &count, count - 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+bool RMBloomFilterMayContain(RMBloomFilter *filter, uint64_t hash)
+{
+    for (unsigned int i = 0; i < filter->hashCount; i++)
+    {
+        if (__atomic_load_n(&filter->counters[RMBloomFilterIndex(filter, hash, i)], __ATOMIC_RELAXED) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+void RMBloomFilterClear(RMBloomFilter *filter)
+{
+    for (size_t i = 0; i <= filter->counterMask; i++)
+        __atomic_store_n(&filter->counters[i], 0, __ATOMIC_RELAXED);
+}
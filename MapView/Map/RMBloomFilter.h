@@ -0,0 +1,69 @@
+//
+//  RMBloomFilter.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMBLOOMFILTER_H_
+#define _RMBLOOMFILTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMCacheKey.h"
+
+// A counting Bloom filter of key hashes (see RMCacheKeyHash()), kept in front of a
+// persistent tile cache so that most lookups of tiles that were never stored are
+// answered without touching the disk. It never misses a key that was added and not
+// removed; it reports a key that is not there with about the false positive rate it
+// was created with, as long as it holds no more keys than it was sized for.
+//
+// Every key sets one 8-bit counter in each of several positions, so that keys can be
+// removed again. A counter that reaches 255 stays there, giving false positives but
+// never false negatives.
+//
+// All functions may run concurrently; counters are updated atomically.
+
+typedef struct RMBloomFilter RMBloomFilter;
+
+// Create a filter for about expectedEntries keys with the given false positive rate,
+// for example 0.01. Returns NULL if memory could not be allocated.
+RMBloomFilter *RMBloomFilterCreate(size_t expectedEntries, double falsePositiveRate);
+
+void RMBloomFilterDestroy(RMBloomFilter *filter);
+
+void RMBloomFilterAdd(RMBloomFilter *filter, uint64_t hash);
+
+// Remove a key hash that was added before. Removing one that was not corrupts the filter.
+void RMBloomFilterRemove(RMBloomFilter *filter, uint64_t hash);
+
+// False if the key hash was certainly not added, or has been removed since.
+bool RMBloomFilterMayContain(RMBloomFilter *filter, uint64_t hash);
+
+// Remove all keys.
+void RMBloomFilterClear(RMBloomFilter *filter);
+
+#endif
@@ -0,0 +1,665 @@
+//
+//  RMClusterIndex.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMClusterIndex.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Entries of a k-d tree leaf, searched linearly
+#define kRMClusterIndexNodeSize 64
+
+// References to clusters rather than points
+#define kRMClusterIndexClusterBit ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+// Spherical mercator width in meters over a 256 pixel tile
+#define kRMClusterIndexDefaultMetersPerPixel (2.0 * 20037508.342789244 / 256.0)
+
+// The points and clusters shown at one zoom level, as separate arrays sorted into
+// an implicit k-d tree: the median of every range splits it, alternately by x and y.
+typedef struct {
+    size_t count;
+    double *x, *y;
+    size_t *weight; // points in the entry
+    size_t *ref;    // index of the point, or of the cluster with kRMClusterIndexClusterBit
+} RMClusterIndexLevel;
+
+typedef struct {
+    double x, y;
+    size_t count;
+    int zoom;
+    size_t firstChild, childCount; // in childRefs
+} RMClusterIndexCluster;
+
+struct RMClusterIndex {
+    RMClusterIndexOptions options;
+
+    uintptr_t *items;
+    RMProjectedPoint *points;
+    size_t pointCount;
+
+    // One level per zoom from minZoom to maxZoom + 1, the last holding the points
+    RMClusterIndexLevel *levels;
+    unsigned int levelCount;
+
+    RMClusterIndexCluster *clusters;
+    size_t clusterCount, clusterCapacity;
+
+    size_t *childRefs;
+    size_t childRefCount, childRefCapacity;
+};
+
+#pragma mark -
+
+static bool RMClusterIndexLevelAllocate(RMClusterIndexLevel *level, size_t capacity)
+{
+    if (capacity == 0)
+        capacity = 1;
+
+    level->x = malloc(capacity * sizeof(double));
+    level->y = malloc(capacity * sizeof(double));
+    level->weight = malloc(capacity * sizeof(size_t));
+    level->ref = malloc(capacity * sizeof(size_t));
+
+    return (level->x && level->y && level->weight && level->ref);
+}
+
+static void RMClusterIndexLevelFree(RMClusterIndexLevel *level)
+{
+    free(level->x);
+    free(level->y);
+    free(level->weight);
+    free(level->ref);
+}
+
+static inline void RMClusterIndexLevelSwap(RMClusterIndexLevel *level, long i, long j)
+{
+    double x = level->x[i]; level->x[i] = level->x[j]; level->x[j] = x;
+    double y = level->y[i]; level->y[i] = level->y[j]; level->y[j] = y;
+    size_t weight = level->weight[i]; level->weight[i] = level->weight[j]; level->weight[j] = weight;
+    size_t ref = level->ref[i]; level->ref[i] = level->ref[j]; level->ref[j] = ref;
+}
+
+static inline double RMClusterIndexLevelCoordinate(const RMClusterIndexLevel *level, long i, int axis)
+{
+    return (axis == 0 ? level->x[i] : level->y[i]);
+}
+
+// Floyd-Rivest selection: put the k-th smallest coordinate on the axis at k, with
+// the smaller ones before it and the larger ones after
+static void RMClusterIndexSelect(RMClusterIndexLevel *level, long k, long left, long right, int axis)
+{
+    while (right > left)
+    {
+        if (right - left > 600)
+        {
+            double n = right - left + 1, m = k - left + 1;
+            double z = log(n), s = 0.5 * exp(2.0 * z / 3.0);
+            double sd = 0.5 * sqrt(z * s * (n - s) / n) * (m - n / 2.0 < 0 ? -1.0 : 1.0);
+            long newLeft = (long)fmax(left, floor(k - m * s / n + sd));
+            long newRight = (long)fmin(right, floor(k + (n - m) * s / n + sd));
+
+            RMClusterIndexSelect(level, k, newLeft, newRight, axis);
+        }
+
+        double t = RMClusterIndexLevelCoordinate(level, k, axis);
+        long i = left, j = right;
+
+        RMClusterIndexLevelSwap(level, left, k);
+
+        if (RMClusterIndexLevelCoordinate(level, right, axis) > t)
+            RMClusterIndexLevelSwap(level, left, right);
+
+        while (i < j)
+        {
+            RMClusterIndexLevelSwap(level, i, j);
+            i++;
+            j--;
+
+            while (RMClusterIndexLevelCoordinate(level, i, axis) < t)
+                i++;
+
+            while (RMClusterIndexLevelCoordinate(level, j, axis) > t)
+                j--;
+        }
+
+        if (RMClusterIndexLevelCoordinate(level, left, axis) == t)
+        {
+            RMClusterIndexLevelSwap(level, left, j);
+        }
+        else
+        {
+            j++;
+            RMClusterIndexLevelSwap(level, j, right);
+        }
+
+        if (j <= k)
+            left = j + 1;
+
+        if (k <= j)
+            right = j - 1;
+    }
+}
+
+static void RMClusterIndexSort(RMClusterIndexLevel *level, long left, long right, int axis)
+{
+    while (right - left > kRMClusterIndexNodeSize)
+    {
+        long middle = (left + right) / 2;
+
+        RMClusterIndexSelect(level, middle, left, right, axis);
+        RMClusterIndexSort(level, left, middle - 1, 1 - axis);
+
+        left = middle + 1;
+        axis = 1 - axis;
+    }
+}
+
+// Call found with every entry of the level within the rectangle, or within radius of
+// (minX, minY) if radius is positive, stopping when it returns false. Returns the
+// number found.
+typedef bool (*RMClusterIndexFound)(const RMClusterIndex *index, const RMClusterIndexLevel *level, size_t i, void *context);
+
+static size_t RMClusterIndexSearch(const RMClusterIndex *index, const RMClusterIndexLevel *level, double minX, double minY, double maxX, double maxY, double radius, RMClusterIndexFound found, void *context)
+{
+    double centerX = minX, centerY = minY, squaredRadius = radius * radius;
+    long stack[3 * 128];
+    int depth = 0;
+    size_t foundCount = 0;
+
+    if (level->count == 0)
+        return 0;
+
+    if (radius > 0.0)
+    {
+        minX = centerX - radius;
+        maxX = centerX + radius;
+        minY = centerY - radius;
+        maxY = centerY + radius;
+    }
+
+    stack[depth++] = 0;
+    stack[depth++] = (long)level->count - 1;
+    stack[depth++] = 0;
+
+    while (depth > 0)
+    {
+        int axis = (int)stack[--depth];
+        long right = stack[--depth];
+        long left = stack[--depth];
+
+        if (right - left <= kRMClusterIndexNodeSize)
+        {
+            for (long i = left; i <= right; i++)
+            {
+                double x = level->x[i], y = level->y[i];
+                bool inside;
+
+                if (radius > 0.0)
+                    inside = ((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY) <= squaredRadius);
+                else
+                    inside = (x >= minX && x <= maxX && y >= minY && y <= maxY);
+
+                if (inside)
+                {
+                    foundCount++;
+
+                    if ( ! found(index, level, (size_t)i, context))
+                        return foundCount;
+                }
+            }
+
+            continue;
+        }
+
+        long middle = (left + right) / 2;
+        double x = level->x[middle], y = level->y[middle];
+        bool inside;
+
+        if (radius > 0.0)
+            inside = ((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY) <= squaredRadius);
+        else
+            inside = (x >= minX && x <= maxX && y >= minY && y <= maxY);
+
+        if (inside)
+        {
+            foundCount++;
+
+            if ( ! found(index, level, (size_t)middle, context))
+                return foundCount;
+        }
+
+        if (axis == 0 ? minX <= x : minY <= y)
+        {
+            stack[depth++] = left;
+            stack[depth++] = middle - 1;
+            stack[depth++] = 1 - axis;
+        }
+
+        if (axis == 0 ? maxX >= x : maxY >= y)
+        {
+            stack[depth++] = middle + 1;
+            stack[depth++] = right;
+            stack[depth++] = 1 - axis;
+        }
+    }
+
+    return foundCount;
+}
+
+#pragma mark -
+
+typedef struct {
+    size_t *entries;
+    size_t count, capacity;
+    const unsigned char *taken;
+    bool failed;
+} RMClusterIndexNeighbors;
+
+static bool RMClusterIndexAddNeighbor(const RMClusterIndex *index, const RMClusterIndexLevel *level, size_t i, void *context)
+{
+    RMClusterIndexNeighbors *neighbors = context;
+
+    (void)index;
+    (void)level;
+
+    if (neighbors->taken[i])
+        return true;
+
+    if (neighbors->count == neighbors->capacity)
+    {
+        size_t capacity = (neighbors->capacity ? 2 * neighbors->capacity : 64);
+        size_t *entries = realloc(neighbors->entries, capacity * sizeof(size_t));
+
+        if ( ! entries)
+        {
+            neighbors->failed = true;
+            return false;
+        }
+
+        neighbors->entries = entries;
+        neighbors->capacity = capacity;
+    }
+
+    neighbors->entries[neighbors->count++] = i;
+
+    return true;
+}
+
+static bool RMClusterIndexReserve(void **array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return true;
+
+    size_t newCapacity = (*capacity ? *capacity : 64);
+
+    while (newCapacity < needed)
+        newCapacity *= 2;
+
+    void *newArray = realloc(*array, newCapacity * size);
+
+    if ( ! newArray)
+        return false;
+
+    *array = newArray;
+    *capacity = newCapacity;
+
+    return true;
+}
+
+// Cluster the entries of the level below (zoom + 1) into the level for zoom
+static bool RMClusterIndexClusterLevel(RMClusterIndex *index, const RMClusterIndexLevel *below, RMClusterIndexLevel *level, int zoom)
+{
+    double radius = index->options.radius * index->options.metersPerPixelAtZoomZero / pow(2.0, zoom);
+    unsigned char *taken = calloc(below->count + 1, 1);
+    RMClusterIndexNeighbors neighbors = { NULL, 0, 0, taken, false };
+
+    if ( ! taken || ! RMClusterIndexLevelAllocate(level, below->count))
+    {
+        free(taken);
+        return false;
+    }
+
+    level->count = 0;
+
+    for (size_t i = 0; i < below->count; i++)
+    {
+        if (taken[i])
+            continue;
+
+        taken[i] = 1;
+        neighbors.count = 0;
+
+        RMClusterIndexSearch(index, below, below->x[i], below->y[i], 0.0, 0.0, radius, RMClusterIndexAddNeighbor, &neighbors);
+
+        if (neighbors.failed)
+            break;
+
+        size_t weight = below->weight[i];
+
+        for (size_t n = 0; n < neighbors.count; n++)
+            weight += below->weight[neighbors.entries[n]];
+
+        size_t out = level->count++;
+
+        if (neighbors.count == 0 || weight < index->options.minPoints)
+        {
+            level->x[out] = below->x[i];
+            level->y[out] = below->y[i];
+            level->weight[out] = below->weight[i];
+            level->ref[out] = below->ref[i];
+            continue;
+        }
+
+        if ( ! RMClusterIndexReserve((void **)&index->clusters, &index->clusterCapacity, index->clusterCount + 1, sizeof(RMClusterIndexCluster)) ||
+            ! RMClusterIndexReserve((void **)&index->childRefs, &index->childRefCapacity, index->childRefCount + neighbors.count + 1, sizeof(size_t)))
+        {
+            neighbors.failed = true;
+            break;
+        }
+
+        RMClusterIndexCluster *cluster = &index->clusters[index->clusterCount];
+        double weightedX = below->x[i] * below->weight[i], weightedY = below->y[i] * below->weight[i];
+
+        cluster->firstChild = index->childRefCount;
+        cluster->childCount = neighbors.count + 1;
+        cluster->zoom = zoom;
+        cluster->count = weight;
+
+        index->childRefs[index->childRefCount++] = below->ref[i];
+
+        for (size_t n = 0; n < neighbors.count; n++)
+        {
+            size_t j = neighbors.entries[n];
+
+            taken[j] = 1;
+            weightedX += below->x[j] * below->weight[j];
+            weightedY += below->y[j] * below->weight[j];
+            index->childRefs[index->childRefCount++] = below->ref[j];
+        }
+
+        cluster->x = weightedX / weight;
+        cluster->y = weightedY / weight;
+
+        level->x[out] = cluster->x;
+        level->y[out] = cluster->y;
+        level->weight[out] = weight;
+        level->ref[out] = index->clusterCount++ | kRMClusterIndexClusterBit;
+    }
+
+    free(taken);
+    free(neighbors.entries);
+
+    if (neighbors.failed)
+        return false;
+
+    RMClusterIndexSort(level, 0, (long)level->count - 1, 0);
+
+    return true;
+}
+
+static void RMClusterIndexMakeCluster(const RMClusterIndex *index, size_t ref, double x, double y, size_t weight, RMCluster *cluster)
+{
+    cluster->center.x = x;
+    cluster->center.y = y;
+    cluster->count = weight;
+
+    if (ref & kRMClusterIndexClusterBit)
+    {
+        cluster->clusterID = (uint32_t)((ref & ~kRMClusterIndexClusterBit) + 1);
+        cluster->item = 0;
+    }
+    else
+    {
+        cluster->clusterID = 0;
+        cluster->item = index->items[ref];
+    }
+}
+
+static const RMClusterIndexCluster *RMClusterIndexClusterForID(const RMClusterIndex *index, uint32_t clusterID)
+{
+    if (clusterID == 0 || clusterID > index->clusterCount)
+        return NULL;
+
+    return &index->clusters[clusterID - 1];
+}
+
+#pragma mark -
+
+RMClusterIndexOptions RMClusterIndexDefaultOptions(void)
+{
+    RMClusterIndexOptions options = { 60.0, kRMClusterIndexDefaultMetersPerPixel, 0, 16, 2 };
+
+    return options;
+}
+
+RMClusterIndex *RMClusterIndexCreate(const RMClusterIndexOptions *options, const uintptr_t *items, const RMProjectedPoint *points, size_t count)
+{
+    if (options->radius <= 0.0 || options->metersPerPixelAtZoomZero <= 0.0 || options->minZoom < 0 ||
+        options->maxZoom < options->minZoom || options->maxZoom > 30 || options->minPoints < 2)
+        return NULL;
+
+    RMClusterIndex *index = calloc(1, sizeof(RMClusterIndex));
+
+    if ( ! index)
+        return NULL;
+
+    index->options = *options;
+    index->pointCount = count;
+    index->items = malloc((count ? count : 1) * sizeof(uintptr_t));
+    index->points = malloc((count ? count : 1) * sizeof(RMProjectedPoint));
+    index->levels = calloc(options->maxZoom - options->minZoom + 2, sizeof(RMClusterIndexLevel));
+
+    if ( ! index->items || ! index->points || ! index->levels)
+    {
+        RMClusterIndexDestroy(index);
+        return NULL;
+    }
+
+    if (count)
+    {
+        memcpy(index->items, items, count * sizeof(uintptr_t));
+        memcpy(index->points, points, count * sizeof(RMProjectedPoint));
+    }
+
+    // The points, above the deepest clustered zoom
+    RMClusterIndexLevel *level = &index->levels[index->levelCount++];
+
+    if ( ! RMClusterIndexLevelAllocate(level, count))
+    {
+        RMClusterIndexDestroy(index);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        level->x[i] = points[i].x;
+        level->y[i] = points[i].y;
+        level->weight[i] = 1;
+        level->ref[i] = i;
+    }
+
+    level->count = count;
+
+    RMClusterIndexSort(level, 0, (long)count - 1, 0);
+
+    // Then every zoom up from the deepest, built from the one below; levels[] is
+    // ordered by zoom once done
+    for (int zoom = options->maxZoom; zoom >= options->minZoom; zoom--)
+    {
+        RMClusterIndexLevel *below = &index->levels[index->levelCount - 1];
+
+        if ( ! RMClusterIndexClusterLevel(index, below, &index->levels[index->levelCount++], zoom))
+        {
+            RMClusterIndexDestroy(index);
+            return NULL;
+        }
+    }
+
+    for (unsigned int i = 0; i < index->levelCount / 2; i++)
+    {
+        RMClusterIndexLevel swap = index->levels[i];
+
+        index->levels[i] = index->levels[index->levelCount - 1 - i];
+        index->levels[index->levelCount - 1 - i] = swap;
+    }
+
+    return index;
+}
+
+void RMClusterIndexDestroy(RMClusterIndex *index)
+{
+    if ( ! index)
+        return;
+
+    if (index->levels)
+    {
+        for (int i = 0; i < index->options.maxZoom - index->options.minZoom + 2; i++)
+            RMClusterIndexLevelFree(&index->levels[i]);
+    }
+
+    free(index->levels);
+    free(index->items);
+    free(index->points);
+    free(index->clusters);
+    free(index->childRefs);
+    free(index);
+}
+
+typedef struct {
+    RMClusterIndexVisitor visitor;
+    void *context;
+} RMClusterIndexQueryContext;
+
+static bool RMClusterIndexVisitEntry(const RMClusterIndex *index, const RMClusterIndexLevel *level, size_t i, void *context)
+{
+    RMClusterIndexQueryContext *query = context;
+    RMCluster cluster;
+
+    RMClusterIndexMakeCluster(index, level->ref[i], level->x[i], level->y[i], level->weight[i], &cluster);
+
+    return query->visitor(&cluster, query->context);
+}
+
+size_t RMClusterIndexQuery(const RMClusterIndex *index, RMProjectedRect rect, double zoom, RMClusterIndexVisitor visitor, void *context)
+{
+    int levelZoom = (int)floor(zoom);
+
+    if (levelZoom < index->options.minZoom)
+        levelZoom = index->options.minZoom;
+
+    if (levelZoom > index->options.maxZoom + 1)
+        levelZoom = index->options.maxZoom + 1;
+
+    RMClusterIndexQueryContext query = { visitor, context };
+    double x1 = rect.origin.x, x2 = rect.origin.x + rect.size.width;
+    double y1 = rect.origin.y, y2 = rect.origin.y + rect.size.height;
+
+    return RMClusterIndexSearch(index, &index->levels[levelZoom - index->options.minZoom], fmin(x1, x2), fmin(y1, y2), fmax(x1, x2), fmax(y1, y2), 0.0, RMClusterIndexVisitEntry, &query);
+}
+
+size_t RMClusterIndexEnumerateChildren(const RMClusterIndex *index, uint32_t clusterID, RMClusterIndexVisitor visitor, void *context)
+{
+    const RMClusterIndexCluster *cluster = RMClusterIndexClusterForID(index, clusterID);
+    size_t visited = 0;
+
+    if ( ! cluster)
+        return 0;
+
+    for (size_t i = 0; i < cluster->childCount; i++)
+    {
+        size_t ref = index->childRefs[cluster->firstChild + i];
+        RMCluster child;
+
+        if (ref & kRMClusterIndexClusterBit)
+        {
+            const RMClusterIndexCluster *childCluster = &index->clusters[ref & ~kRMClusterIndexClusterBit];
+
+            RMClusterIndexMakeCluster(index, ref, childCluster->x, childCluster->y, childCluster->count, &child);
+        }
+        else
+        {
+            RMClusterIndexMakeCluster(index, ref, index->points[ref].x, index->points[ref].y, 1, &child);
+        }
+
+        visited++;
+
+        if ( ! visitor(&child, context))
+            break;
+    }
+
+    return visited;
+}
+
+static bool RMClusterIndexEnumerateRefItems(const RMClusterIndex *index, const RMClusterIndexCluster *cluster, RMClusterIndexItemVisitor visitor, void *context, size_t *visited)
+{
+    for (size_t i = 0; i < cluster->childCount; i++)
+    {
+        size_t ref = index->childRefs[cluster->firstChild + i];
+
+        if (ref & kRMClusterIndexClusterBit)
+        {
+            if ( ! RMClusterIndexEnumerateRefItems(index, &index->clusters[ref & ~kRMClusterIndexClusterBit], visitor, context, visited))
+                return false;
+        }
+        else
+        {
+            (*visited)++;
+
+            if ( ! visitor(index->items[ref], context))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+size_t RMClusterIndexEnumerateItems(const RMClusterIndex *index, uint32_t clusterID, RMClusterIndexItemVisitor visitor, void *context)
+{
+    const RMClusterIndexCluster *cluster = RMClusterIndexClusterForID(index, clusterID);
+    size_t visited = 0;
+
+    if (cluster)
+        RMClusterIndexEnumerateRefItems(index, cluster, visitor, context, &visited);
+
+    return visited;
+}
+
+int RMClusterIndexExpansionZoom(const RMClusterIndex *index, uint32_t clusterID)
+{
+    const RMClusterIndexCluster *cluster = RMClusterIndexClusterForID(index, clusterID);
+
+    // A cluster is made of at least two entries of the zoom level below, where it splits
+    return (cluster ? cluster->zoom + 1 : -1);
+}
+
+size_t RMClusterIndexCount(const RMClusterIndex *index)
+{
+    return index->pointCount;
+}
@@ -0,0 +1,97 @@
+//
+//  RMClusterIndex.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMCLUSTERINDEX_H_
+#define _RMCLUSTERINDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+
+// Clusters of point annotations computed once for every integer zoom level, so that
+// showing the clusters of a viewport is a range search rather than clustering again.
+//
+// Building starts from the points, one level above the deepest clustered zoom, and
+// works up: at each zoom every point or cluster not yet taken absorbs those of the
+// level below within the clustering radius (in screen pixels at that zoom) into a
+// cluster at their gravity center. Every level is stored as a static k-d tree.
+//
+// A built index is not modified, so it may be queried from several threads at once.
+
+typedef struct RMClusterIndex RMClusterIndex;
+
+typedef struct {
+    // Clustering radius in pixels, and the projected meters per pixel at zoom 0
+    double radius;
+    double metersPerPixelAtZoomZero;
+    // Zoom levels clustered; above maxZoom queries return the points themselves
+    int minZoom, maxZoom;
+    // Fewest points to make a cluster
+    size_t minPoints;
+} RMClusterIndexOptions;
+
+typedef struct {
+    RMProjectedPoint center; // gravity center of a cluster, location of a point
+    size_t count;            // points in a cluster, 1 for a point
+    uint32_t clusterID;      // 0 for a point
+    uintptr_t item;          // the item of a point, 0 for a cluster
+} RMCluster;
+
+// Return false to stop.
+typedef bool (*RMClusterIndexVisitor)(const RMCluster *cluster, void *context);
+typedef bool (*RMClusterIndexItemVisitor)(uintptr_t item, void *context);
+
+// Options for 256 pixel spherical mercator tiles and a 60 pixel radius, zooms 0 to 16.
+RMClusterIndexOptions RMClusterIndexDefaultOptions(void);
+
+// Build the index of count points, items being opaque values such as object pointers.
+// Returns NULL if memory could not be allocated.
+RMClusterIndex *RMClusterIndexCreate(const RMClusterIndexOptions *options, const uintptr_t *items, const RMProjectedPoint *points, size_t count);
+
+void RMClusterIndexDestroy(RMClusterIndex *index);
+
+// Call visitor with every cluster or point of the zoom level (rounded down, and
+// clamped to the indexed ones) inside rect. Returns the number visited.
+size_t RMClusterIndexQuery(const RMClusterIndex *index, RMProjectedRect rect, double zoom, RMClusterIndexVisitor visitor, void *context);
+
+// Call visitor with the clusters and points a cluster was made of, one zoom level
+// deeper. Returns the number visited, 0 if there is no such cluster.
+size_t RMClusterIndexEnumerateChildren(const RMClusterIndex *index, uint32_t clusterID, RMClusterIndexVisitor visitor, void *context);
+
+// Call visitor with the item of every point in the cluster. Returns the number visited.
+size_t RMClusterIndexEnumerateItems(const RMClusterIndex *index, uint32_t clusterID, RMClusterIndexItemVisitor visitor, void *context);
+
+// The zoom level at which the cluster splits into several clusters or points, or -1
+// if there is no such cluster.
+int RMClusterIndexExpansionZoom(const RMClusterIndex *index, uint32_t clusterID);
+
+size_t RMClusterIndexCount(const RMClusterIndex *index);
+
+#endif
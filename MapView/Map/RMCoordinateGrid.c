@@ -0,0 +1,746 @@
+//
+//  RMCoordinateGrid.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMCoordinateGrid.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RMPathClipper.h"
+
+// The latitude of the top of the zoom 0 tile
+#define kRMCoordinateGridMaximumLatitude 85.051128779806589
+
+#define kRMCoordinateGridParallelTables 8
+
+// More parallels than this are not worked out, as they would not be drawn apart
+#define kRMCoordinateGridMaximumParallels (1 << 22)
+
+// The radius of the sphere of spherical mercator, and the WGS 84 ellipsoid of UTM
+#define kRMCoordinateGridSphereRadius 6378137.0
+#define kRMCoordinateGridSemiMajorAxis 6378137.0
+#define kRMCoordinateGridFlattening (1.0 / 298.257223563)
+
+#define kRMUTMScaleFactor 0.9996
+#define kRMUTMFalseEasting 500000.0
+#define kRMUTMFalseNorthing 10000000.0
+
+// Pixels between the points of the UTM lines, and at most points per line
+#define kRMCoordinateGridSampleSpacing 16.0
+#define kRMCoordinateGridMaximumSamples 256
+
+// Points along each side of a zone and band in a tile, to find its eastings and northings
+#define kRMCoordinateGridExtentSamples 8
+
+static const char kRMCoordinateGridBands[] = "CDEFGHJKLMNPQRSTUVWX";
+
+#define kRMCoordinateGridBandCount 20
+#define kRMCoordinateGridBandV 17
+#define kRMCoordinateGridBandX 19
+#define kRMCoordinateGridFirstNorthernBand 10
+
+typedef struct {
+    double spacing;
+    int64_t northIndex; // the latitude of the first parallel, in spacings
+    size_t count;
+    double *positions; // from the north, in zoom 0 tiles
+    unsigned long lastUse;
+} RMCoordinateGridParallels;
+
+struct RMCoordinateGrid {
+    int tileSideLength;
+
+    RMCoordinateGridParallels parallels[kRMCoordinateGridParallelTables];
+    unsigned long useCount;
+
+    // The series of Krüger for UTM, to the third power of the third flattening
+    double meridianRadius, eccentricityTerm;
+    double alpha[3], beta[3], delta[3];
+
+    // The coverage of every row by parallels and of every column by meridians, and the
+    // columns covered
+    float *rowCoverage, *columnCoverage;
+    int *coveredColumns;
+    double lineWidth;
+
+    RMRasterizer *rasterizer;
+    RMPathClipper *clipper;
+};
+
+typedef struct {
+    double west, east, south, north;
+} RMCoordinateGridBounds;
+
+#pragma mark - Mercator
+
+// Positions in zoom 0 tiles, from the west and the north
+static double RMCoordinateGridMercatorX(double longitude)
+{
+    return (longitude + 180.0) / 360.0;
+}
+
+static double RMCoordinateGridMercatorY(double latitude)
+{
+    return 0.5 - asinh(tan(latitude * M_PI / 180.0)) / (2.0 * M_PI);
+}
+
+static double RMCoordinateGridLongitude(double mercatorX)
+{
+    return mercatorX * 360.0 - 180.0;
+}
+
+static double RMCoordinateGridLatitude(double mercatorY)
+{
+    return atan(sinh(M_PI * (1.0 - 2.0 * mercatorY))) * 180.0 / M_PI;
+}
+
+double RMCoordinateGridLongitudeToPixel(const RMCoordinateGrid *grid, uint32_t x, int zoom, double longitude)
+{
+    return RMCoordinateGridMercatorX(longitude) * ldexp(grid->tileSideLength, zoom) - (double)x * grid->tileSideLength;
+}
+
+double RMCoordinateGridLatitudeToPixel(const RMCoordinateGrid *grid, uint32_t y, int zoom, double latitude)
+{
+    return RMCoordinateGridMercatorY(latitude) * ldexp(grid->tileSideLength, zoom) - (double)y * grid->tileSideLength;
+}
+
+double RMCoordinateGridPixelToLongitude(const RMCoordinateGrid *grid, uint32_t x, int zoom, double pixels)
+{
+    return RMCoordinateGridLongitude(((double)x * grid->tileSideLength + pixels) / ldexp(grid->tileSideLength, zoom));
+}
+
+double RMCoordinateGridPixelToLatitude(const RMCoordinateGrid *grid, uint32_t y, int zoom, double pixels)
+{
+    return RMCoordinateGridLatitude(((double)y * grid->tileSideLength + pixels) / ldexp(grid->tileSideLength, zoom));
+}
+
+// The longitudes and latitudes of the tile and the pixels around it, within those of
+// the zoom 0 tile
+static RMCoordinateGridBounds RMCoordinateGridTileBounds(const RMCoordinateGrid *grid, uint32_t x, uint32_t y, int zoom, double padding)
+{
+    double worldSideLength = ldexp(grid->tileSideLength, zoom);
+    double west = ((double)x * grid->tileSideLength - padding) / worldSideLength;
+    double east = ((double)(x + 1) * grid->tileSideLength + padding) / worldSideLength;
+    double north = ((double)y * grid->tileSideLength - padding) / worldSideLength;
+    double south = ((double)(y + 1) * grid->tileSideLength + padding) / worldSideLength;
+
+    RMCoordinateGridBounds bounds = {
+        RMCoordinateGridLongitude(fmax(west, 0.0)),
+        RMCoordinateGridLongitude(fmin(east, 1.0)),
+        RMCoordinateGridLatitude(fmin(south, 1.0)),
+        RMCoordinateGridLatitude(fmax(north, 0.0)),
+    };
+
+    return bounds;
+}
+
+#pragma mark - Graticule
+
+static void RMCoordinateGridFreeParallels(RMCoordinateGridParallels *parallels)
+{
+    free(parallels->positions);
+    memset(parallels, 0, sizeof(RMCoordinateGridParallels));
+}
+
+// The parallels of spacing, worked out for the whole planet the first time, in place
+// of those used longest ago
+static RMCoordinateGridParallels *RMCoordinateGridParallelsForSpacing(RMCoordinateGrid *grid, double spacing)
+{
+    RMCoordinateGridParallels *parallels = &grid->parallels[0];
+
+    if ( ! (spacing > 0.0))
+        return NULL;
+
+    for (int i = 0; i < kRMCoordinateGridParallelTables; i++)
+    {
+        if (grid->parallels[i].positions && grid->parallels[i].spacing == spacing)
+        {
+            grid->parallels[i].lastUse = ++grid->useCount;
+            return &grid->parallels[i];
+        }
+
+        if (grid->parallels[i].lastUse < parallels->lastUse)
+            parallels = &grid->parallels[i];
+    }
+
+    double northIndex = floor(kRMCoordinateGridMaximumLatitude / spacing);
+
+    if (northIndex * 2.0 + 1.0 > kRMCoordinateGridMaximumParallels)
+        return NULL;
+
+    size_t count = (size_t)northIndex * 2 + 1;
+    double *positions = malloc(count * sizeof(double));
+
+    if ( ! positions)
+        return NULL;
+
+    RMCoordinateGridFreeParallels(parallels);
+
+    for (size_t i = 0; i < count; i++)
+        positions[i] = RMCoordinateGridMercatorY((northIndex - (double)i) * spacing);
+
+    parallels->spacing = spacing;
+    parallels->northIndex = (int64_t)northIndex;
+    parallels->count = count;
+    parallels->positions = positions;
+    parallels->lastUse = ++grid->useCount;
+
+    return parallels;
+}
+
+typedef bool (*RMCoordinateGridLineVisitor)(const RMCoordinateGridLine *line, void *context);
+
+// Call visitor with the parallels then the meridians within padding pixels of the tile,
+// until it returns false
+static bool RMCoordinateGridEnumerateLines(RMCoordinateGrid *grid, double spacing, uint32_t x, uint32_t y, int zoom, double padding, RMCoordinateGridLineVisitor visitor, void *context)
+{
+    RMCoordinateGridParallels *parallels = RMCoordinateGridParallelsForSpacing(grid, spacing);
+
+    if ( ! parallels)
+        return false;
+
+    double worldSideLength = ldexp(grid->tileSideLength, zoom);
+    double top = ((double)y * grid->tileSideLength - padding) / worldSideLength;
+    double bottom = ((double)(y + 1) * grid->tileSideLength + padding) / worldSideLength;
+    size_t low = 0, high = parallels->count;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (parallels->positions[middle] < top)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    RMCoordinateGridLine line;
+
+    line.type = RMCoordinateGridLineParallel;
+
+    for (size_t i = low; i < parallels->count && parallels->positions[i] <= bottom; i++)
+    {
+        line.degrees = (double)(parallels->northIndex - (int64_t)i) * spacing;
+        line.position = parallels->positions[i] * worldSideLength - (double)y * grid->tileSideLength;
+
+        if ( ! visitor(&line, context))
+            return true;
+    }
+
+    double left = ((double)x * grid->tileSideLength - padding) / worldSideLength;
+    double right = ((double)(x + 1) * grid->tileSideLength + padding) / worldSideLength;
+    double first = ceil(RMCoordinateGridLongitude(fmax(left, 0.0)) / spacing);
+    double last = floor(RMCoordinateGridLongitude(fmin(right, 1.0)) / spacing);
+
+    line.type = RMCoordinateGridLineMeridian;
+
+    for (double i = first; i <= last; i++)
+    {
+        line.degrees = i * spacing;
+        line.position = RMCoordinateGridMercatorX(line.degrees) * worldSideLength - (double)x * grid->tileSideLength;
+
+        if ( ! visitor(&line, context))
+            return true;
+    }
+
+    return true;
+}
+
+typedef struct {
+    RMCoordinateGridLine *lines;
+    size_t count, capacity;
+} RMCoordinateGridLineList;
+
+static bool RMCoordinateGridCollectLine(const RMCoordinateGridLine *line, void *context)
+{
+    RMCoordinateGridLineList *list = context;
+
+    if (list->count == list->capacity)
+        return false;
+
+    list->lines[list->count++] = *line;
+
+    return true;
+}
+
+size_t RMCoordinateGridTileLines(RMCoordinateGrid *grid, double spacing, uint32_t x, uint32_t y, int zoom, double padding, RMCoordinateGridLine *lines, size_t capacity)
+{
+    RMCoordinateGridLineList list = { lines, 0, capacity };
+
+    RMCoordinateGridEnumerateLines(grid, spacing, x, y, zoom, padding, RMCoordinateGridCollectLine, &list);
+
+    return list.count;
+}
+
+// Add the coverage of the line to its rows or columns
+static bool RMCoordinateGridAddLine(const RMCoordinateGridLine *line, void *context)
+{
+    RMCoordinateGrid *grid = context;
+    float *coverage = (line->type == RMCoordinateGridLineParallel ? grid->rowCoverage : grid->columnCoverage);
+    double from = line->position - grid->lineWidth / 2.0, to = line->position + grid->lineWidth / 2.0;
+    int first = (int)fmax(floor(from), 0.0), last = (int)fmin(ceil(to), grid->tileSideLength) - 1;
+
+    for (int i = first; i <= last; i++)
+        coverage[i] = fminf(coverage[i] + (float)(fmin(to, i + 1.0) - fmax(from, i)), 1.0f);
+
+    return true;
+}
+
+// Meridians and parallels are straight across the tile, so the coverage of a pixel
+// is that of its row and column together, and only the rows and the columns covered
+// are blended
+static bool RMCoordinateGridDrawGraticule(RMCoordinateGrid *grid, double spacing, uint32_t x, uint32_t y, int zoom, RMRasterizerColor color, double lineWidth, uint8_t *pixels, size_t bytesPerRow)
+{
+    int length = grid->tileSideLength, coveredColumnCount = 0;
+    float premultiplied[4] = { color.red * color.alpha, color.green * color.alpha, color.blue * color.alpha, color.alpha };
+    bool drawn = false;
+
+    memset(grid->rowCoverage, 0, length * sizeof(float));
+    memset(grid->columnCoverage, 0, length * sizeof(float));
+    grid->lineWidth = lineWidth;
+
+    if ( ! RMCoordinateGridEnumerateLines(grid, spacing, x, y, zoom, lineWidth / 2.0, RMCoordinateGridAddLine, grid))
+        return false;
+
+    for (int column = 0; column < length; column++)
+    {
+        if (grid->columnCoverage[column] > 0.0f)
+            grid->coveredColumns[coveredColumnCount++] = column;
+    }
+
+    for (int row = 0; row < length; row++)
+    {
+        float rowCoverage = grid->rowCoverage[row];
+        uint8_t *rowPixels = pixels + row * bytesPerRow;
+        int count = (rowCoverage > 0.0f ? length : coveredColumnCount);
+
+        for (int i = 0; i < count; i++)
+        {
+            int column = (rowCoverage > 0.0f ? i : grid->coveredColumns[i]);
+            float coverage = rowCoverage + grid->columnCoverage[column] * (1.0f - rowCoverage);
+            float remaining = 1.0f - premultiplied[3] * coverage;
+            uint8_t *pixel = rowPixels + 4 * column;
+
+            for (int c = 0; c < 4; c++)
+                pixel[c] = (uint8_t)(premultiplied[c] * 255.0f * coverage + pixel[c] * remaining + 0.5f);
+
+            drawn = true;
+        }
+    }
+
+    return drawn;
+}
+
+#pragma mark - UTM
+
+static void RMCoordinateGridBandRange(int band, double *south, double *north)
+{
+    *south = -80.0 + 8.0 * band;
+    *north = (band == kRMCoordinateGridBandX ? 84.0 : *south + 8.0);
+}
+
+// The longitudes of a zone in a band, wider in southwestern Norway and Svalbard. Returns
+// false for the zones left out of Svalbard.
+static bool RMCoordinateGridZoneRange(int zone, int band, double *west, double *east)
+{
+    *west = (zone - 1) * 6.0 - 180.0;
+    *east = *west + 6.0;
+
+    if (band == kRMCoordinateGridBandV)
+    {
+        if (zone == 31)
+            *east = 3.0;
+        else if (zone == 32)
+            *west = 3.0;
+    }
+    else if (band == kRMCoordinateGridBandX && zone >= 31 && zone <= 37)
+    {
+        if (zone % 2 == 0)
+            return false;
+
+        *west = (zone == 31 ? 0.0 : (zone - 32) * 12.0 - 3.0);
+        *east = (zone == 37 ? 42.0 : (zone - 31) * 12.0 + 9.0);
+    }
+
+    return true;
+}
+
+typedef bool (*RMCoordinateGridZoneVisitor)(int zone, int band, RMCoordinateGridBounds cell, void *context);
+
+// Call visitor with the zones and bands overlapping bounds, until it returns false
+static void RMCoordinateGridEnumerateZones(RMCoordinateGridBounds bounds, RMCoordinateGridZoneVisitor visitor, void *context)
+{
+    int firstZone = (int)floor((bounds.west + 180.0) / 6.0), lastZone = (int)floor((bounds.east + 180.0) / 6.0) + 2;
+
+    if (firstZone < 1)
+        firstZone = 1;
+    if (lastZone > 60)
+        lastZone = 60;
+
+    for (int band = 0; band < kRMCoordinateGridBandCount; band++)
+    {
+        RMCoordinateGridBounds cell;
+
+        RMCoordinateGridBandRange(band, &cell.south, &cell.north);
+
+        if (cell.south >= bounds.north || cell.north <= bounds.south)
+            continue;
+
+        for (int zone = firstZone; zone <= lastZone; zone++)
+        {
+            if ( ! RMCoordinateGridZoneRange(zone, band, &cell.west, &cell.east))
+                continue;
+
+            if (cell.west >= bounds.east || cell.east <= bounds.west)
+                continue;
+
+            if ( ! visitor(zone, band, cell, context))
+                return;
+        }
+    }
+}
+
+static void RMCoordinateGridPrepareUTM(RMCoordinateGrid *grid)
+{
+    double n = kRMCoordinateGridFlattening / (2.0 - kRMCoordinateGridFlattening);
+    double n2 = n * n, n3 = n2 * n;
+
+    grid->meridianRadius = kRMUTMScaleFactor * kRMCoordinateGridSemiMajorAxis / (1.0 + n) * (1.0 + n2 / 4.0 + n2 * n2 / 64.0);
+    grid->eccentricityTerm = 2.0 * sqrt(n) / (1.0 + n);
+
+    grid->alpha[0] = n / 2.0 - 2.0 * n2 / 3.0 + 5.0 * n3 / 16.0;
+    grid->alpha[1] = 13.0 * n2 / 48.0 - 3.0 * n3 / 5.0;
+    grid->alpha[2] = 61.0 * n3 / 240.0;
+
+    grid->beta[0] = n / 2.0 - 2.0 * n2 / 3.0 + 37.0 * n3 / 96.0;
+    grid->beta[1] = n2 / 48.0 + n3 / 15.0;
+    grid->beta[2] = 17.0 * n3 / 480.0;
+
+    grid->delta[0] = 2.0 * n - 2.0 * n2 / 3.0 - 2.0 * n3;
+    grid->delta[1] = 7.0 * n2 / 3.0 - 8.0 * n3 / 5.0;
+    grid->delta[2] = 56.0 * n3 / 15.0;
+}
+
+static double RMCoordinateGridCentralMeridian(int zone)
+{
+    return (zone - 1) * 6.0 - 177.0;
+}
+
+// Easting and northing of a latitude and longitude in a zone, without false northing
+static void RMCoordinateGridToUTM(const RMCoordinateGrid *grid, int zone, double latitude, double longitude, double *easting, double *northing)
+{
+    double phi = latitude * M_PI / 180.0;
+    double lambda = (longitude - RMCoordinateGridCentralMeridian(zone)) * M_PI / 180.0;
+    double sinPhi = sin(phi);
+    double t = sinh(atanh(sinPhi) - grid->eccentricityTerm * atanh(grid->eccentricityTerm * sinPhi));
+    double xiPrime = atan2(t, cos(lambda));
+    double etaPrime = atanh(sin(lambda) / sqrt(1.0 + t * t));
+    double xi = xiPrime, eta = etaPrime;
+
+    for (int j = 1; j <= 3; j++)
+    {
+        xi += grid->alpha[j - 1] * sin(2.0 * j * xiPrime) * cosh(2.0 * j * etaPrime);
+        eta += grid->alpha[j - 1] * cos(2.0 * j * xiPrime) * sinh(2.0 * j * etaPrime);
+    }
+
+    *easting = kRMUTMFalseEasting + grid->meridianRadius * eta;
+    *northing = grid->meridianRadius * xi;
+}
+
+static void RMCoordinateGridFromUTM(const RMCoordinateGrid *grid, int zone, double easting, double northing, double *latitude, double *longitude)
+{
+    double xi = northing / grid->meridianRadius;
+    double eta = (easting - kRMUTMFalseEasting) / grid->meridianRadius;
+    double xiPrime = xi, etaPrime = eta;
+
+    for (int j = 1; j <= 3; j++)
+    {
+        xiPrime -= grid->beta[j - 1] * sin(2.0 * j * xi) * cosh(2.0 * j * eta);
+        etaPrime -= grid->beta[j - 1] * cos(2.0 * j * xi) * sinh(2.0 * j * eta);
+    }
+
+    double chi = asin(sin(xiPrime) / cosh(etaPrime));
+    double phi = chi;
+
+    for (int j = 1; j <= 3; j++)
+        phi += grid->delta[j - 1] * sin(2.0 * j * chi);
+
+    *latitude = phi * 180.0 / M_PI;
+    *longitude = RMCoordinateGridCentralMeridian(zone) + atan2(sinh(etaPrime), cos(xiPrime)) * 180.0 / M_PI;
+}
+
+typedef struct {
+    RMCoordinateGrid *grid;
+    uint32_t x, y;
+    int zoom;
+    double spacing;
+    RMProjectedRect tileRect; // in pixels, with the width of the lines around the tile
+} RMCoordinateGridUTMDrawing;
+
+static RMProjectedPoint RMCoordinateGridPixel(const RMCoordinateGridUTMDrawing *drawing, double latitude, double longitude)
+{
+    return RMProjectedPointMake(RMCoordinateGridLongitudeToPixel(drawing->grid, drawing->x, drawing->zoom, longitude),
+                                RMCoordinateGridLatitudeToPixel(drawing->grid, drawing->y, drawing->zoom, latitude));
+}
+
+static void RMCoordinateGridAddSegment(const RMCoordinateGridUTMDrawing *drawing, RMProjectedPoint a, RMProjectedPoint b)
+{
+    if ( ! RMPathClipperClipSegment(drawing->tileRect, &a, &b))
+        return;
+
+    RMRasterizerAddElement(RMPathElementMoveToPoint, a, drawing->grid->rasterizer);
+    RMRasterizerAddElement(RMPathElementAddLineToPoint, b, drawing->grid->rasterizer);
+}
+
+// The line of constant easting, or northing, from one end of the other range to the
+// other, through the clipper
+static void RMCoordinateGridAddUTMLine(const RMCoordinateGridUTMDrawing *drawing, int zone, bool constantEasting, double value, double from, double to, double stepMeters, double falseNorthing)
+{
+    RMCoordinateGrid *grid = drawing->grid;
+    int steps = (int)ceil((to - from) / stepMeters);
+
+    if (steps < 1)
+        steps = 1;
+    if (steps > kRMCoordinateGridMaximumSamples)
+        steps = kRMCoordinateGridMaximumSamples;
+
+    for (int i = 0; i <= steps; i++)
+    {
+        double along = from + (to - from) * i / steps;
+        double latitude, longitude;
+
+        if (constantEasting)
+            RMCoordinateGridFromUTM(grid, zone, value, along - falseNorthing, &latitude, &longitude);
+        else
+            RMCoordinateGridFromUTM(grid, zone, along, value - falseNorthing, &latitude, &longitude);
+
+        RMPathClipperAddElement((i == 0 ? RMPathElementMoveToPoint : RMPathElementAddLineToPoint),
+                                RMCoordinateGridPixel(drawing, latitude, longitude),
+                                grid->clipper);
+    }
+}
+
+static bool RMCoordinateGridAddZone(int zone, int band, RMCoordinateGridBounds cell, void *context)
+{
+    RMCoordinateGridUTMDrawing *drawing = context;
+    RMCoordinateGrid *grid = drawing->grid;
+
+    RMProjectedPoint northWest = RMCoordinateGridPixel(drawing, cell.north, cell.west);
+    RMProjectedPoint southEast = RMCoordinateGridPixel(drawing, cell.south, cell.east);
+
+    // The sides of every zone and band, those they share drawn once by the nonzero rule
+    RMCoordinateGridAddSegment(drawing, northWest, RMProjectedPointMake(southEast.x, northWest.y));
+    RMCoordinateGridAddSegment(drawing, RMProjectedPointMake(southEast.x, northWest.y), southEast);
+    RMCoordinateGridAddSegment(drawing, southEast, RMProjectedPointMake(northWest.x, southEast.y));
+    RMCoordinateGridAddSegment(drawing, RMProjectedPointMake(northWest.x, southEast.y), northWest);
+
+    if ( ! (drawing->spacing > 0.0))
+        return true;
+
+    // The part of the zone and band in the tile, in pixels and in degrees
+    double left = fmax(northWest.x, drawing->tileRect.origin.x);
+    double right = fmin(southEast.x, drawing->tileRect.origin.x + drawing->tileRect.size.width);
+    double top = fmax(northWest.y, drawing->tileRect.origin.y);
+    double bottom = fmin(southEast.y, drawing->tileRect.origin.y + drawing->tileRect.size.height);
+
+    if (left >= right || top >= bottom)
+        return true;
+
+    double worldSideLength = ldexp(grid->tileSideLength, drawing->zoom);
+    double originX = (double)drawing->x * grid->tileSideLength, originY = (double)drawing->y * grid->tileSideLength;
+    double west = RMCoordinateGridLongitude((originX + left) / worldSideLength);
+    double east = RMCoordinateGridLongitude((originX + right) / worldSideLength);
+    double north = RMCoordinateGridLatitude((originY + top) / worldSideLength);
+    double south = RMCoordinateGridLatitude((originY + bottom) / worldSideLength);
+
+    // Eastings and northings are at their extremes on the sides, on the equator or on
+    // the central meridian
+    double centralMeridian = RMCoordinateGridCentralMeridian(zone);
+    double minimumEasting = INFINITY, maximumEasting = -INFINITY;
+    double minimumNorthing = INFINITY, maximumNorthing = -INFINITY;
+
+    for (int i = 0; i <= kRMCoordinateGridExtentSamples + 1; i++)
+    {
+        double fraction = (double)i / kRMCoordinateGridExtentSamples;
+        double longitude = west + (east - west) * fraction, latitude = south + (north - south) * fraction;
+
+        if (i > kRMCoordinateGridExtentSamples)
+        {
+            longitude = fmin(fmax(centralMeridian, west), east);
+            latitude = fmin(fmax(0.0, south), north);
+        }
+
+        double points[4][2] = { { south, longitude }, { north, longitude }, { latitude, west }, { latitude, east } };
+
+        for (int j = 0; j < 4; j++)
+        {
+            double easting, northing;
+
+            RMCoordinateGridToUTM(grid, zone, points[j][0], points[j][1], &easting, &northing);
+
+            minimumEasting = fmin(minimumEasting, easting);
+            maximumEasting = fmax(maximumEasting, easting);
+            minimumNorthing = fmin(minimumNorthing, northing);
+            maximumNorthing = fmax(maximumNorthing, northing);
+        }
+    }
+
+    // Lines closer than a pixel are left out
+    double spacing = drawing->spacing;
+
+    if ((maximumEasting - minimumEasting) / spacing > (right - left) || (maximumNorthing - minimumNorthing) / spacing > (bottom - top))
+        return true;
+
+    double falseNorthing = (band < kRMCoordinateGridFirstNorthernBand ? kRMUTMFalseNorthing : 0.0);
+    double maximumAbsoluteLatitude = fmax(fabs(north), fabs(south));
+    double stepMeters = kRMCoordinateGridSampleSpacing * 2.0 * M_PI * kRMCoordinateGridSphereRadius * cos(maximumAbsoluteLatitude * M_PI / 180.0) / worldSideLength;
+    RMProjectedRect clipRect = RMProjectedRectMake(left, top, right - left, bottom - top);
+
+    minimumNorthing += falseNorthing;
+    maximumNorthing += falseNorthing;
+
+    RMPathClipperBegin(grid->clipper, clipRect, RMPathClipperModeStroke, RMRasterizerAddElement, grid->rasterizer);
+
+    for (double easting = ceil(minimumEasting / spacing) * spacing; easting <= maximumEasting; easting += spacing)
+        RMCoordinateGridAddUTMLine(drawing, zone, true, easting, minimumNorthing, maximumNorthing, stepMeters, falseNorthing);
+
+    for (double northing = ceil(minimumNorthing / spacing) * spacing; northing <= maximumNorthing; northing += spacing)
+        RMCoordinateGridAddUTMLine(drawing, zone, false, northing, minimumEasting, maximumEasting, stepMeters, falseNorthing);
+
+    RMPathClipperEnd(grid->clipper);
+
+    return true;
+}
+
+typedef struct {
+    const RMCoordinateGrid *grid;
+    uint32_t x, y;
+    int zoom;
+    double padding;
+    RMCoordinateGridZone *zones;
+    size_t count, capacity;
+} RMCoordinateGridZoneList;
+
+static bool RMCoordinateGridCollectZone(int zone, int band, RMCoordinateGridBounds cell, void *context)
+{
+    RMCoordinateGridZoneList *list = context;
+    double length = list->grid->tileSideLength;
+    double x = RMCoordinateGridLongitudeToPixel(list->grid, list->x, list->zoom, (cell.west + cell.east) / 2.0);
+    double y = RMCoordinateGridLatitudeToPixel(list->grid, list->y, list->zoom, (cell.south + cell.north) / 2.0);
+
+    if (x < -list->padding || x > length + list->padding || y < -list->padding || y > length + list->padding)
+        return true;
+
+    if (list->count == list->capacity)
+        return false;
+
+    RMCoordinateGridZone *item = &list->zones[list->count++];
+
+    item->zone = zone;
+    item->band = kRMCoordinateGridBands[band];
+    item->x = x;
+    item->y = y;
+
+    return true;
+}
+
+size_t RMCoordinateGridTileZones(const RMCoordinateGrid *grid, uint32_t x, uint32_t y, int zoom, double padding, RMCoordinateGridZone *zones, size_t capacity)
+{
+    RMCoordinateGridZoneList list = { grid, x, y, zoom, padding, zones, 0, capacity };
+
+    RMCoordinateGridEnumerateZones(RMCoordinateGridTileBounds(grid, x, y, zoom, padding), RMCoordinateGridCollectZone, &list);
+
+    return list.count;
+}
+
+#pragma mark -
+
+RMCoordinateGrid *RMCoordinateGridCreate(int tileSideLength)
+{
+    if (tileSideLength <= 0)
+        return NULL;
+
+    RMCoordinateGrid *grid = calloc(1, sizeof(RMCoordinateGrid));
+
+    if ( ! grid)
+        return NULL;
+
+    grid->tileSideLength = tileSideLength;
+    grid->rowCoverage = malloc(tileSideLength * sizeof(float));
+    grid->columnCoverage = malloc(tileSideLength * sizeof(float));
+    grid->coveredColumns = malloc(tileSideLength * sizeof(int));
+    grid->rasterizer = RMRasterizerCreate(tileSideLength, tileSideLength);
+    grid->clipper = RMPathClipperCreate();
+
+    if ( ! grid->rowCoverage || ! grid->columnCoverage || ! grid->coveredColumns || ! grid->rasterizer || ! grid->clipper)
+    {
+        RMCoordinateGridDestroy(grid);
+        return NULL;
+    }
+
+    RMCoordinateGridPrepareUTM(grid);
+
+    return grid;
+}
+
+void RMCoordinateGridDestroy(RMCoordinateGrid *grid)
+{
+    if ( ! grid)
+        return;
+
+    for (int i = 0; i < kRMCoordinateGridParallelTables; i++)
+        RMCoordinateGridFreeParallels(&grid->parallels[i]);
+
+    free(grid->rowCoverage);
+    free(grid->columnCoverage);
+    free(grid->coveredColumns);
+    RMRasterizerDestroy(grid->rasterizer);
+    RMPathClipperDestroy(grid->clipper);
+    free(grid);
+}
+
+bool RMCoordinateGridDrawTile(RMCoordinateGrid *grid, RMCoordinateGridType type, double spacing, uint32_t x, uint32_t y, int zoom, RMRasterizerColor color, double lineWidth, uint8_t *pixels, size_t bytesPerRow)
+{
+    if (type != RMCoordinateGridUTM)
+        return RMCoordinateGridDrawGraticule(grid, spacing, x, y, zoom, color, lineWidth, pixels, bytesPerRow);
+
+    RMRasterizerStrokeStyle style = { lineWidth, RMRasterizerLineCapButt, RMRasterizerLineJoinBevel, 10.0 };
+    double padding = lineWidth / 2.0 + 1.0;
+
+    RMCoordinateGridUTMDrawing drawing = {
+        grid, x, y, zoom, spacing,
+        RMProjectedRectMake(-padding, -padding, grid->tileSideLength + 2.0 * padding, grid->tileSideLength + 2.0 * padding)
+    };
+
+    // All the lines are one path, so that they are blended once where they cross
+    RMRasterizerBeginStroke(grid->rasterizer, &style);
+    RMCoordinateGridEnumerateZones(RMCoordinateGridTileBounds(grid, x, y, zoom, padding), RMCoordinateGridAddZone, &drawing);
+
+    return RMRasterizerDraw(grid->rasterizer, RMRasterizerFillRuleNonZero, color, pixels, bytesPerRow);
+}
@@ -0,0 +1,118 @@
+//
+//  RMCoordinateGrid.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#ifndef _RMCOORDINATEGRID_H_
+#define _RMCOORDINATEGRID_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMRasterizer.h"
+
+// The lines of a coordinate grid over spherical mercator tiles, found from the tile
+// numbers alone and drawn straight into the tile, so that a tile costs less to draw
+// again than to keep in a cache.
+//
+// Meridians are evenly spaced in mercator, so their pixels are found with a multiply.
+// The mercator positions of the parallels of a spacing are worked out in one pass the
+// first time that spacing is used, for the whole planet and every zoom level at once,
+// and a tile finds its parallels by binary search in them. As both cross the tile
+// straight, they are drawn from the coverage of each row and column, blending only
+// the rows and columns they cover.
+//
+// The UTM grid is drawn with RMRasterizer as its zones and latitude bands, with the
+// exceptions around Norway and Svalbard, and the lines of easting and northing inside
+// every zone, which are curves in mercator: those are sampled every few pixels with
+// the series of Krüger for the transverse mercator on the WGS 84 ellipsoid, and
+// clipped to their zone and band.
+//
+// Tiles are numbered as RMTile, y from the north, and positions are in pixels from the
+// top left corner of the tile. It does no locking of its own.
+
+typedef struct RMCoordinateGrid RMCoordinateGrid;
+
+typedef enum {
+    // Meridians and parallels every spacing degrees
+    RMCoordinateGridGraticule,
+    // UTM zones and bands, and lines every spacing meters of easting and northing
+    // inside them, or none if spacing is 0
+    RMCoordinateGridUTM,
+} RMCoordinateGridType;
+
+typedef enum {
+    RMCoordinateGridLineParallel,
+    RMCoordinateGridLineMeridian,
+} RMCoordinateGridLineType;
+
+typedef struct {
+    RMCoordinateGridLineType type;
+    // The latitude of a parallel, or the longitude of a meridian
+    double degrees;
+    // Pixels from the top of the tile for a parallel, from its left for a meridian
+    double position;
+} RMCoordinateGridLine;
+
+typedef struct {
+    int zone; // 1 to 60
+    char band; // 'C' to 'X'
+    // The middle of the zone and band, in pixels of the tile
+    double x, y;
+} RMCoordinateGridZone;
+
+// Returns NULL if memory could not be allocated.
+RMCoordinateGrid *RMCoordinateGridCreate(int tileSideLength);
+
+void RMCoordinateGridDestroy(RMCoordinateGrid *grid);
+
+// The pixels of a longitude from the left of tile x, and of a latitude from the top of
+// tile y, at zoom.
+double RMCoordinateGridLongitudeToPixel(const RMCoordinateGrid *grid, uint32_t x, int zoom, double longitude);
+double RMCoordinateGridLatitudeToPixel(const RMCoordinateGrid *grid, uint32_t y, int zoom, double latitude);
+
+// The longitude of pixels from the left of tile x, and the latitude of pixels from the
+// top of tile y, at zoom.
+double RMCoordinateGridPixelToLongitude(const RMCoordinateGrid *grid, uint32_t x, int zoom, double pixels);
+double RMCoordinateGridPixelToLatitude(const RMCoordinateGrid *grid, uint32_t y, int zoom, double pixels);
+
+// Write into lines the parallels then the meridians every spacing degrees within
+// padding pixels of the tile, at most capacity of them. Returns the number written,
+// or 0 if the parallels of spacing could not be allocated.
+size_t RMCoordinateGridTileLines(RMCoordinateGrid *grid, double spacing, uint32_t x, uint32_t y, int zoom, double padding, RMCoordinateGridLine *lines, size_t capacity);
+
+// Write into zones the UTM zones and bands whose middle is within padding pixels of
+// the tile, at most capacity of them. Returns the number written.
+size_t RMCoordinateGridTileZones(const RMCoordinateGrid *grid, uint32_t x, uint32_t y, int zoom, double padding, RMCoordinateGridZone *zones, size_t capacity);
+
+// Blend the lines of the grid over pixels, tileSideLength rows of RGBA with the alpha
+// premultiplied as with kCGImageAlphaPremultipliedLast. Returns false if no line
+// crosses the tile, or if memory could not be allocated.
+bool RMCoordinateGridDrawTile(RMCoordinateGrid *grid, RMCoordinateGridType type, double spacing, uint32_t x, uint32_t y, int zoom, RMRasterizerColor color, double lineWidth, uint8_t *pixels, size_t bytesPerRow);
+
+#endif
@@ -35,7 +35,10 @@ typedef enum : short {
     GridModeUTM // 32T 5910
 } CoordinateGridMode;
 
-// UTM grid is missing for now
+// Tiles are drawn with RMCoordinateGrid every time they are shown, without going
+// through the tile cache. In GridModeUTM the zones and bands are drawn with the lines
+// of easting and northing inside them from zoom 6, and labelled with their grid zone
+// designators.
 
 @interface RMCoordinateGridSource : RMAbstractMercatorTileSource
 
@@ -28,10 +28,12 @@
 
 #import "RMCoordinateGridSource.h"
 
-#import "RMTileCache.h"
+#import "RMCoordinateGrid.h"
 
 #define kTileSidePadding 25.0 // px
 
+#define kMaximumLabelledLines 64
+
 static double coordinateGridSpacing[19] = {
     45.0, // 0
     45.0, // 1
@@ -76,7 +78,49 @@ static double coordinateGridSpacingDecimal[19] = {
     0.01, // 18
 };
 
+// Meters between the lines of easting and northing inside the UTM zones, none at the
+// lowest zoom levels
+static double utmGridSpacing[19] = {
+    0.0, // 0
+    0.0, // 1
+    0.0, // 2
+    0.0, // 3
+    0.0, // 4
+    0.0, // 5
+    100000.0, // 6
+    100000.0, // 7
+    100000.0, // 8
+    10000.0, // 9
+    10000.0, // 10
+    10000.0, // 11
+    10000.0, // 12
+    1000.0, // 13
+    1000.0, // 14
+    1000.0, // 15
+    1000.0, // 16
+    100.0, // 17
+    100.0, // 18
+};
+
+static RMRasterizerColor RMCoordinateGridSourceColor(UIColor *color)
+{
+    CGFloat red = 0.0, green = 0.0, blue = 0.0, alpha = 0.0;
+
+    // Pattern colors and those of other color spaces are left out
+    if ( ! [color getRed:&red green:&green blue:&blue alpha:&alpha])
+        alpha = 0.0;
+
+    RMRasterizerColor rasterizerColor = { red, green, blue, alpha };
+
+    return rasterizerColor;
+}
+
+#pragma mark -
+
 @implementation RMCoordinateGridSource
+{
+    RMCoordinateGrid *_grid;
+}
 
 @synthesize gridColor = _gridColor;
 @synthesize gridLineWidth = _gridLineWidth;
@@ -104,210 +148,210 @@ static double coordinateGridSpacingDecimal[19] = {
     self.minorLabelFont = [UIFont boldSystemFontOfSize:14.0];
     self.majorLabelFont = [UIFont boldSystemFontOfSize:11.0];
 
-    return self;
-}
+    _grid = RMCoordinateGridCreate(self.tileSideLength);
 
-- (UIImage *)imageForTile:(RMTile)tile inCache:(RMTileCache *)tileCache
-{
-    if (tile.zoom < 0 || tile.zoom > 18)
+    if ( ! _grid)
+    {
+        [self release];
         return nil;
+    }
 
-    UIImage *image = nil;
-
-	tile = [[self mercatorToTileProjection] normaliseTile:tile];
-    image = [tileCache cachedImage:tile withCacheKey:[self uniqueTilecacheKey]];
-
-    if (image)
-        return image;
-
-    // Implementation
-
-    RMProjectedRect planetBounds = self.projection.planetBounds;
-
-    double scale = (1<<tile.zoom);
-    double tileMetersPerPixel = planetBounds.size.width / (self.tileSideLength * scale);
-    double paddedTileSideLength = self.tileSideLength + (2.0 * kTileSidePadding);
-
-    CGPoint bottomLeft = CGPointMake((tile.x * self.tileSideLength) - kTileSidePadding,
-                                     ((scale - tile.y - 1) * self.tileSideLength) - kTileSidePadding);
+    return self;
+}
 
-    RMProjectedRect normalizedProjectedRect;
-    normalizedProjectedRect.origin.x = (bottomLeft.x * tileMetersPerPixel) - fabs(planetBounds.origin.x);
-    normalizedProjectedRect.origin.y = (bottomLeft.y * tileMetersPerPixel) - fabs(planetBounds.origin.y);
-    normalizedProjectedRect.size.width = paddedTileSideLength * tileMetersPerPixel;
-    normalizedProjectedRect.size.height = paddedTileSideLength * tileMetersPerPixel;
+- (void)dealloc
+{
+    RMCoordinateGridDestroy(_grid); _grid = NULL;
+    [_gridColor release]; _gridColor = nil;
+    [_minorLabelColor release]; _minorLabelColor = nil;
+    [_minorLabelFont release]; _minorLabelFont = nil;
+    [_majorLabelColor release]; _majorLabelColor = nil;
+    [_majorLabelFont release]; _majorLabelFont = nil;
+    [super dealloc];
+}
 
-    CLLocationCoordinate2D southWest = [self.projection projectedPointToCoordinate:
-                                        RMProjectedPointMake(normalizedProjectedRect.origin.x,
-                                                             normalizedProjectedRect.origin.y)];
-    CLLocationCoordinate2D northEast = [self.projection projectedPointToCoordinate:
-                                        RMProjectedPointMake(normalizedProjectedRect.origin.x + normalizedProjectedRect.size.width,
-                                                             normalizedProjectedRect.origin.y + normalizedProjectedRect.size.height)];
+#pragma mark -
 
-    double gridSpacing;
+- (void)getMajorLabel:(NSString **)majorLabel minorLabel:(NSString **)minorLabel forDegrees:(double)value
+{
+    double degrees = (value > 0.0 ? floor(value) : ceil(value));
+    double fraction = (value > 0.0 ? value - floor(value) : ceil(value) - value);
 
     switch (self.gridMode)
     {
         case GridModeGeographic: {
-            gridSpacing = coordinateGridSpacing[tile.zoom];
+            *majorLabel = [NSString stringWithFormat:@"%.0f˚", degrees];
+            *minorLabel = [NSString stringWithFormat:@"%02.0f'", fraction * 60.0];
             break;
         }
         case GridModeGeographicDecimal:
         case GridModeUTM:
         default: {
-            gridSpacing = coordinateGridSpacingDecimal[tile.zoom];
-            break;
+            *majorLabel = [NSString stringWithFormat:@"%.0f", degrees];
+            *minorLabel = [NSString stringWithFormat:@"%02.0f", fraction * 100.0];
         }
     }
+}
 
-    double coordinatesLatitudeSpan = northEast.latitude - southWest.latitude,
-           coordinatesLongitudeSpan = northEast.longitude - southWest.longitude;
-    double bottom = floor(southWest.latitude / gridSpacing) * gridSpacing,
-           top = floor(northEast.latitude / gridSpacing) * gridSpacing;
-    double left = ceil(southWest.longitude / gridSpacing) * gridSpacing,
-           right = ceil(northEast.longitude / gridSpacing) * gridSpacing;
-
-    // Draw the tile
-
-	UIGraphicsBeginImageContext(CGSizeMake(paddedTileSideLength, paddedTileSideLength));
-	CGContextRef context = UIGraphicsGetCurrentContext();
+// The major label ends left of point, and the minor one starts right of it
+- (void)drawMajorLabel:(NSString *)majorLabel minorLabel:(NSString *)minorLabel atPoint:(CGPoint)point inContext:(CGContextRef)context
+{
+    CGSize majorLabelSize = [majorLabel sizeWithFont:self.majorLabelFont];
+    CGSize minorLabelSize = (minorLabel ? [minorLabel sizeWithFont:self.minorLabelFont] : CGSizeZero);
 
-    CGContextSetStrokeColorWithColor(context, self.gridColor.CGColor);
-    CGContextSetLineWidth(context, self.gridLineWidth);
+    CGFloat upperBorder = point.y - MAX((majorLabelSize.height / 2.0), (minorLabelSize.height / 2.0));
+    CGRect labelBackgroundRect = CGRectMake(point.x - majorLabelSize.width - 3.0, upperBorder - 1.0, majorLabelSize.width + minorLabelSize.width + 8.0, MAX(majorLabelSize.height, minorLabelSize.height) + 2.0);
 
-    // Grid lines
+    CGContextSetFillColorWithColor(context, [UIColor clearColor].CGColor);
+    UIRectFill(labelBackgroundRect);
 
-    for (double row = top; row >= bottom; row -= gridSpacing)
-    {
-        CGFloat yCoordinate = paddedTileSideLength - (((row - southWest.latitude) / coordinatesLatitudeSpan) * paddedTileSideLength);
-        CGContextMoveToPoint(context, 0.0, yCoordinate);
-        CGContextAddLineToPoint(context, paddedTileSideLength, yCoordinate);
-    }
+    CGContextSetFillColorWithColor(context, self.majorLabelColor.CGColor);
+    [majorLabel drawAtPoint:CGPointMake(point.x - majorLabelSize.width - 1.0, upperBorder) withFont:self.majorLabelFont];
 
-    for (double column = left; column <= right; column += gridSpacing)
+    if (minorLabel)
     {
-        CGFloat xCoordinate = ((column - southWest.longitude) / coordinatesLongitudeSpan) * paddedTileSideLength;
-        CGContextMoveToPoint(context, xCoordinate, 0.0);
-        CGContextAddLineToPoint(context, xCoordinate, paddedTileSideLength);
+        CGContextSetFillColorWithColor(context, self.minorLabelColor.CGColor);
+        [minorLabel drawAtPoint:CGPointMake(point.x + 1.0, upperBorder) withFont:self.minorLabelFont];
     }
+}
 
-    CGContextStrokePath(context);
+// Parallels are labelled halfway between meridians, and meridians halfway between
+// parallels, including those just off the tile whose labels reach into it
+- (void)drawLineLabelsForTile:(RMTile)tile gridSpacing:(double)gridSpacing inContext:(CGContextRef)context
+{
+    RMCoordinateGridLine lines[kMaximumLabelledLines];
+    size_t count = RMCoordinateGridTileLines(_grid, gridSpacing, tile.x, tile.y, tile.zoom, kTileSidePadding, lines, kMaximumLabelledLines);
 
-    // Labels
+    double west = RMCoordinateGridPixelToLongitude(_grid, tile.x, tile.zoom, -kTileSidePadding);
+    double east = RMCoordinateGridPixelToLongitude(_grid, tile.x, tile.zoom, self.tileSideLength + kTileSidePadding);
+    double north = RMCoordinateGridPixelToLatitude(_grid, tile.y, tile.zoom, -kTileSidePadding);
+    double south = RMCoordinateGridPixelToLatitude(_grid, tile.y, tile.zoom, self.tileSideLength + kTileSidePadding);
 
-    for (double row = top; row >= bottom; row -= gridSpacing)
+    for (size_t i = 0; i < count; i++)
     {
-        if (self.gridLabelInterval > 1 && fmod(round(row / gridSpacing), (double)self.gridLabelInterval) != 0)
+        RMCoordinateGridLine line = lines[i];
+
+        if (self.gridLabelInterval > 1 && fmod(round(line.degrees / gridSpacing), (double)self.gridLabelInterval) != 0)
             continue;
 
-        CGFloat yCoordinate = paddedTileSideLength - (((row - southWest.latitude) / coordinatesLatitudeSpan) * paddedTileSideLength);
+        NSString *majorLabel = nil, *minorLabel = nil;
 
-        for (double column = (left - (gridSpacing/2.0)); column <= (right + (gridSpacing / 2.0)); column += gridSpacing)
-        {
-            CGFloat xCoordinate = ((column - southWest.longitude) / coordinatesLongitudeSpan) * paddedTileSideLength;
+        [self getMajorLabel:&majorLabel minorLabel:&minorLabel forDegrees:line.degrees];
 
-            NSString *label1 = nil, *label2 = nil;
-            double degrees = (row > 0.0 ? floor(row) : ceil(row));
-            double fraction = (row > 0.0 ? row - floor(row) : ceil(row) - row);
+        if (line.type == RMCoordinateGridLineParallel)
+        {
+            for (double column = (floor(west / gridSpacing) + 0.5) * gridSpacing; column <= east; column += gridSpacing)
+            {
+                CGFloat xCoordinate = RMCoordinateGridLongitudeToPixel(_grid, tile.x, tile.zoom, column);
 
-            switch (self.gridMode)
+                [self drawMajorLabel:majorLabel minorLabel:minorLabel atPoint:CGPointMake(xCoordinate, line.position) inContext:context];
+            }
+        }
+        else
+        {
+            for (double row = (floor(south / gridSpacing) + 0.5) * gridSpacing; row <= north; row += gridSpacing)
             {
-                case GridModeGeographic: {
-                    label1 = [NSString stringWithFormat:@"%.0f˚", degrees];
-                    label2 = [NSString stringWithFormat:@"%02.0f'", fraction * 60.0];
-                    break;
-                }
-                case GridModeGeographicDecimal:
-                case GridModeUTM:
-                default: {
-                    label1 = [NSString stringWithFormat:@"%.0f", degrees];
-                    label2 = [NSString stringWithFormat:@"%02.0f", fraction * 100.0];
-                }
+                CGFloat yCoordinate = RMCoordinateGridLatitudeToPixel(_grid, tile.y, tile.zoom, row);
+
+                [self drawMajorLabel:majorLabel minorLabel:minorLabel atPoint:CGPointMake(line.position, yCoordinate) inContext:context];
             }
+        }
+    }
+}
 
-            // potential problem: some of these functions are not thread safe, so the app will crash
-            // if any other thread uses these functions outside of the @synchronized
-            @synchronized (self)
-            {
-                CGSize label1Size = [label1 sizeWithFont:self.majorLabelFont];
-                CGSize label2Size = [label2 sizeWithFont:self.minorLabelFont];
+- (void)drawZoneLabelsForTile:(RMTile)tile inContext:(CGContextRef)context
+{
+    RMCoordinateGridZone zones[kMaximumLabelledLines];
+    size_t count = RMCoordinateGridTileZones(_grid, tile.x, tile.y, tile.zoom, kTileSidePadding, zones, kMaximumLabelledLines);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        NSString *label = [NSString stringWithFormat:@"%d%c", zones[i].zone, zones[i].band];
+        CGSize labelSize = [label sizeWithFont:self.majorLabelFont];
+
+        [self drawMajorLabel:label minorLabel:nil atPoint:CGPointMake(zones[i].x + labelSize.width / 2.0, zones[i].y) inContext:context];
+    }
+}
+
+// Tiles are drawn again every time they are asked for instead of being cached, as the
+// lines are found from the tile numbers alone and drawn without Core Graphics
+- (UIImage *)imageForTile:(RMTile)tile inCache:(RMTileCache *)tileCache
+{
+    if (tile.zoom < 0 || tile.zoom > 18)
+        return nil;
 
-                CGFloat upperBorder = yCoordinate - MAX((label1Size.height / 2.0), (label2Size.height / 2.0));
-                CGRect labelBackgroundRect = CGRectMake(xCoordinate - label1Size.width - 3.0, upperBorder - 1.0, label1Size.width + label2Size.width + 8.0, MAX(label1Size.height, label2Size.height) + 2.0);
+    UIImage *image = nil;
 
-                CGContextSetFillColorWithColor(context, [UIColor clearColor].CGColor);
-                UIRectFill(labelBackgroundRect);
+    tile = [[self mercatorToTileProjection] normaliseTile:tile];
 
-                CGContextSetFillColorWithColor(context, self.majorLabelColor.CGColor);
-                [label1 drawAtPoint:CGPointMake(xCoordinate - label1Size.width - 1.0, upperBorder) withFont:self.majorLabelFont];
+    double gridSpacing;
+    RMCoordinateGridType gridType = RMCoordinateGridGraticule;
 
-                CGContextSetFillColorWithColor(context, self.minorLabelColor.CGColor);
-                [label2 drawAtPoint:CGPointMake(xCoordinate + 1.0, upperBorder) withFont:self.minorLabelFont];
-            }
+    switch (self.gridMode)
+    {
+        case GridModeGeographic: {
+            gridSpacing = coordinateGridSpacing[tile.zoom];
+            break;
+        }
+        case GridModeUTM: {
+            gridSpacing = utmGridSpacing[tile.zoom];
+            gridType = RMCoordinateGridUTM;
+            break;
+        }
+        case GridModeGeographicDecimal:
+        default: {
+            gridSpacing = coordinateGridSpacingDecimal[tile.zoom];
+            break;
         }
     }
 
-    for (double column=left; column<=right; column += gridSpacing)
-    {
-        if (self.gridLabelInterval > 1 && fmod(round(column / gridSpacing), (double)self.gridLabelInterval) != 0)
-            continue;
+    size_t sideLength = self.tileSideLength;
+    size_t bytesPerRow = sideLength * 4;
+    uint8_t *pixels = calloc(sideLength, bytesPerRow);
 
-        CGFloat xCoordinate = ((column - southWest.longitude) / coordinatesLongitudeSpan) * paddedTileSideLength;
+    if ( ! pixels)
+        return nil;
 
-        for (double row = (top + (gridSpacing/2.0)); row >= (bottom - (gridSpacing/2.0)); row -= gridSpacing)
-        {
-            CGFloat yCoordinate = paddedTileSideLength - (((row - southWest.latitude) / coordinatesLatitudeSpan) * paddedTileSideLength);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(pixels, sideLength, sideLength, 8, bytesPerRow, colorSpace, kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
 
-            NSString *label1 = nil, *label2 = nil;
-            double degrees = (column > 0.0 ? floor(column) : ceil(column));
-            double fraction = (column > 0.0 ? column - floor(column) : ceil(column) - column);
+    if ( ! context)
+    {
+        free(pixels);
+        return nil;
+    }
 
-            switch (self.gridMode)
-            {
-                case GridModeGeographic: {
-                    label1 = [NSString stringWithFormat:@"%.0f˚", degrees];
-                    label2 = [NSString stringWithFormat:@"%02.0f'", fraction * 60.0];
-                    break;
-                }
-                case GridModeGeographicDecimal:
-                case GridModeUTM:
-                default: {
-                    label1 = [NSString stringWithFormat:@"%.0f", degrees];
-                    label2 = [NSString stringWithFormat:@"%02.0f", fraction * 100.0];
-                }
-            }
+    // potential problem: some of the UIKit functions are not thread safe, so the app will crash
+    // if any other thread uses these functions outside of the @synchronized
+    @synchronized (self)
+    {
+        // Grid lines
 
-            @synchronized (self)
-            {
-                CGSize label1Size = [label1 sizeWithFont:self.majorLabelFont];
-                CGSize label2Size = [label2 sizeWithFont:self.minorLabelFont];
+        RMCoordinateGridDrawTile(_grid, gridType, gridSpacing, tile.x, tile.y, tile.zoom, RMCoordinateGridSourceColor(self.gridColor), self.gridLineWidth, pixels, bytesPerRow);
 
-                CGFloat upperBorder = yCoordinate - MAX((label1Size.height / 2.0), (label2Size.height / 2.0));
-                CGRect labelBackgroundRect = CGRectMake(xCoordinate - label1Size.width - 3.0, upperBorder - 1.0, label1Size.width + label2Size.width + 8.0, MAX(label1Size.height, label2Size.height) + 2.0);
+        // Labels, with UIKit in the same pixels, y pointing down
 
-                CGContextSetFillColorWithColor(context, [UIColor clearColor].CGColor);
-                UIRectFill(labelBackgroundRect);
+        CGContextTranslateCTM(context, 0.0, sideLength);
+        CGContextScaleCTM(context, 1.0, -1.0);
+        UIGraphicsPushContext(context);
 
-                CGContextSetFillColorWithColor(context, self.majorLabelColor.CGColor);
-                [label1 drawAtPoint:CGPointMake(xCoordinate - label1Size.width - 1.0, upperBorder) withFont:self.majorLabelFont];
+        if (gridType == RMCoordinateGridUTM)
+            [self drawZoneLabelsForTile:tile inContext:context];
+        else
+            [self drawLineLabelsForTile:tile gridSpacing:gridSpacing inContext:context];
 
-                CGContextSetFillColorWithColor(context, self.minorLabelColor.CGColor);
-                [label2 drawAtPoint:CGPointMake(xCoordinate + 1.0, upperBorder) withFont:self.minorLabelFont];
-            }
-        }
+        UIGraphicsPopContext();
     }
 
     // Image
 
-    image = UIGraphicsGetImageFromCurrentImageContext();
-	UIGraphicsEndImageContext();
-
-    CGImageRef imageRef = CGImageCreateWithImageInRect([image CGImage], CGRectMake(kTileSidePadding, kTileSidePadding, self.tileSideLength, self.tileSideLength));
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
     image = [UIImage imageWithCGImage:imageRef];
     CGImageRelease(imageRef);
 
-    if (image)
-        [tileCache addImage:image forTile:tile withCacheKey:[self uniqueTilecacheKey]];
+    CGContextRelease(context);
+    free(pixels);
 
 	return image;
 }
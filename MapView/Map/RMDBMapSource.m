@@ -74,6 +74,7 @@
 #import "RMFractalTileProjection.h"
 #import "FMDatabase.h"
 #import "FMDatabaseQueue.h"
+#import "RMSQLiteReaderPool.h"
 
 #pragma mark --- begin constants ----
 
@@ -96,6 +97,11 @@
 #define kShortAttributionKey @"map.shortAttribution"
 #define kLongAttributionKey @"map.longAttribution"
 
+// Tile reads go through a pool of read-only connections with up to this much of the file mapped
+#define kDBMapSourceMemoryMapSize (128 * 1024 * 1024)
+
+static const char kDBMapSourceTileQuery[] = "SELECT image FROM tiles WHERE tilekey = ?";
+
 #pragma mark --- end constants ----
 
 @interface RMDBMapSource (Preferences)
@@ -111,6 +117,7 @@
 @implementation RMDBMapSource
 {
     FMDatabaseQueue *_queue;
+    RMSQLiteReaderPool *_readerPool;
 
     // coverage area
     CLLocationCoordinate2D _topLeft;
@@ -143,6 +150,15 @@
         // [db setTraceExecution:YES];
     }];
 
+    _readerPool = RMSQLiteReaderPoolCreate([path fileSystemRepresentation], 0, kDBMapSourceMemoryMapSize);
+
+    if ( ! _readerPool)
+    {
+        RMLog(@"Error opening db map source %@ for reading tiles", path);
+        [self release];
+        return nil;
+    }
+
     RMLog(@"Opening db map source %@", path);
 
     // get the tile side length
@@ -178,6 +194,7 @@
 {
     [_uniqueTilecacheKey release]; _uniqueTilecacheKey = nil;
     [_queue release]; _queue = nil;
+    RMSQLiteReaderPoolDestroy(_readerPool); _readerPool = NULL;
     [super dealloc];
 }
 
@@ -200,7 +217,8 @@
 
 - (UIImage *)imageForTile:(RMTile)tile inCache:(RMTileCache *)tileCache
 {
-    __block UIImage *image = nil;
+    UIImage *image = nil;
+    NSData *imageData = nil;
 
 	tile = [[self mercatorToTileProjection] normaliseTile:tile];
     image = [tileCache cachedImage:tile withCacheKey:[self uniqueTilecacheKey]];
@@ -209,26 +227,22 @@
         return image;
 
     // get the unique key for the tile
-    NSNumber *key = [NSNumber numberWithLongLong:RMTileKey(tile)];
-
-    [_queue inDatabase:^(FMDatabase *db)
-    {
-        // fetch the image from the db
-        FMResultSet *result = [db executeQuery:@"SELECT image FROM tiles WHERE tilekey = ?", key];
+    int64_t key = (int64_t)RMTileKey(tile);
+    size_t length = 0;
 
-        if ([db hadError])
-            NSLog(@"DB error %d on line %d: %@", [db lastErrorCode], __LINE__, [db lastErrorMessage]);
-
-        if ([result next])
-            image = [[[UIImage alloc] initWithData:[result dataForColumnIndex:0]] autorelease];
-        else
-            image = [RMTileImage missingTile];
+    // fetch the image from the db, on a connection of this thread's own
+    void *data = RMSQLiteReaderPoolCopyBlob(_readerPool, kDBMapSourceTileQuery, &key, 1, &length);
 
-        [result close];
-    }];
+    if (data)
+    {
+        imageData = [NSData dataWithBytesNoCopy:data length:length freeWhenDone:YES];
+        image = [[[UIImage alloc] initWithData:imageData] autorelease];
+    }
+    else
+        image = [RMTileImage missingTile];
 
     if (image)
-        [tileCache addImage:image forTile:tile withCacheKey:[self uniqueTilecacheKey]];
+        [tileCache addImage:image withData:imageData forTile:tile withCacheKey:[self uniqueTilecacheKey]];
 
 	return image;
 }
@@ -55,6 +55,8 @@
 /** @name Configuring Cache Behavior */
 
 /** Set the cache purge strategy to use for the database.
+*
+*   With RMCachePurgeStrategyTinyLFU, tiles are purged in least-recently used order, but once the cache is full a new tile is only added if it has been requested more often recently than the tile it would replace. The request frequencies are kept in memory and start over when the cache is created.
 *   @param theStrategy The cache strategy to use. */
 - (void)setPurgeStrategy:(RMCachePurgeStrategy)theStrategy;
 
@@ -67,7 +69,7 @@
 - (void)setMinimalPurge:(NSUInteger)thePurgeMinimum;
 
 /** Set the expiry period for cache purging.
-*   @param theExpiryPeriod The amount of time to elapse before a tile should be removed from the cache. If set to zero, tile count-based purging will be used instead of time-based. */
+*   @param theExpiryPeriod The amount of time to elapse before a tile should be removed from the cache. If set to zero, tile count-based purging will be used instead of time-based. Expired tiles are removed in the background, at most a minute after they expire once the cache is being used. */
 - (void)setExpiryPeriod:(NSTimeInterval)theExpiryPeriod;
 
 @end
@@ -30,8 +30,32 @@
 #import "FMDatabaseQueue.h"
 #import "RMTileImage.h"
 #import "RMTile.h"
-
-#define kWriteQueueLimit 15
+#import "RMCacheKey.h"
+#import "RMFrequencySketch.h"
+#import "RMTileWriteBuffer.h"
+#import "RMBloomFilter.h"
+
+// Tile inserts and LRU touches are buffered and committed together, one transaction
+// per batch or per interval. Beyond the byte limit, adding a tile waits for a flush.
+#define kWriteBatchSize 64
+#define kWriteBatchInterval 0.5
+#define kWriteBufferByteLimit (4 * 1024 * 1024)
+
+// Space freed by deleted tiles is given back by incremental vacuum steps, and expired
+// tiles are deleted in steps too, so that tile reads only ever wait for one step.
+#define kVacuumPagesPerStep 256
+#define kExpiryTilesPerStep 256
+#define kExpirySweepInterval 60.0
+
+// The lookup filter is sized for the capacity, or for kLookupFilterMinimumEntries,
+// or twice the tiles already stored when there is no capacity.
+#define kLookupFilterMinimumEntries 16384
+#define kLookupFilterFalsePositiveRate 0.01
+
+// Tiles tracked by the TinyLFU frequency sketch per tile of capacity, so that the counts
+// of the tiles in regular use outlast a pan over many times the capacity in new tiles.
+#define kFrequencySketchScale 16
+#define kFrequencySketchMaximumSize (1 << 20)
 
 @interface RMDatabaseCache ()
 
@@ -39,6 +63,15 @@
 - (NSUInteger)countTiles;
 - (void)touchTile:(RMTile)tile withKey:(NSString *)cacheKey;
 - (void)purgeTiles:(NSUInteger)count;
+- (BOOL)shouldAdmitTile:(RMTile)tile withKey:(NSString *)cacheKey;
+- (void)flushWrites;
+- (void)scheduleFlush:(RMTileWriteBufferState)state;
+- (void)scheduleIncrementalVacuum;
+- (void)vacuumStep;
+- (void)scheduleExpirySweep;
+- (void)expireTiles;
+- (void)loadLookupFilter;
+- (int)deleteTilesInDatabase:(FMDatabase *)db selectedBy:(NSString *)query withArguments:(NSArray *)arguments;
 
 @end
 
@@ -52,12 +85,26 @@
     NSUInteger _tileCount;
     NSOperationQueue *_writeQueue;
     NSRecursiveLock *_writeQueueLock;
+    RMTileWriteBuffer *_writeBuffer;
+    BOOL _flushScheduled;
+    BOOL _vacuumScheduled;
+    BOOL _expirySweepScheduled;
+    NSTimeInterval _lastExpirySweep;
 
     // Cache
     RMCachePurgeStrategy _purgeStrategy;
     NSUInteger _capacity;
     NSUInteger _minimalPurge;
     NSTimeInterval _expiryPeriod;
+
+    // Recent request frequencies for RMCachePurgeStrategyTinyLFU, kept in memory only
+    RMFrequencySketch *_frequencySketch;
+
+    // The tiles in the database and the write buffer, to answer most misses without a query.
+    // It is made and filled in the background after opening, and only consulted once
+    // _lookupFilterLoaded; it is only changed with _writeQueueLock held, and never replaced.
+    RMBloomFilter *_lookupFilter;
+    BOOL _lookupFilterLoaded;
 }
 
 @synthesize databasePath = _databasePath;
@@ -90,15 +137,56 @@
 
 - (void)configureDBForFirstUse
 {
+    __block BOOL needsIncrementalVacuum = NO;
+
     [_queue inDatabase:^(FMDatabase *db) {
         [[db executeQuery:@"PRAGMA synchronous=OFF"] close];
         [[db executeQuery:@"PRAGMA journal_mode=OFF"] close];
         [[db executeQuery:@"PRAGMA cache-size=100"] close];
         [[db executeQuery:@"PRAGMA count_changes=OFF"] close];
+        // Has to come before the first table is created to take effect without a VACUUM
+        [db executeUpdate:@"PRAGMA auto_vacuum=INCREMENTAL"];
         [db executeUpdate:@"CREATE TABLE IF NOT EXISTS ZCACHE (tile_hash INTEGER NOT NULL, cache_key VARCHAR(25) NOT NULL, last_used DOUBLE NOT NULL, data BLOB NOT NULL)"];
         [db executeUpdate:@"CREATE UNIQUE INDEX IF NOT EXISTS main_index ON ZCACHE(tile_hash, cache_key)"];
         [db executeUpdate:@"CREATE INDEX IF NOT EXISTS last_used_index ON ZCACHE(last_used)"];
+
+        // The tile count, kept up to date by triggers so that it never needs a COUNT() scan.
+        // Databases created before it existed are counted once here.
+        [db beginTransaction];
+        [db executeUpdate:@"CREATE TABLE IF NOT EXISTS ZCACHE_COUNT (count INTEGER NOT NULL)"];
+        [db executeUpdate:@"CREATE TRIGGER IF NOT EXISTS zcache_count_insert AFTER INSERT ON ZCACHE BEGIN UPDATE ZCACHE_COUNT SET count = count + 1; END"];
+        [db executeUpdate:@"CREATE TRIGGER IF NOT EXISTS zcache_count_delete AFTER DELETE ON ZCACHE BEGIN UPDATE ZCACHE_COUNT SET count = count - 1; END"];
+        [db executeUpdate:@"INSERT INTO ZCACHE_COUNT (count) SELECT (SELECT COUNT(tile_hash) FROM ZCACHE) WHERE NOT EXISTS (SELECT 1 FROM ZCACHE_COUNT)"];
+        [db commit];
+
+        FMResultSet *results = [db executeQuery:@"PRAGMA auto_vacuum"];
+
+        if ([results next])
+            needsIncrementalVacuum = ([results intForColumnIndex:0] != 2);
+
+        [results close];
     }];
+
+    if (needsIncrementalVacuum)
+    {
+        // Databases created without auto_vacuum need one full VACUUM to switch over,
+        // done once and in the background.
+        [_writeQueue addOperationWithBlock:^{
+            RMLog(@"converting the db cache to incremental vacuum");
+
+            [_writeQueueLock lock];
+
+            [_queue inDatabase:^(FMDatabase *db)
+             {
+                 [db executeUpdate:@"PRAGMA auto_vacuum=INCREMENTAL"];
+
+                 if ( ! [db executeUpdate:@"VACUUM"])
+                     RMLog(@"Error converting the db cache to incremental vacuum");
+             }];
+
+            [_writeQueueLock unlock];
+        }];
+    }
 }
 
 - (id)initWithDatabase:(NSString *)path
@@ -111,6 +199,7 @@
     _writeQueue = [NSOperationQueue new];
     [_writeQueue setMaxConcurrentOperationCount:1];
     _writeQueueLock = [NSRecursiveLock new];
+    _writeBuffer = RMTileWriteBufferCreate(kWriteBatchSize, kWriteBufferByteLimit);
 
 	RMLog(@"Opening database at %@", path);
 
@@ -135,6 +224,10 @@
 
     _tileCount = [self countTiles];
 
+    [_writeQueue addOperationWithBlock:^{
+        [self loadLookupFilter];
+    }];
+
 	return self;	
 }
 
@@ -146,17 +239,25 @@
 - (void)dealloc
 {
     self.databasePath = nil;
+    [_writeQueue waitUntilAllOperationsAreFinished];
+    [self flushWrites];
     [_writeQueueLock lock];
     [_writeQueue release]; _writeQueue = nil;
+    RMTileWriteBufferDestroy(_writeBuffer); _writeBuffer = NULL;
     [_writeQueueLock unlock];
     [_writeQueueLock release]; _writeQueueLock = nil;
     [_queue release]; _queue = nil;
+    RMFrequencySketchDestroy(_frequencySketch); _frequencySketch = NULL;
+    RMBloomFilterDestroy(_lookupFilter); _lookupFilter = NULL;
 	[super dealloc];
 }
 
 - (void)setPurgeStrategy:(RMCachePurgeStrategy)theStrategy
 {
 	_purgeStrategy = theStrategy;
+
+    if (_purgeStrategy == RMCachePurgeStrategyTinyLFU && ! _frequencySketch)
+        _frequencySketch = RMFrequencySketchCreate(MIN((_capacity ? _capacity : 1000) * kFrequencySketchScale, kFrequencySketchMaximumSize));
 }
 
 - (void)setCapacity:(NSUInteger)theCapacity
@@ -181,56 +282,61 @@
 //	RMLog(@"DB cache check for tile %d %d %d", tile.x, tile.y, tile.zoom);
 
     __block UIImage *cachedImage = nil;
+    uint64_t keyHash = RMCacheKeyHash(RMTileKey(tile), [aCacheKey UTF8String]);
 
-    [_writeQueueLock lock];
-
-    [_queue inDatabase:^(FMDatabase *db)
-     {
-         FMResultSet *results = [db executeQuery:@"SELECT data FROM ZCACHE WHERE tile_hash = ? AND cache_key = ?", [RMTileCache tileHash:tile], aCacheKey];
+    if (_frequencySketch)
+        RMFrequencySketchIncrement(_frequencySketch, keyHash);
 
-         if ([db hadError])
-         {
-             RMLog(@"DB error while fetching tile data: %@", [db lastErrorMessage]);
-             return;
-         }
+    // Most misses are tiles that were never stored, which the filter knows without a query.
+    if (__atomic_load_n(&_lookupFilterLoaded, __ATOMIC_ACQUIRE) && ! RMBloomFilterMayContain(_lookupFilter, keyHash))
+    {
+        if (_expiryPeriod > 0)
+            [self scheduleExpirySweep];
 
-         NSData *data = nil;
+        return nil;
+    }
 
-         if ([results next])
-         {
-             data = [results dataForColumnIndex:0];
-             if (data) cachedImage = [UIImage imageWithData:data];
-         }
+    // Tiles still waiting in the write buffer are not in the database yet.
+    size_t pendingLength = 0;
+    void *pendingData = RMTileWriteBufferCopyTileData(_writeBuffer, (int64_t)RMTileKey(tile), [aCacheKey UTF8String], &pendingLength);
 
-         [results close];
-     }];
+    if (pendingData)
+    {
+        cachedImage = [UIImage imageWithData:[NSData dataWithBytesNoCopy:pendingData length:pendingLength freeWhenDone:YES]];
+    }
+    else
+    {
+        [_writeQueueLock lock];
 
-    [_writeQueueLock unlock];
+        [_queue inDatabase:^(FMDatabase *db)
+         {
+             FMResultSet *results = [db executeQuery:@"SELECT data FROM ZCACHE WHERE tile_hash = ? AND cache_key = ?", [RMTileCache tileHash:tile], aCacheKey];
 
-    if (_capacity != 0 && _purgeStrategy == RMCachePurgeStrategyLRU)
-        [self touchTile:tile withKey:aCacheKey];
+             if ([db hadError])
+             {
+                 RMLog(@"DB error while fetching tile data: %@", [db lastErrorMessage]);
+                 return;
+             }
 
-    if (_expiryPeriod > 0)
-    {
-        if (rand() % 100 == 0)
-        {
-            [_writeQueueLock lock];
+             NSData *data = nil;
 
-            [_queue inDatabase:^(FMDatabase *db)
+             if ([results next])
              {
-                 BOOL result = [db executeUpdate:@"DELETE FROM ZCACHE WHERE last_used < ?", [NSDate dateWithTimeIntervalSinceNow:-_expiryPeriod]];
+                 data = [results dataForColumnIndex:0];
+                 if (data) cachedImage = [UIImage imageWithData:data];
+             }
 
-                 if (result == NO)
-                     RMLog(@"Error expiring cache");
+             [results close];
+         }];
 
-                 [[db executeQuery:@"VACUUM"] close];
-             }];
+        [_writeQueueLock unlock];
+    }
 
-            [_writeQueueLock unlock];
+    if (_capacity != 0 && (_purgeStrategy == RMCachePurgeStrategyLRU || _purgeStrategy == RMCachePurgeStrategyTinyLFU))
+        [self touchTile:tile withKey:aCacheKey];
 
-            _tileCount = [self countTiles];
-        }
-    }
+    if (_expiryPeriod > 0)
+        [self scheduleExpirySweep];
 
 //    RMLog(@"DB cache     hit    tile %d %d %d (%@)", tile.x, tile.y, tile.zoom, [RMTileCache tileHash:tile]);
 
@@ -239,54 +345,107 @@
 
 - (void)addImage:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
 {
-    // TODO: Converting the image here (again) is not so good...
-	NSData *data = UIImagePNGRepresentation(image);
+    // Only for tiles that do not come from encoded data, such as composited ones.
+    [self addImage:image withData:UIImagePNGRepresentation(image) forTile:tile withCacheKey:aCacheKey];
+}
+
+- (void)addImage:(UIImage *)image withData:(NSData *)data forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    if ( ! data)
+        return;
 
     if (_capacity != 0)
     {
         NSUInteger tilesInDb = [self count];
 
         if (_capacity <= tilesInDb && _expiryPeriod == 0)
+        {
+            // TinyLFU: a full cache only takes the tile if it is requested more often
+            // than the tile it would push out, so one-off tiles do not flush it.
+            if (_purgeStrategy == RMCachePurgeStrategyTinyLFU && ! [self shouldAdmitTile:tile withKey:aCacheKey])
+                return;
+
             [self purgeTiles:MAX(_minimalPurge, 1+tilesInDb-_capacity)];
+        }
 
 //        RMLog(@"DB cache     insert tile %d %d %d (%@)", tile.x, tile.y, tile.zoom, [RMTileCache tileHash:tile]);
 
-        // Don't add new images to the database while there are still more than kWriteQueueLimit
-        // insert operations pending. This prevents some memory issues.
-
-        BOOL skipThisTile = NO;
+        RMTileWriteBufferState state = RMTileWriteBufferAddTile(_writeBuffer, (int64_t)RMTileKey(tile), [aCacheKey UTF8String], [[NSDate date] timeIntervalSince1970], [data bytes], [data length]);
 
+        // Only after queueing the tile, see -removeAllCachedImages.
         [_writeQueueLock lock];
 
-        if ([_writeQueue operationCount] > kWriteQueueLimit)
-            skipThisTile = YES;
+        if (_lookupFilter)
+            RMBloomFilterAdd(_lookupFilter, RMCacheKeyHash(RMTileKey(tile), [aCacheKey UTF8String]));
 
         [_writeQueueLock unlock];
 
-        if (skipThisTile)
-            return;
+        [self scheduleFlush:state];
+	}
+}
 
-        [_writeQueue addOperationWithBlock:^{
-            __block BOOL result = NO;
+#pragma mark -
 
-            [_writeQueueLock lock];
+- (void)flushWrites
+{
+    __block long inserted = 0, failures = 0;
 
-            [_queue inDatabase:^(FMDatabase *db)
-             {
-                 result = [db executeUpdate:@"INSERT OR IGNORE INTO ZCACHE (tile_hash, cache_key, last_used, data) VALUES (?, ?, ?, ?)", [RMTileCache tileHash:tile], aCacheKey, [NSDate date], data];
-             }];
+    [_writeQueueLock lock];
 
-            [_writeQueueLock unlock];
+    [_queue inDatabase:^(FMDatabase *db)
+     {
+         inserted = RMTileWriteBufferFlush(_writeBuffer, [db sqliteHandle], &failures);
+     }];
 
-            if (result == NO)
-                RMLog(@"Error occured adding data");
-            else
-                _tileCount++;
-        }];
-	}
+    if (inserted > 0)
+        _tileCount += inserted;
+
+    [_writeQueueLock unlock];
+
+    if (inserted < 0)
+        RMLog(@"Error occured committing tiles to the db cache");
+    else if (failures > 0)
+        RMLog(@"Error occured adding data for %ld tiles", failures);
 }
 
-#pragma mark -
+- (void)scheduleFlush:(RMTileWriteBufferState)state
+{
+    if (state == RMTileWriteBufferFull)
+    {
+        // Backpressure: rather than dropping tiles, the producer waits for the database.
+        [self flushWrites];
+        return;
+    }
+
+    [_writeQueueLock lock];
+
+    BOOL flushNow = (state == RMTileWriteBufferBatchReady && [_writeQueue operationCount] == 0);
+    BOOL flushLater = ( ! flushNow && ! _flushScheduled);
+
+    if (flushLater)
+        _flushScheduled = YES;
+
+    [_writeQueueLock unlock];
+
+    if (flushNow)
+    {
+        [_writeQueue addOperationWithBlock:^{
+            [self flushWrites];
+        }];
+    }
+    else if (flushLater)
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kWriteBatchInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+            [_writeQueueLock lock];
+            _flushScheduled = NO;
+            [_writeQueueLock unlock];
+
+            [_writeQueue addOperationWithBlock:^{
+                [self flushWrites];
+            }];
+        });
+    }
+}
 
 - (NSUInteger)count
 {
@@ -301,7 +460,7 @@
 
     [_queue inDatabase:^(FMDatabase *db)
      {
-         FMResultSet *results = [db executeQuery:@"SELECT COUNT(tile_hash) FROM ZCACHE"];
+         FMResultSet *results = [db executeQuery:@"SELECT count FROM ZCACHE_COUNT"];
 
          if ([results next])
              count = [results intForColumnIndex:0];
@@ -324,66 +483,307 @@
 
     [_queue inDatabase:^(FMDatabase *db)
      {
-         BOOL result = [db executeUpdate:@"DELETE FROM ZCACHE WHERE tile_hash IN (SELECT tile_hash FROM ZCACHE ORDER BY last_used LIMIT ?)", [NSNumber numberWithUnsignedInt:count]];
+         int result = [self deleteTilesInDatabase:db selectedBy:@"SELECT rowid, tile_hash, cache_key FROM ZCACHE ORDER BY last_used LIMIT ?" withArguments:[NSArray arrayWithObject:[NSNumber numberWithUnsignedInt:count]]];
 
-         if (result == NO)
+         if (result < 0)
              RMLog(@"Error purging cache");
+     }];
+
+    [_writeQueueLock unlock];
+
+    _tileCount = [self countTiles];
+
+    [self scheduleIncrementalVacuum];
+}
+
+- (void)scheduleIncrementalVacuum
+{
+    [_writeQueueLock lock];
+
+    BOOL schedule = ! _vacuumScheduled;
+    _vacuumScheduled = YES;
+
+    [_writeQueueLock unlock];
+
+    if (schedule)
+    {
+        [_writeQueue addOperationWithBlock:^{
+            [self vacuumStep];
+        }];
+    }
+}
+
+- (void)vacuumStep
+{
+    __block int freedPages = 0;
+
+    [_writeQueueLock lock];
+
+    [_queue inDatabase:^(FMDatabase *db)
+     {
+         // Every step of the statement gives back one free page.
+         FMResultSet *results = [db executeQuery:[NSString stringWithFormat:@"PRAGMA incremental_vacuum(%d)", kVacuumPagesPerStep]];
 
-         [[db executeQuery:@"VACUUM"] close];
+         while ([results next])
+             freedPages++;
+
+         [results close];
      }];
 
+    BOOL moreToFree = (freedPages == kVacuumPagesPerStep);
+
+    if ( ! moreToFree)
+        _vacuumScheduled = NO;
+
+    [_writeQueueLock unlock];
+
+    if (moreToFree)
+    {
+        [_writeQueue addOperationWithBlock:^{
+            [self vacuumStep];
+        }];
+    }
+}
+
+- (void)scheduleExpirySweep
+{
+    [_writeQueueLock lock];
+
+    BOOL schedule = ( ! _expirySweepScheduled && [NSDate timeIntervalSinceReferenceDate] - _lastExpirySweep >= kExpirySweepInterval);
+
+    if (schedule)
+        _expirySweepScheduled = YES;
+
     [_writeQueueLock unlock];
 
+    if (schedule)
+    {
+        [_writeQueue addOperationWithBlock:^{
+            [self expireTiles];
+        }];
+    }
+}
+
+- (void)expireTiles
+{
+    __block int expired = 0;
+
+    [_writeQueueLock lock];
+
+    [_queue inDatabase:^(FMDatabase *db)
+     {
+         NSArray *arguments = [NSArray arrayWithObjects:[NSDate dateWithTimeIntervalSinceNow:-_expiryPeriod], [NSNumber numberWithInt:kExpiryTilesPerStep], nil];
+         int result = [self deleteTilesInDatabase:db selectedBy:@"SELECT rowid, tile_hash, cache_key FROM ZCACHE WHERE last_used < ? LIMIT ?" withArguments:arguments];
+
+         if (result < 0)
+             RMLog(@"Error expiring cache");
+         else
+             expired = result;
+     }];
+
     _tileCount = [self countTiles];
+
+    BOOL moreToExpire = (expired == kExpiryTilesPerStep);
+
+    if ( ! moreToExpire)
+    {
+        _expirySweepScheduled = NO;
+        _lastExpirySweep = [NSDate timeIntervalSinceReferenceDate];
+    }
+
+    [_writeQueueLock unlock];
+
+    if (moreToExpire)
+    {
+        [_writeQueue addOperationWithBlock:^{
+            [self expireTiles];
+        }];
+    }
+
+    if (expired > 0)
+        [self scheduleIncrementalVacuum];
+}
+
+- (BOOL)shouldAdmitTile:(RMTile)tile withKey:(NSString *)cacheKey
+{
+    if ( ! _frequencySketch)
+        return YES;
+
+    __block uint64_t victimHash = 0;
+    __block BOOL hasVictim = NO;
+
+    [_writeQueueLock lock];
+
+    [_queue inDatabase:^(FMDatabase *db)
+     {
+         FMResultSet *results = [db executeQuery:@"SELECT tile_hash, cache_key FROM ZCACHE ORDER BY last_used LIMIT 1"];
+
+         if ([results next])
+         {
+             victimHash = RMCacheKeyHash((uint64_t)[results longLongIntForColumnIndex:0], [[results stringForColumnIndex:1] UTF8String]);
+             hasVictim = YES;
+         }
+
+         [results close];
+     }];
+
+    [_writeQueueLock unlock];
+
+    if ( ! hasVictim)
+        return YES;
+
+    uint64_t candidateHash = RMCacheKeyHash(RMTileKey(tile), [cacheKey UTF8String]);
+
+    return RMFrequencySketchEstimate(_frequencySketch, candidateHash) > RMFrequencySketchEstimate(_frequencySketch, victimHash);
+}
+
+- (void)removeImageForTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    // A copy of the tile still in the write buffer would be written after the deletion.
+    [self flushWrites];
+
+    __block int result = 0;
+
+    [_writeQueueLock lock];
+
+    [_queue inDatabase:^(FMDatabase *db)
+     {
+         result = [self deleteTilesInDatabase:db
+                                   selectedBy:@"SELECT rowid, tile_hash, cache_key FROM ZCACHE WHERE tile_hash = ? AND cache_key = ?"
+                                withArguments:[NSArray arrayWithObjects:[RMTileCache tileHash:tile], aCacheKey, nil]];
+     }];
+
+    if (result > 0)
+        _tileCount -= MIN((NSUInteger)result, _tileCount);
+
+    [_writeQueueLock unlock];
+
+    if (result < 0)
+        RMLog(@"Error removing a tile from the db cache");
 }
 
 - (void)removeAllCachedImages 
 {
     RMLog(@"removing all tiles from the db cache");
 
+    RMTileWriteBufferDiscard(_writeBuffer);
+
     [_writeQueue addOperationWithBlock:^{
         [_writeQueueLock lock];
 
+        __atomic_store_n(&_lookupFilterLoaded, NO, __ATOMIC_RELEASE);
+
         [_queue inDatabase:^(FMDatabase *db)
          {
              BOOL result = [db executeUpdate:@"DELETE FROM ZCACHE"];
 
              if (result == NO)
                  RMLog(@"Error purging cache");
-
-             [[db executeQuery:@"VACUUM"] close];
          }];
 
+        // Tiles added meanwhile are queued before they are added to the filter, so
+        // whatever the clearing drops, the reload finds in the database.
+        if (_lookupFilter)
+            RMBloomFilterClear(_lookupFilter);
+
         [_writeQueueLock unlock];
 
         _tileCount = [self countTiles];
+
+        [self loadLookupFilter];
+
+        [self scheduleIncrementalVacuum];
     }];
 }
 
-- (void)touchTile:(RMTile)tile withKey:(NSString *)cacheKey
+// Made here rather than when opening, so that it is sized for the capacity set after
+// -init, and so that it is never replaced once tiles are being added to it.
+- (void)loadLookupFilter
 {
-    [_writeQueue addOperationWithBlock:^{
-        [_writeQueueLock lock];
+    [_writeQueueLock lock];
 
-        [_queue inDatabase:^(FMDatabase *db)
-         {
-             BOOL result = [db executeUpdate:@"UPDATE ZCACHE SET last_used = ? WHERE tile_hash = ? AND cache_key = ?", [NSDate date], [RMTileCache tileHash:tile], cacheKey];
-
-             if (result == NO)
-                 RMLog(@"Error touching tile");
-         }];
+    if ( ! _lookupFilter)
+        _lookupFilter = RMBloomFilterCreate(MAX(MAX(kLookupFilterMinimumEntries, 2 * _tileCount), _capacity), kLookupFilterFalsePositiveRate);
 
+    if ( ! _lookupFilter)
+    {
         [_writeQueueLock unlock];
-    }];
+        return;
+    }
+
+    // Buffered tiles have to be in the database for the scan to see them.
+    [self flushWrites];
+
+    [_queue inDatabase:^(FMDatabase *db)
+     {
+         FMResultSet *results = [db executeQuery:@"SELECT tile_hash, cache_key FROM ZCACHE"];
+
+         while ([results next])
+             RMBloomFilterAdd(_lookupFilter, RMCacheKeyHash((uint64_t)[results longLongIntForColumnIndex:0], (const char *)[results UTF8StringForColumnIndex:1]));
+
+         [results close];
+     }];
+
+    __atomic_store_n(&_lookupFilterLoaded, YES, __ATOMIC_RELEASE);
+
+    [_writeQueueLock unlock];
+}
+
+// Delete the tiles found by query, which selects their rowid, tile_hash and cache_key,
+// and remove them from the lookup filter. Returns the number deleted, or -1 on error.
+- (int)deleteTilesInDatabase:(FMDatabase *)db selectedBy:(NSString *)query withArguments:(NSArray *)arguments
+{
+    NSMutableArray *rowids = [NSMutableArray array];
+    NSMutableData *keyHashes = [NSMutableData data];
+
+    FMResultSet *results = [db executeQuery:query withArgumentsInArray:arguments];
+
+    while ([results next])
+    {
+        uint64_t keyHash = RMCacheKeyHash((uint64_t)[results longLongIntForColumnIndex:1], (const char *)[results UTF8StringForColumnIndex:2]);
+
+        [rowids addObject:[NSNumber numberWithLongLong:[results longLongIntForColumnIndex:0]]];
+        [keyHashes appendBytes:&keyHash length:sizeof(keyHash)];
+    }
+
+    [results close];
+
+    if ([db hadError])
+        return -1;
+
+    if ([rowids count] == 0)
+        return 0;
+
+    if ( ! [db executeUpdate:[NSString stringWithFormat:@"DELETE FROM ZCACHE WHERE rowid IN (%@)", [rowids componentsJoinedByString:@","]]])
+        return -1;
+
+    // Until loaded, the filter may not hold these tiles yet; removing them could drop others.
+    if (_lookupFilter && _lookupFilterLoaded)
+    {
+        const uint64_t *hashes = [keyHashes bytes];
+
+        for (NSUInteger i = 0; i < [rowids count]; i++)
+            RMBloomFilterRemove(_lookupFilter, hashes[i]);
+    }
+
+    return [db changes];
+}
+
+- (void)touchTile:(RMTile)tile withKey:(NSString *)cacheKey
+{
+    RMTileWriteBufferState state = RMTileWriteBufferTouchTile(_writeBuffer, (int64_t)RMTileKey(tile), [cacheKey UTF8String], [[NSDate date] timeIntervalSince1970]);
+
+    [self scheduleFlush:state];
 }
 
 - (void)didReceiveMemoryWarning
 {
     RMLog(@"Low memory in the database tilecache");
 
-    [_writeQueueLock lock];
-    [_writeQueue cancelAllOperations];
-    [_writeQueueLock unlock];
+    // Write the buffered tiles out to free their memory, rather than dropping them.
+    [_writeQueue addOperationWithBlock:^{
+        [self flushWrites];
+    }];
 }
 
 @end
@@ -0,0 +1,147 @@
+//
+//  RMFrequencySketch.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "RMFrequencySketch.h"
+
+#include <stdlib.h>
+
+#define kRMFrequencySketchDepth 4
+#define kRMFrequencySketchMaximumCount 15
+#define kRMFrequencySketchMinimumWidth 64
+
+struct RMFrequencySketch {
+    uint8_t *counters; // kRMFrequencySketchDepth rows of width counters
+    size_t widthMask;
+    size_t sampleSize;
+    size_t samples;
+};
+
+static const uint64_t kRMFrequencySketchSeeds[kRMFrequencySketchDepth] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+};
+
+static size_t RMFrequencySketchIndex(RMFrequencySketch *sketch, uint64_t hash, int row)
+{
+    uint64_t h = (hash + kRMFrequencySketchSeeds[row]) * kRMFrequencySketchSeeds[row];
+
+    return (size_t)(row * (sketch->widthMask + 1) + ((h >> 32) & sketch->widthMask));
+}
+
+// Halve every counter, the aging step of TinyLFU.
+static void RMFrequencySketchReset(RMFrequencySketch *sketch)
+{
+    size_t size = kRMFrequencySketchDepth * (sketch->widthMask + 1);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t count = __atomic_load_n(&sketch->counters[i], __ATOMIC_RELAXED);
+
+        if (count)
+            __atomic_store_n(&sketch->counters[i], count >> 1, __ATOMIC_RELAXED);
+    }
+}
+
+#pragma mark -
+
+RMFrequencySketch *RMFrequencySketchCreate(size_t expectedEntries)
+{
+    RMFrequencySketch *sketch = calloc(1, sizeof(RMFrequencySketch));
+
+    if ( ! sketch)
+        return NULL;
+
+    size_t width = kRMFrequencySketchMinimumWidth;
+
+    while (width < expectedEntries && width < ((size_t)1 << 24))
+        width <<= 1;
+
+    sketch->counters = calloc(kRMFrequencySketchDepth * width, sizeof(uint8_t));
+
+    if ( ! sketch->counters)
+    {
+        free(sketch);
+        return NULL;
+    }
+
+    sketch->widthMask = width - 1;
+    sketch->sampleSize = 10 * width;
+
+    return sketch;
+}
+
+void RMFrequencySketchDestroy(RMFrequencySketch *sketch)
+{
+    if ( ! sketch)
+        return;
+
+    free(sketch->counters);
+    free(sketch);
+}
+
+void RMFrequencySketchIncrement(RMFrequencySketch *sketch, uint64_t hash)
+{
+    for (int row = 0; row < kRMFrequencySketchDepth; row++)
+    {
+        uint8_t *counter = &sketch->counters[RMFrequencySketchIndex(sketch, hash, row)];
+
+        if (__atomic_load_n(counter, __ATOMIC_RELAXED) < kRMFrequencySketchMaximumCount)
+            __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    }
+
+    // Only the thread that brings the count to the sample size resets.
+    if (__atomic_add_fetch(&sketch->samples, 1, __ATOMIC_RELAXED) == sketch->sampleSize)
+    {
+        RMFrequencySketchReset(sketch);
+        __atomic_store_n(&sketch->samples, sketch->sampleSize / 2, __ATOMIC_RELAXED);
+    }
+}
+
+unsigned int RMFrequencySketchEstimate(RMFrequencySketch *sketch, uint64_t hash)
+{
+    unsigned int estimate = kRMFrequencySketchMaximumCount;
+
+    for (int row = 0; row < kRMFrequencySketchDepth; row++)
+    {
+        unsigned int count = __atomic_load_n(&sketch->counters[RMFrequencySketchIndex(sketch, hash, row)], __ATOMIC_RELAXED);
+
+        if (count < estimate)
+            estimate = count;
+    }
+
+    // A concurrent increment may have overshot the saturation point by one.
+    return (estimate < kRMFrequencySketchMaximumCount ? estimate : kRMFrequencySketchMaximumCount);
+}
+
+void RMFrequencySketchClear(RMFrequencySketch *sketch)
+{
+    size_t size = kRMFrequencySketchDepth * (sketch->widthMask + 1);
+
+    for (size_t i = 0; i < size; i++)
+        __atomic_store_n(&sketch->counters[i], 0, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&sketch->samples, 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,59 @@
+//
+//  RMFrequencySketch.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _RMFREQUENCYSKETCH_H_
+#define _RMFREQUENCYSKETCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A count-min sketch estimating how often each key was seen recently, for the
+// TinyLFU cache admission policy. Counts saturate at 15 and are all halved once
+// ten times as many keys as the sketch was sized for have been recorded, so that
+// the estimates follow the recent popularity of tiles rather than all time counts.
+//
+// Increments and estimates may run concurrently; the counters are updated with
+// relaxed atomics, which can lose an increment now and then but nothing worse.
+
+typedef struct RMFrequencySketch RMFrequencySketch;
+
+// Create a sketch for about expectedEntries distinct keys, the capacity of the
+// cache it serves. Returns NULL if memory could not be allocated.
+RMFrequencySketch *RMFrequencySketchCreate(size_t expectedEntries);
+
+void RMFrequencySketchDestroy(RMFrequencySketch *sketch);
+
+// Record one occurrence of the key hash.
+void RMFrequencySketchIncrement(RMFrequencySketch *sketch, uint64_t hash);
+
+// The estimated recent occurrence count of the key hash, between 0 and 15.
+unsigned int RMFrequencySketchEstimate(RMFrequencySketch *sketch, uint64_t hash);
+
+// Forget all counts.
+void RMFrequencySketchClear(RMFrequencySketch *sketch);
+
+#endif
@@ -0,0 +1,809 @@
+//
+//  RMHeatmap.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMHeatmap.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Define as 0 to use the scalar code, as with compilers without vector extensions
+#ifndef RM_HEATMAP_VECTORS
+#if defined(__GNUC__)
+#define RM_HEATMAP_VECTORS 1
+#endif
+#endif
+
+#define kRMHeatmapMaximumZoom 24
+
+#define kRMHeatmapMinimumSlots 64
+
+#define kRMHeatmapEmptyKey UINT64_MAX
+
+#define kRMHeatmapDefaultPlanetHalfWidth 20037508.342789244
+
+#if RM_HEATMAP_VECTORS
+typedef float RMHeatmapVector __attribute__((vector_size(16)));
+#endif
+
+// Open addressing tables of 64 bit keys, at most half full, with a count per key for
+// the bins and without for the set of drawn tiles. Bins whose count falls to zero
+// stay until the table grows; keys of the set are removed by shifting back the ones
+// after them.
+typedef struct {
+    uint64_t *keys;
+    uint32_t *counts;
+    size_t mask, used;
+} RMHeatmapTable;
+
+typedef struct {
+    RMHeatmapTable bins; // keyed by bin x << 32 | y, from the north
+    bool built;
+    uint32_t maximumCount;
+} RMHeatmapLevel;
+
+struct RMHeatmap {
+    RMHeatmapOptions options;
+    int binsPerTile;
+
+    // Weights from -kernelHalfWidth to kernelHalfWidth bins, adding up to 1, and the
+    // bins around a tile that count: the half width, and one for scaling up
+    float *kernel;
+    int kernelHalfWidth, reach;
+
+    RMHeatmapLevel levels[kRMHeatmapMaximumZoom + 1];
+    size_t count;
+
+    uint8_t colormap[256][4];
+
+    // Tiles drawn, keyed by zoom << 48 | x << 24 | y, and those changed since
+    RMHeatmapTable drawn;
+    uint64_t *invalidated;
+    size_t invalidatedCount, invalidatedCapacity;
+
+    // Drawing: the counts of the bins of a tile and around it, blurred across, then
+    // down, and the position of every pixel in the bins for scaling up
+    float *counts, *blurredRows, *density, *line;
+    int *pixelBin;
+    float *pixelFraction;
+};
+
+#pragma mark - Tables
+
+static size_t RMHeatmapHashKey(uint64_t key)
+{
+    uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+
+    return (size_t)(hash ^ (hash >> 31));
+}
+
+static size_t RMHeatmapTableFind(const RMHeatmapTable *table, uint64_t key)
+{
+    size_t slot = RMHeatmapHashKey(key) & table->mask;
+
+    while (table->keys[slot] != kRMHeatmapEmptyKey && table->keys[slot] != key)
+        slot = (slot + 1) & table->mask;
+
+    return slot;
+}
+
+static bool RMHeatmapTableAllocate(RMHeatmapTable *table, size_t slotCount, bool withCounts)
+{
+    uint64_t *keys = malloc(slotCount * sizeof(uint64_t));
+    uint32_t *counts = (withCounts ? malloc(slotCount * sizeof(uint32_t)) : NULL);
+
+    if ( ! keys || (withCounts && ! counts))
+    {
+        free(keys);
+        free(counts);
+        return false;
+    }
+
+    for (size_t i = 0; i < slotCount; i++)
+        keys[i] = kRMHeatmapEmptyKey;
+
+    RMHeatmapTable old = *table;
+    size_t oldSlotCount = (old.keys ? old.mask + 1 : 0);
+
+    table->keys = keys;
+    table->counts = counts;
+    table->mask = slotCount - 1;
+    table->used = 0;
+
+    for (size_t i = 0; i < oldSlotCount; i++)
+    {
+        if (old.keys[i] == kRMHeatmapEmptyKey || (withCounts && old.counts[i] == 0))
+            continue;
+
+        size_t slot = RMHeatmapTableFind(table, old.keys[i]);
+
+        keys[slot] = old.keys[i];
+
+        if (withCounts)
+            counts[slot] = old.counts[i];
+
+        table->used++;
+    }
+
+    free(old.keys);
+    free(old.counts);
+
+    return true;
+}
+
+static void RMHeatmapTableFree(RMHeatmapTable *table)
+{
+    free(table->keys);
+    free(table->counts);
+    memset(table, 0, sizeof(RMHeatmapTable));
+}
+
+static void RMHeatmapTableClear(RMHeatmapTable *table)
+{
+    if ( ! table->keys)
+        return;
+
+    for (size_t i = 0; i <= table->mask; i++)
+        table->keys[i] = kRMHeatmapEmptyKey;
+
+    table->used = 0;
+}
+
+// The slot of the key, added if it was not there. Returns SIZE_MAX if memory could
+// not be allocated.
+static size_t RMHeatmapTableInsert(RMHeatmapTable *table, uint64_t key, bool withCounts)
+{
+    if ( ! table->keys || 2 * (table->used + 1) > table->mask + 1)
+    {
+        size_t slotCount = (table->keys ? 2 * (table->mask + 1) : kRMHeatmapMinimumSlots);
+
+        // Dropping the bins counted down to zero may leave room enough already
+        if (table->keys && withCounts)
+        {
+            size_t live = 0;
+
+            for (size_t i = 0; i <= table->mask; i++)
+                live += (table->keys[i] != kRMHeatmapEmptyKey && table->counts[i] != 0);
+
+            if (4 * (live + 1) <= table->mask + 1)
+                slotCount = table->mask + 1;
+        }
+
+        if ( ! RMHeatmapTableAllocate(table, slotCount, withCounts))
+            return SIZE_MAX;
+    }
+
+    size_t slot = RMHeatmapTableFind(table, key);
+
+    if (table->keys[slot] == kRMHeatmapEmptyKey)
+    {
+        table->keys[slot] = key;
+
+        if (withCounts)
+            table->counts[slot] = 0;
+
+        table->used++;
+    }
+
+    return slot;
+}
+
+static uint32_t RMHeatmapTableCount(const RMHeatmapTable *table, uint64_t key)
+{
+    if ( ! table->used)
+        return 0;
+
+    size_t slot = RMHeatmapTableFind(table, key);
+
+    return (table->keys[slot] == kRMHeatmapEmptyKey ? 0 : table->counts[slot]);
+}
+
+// Returns true if the key was there.
+static bool RMHeatmapTableRemove(RMHeatmapTable *table, uint64_t key)
+{
+    if ( ! table->used)
+        return false;
+
+    size_t slot = RMHeatmapTableFind(table, key);
+
+    if (table->keys[slot] == kRMHeatmapEmptyKey)
+        return false;
+
+    // Move back the keys after it that would not be found past the hole
+    size_t hole = slot;
+
+    for (size_t next = (hole + 1) & table->mask; table->keys[next] != kRMHeatmapEmptyKey; next = (next + 1) & table->mask)
+    {
+        size_t home = RMHeatmapHashKey(table->keys[next]) & table->mask;
+
+        if (((next - home) & table->mask) >= ((next - hole) & table->mask))
+        {
+            table->keys[hole] = table->keys[next];
+            hole = next;
+        }
+    }
+
+    table->keys[hole] = kRMHeatmapEmptyKey;
+    table->used--;
+
+    return true;
+}
+
+#pragma mark - Invalidation
+
+static inline uint64_t RMHeatmapTileKey(uint32_t x, uint32_t y, int zoom)
+{
+    return (uint64_t)zoom << 48 | (uint64_t)x << 24 | y;
+}
+
+static void RMHeatmapInvalidateTileKey(RMHeatmap *heatmap, uint64_t key)
+{
+    if ( ! RMHeatmapTableRemove(&heatmap->drawn, key))
+        return;
+
+    if (heatmap->invalidatedCount == heatmap->invalidatedCapacity)
+    {
+        size_t capacity = (heatmap->invalidatedCapacity ? 2 * heatmap->invalidatedCapacity : 64);
+        uint64_t *invalidated = realloc(heatmap->invalidated, capacity * sizeof(uint64_t));
+
+        // The tile stays drawn as far as anyone can tell, which is all that can be done
+        if ( ! invalidated)
+            return;
+
+        heatmap->invalidated = invalidated;
+        heatmap->invalidatedCapacity = capacity;
+    }
+
+    heatmap->invalidated[heatmap->invalidatedCount++] = key;
+}
+
+// Every drawn tile of the zoom level, or of all of them if zoom is negative
+static void RMHeatmapInvalidateLevel(RMHeatmap *heatmap, int zoom)
+{
+    size_t slot = 0;
+
+    // Removing a key may move another one back into its slot, so the slot is looked
+    // at again until it holds nothing to remove
+    while (heatmap->drawn.used && slot <= heatmap->drawn.mask)
+    {
+        uint64_t key = heatmap->drawn.keys[slot];
+
+        if (key != kRMHeatmapEmptyKey && (zoom < 0 || (int)(key >> 48) == zoom))
+            RMHeatmapInvalidateTileKey(heatmap, key);
+        else
+            slot++;
+    }
+}
+
+// The drawn tiles of the zoom level within reach of the bin
+static void RMHeatmapInvalidateTilesNearBin(RMHeatmap *heatmap, int64_t binX, int64_t binY, int zoom)
+{
+    int64_t lastTile = ((int64_t)1 << zoom) - 1;
+    int64_t firstX = (binX - heatmap->reach) / heatmap->binsPerTile, lastX = (binX + heatmap->reach) / heatmap->binsPerTile;
+    int64_t firstY = (binY - heatmap->reach) / heatmap->binsPerTile, lastY = (binY + heatmap->reach) / heatmap->binsPerTile;
+
+    if (binX < heatmap->reach)
+        firstX = 0;
+    if (binY < heatmap->reach)
+        firstY = 0;
+    if (lastX > lastTile)
+        lastX = lastTile;
+    if (lastY > lastTile)
+        lastY = lastTile;
+
+    for (int64_t y = firstY; y <= lastY; y++)
+        for (int64_t x = firstX; x <= lastX; x++)
+            RMHeatmapInvalidateTileKey(heatmap, RMHeatmapTileKey((uint32_t)x, (uint32_t)y, zoom));
+}
+
+#pragma mark - Bins
+
+static inline uint64_t RMHeatmapBinKey(int64_t x, int64_t y)
+{
+    return (uint64_t)x << 32 | (uint64_t)y;
+}
+
+// The bin of the point at the deepest zoom level, clamped to the planet
+static void RMHeatmapBinOfPoint(const RMHeatmap *heatmap, RMProjectedPoint point, int64_t *binX, int64_t *binY)
+{
+    const RMProjectedRect *planet = &heatmap->options.planetBounds;
+    int64_t bins = (int64_t)heatmap->binsPerTile << heatmap->options.maxZoom;
+    double binSize = planet->size.width / bins;
+    double x = floor((point.x - planet->origin.x) / binSize);
+    double y = floor((planet->origin.y + planet->size.height - point.y) / binSize);
+
+    *binX = (x < 0.0 ? 0 : (x >= bins ? bins - 1 : (int64_t)x));
+    *binY = (y < 0.0 ? 0 : (y >= bins ? bins - 1 : (int64_t)y));
+}
+
+static bool RMHeatmapBuildLevel(RMHeatmap *heatmap, int zoom)
+{
+    RMHeatmapLevel *level = &heatmap->levels[zoom];
+    const RMHeatmapTable *base = &heatmap->levels[heatmap->options.maxZoom].bins;
+    int shift = heatmap->options.maxZoom - zoom;
+
+    RMHeatmapTableClear(&level->bins);
+    level->maximumCount = 0;
+
+    for (size_t i = 0; base->keys && i <= base->mask; i++)
+    {
+        if (base->keys[i] == kRMHeatmapEmptyKey || base->counts[i] == 0)
+            continue;
+
+        int64_t x = (int64_t)(base->keys[i] >> 32) >> shift, y = (int64_t)(base->keys[i] & 0xffffffff) >> shift;
+        size_t slot = RMHeatmapTableInsert(&level->bins, RMHeatmapBinKey(x, y), true);
+
+        if (slot == SIZE_MAX)
+            return false;
+
+        level->bins.counts[slot] += base->counts[i];
+
+        if (level->bins.counts[slot] > level->maximumCount)
+            level->maximumCount = level->bins.counts[slot];
+    }
+
+    level->built = true;
+
+    return true;
+}
+
+// Add one point to the bin, or remove one, in every level kept up to date
+static bool RMHeatmapChangeBin(RMHeatmap *heatmap, int64_t binX, int64_t binY, bool adding)
+{
+    for (int zoom = heatmap->options.maxZoom; zoom >= 0; zoom--)
+    {
+        RMHeatmapLevel *level = &heatmap->levels[zoom];
+        int shift = heatmap->options.maxZoom - zoom;
+        int64_t x = binX >> shift, y = binY >> shift;
+
+        if (level->built)
+        {
+            uint64_t key = RMHeatmapBinKey(x, y);
+
+            if (adding)
+            {
+                size_t slot = RMHeatmapTableInsert(&level->bins, key, true);
+
+                if (slot == SIZE_MAX)
+                {
+                    // Made again from the deepest level when next drawn
+                    if (zoom == heatmap->options.maxZoom)
+                        return false;
+
+                    level->built = false;
+                    RMHeatmapInvalidateLevel(heatmap, zoom);
+                    continue;
+                }
+
+                if (++level->bins.counts[slot] > level->maximumCount)
+                {
+                    level->maximumCount = level->bins.counts[slot];
+                    RMHeatmapInvalidateLevel(heatmap, zoom);
+                }
+            }
+            else
+            {
+                size_t slot = RMHeatmapTableFind(&level->bins, key);
+
+                if (level->bins.keys[slot] == kRMHeatmapEmptyKey || level->bins.counts[slot] == 0)
+                    return false;
+
+                level->bins.counts[slot]--;
+            }
+        }
+
+        if (heatmap->drawn.used)
+            RMHeatmapInvalidateTilesNearBin(heatmap, x, y, zoom);
+    }
+
+    return true;
+}
+
+#pragma mark - Drawing
+
+// Blur the rows of counts across into columns columns, then those down into rows rows
+static void RMHeatmapBlur(RMHeatmap *heatmap, int rows, int columns)
+{
+    const float *kernel = heatmap->kernel;
+    int taps = 2 * heatmap->kernelHalfWidth + 1;
+    int countsWidth = columns + taps - 1;
+
+    for (int i = 0; i < rows + taps - 1; i++)
+    {
+        const float *in = heatmap->counts + i * countsWidth;
+        float *out = heatmap->blurredRows + i * columns;
+        int j = 0;
+
+#if RM_HEATMAP_VECTORS
+        for ( ; j + 4 <= columns; j += 4)
+        {
+            RMHeatmapVector sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+            for (int t = 0; t < taps; t++)
+            {
+                RMHeatmapVector v;
+
+                memcpy(&v, in + j + t, sizeof(v));
+                sum += kernel[t] * v;
+            }
+
+            memcpy(out + j, &sum, sizeof(sum));
+        }
+#endif
+
+        for ( ; j < columns; j++)
+        {
+            float sum = 0.0f;
+
+            for (int t = 0; t < taps; t++)
+                sum += kernel[t] * in[j + t];
+
+            out[j] = sum;
+        }
+    }
+
+    for (int i = 0; i < rows; i++)
+    {
+        float *out = heatmap->density + i * columns;
+        int j = 0;
+
+#if RM_HEATMAP_VECTORS
+        for ( ; j + 4 <= columns; j += 4)
+        {
+            RMHeatmapVector sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+            for (int t = 0; t < taps; t++)
+            {
+                RMHeatmapVector v;
+
+                memcpy(&v, heatmap->blurredRows + (i + t) * columns + j, sizeof(v));
+                sum += kernel[t] * v;
+            }
+
+            memcpy(out + j, &sum, sizeof(sum));
+        }
+#endif
+
+        for ( ; j < columns; j++)
+        {
+            float sum = 0.0f;
+
+            for (int t = 0; t < taps; t++)
+                sum += kernel[t] * heatmap->blurredRows[(i + t) * columns + j];
+
+            out[j] = sum;
+        }
+    }
+}
+
+static void RMHeatmapClearTile(const RMHeatmap *heatmap, uint8_t *pixels, size_t bytesPerRow)
+{
+    for (int y = 0; y < heatmap->options.tileSideLength; y++)
+        memset(pixels + y * bytesPerRow, 0, 4 * heatmap->options.tileSideLength);
+}
+
+#pragma mark -
+
+RMHeatmapOptions RMHeatmapDefaultOptions(void)
+{
+    RMHeatmapOptions options = {
+        RMProjectedRectMake(-kRMHeatmapDefaultPlanetHalfWidth, -kRMHeatmapDefaultPlanetHalfWidth, 2.0 * kRMHeatmapDefaultPlanetHalfWidth, 2.0 * kRMHeatmapDefaultPlanetHalfWidth),
+        256, 4, 12.0, 18
+    };
+
+    return options;
+}
+
+RMHeatmap *RMHeatmapCreate(const RMHeatmapOptions *options)
+{
+    if (options->tileSideLength <= 0 || options->binSize <= 0 || options->tileSideLength % options->binSize != 0 ||
+        options->radius <= 0.0 || options->maxZoom < 0 || options->maxZoom > kRMHeatmapMaximumZoom ||
+        options->planetBounds.size.width <= 0.0)
+        return NULL;
+
+    RMHeatmap *heatmap = calloc(1, sizeof(RMHeatmap));
+
+    if ( ! heatmap)
+        return NULL;
+
+    heatmap->options = *options;
+    heatmap->binsPerTile = options->tileSideLength / options->binSize;
+
+    double sigma = options->radius / options->binSize;
+    int halfWidth = (int)ceil(3.0 * sigma);
+
+    heatmap->kernelHalfWidth = halfWidth;
+    heatmap->reach = halfWidth + 1;
+
+    int side = heatmap->binsPerTile + 2; // the tile and one bin around it
+    int countsSide = side + 2 * halfWidth;
+
+    heatmap->kernel = malloc((2 * halfWidth + 1) * sizeof(float));
+    heatmap->counts = malloc(countsSide * countsSide * sizeof(float));
+    heatmap->blurredRows = malloc(countsSide * side * sizeof(float));
+    heatmap->density = malloc(side * side * sizeof(float));
+    heatmap->line = malloc(side * sizeof(float));
+    heatmap->pixelBin = malloc(options->tileSideLength * sizeof(int));
+    heatmap->pixelFraction = malloc(options->tileSideLength * sizeof(float));
+
+    if ( ! heatmap->kernel || ! heatmap->counts || ! heatmap->blurredRows || ! heatmap->density || ! heatmap->line ||
+        ! heatmap->pixelBin || ! heatmap->pixelFraction)
+    {
+        RMHeatmapDestroy(heatmap);
+        return NULL;
+    }
+
+    double sum = 0.0;
+
+    for (int t = -halfWidth; t <= halfWidth; t++)
+        sum += exp(-(t * t) / (2.0 * sigma * sigma));
+
+    for (int t = -halfWidth; t <= halfWidth; t++)
+        heatmap->kernel[t + halfWidth] = exp(-(t * t) / (2.0 * sigma * sigma)) / sum;
+
+    // The center of every pixel between the centers of two bins, the first one of the
+    // density being the bin left of the tile
+    for (int p = 0; p < options->tileSideLength; p++)
+    {
+        double u = (p + 0.5) / options->binSize + 0.5;
+
+        heatmap->pixelBin[p] = (int)floor(u);
+        heatmap->pixelFraction[p] = u - floor(u);
+    }
+
+    heatmap->levels[options->maxZoom].built = true;
+
+    RMRasterizerColor colors[] = {
+        { 0.0f, 0.0f, 1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f, 0.7f },
+        { 0.0f, 1.0f, 1.0f, 0.8f },
+        { 0.0f, 1.0f, 0.0f, 0.85f },
+        { 1.0f, 1.0f, 0.0f, 0.9f },
+        { 1.0f, 0.0f, 0.0f, 1.0f },
+    };
+
+    RMHeatmapSetColors(heatmap, colors, sizeof(colors) / sizeof(colors[0]));
+
+    return heatmap;
+}
+
+void RMHeatmapDestroy(RMHeatmap *heatmap)
+{
+    if ( ! heatmap)
+        return;
+
+    for (int zoom = 0; zoom <= kRMHeatmapMaximumZoom; zoom++)
+        RMHeatmapTableFree(&heatmap->levels[zoom].bins);
+
+    RMHeatmapTableFree(&heatmap->drawn);
+    free(heatmap->invalidated);
+    free(heatmap->kernel);
+    free(heatmap->counts);
+    free(heatmap->blurredRows);
+    free(heatmap->density);
+    free(heatmap->line);
+    free(heatmap->pixelBin);
+    free(heatmap->pixelFraction);
+    free(heatmap);
+}
+
+bool RMHeatmapAddPoints(RMHeatmap *heatmap, const RMProjectedPoint *points, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t x, y;
+
+        RMHeatmapBinOfPoint(heatmap, points[i], &x, &y);
+
+        if ( ! RMHeatmapChangeBin(heatmap, x, y, true))
+            return false;
+
+        heatmap->count++;
+    }
+
+    return true;
+}
+
+void RMHeatmapRemovePoints(RMHeatmap *heatmap, const RMProjectedPoint *points, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t x, y;
+
+        RMHeatmapBinOfPoint(heatmap, points[i], &x, &y);
+
+        // Checked against the deepest level first, which is always kept up to date
+        if (RMHeatmapTableCount(&heatmap->levels[heatmap->options.maxZoom].bins, RMHeatmapBinKey(x, y)) == 0)
+            continue;
+
+        RMHeatmapChangeBin(heatmap, x, y, false);
+        heatmap->count--;
+    }
+}
+
+void RMHeatmapRemoveAllPoints(RMHeatmap *heatmap)
+{
+    for (int zoom = 0; zoom <= heatmap->options.maxZoom; zoom++)
+    {
+        RMHeatmapLevel *level = &heatmap->levels[zoom];
+
+        RMHeatmapTableFree(&level->bins);
+        level->built = (zoom == heatmap->options.maxZoom);
+        level->maximumCount = 0;
+    }
+
+    heatmap->count = 0;
+
+    RMHeatmapInvalidateLevel(heatmap, -1);
+}
+
+size_t RMHeatmapPointCount(const RMHeatmap *heatmap)
+{
+    return heatmap->count;
+}
+
+void RMHeatmapSetColors(RMHeatmap *heatmap, const RMRasterizerColor *colors, size_t count)
+{
+    if (count < 2)
+        return;
+
+    for (int i = 0; i < 256; i++)
+    {
+        double position = i / 255.0 * (count - 1);
+        size_t first = (size_t)position;
+
+        if (first >= count - 1)
+            first = count - 2;
+
+        float fraction = (float)(position - first);
+        const RMRasterizerColor *a = &colors[first], *b = &colors[first + 1];
+        float alpha = a->alpha + (b->alpha - a->alpha) * fraction;
+        float components[3] = {
+            a->red + (b->red - a->red) * fraction,
+            a->green + (b->green - a->green) * fraction,
+            a->blue + (b->blue - a->blue) * fraction,
+        };
+
+        for (int c = 0; c < 3; c++)
+            heatmap->colormap[i][c] = (uint8_t)(components[c] * alpha * 255.0f + 0.5f);
+
+        heatmap->colormap[i][3] = (uint8_t)(alpha * 255.0f + 0.5f);
+    }
+
+    RMHeatmapInvalidateLevel(heatmap, -1);
+}
+
+bool RMHeatmapDrawTile(RMHeatmap *heatmap, uint32_t x, uint32_t y, int zoom, uint8_t *pixels, size_t bytesPerRow)
+{
+    if (zoom < 0 || zoom > heatmap->options.maxZoom || x >> zoom || y >> zoom)
+    {
+        RMHeatmapClearTile(heatmap, pixels, bytesPerRow);
+        return false;
+    }
+
+    RMHeatmapLevel *level = &heatmap->levels[zoom];
+
+    if (( ! level->built && ! RMHeatmapBuildLevel(heatmap, zoom)) ||
+        RMHeatmapTableInsert(&heatmap->drawn, RMHeatmapTileKey(x, y, zoom), false) == SIZE_MAX)
+    {
+        RMHeatmapClearTile(heatmap, pixels, bytesPerRow);
+        return false;
+    }
+
+    // The counts of the tile's bins and of those within reach around it
+    int binsPerTile = heatmap->binsPerTile;
+    int side = binsPerTile + 2;
+    int countsSide = side + 2 * heatmap->kernelHalfWidth;
+    int64_t bins = (int64_t)binsPerTile << zoom;
+    int64_t firstX = (int64_t)x * binsPerTile - heatmap->reach;
+    int64_t firstY = (int64_t)y * binsPerTile - heatmap->reach;
+    bool found = false;
+
+    for (int i = 0; i < countsSide; i++)
+    {
+        float *row = heatmap->counts + i * countsSide;
+        int64_t binY = firstY + i;
+
+        for (int j = 0; j < countsSide; j++)
+        {
+            int64_t binX = firstX + j;
+            uint32_t count = 0;
+
+            if (binY >= 0 && binY < bins && binX >= 0 && binX < bins)
+                count = RMHeatmapTableCount(&level->bins, RMHeatmapBinKey(binX, binY));
+
+            row[j] = count;
+            found |= (count != 0);
+        }
+    }
+
+    if ( ! found)
+    {
+        RMHeatmapClearTile(heatmap, pixels, bytesPerRow);
+        return false;
+    }
+
+    RMHeatmapBlur(heatmap, side, side);
+
+    // Scaled so that the fullest bin of the level, alone, reaches the top of the colormap
+    float center = heatmap->kernel[heatmap->kernelHalfWidth];
+    float scale = 255.0f / (level->maximumCount * center * center);
+
+    for (int py = 0; py < heatmap->options.tileSideLength; py++)
+    {
+        const float *above = heatmap->density + heatmap->pixelBin[py] * side;
+        const float *below = above + side;
+        float fraction = heatmap->pixelFraction[py];
+        float *line = heatmap->line;
+        uint8_t *out = pixels + py * bytesPerRow;
+        int j = 0;
+
+        // Between the rows of bins first, then along the line for every pixel
+#if RM_HEATMAP_VECTORS
+        for ( ; j + 4 <= side; j += 4)
+        {
+            RMHeatmapVector a, b;
+
+            memcpy(&a, above + j, sizeof(a));
+            memcpy(&b, below + j, sizeof(b));
+            a = (a + (b - a) * fraction) * scale;
+            memcpy(line + j, &a, sizeof(a));
+        }
+#endif
+
+        for ( ; j < side; j++)
+            line[j] = (above[j] + (below[j] - above[j]) * fraction) * scale;
+
+        for (int px = 0; px < heatmap->options.tileSideLength; px++)
+        {
+            int bin = heatmap->pixelBin[px];
+            float value = line[bin] + (line[bin + 1] - line[bin]) * heatmap->pixelFraction[px];
+            int index = (value >= 255.0f ? 255 : (value > 0.0f ? (int)(value + 0.5f) : 0));
+
+            memcpy(out + 4 * px, heatmap->colormap[index], 4);
+        }
+    }
+
+    return true;
+}
+
+size_t RMHeatmapTakeInvalidatedTiles(RMHeatmap *heatmap, RMHeatmapTileVisitor visitor, void *context)
+{
+    size_t count = heatmap->invalidatedCount;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t key = heatmap->invalidated[i];
+
+        visitor((uint32_t)(key >> 24) & 0xffffff, (uint32_t)key & 0xffffff, (int)(key >> 48), context);
+    }
+
+    heatmap->invalidatedCount = 0;
+
+    return count;
+}
@@ -0,0 +1,110 @@
+//
+//  RMHeatmap.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMHEATMAP_H_
+#define _RMHEATMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+#include "RMRasterizer.h"
+
+// Kernel density heatmap tiles of a set of points, such as annotations too many to
+// show as markers.
+//
+// Points are counted in square bins of a few pixels at the deepest zoom level, in a
+// hash table of the bins holding any. The bins of the other zoom levels are made from
+// those the first time a tile of the level is drawn, and kept up to date afterwards.
+// A tile is drawn from the counts of its bins and those around it within the reach of
+// the kernel: blurred by a Gaussian in two passes, one per axis, four bins at a time
+// with the vector extensions of GCC and Clang where available, then scaled up to the
+// tile and looked up in a colormap.
+//
+// The density is scaled so that the fullest bin of a level is at the top of the
+// colormap; the scale of a level only grows as points are added, until all of them
+// are removed.
+//
+// Tiles that were drawn and whose pixels have changed since, because points near them
+// were added or removed, are listed by RMHeatmapTakeInvalidatedTiles(), so that only
+// those have to be removed from a cache.
+//
+// Tiles are numbered as RMTile, y from the north. It does no locking of its own.
+
+typedef struct RMHeatmap RMHeatmap;
+
+typedef struct {
+    // The area of the zoom 0 tile, such as the planetBounds of RMProjection
+    RMProjectedRect planetBounds;
+    int tileSideLength;
+    // Pixels on the side of a bin, dividing tileSideLength
+    int binSize;
+    // Standard deviation of the kernel, in pixels
+    double radius;
+    // Deepest zoom level, at most 24
+    int maxZoom;
+} RMHeatmapOptions;
+
+typedef void (*RMHeatmapTileVisitor)(uint32_t x, uint32_t y, int zoom, void *context);
+
+// Options for 256 pixel spherical mercator tiles, 4 pixel bins and a 12 pixel radius,
+// zooms 0 to 18.
+RMHeatmapOptions RMHeatmapDefaultOptions(void);
+
+// Returns NULL if memory could not be allocated or the options are not valid.
+RMHeatmap *RMHeatmapCreate(const RMHeatmapOptions *options);
+
+void RMHeatmapDestroy(RMHeatmap *heatmap);
+
+// Returns false if memory could not be allocated, in which case some of the points
+// may have been added.
+bool RMHeatmapAddPoints(RMHeatmap *heatmap, const RMProjectedPoint *points, size_t count);
+
+// Remove points added before, at the same locations.
+void RMHeatmapRemovePoints(RMHeatmap *heatmap, const RMProjectedPoint *points, size_t count);
+
+void RMHeatmapRemoveAllPoints(RMHeatmap *heatmap);
+
+size_t RMHeatmapPointCount(const RMHeatmap *heatmap);
+
+// The colors from no density to the most, evenly spaced, with at least two colors.
+// The colormap is made of 256 steps between them. The default goes from clear to
+// blue, cyan, green, yellow and red.
+void RMHeatmapSetColors(RMHeatmap *heatmap, const RMRasterizerColor *colors, size_t count);
+
+// Write the tile into pixels, tileSideLength rows of RGBA with the alpha premultiplied
+// as with kCGImageAlphaPremultipliedLast. Returns false if there is no point near the
+// tile, in which case the pixels are all clear, or if memory could not be allocated.
+bool RMHeatmapDrawTile(RMHeatmap *heatmap, uint32_t x, uint32_t y, int zoom, uint8_t *pixels, size_t bytesPerRow);
+
+// Call visitor with every tile drawn whose pixels have changed since, and forget
+// them until they are drawn again. Returns the number of tiles visited.
+size_t RMHeatmapTakeInvalidatedTiles(RMHeatmap *heatmap, RMHeatmapTileVisitor visitor, void *context);
+
+#endif
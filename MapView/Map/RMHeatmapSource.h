@@ -0,0 +1,65 @@
+//
+//  RMHeatmapSource.h
+//  MapView
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#import "RMAbstractMercatorTileSource.h"
+
+@class RMAnnotation;
+
+// Posted on the main thread, with the source as object, once changed tiles are removed
+#define RMHeatmapSourceDidInvalidateTiles @"RMHeatmapSourceDidInvalidateTiles"
+
+// Heatmap tiles of the density of a set of points, for more annotations than can be
+// shown as markers or clusters. The density is counted and blurred by RMHeatmap.
+//
+// Tiles are kept in the memory cache only, since the points are not kept across
+// launches. When points are added or removed, the tiles they change are removed from
+// it in the background, and no others; call -[RMMapView reloadTileSource:] with it
+// when RMHeatmapSourceDidInvalidateTiles is posted to show them drawn again.
+
+@interface RMHeatmapSource : RMAbstractMercatorTileSource
+
+// radius is the standard deviation of the kernel in pixels, 12 by default.
+- (id)initWithRadius:(CGFloat)radius;
+
+- (void)addCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count;
+- (void)removeCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count;
+
+// The points are the projected locations of the annotations when they are added;
+// they must be removed before they are moved.
+- (void)addAnnotations:(NSArray *)annotations;
+- (void)removeAnnotations:(NSArray *)annotations;
+
+- (void)removeAllPoints;
+
+@property (nonatomic, readonly) NSUInteger pointCount;
+
+// The UIColors from no density to the most, evenly spaced. The default goes from clear
+// to blue, cyan, green, yellow and red.
+- (void)setGradientColors:(NSArray *)colors;
+
+@end
@@ -0,0 +1,339 @@
+//
+//  RMHeatmapSource.m
+//  MapView
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#import "RMHeatmapSource.h"
+
+#import "RMAnnotation.h"
+#import "RMTileCache.h"
+#import "RMProjection.h"
+#import "RMHeatmap.h"
+
+#define kDefaultHeatmapRadius 12.0 // px
+
+static void RMHeatmapSourceCollectTile(uint32_t x, uint32_t y, int zoom, void *context)
+{
+    RMTile tile = RMTileMake(x, y, zoom);
+
+    [(NSMutableData *)context appendBytes:&tile length:sizeof(RMTile)];
+}
+
+#pragma mark -
+
+@implementation RMHeatmapSource
+{
+    RMHeatmap *_heatmap;
+
+    // The cache the tiles were last added to, to remove them from when they change
+    RMTileCache *_tileCache;
+    NSString *_uniqueTilecacheKey;
+
+    // Removes the changed tiles from the cache, in the order of the changes
+    dispatch_queue_t _invalidationQueue;
+}
+
+- (id)init
+{
+    return [self initWithRadius:kDefaultHeatmapRadius];
+}
+
+- (id)initWithRadius:(CGFloat)radius
+{
+    if (!(self = [super init]))
+        return nil;
+
+    RMHeatmapOptions options = RMHeatmapDefaultOptions();
+    options.planetBounds = self.projection.planetBounds;
+    options.tileSideLength = self.tileSideLength;
+    options.radius = radius;
+    options.maxZoom = self.maxZoom;
+
+    _heatmap = RMHeatmapCreate(&options);
+
+    if ( ! _heatmap)
+    {
+        [self release];
+        return nil;
+    }
+
+    CFUUIDRef uuid = CFUUIDCreate(NULL);
+    NSString *uuidString = (NSString *)CFUUIDCreateString(NULL, uuid);
+    CFRelease(uuid);
+
+    _uniqueTilecacheKey = [[NSString alloc] initWithFormat:@"RMHeatmapSource-%@", uuidString];
+    [uuidString release];
+
+    _invalidationQueue = dispatch_queue_create("routeme.heatmapInvalidationQueue", DISPATCH_QUEUE_SERIAL);
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_invalidationQueue)
+    {
+        dispatch_release(_invalidationQueue); _invalidationQueue = NULL;
+    }
+
+    RMHeatmapDestroy(_heatmap); _heatmap = NULL;
+    [_tileCache release]; _tileCache = nil;
+    [_uniqueTilecacheKey release]; _uniqueTilecacheKey = nil;
+    [super dealloc];
+}
+
+#pragma mark -
+
+// Called with the lock held. The tiles are removed in one batch in the background, and
+// only from the memory cache, which is the only one they are added to.
+- (void)removeInvalidatedTiles
+{
+    NSMutableData *tiles = [NSMutableData data];
+
+    RMHeatmapTakeInvalidatedTiles(_heatmap, RMHeatmapSourceCollectTile, tiles);
+
+    if ([tiles length] == 0 || ! _tileCache)
+        return;
+
+    RMTileCache *tileCache = _tileCache;
+    NSString *cacheKey = _uniqueTilecacheKey;
+
+    dispatch_async(_invalidationQueue, ^{
+        [tileCache removeImagesFromMemoryCacheForTiles:[tiles bytes] count:[tiles length] / sizeof(RMTile) withCacheKey:cacheKey];
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:RMHeatmapSourceDidInvalidateTiles object:self];
+        });
+    });
+}
+
+- (void)changePoints:(const RMProjectedPoint *)points count:(NSUInteger)count adding:(BOOL)adding
+{
+    @synchronized (self)
+    {
+        if (adding)
+        {
+            if ( ! RMHeatmapAddPoints(_heatmap, points, count))
+                RMLog(@"could not add all the points to the heatmap");
+        }
+        else
+        {
+            RMHeatmapRemovePoints(_heatmap, points, count);
+        }
+
+        [self removeInvalidatedTiles];
+    }
+}
+
+- (void)changeCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count adding:(BOOL)adding
+{
+    RMProjectedPoint *points = malloc(count * sizeof(RMProjectedPoint));
+
+    if ( ! points)
+        return;
+
+    RMProjection *projection = self.projection;
+
+    for (NSUInteger i = 0; i < count; i++)
+        points[i] = [projection coordinateToProjectedPoint:coordinates[i]];
+
+    [self changePoints:points count:count adding:adding];
+
+    free(points);
+}
+
+- (void)changeAnnotations:(NSArray *)annotations adding:(BOOL)adding
+{
+    NSUInteger count = [annotations count];
+    RMProjectedPoint *points = malloc(count * sizeof(RMProjectedPoint));
+
+    if ( ! points)
+        return;
+
+    NSUInteger i = 0;
+
+    for (RMAnnotation *annotation in annotations)
+        points[i++] = annotation.projectedLocation;
+
+    [self changePoints:points count:count adding:adding];
+
+    free(points);
+}
+
+- (void)addCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count
+{
+    [self changeCoordinates:coordinates count:count adding:YES];
+}
+
+- (void)removeCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count
+{
+    [self changeCoordinates:coordinates count:count adding:NO];
+}
+
+- (void)addAnnotations:(NSArray *)annotations
+{
+    [self changeAnnotations:annotations adding:YES];
+}
+
+- (void)removeAnnotations:(NSArray *)annotations
+{
+    [self changeAnnotations:annotations adding:NO];
+}
+
+- (void)removeAllPoints
+{
+    @synchronized (self)
+    {
+        RMHeatmapRemoveAllPoints(_heatmap);
+        [self removeInvalidatedTiles];
+    }
+}
+
+- (NSUInteger)pointCount
+{
+    @synchronized (self)
+    {
+        return RMHeatmapPointCount(_heatmap);
+    }
+}
+
+- (void)setGradientColors:(NSArray *)colors
+{
+    NSUInteger count = [colors count];
+
+    if (count < 2)
+        return;
+
+    RMRasterizerColor *rasterizerColors = malloc(count * sizeof(RMRasterizerColor));
+
+    if ( ! rasterizerColors)
+        return;
+
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        CGFloat red = 0.0, green = 0.0, blue = 0.0, alpha = 0.0;
+
+        if ( ! [[colors objectAtIndex:i] getRed:&red green:&green blue:&blue alpha:&alpha])
+            alpha = 0.0;
+
+        rasterizerColors[i].red = red;
+        rasterizerColors[i].green = green;
+        rasterizerColors[i].blue = blue;
+        rasterizerColors[i].alpha = alpha;
+    }
+
+    @synchronized (self)
+    {
+        RMHeatmapSetColors(_heatmap, rasterizerColors, count);
+        [self removeInvalidatedTiles];
+    }
+
+    free(rasterizerColors);
+}
+
+#pragma mark -
+
+- (UIImage *)imageForTile:(RMTile)tile inCache:(RMTileCache *)tileCache
+{
+    if (tile.zoom < 0 || tile.zoom > self.maxZoom)
+        return nil;
+
+    UIImage *image = nil;
+
+    tile = [[self mercatorToTileProjection] normaliseTile:tile];
+    image = [tileCache cachedImage:tile withCacheKey:[self uniqueTilecacheKey]];
+
+    if (image)
+        return image;
+
+    size_t sideLength = self.tileSideLength;
+    size_t bytesPerRow = sideLength * 4;
+    uint8_t *pixels = malloc(sideLength * bytesPerRow);
+
+    if ( ! pixels)
+        return nil;
+
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+
+    // Cached with the lock held, so that points changed meanwhile remove it afterwards
+    @synchronized (self)
+    {
+        if (tileCache != _tileCache)
+        {
+            [_tileCache release];
+            _tileCache = [tileCache retain];
+        }
+
+        RMHeatmapDrawTile(_heatmap, tile.x, tile.y, tile.zoom, pixels, bytesPerRow);
+
+        // Blank tiles are made and cached too, as no image would have the tile asked again
+        CGContextRef context = CGBitmapContextCreate(pixels, sideLength, sideLength, 8, bytesPerRow, colorSpace, kCGImageAlphaPremultipliedLast);
+
+        if (context)
+        {
+            CGImageRef imageRef = CGBitmapContextCreateImage(context);
+            image = [UIImage imageWithCGImage:imageRef];
+            CGImageRelease(imageRef);
+            CGContextRelease(context);
+        }
+
+        // Not on disk, where the tiles of points that are not kept would be left behind
+        if (image)
+            [tileCache addImageToMemoryCache:image forTile:tile withCacheKey:[self uniqueTilecacheKey]];
+    }
+
+    CGColorSpaceRelease(colorSpace);
+    free(pixels);
+
+    return image;
+}
+
+- (NSString *)uniqueTilecacheKey
+{
+    return _uniqueTilecacheKey;
+}
+
+- (NSString *)shortName
+{
+    return @"Heatmap";
+}
+
+- (NSString *)longDescription
+{
+    return [self shortName];
+}
+
+- (NSString *)shortAttribution
+{
+    return @"n/a";
+}
+
+- (NSString *)longAttribution
+{
+    return @"n/a";
+}
+
+@end
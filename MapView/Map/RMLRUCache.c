@@ -0,0 +1,574 @@
+//
+//  RMLRUCache.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "RMLRUCache.h"
+#include "RMCacheKey.h"
+#include "RMFrequencySketch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define kRMLRUCacheInitialBuckets 64
+
+// Share of the limits given to the admission window under W-TinyLFU. Tile requests
+// are strongly biased to recency, as panning brings back the tiles just left, so the
+// window is much larger than the 1% usual for other workloads.
+#define kRMLRUCacheWindowPercent 20
+
+// Keys tracked by the frequency sketch per cache entry. A fast pan requests many
+// times the cache's capacity in new tiles, and the counts of the tiles in regular
+// use have to outlast it.
+#define kRMLRUCacheSketchScale 16
+
+typedef struct RMLRUCacheEntry {
+    struct RMLRUCacheEntry *hashNext;
+    struct RMLRUCacheEntry *prev; // towards the most recently used end
+    struct RMLRUCacheEntry *next; // towards the least recently used end
+    uint64_t tileKey;
+    uint64_t hash;
+    void *value;
+    size_t cost;
+    unsigned char referenced;
+    unsigned char inWindow;
+    char cacheKey[];
+} RMLRUCacheEntry;
+
+typedef struct {
+    RMLRUCacheEntry *head; // most recently used
+    RMLRUCacheEntry *tail; // least recently used
+    size_t count;
+    size_t cost;
+} RMLRUCacheList;
+
+struct RMLRUCache {
+    RMLRUCacheEntry **buckets;
+    size_t bucketMask;
+
+    // Without an admission policy every entry is on the main list. With W-TinyLFU
+    // new entries start on the window list and have to win against the main
+    // list's eviction victim to move over.
+    RMLRUCacheList main;
+    RMLRUCacheList window;
+
+    size_t countLimit;
+    size_t costLimit;
+
+    RMLRUCacheAdmission admission;
+    RMFrequencySketch *sketch;
+
+    RMLRUCacheCallbacks callbacks;
+};
+
+#pragma mark -
+
+static RMLRUCacheEntry **RMLRUCacheFindSlot(RMLRUCache *cache, uint64_t hash, uint64_t tileKey, const char *cacheKey)
+{
+    RMLRUCacheEntry **slot = &cache->buckets[hash & cache->bucketMask];
+
+    while (*slot)
+    {
+        RMLRUCacheEntry *entry = *slot;
+
+        if (entry->hash == hash && entry->tileKey == tileKey && strcmp(entry->cacheKey, cacheKey) == 0)
+            break;
+
+        slot = &entry->hashNext;
+    }
+
+    return slot;
+}
+
+static RMLRUCacheEntry **RMLRUCacheSlotForEntry(RMLRUCache *cache, RMLRUCacheEntry *entry)
+{
+    RMLRUCacheEntry **slot = &cache->buckets[entry->hash & cache->bucketMask];
+
+    while (*slot != entry)
+        slot = &(*slot)->hashNext;
+
+    return slot;
+}
+
+static RMLRUCacheList *RMLRUCacheListForEntry(RMLRUCache *cache, RMLRUCacheEntry *entry)
+{
+    return (entry->inWindow ? &cache->window : &cache->main);
+}
+
+static void RMLRUCacheUnlinkEntry(RMLRUCache *cache, RMLRUCacheEntry *entry)
+{
+    RMLRUCacheList *list = RMLRUCacheListForEntry(cache, entry);
+
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        list->head = entry->next;
+
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        list->tail = entry->prev;
+
+    entry->prev = entry->next = NULL;
+
+    list->count--;
+    list->cost -= entry->cost;
+}
+
+static void RMLRUCacheLinkEntryAtHead(RMLRUCache *cache, RMLRUCacheEntry *entry)
+{
+    RMLRUCacheList *list = RMLRUCacheListForEntry(cache, entry);
+
+    entry->prev = NULL;
+    entry->next = list->head;
+
+    if (list->head)
+        list->head->prev = entry;
+    else
+        list->tail = entry;
+
+    list->head = entry;
+
+    list->count++;
+    list->cost += entry->cost;
+}
+
+static void RMLRUCacheMoveEntryToHead(RMLRUCache *cache, RMLRUCacheEntry *entry)
+{
+    if (entry == RMLRUCacheListForEntry(cache, entry)->head)
+        return;
+
+    RMLRUCacheUnlinkEntry(cache, entry);
+    RMLRUCacheLinkEntryAtHead(cache, entry);
+}
+
+// Unlink the entry from both the hash chain at slot and its list, and free it.
+static void RMLRUCacheDeleteEntry(RMLRUCache *cache, RMLRUCacheEntry **slot)
+{
+    RMLRUCacheEntry *entry = *slot;
+
+    *slot = entry->hashNext;
+    RMLRUCacheUnlinkEntry(cache, entry);
+
+    if (cache->callbacks.release)
+        cache->callbacks.release(entry->value);
+
+    free(entry);
+}
+
+static void RMLRUCacheGrow(RMLRUCache *cache)
+{
+    size_t bucketCount = (cache->bucketMask + 1) * 2;
+    RMLRUCacheEntry **buckets = calloc(bucketCount, sizeof(RMLRUCacheEntry *));
+
+    // Not fatal, the chains just get longer.
+    if ( ! buckets)
+        return;
+
+    for (size_t i = 0; i <= cache->bucketMask; i++)
+    {
+        RMLRUCacheEntry *entry = cache->buckets[i];
+
+        while (entry)
+        {
+            RMLRUCacheEntry *next = entry->hashNext;
+            size_t bucket = entry->hash & (bucketCount - 1);
+
+            entry->hashNext = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucketMask = bucketCount - 1;
+}
+
+// The main list entry to evict next. Second chance: referenced entries move back
+// to the head. Each is cleared on the way, so this ends after at most one pass.
+static RMLRUCacheEntry *RMLRUCacheMainVictim(RMLRUCache *cache)
+{
+    RMLRUCacheEntry *entry = cache->main.tail;
+
+    while (entry && entry->referenced && entry != cache->main.head)
+    {
+        entry->referenced = 0;
+        RMLRUCacheMoveEntryToHead(cache, entry);
+        entry = cache->main.tail;
+    }
+
+    return entry;
+}
+
+static bool RMLRUCacheIsOverLimit(RMLRUCache *cache)
+{
+    size_t count = cache->main.count + cache->window.count;
+    size_t cost = cache->main.cost + cache->window.cost;
+
+    return (cache->costLimit && cost > cache->costLimit) || (cache->countLimit && count > cache->countLimit);
+}
+
+static bool RMLRUCacheIsWindowOverLimit(RMLRUCache *cache)
+{
+    // The window always keeps the entry just added.
+    if (cache->window.count <= 1)
+        return false;
+
+    return (cache->costLimit && cache->window.cost > cache->costLimit * kRMLRUCacheWindowPercent / 100) ||
+           (cache->countLimit && cache->window.count > cache->countLimit * kRMLRUCacheWindowPercent / 100);
+}
+
+// W-TinyLFU: entries leaving the window move to the main list, where the more
+// frequently used of the candidate and the main list's victim stays.
+static void RMLRUCacheAdmitFromWindow(RMLRUCache *cache)
+{
+    while (RMLRUCacheIsWindowOverLimit(cache))
+    {
+        RMLRUCacheEntry *candidate = cache->window.tail;
+        unsigned int candidateFrequency = RMFrequencySketchEstimate(cache->sketch, candidate->hash);
+
+        RMLRUCacheUnlinkEntry(cache, candidate);
+        candidate->inWindow = 0;
+        RMLRUCacheLinkEntryAtHead(cache, candidate);
+
+        while (RMLRUCacheIsOverLimit(cache))
+        {
+            RMLRUCacheEntry *victim = RMLRUCacheMainVictim(cache);
+
+            if (victim != candidate && candidateFrequency > RMFrequencySketchEstimate(cache->sketch, victim->hash))
+            {
+                RMLRUCacheDeleteEntry(cache, RMLRUCacheSlotForEntry(cache, victim));
+            }
+            else
+            {
+                RMLRUCacheDeleteEntry(cache, RMLRUCacheSlotForEntry(cache, candidate));
+                break;
+            }
+        }
+    }
+}
+
+static void RMLRUCacheTrim(RMLRUCache *cache)
+{
+    if (cache->admission == RMLRUCacheAdmissionTinyLFU)
+        RMLRUCacheAdmitFromWindow(cache);
+
+    while (RMLRUCacheIsOverLimit(cache) && RMLRUCacheEvictOldest(cache))
+        ;
+}
+
+static void RMLRUCacheRecordAccess(RMLRUCache *cache, uint64_t hash)
+{
+    if (cache->sketch)
+        RMFrequencySketchIncrement(cache->sketch, hash);
+}
+
+#pragma mark -
+
+RMLRUCache *RMLRUCacheCreate(size_t costLimit, size_t countLimit, const RMLRUCacheCallbacks *callbacks)
+{
+    RMLRUCache *cache = calloc(1, sizeof(RMLRUCache));
+
+    if ( ! cache)
+        return NULL;
+
+    cache->buckets = calloc(kRMLRUCacheInitialBuckets, sizeof(RMLRUCacheEntry *));
+
+    if ( ! cache->buckets)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    cache->bucketMask = kRMLRUCacheInitialBuckets - 1;
+    cache->costLimit = costLimit;
+    cache->countLimit = countLimit;
+    cache->admission = RMLRUCacheAdmissionAlways;
+
+    if (callbacks)
+        cache->callbacks = *callbacks;
+
+    return cache;
+}
+
+void RMLRUCacheDestroy(RMLRUCache *cache)
+{
+    if ( ! cache)
+        return;
+
+    RMLRUCacheRemoveAll(cache);
+    RMFrequencySketchDestroy(cache->sketch);
+
+    free(cache->buckets);
+    free(cache);
+}
+
+bool RMLRUCacheSetAdmission(RMLRUCache *cache, RMLRUCacheAdmission admission, size_t expectedEntries)
+{
+    if (admission == RMLRUCacheAdmissionTinyLFU)
+    {
+        RMFrequencySketch *sketch = RMFrequencySketchCreate((expectedEntries ? expectedEntries : cache->countLimit) * kRMLRUCacheSketchScale);
+
+        if ( ! sketch)
+            return false;
+
+        RMFrequencySketchDestroy(cache->sketch);
+        cache->sketch = sketch;
+    }
+    else
+    {
+        // Everything still in the window is the most recently added, so it goes to the head.
+        while (cache->window.tail)
+        {
+            RMLRUCacheEntry *entry = cache->window.tail;
+
+            RMLRUCacheUnlinkEntry(cache, entry);
+            entry->inWindow = 0;
+            RMLRUCacheLinkEntryAtHead(cache, entry);
+        }
+
+        RMFrequencySketchDestroy(cache->sketch);
+        cache->sketch = NULL;
+    }
+
+    cache->admission = admission;
+
+    return true;
+}
+
+void *RMLRUCacheGet(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey)
+{
+    uint64_t hash = RMCacheKeyHash(tileKey, cacheKey);
+    RMLRUCacheEntry *entry = *RMLRUCacheFindSlot(cache, hash, tileKey, cacheKey);
+
+    RMLRUCacheRecordAccess(cache, hash);
+
+    if ( ! entry)
+        return NULL;
+
+    RMLRUCacheMoveEntryToHead(cache, entry);
+
+    return entry->value;
+}
+
+void *RMLRUCachePeek(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey)
+{
+    RMLRUCacheEntry *entry = *RMLRUCacheFindSlot(cache, RMCacheKeyHash(tileKey, cacheKey), tileKey, cacheKey);
+
+    return (entry ? entry->value : NULL);
+}
+
+void *RMLRUCacheGetShared(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey)
+{
+    uint64_t hash = RMCacheKeyHash(tileKey, cacheKey);
+    RMLRUCacheEntry *entry = *RMLRUCacheFindSlot(cache, hash, tileKey, cacheKey);
+
+    RMLRUCacheRecordAccess(cache, hash);
+
+    if ( ! entry)
+        return NULL;
+
+    // Concurrent readers may all store the flag, test first to keep the cache line shared.
+    if ( ! __atomic_load_n(&entry->referenced, __ATOMIC_RELAXED))
+        __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+
+    return entry->value;
+}
+
+bool RMLRUCachePut(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey, void *value, size_t cost)
+{
+    if (cache->costLimit && cost > cache->costLimit)
+        return false;
+
+    uint64_t hash = RMCacheKeyHash(tileKey, cacheKey);
+    RMLRUCacheEntry **slot = RMLRUCacheFindSlot(cache, hash, tileKey, cacheKey);
+    RMLRUCacheEntry *entry = *slot;
+
+    if (cache->callbacks.retain)
+        value = cache->callbacks.retain(value);
+
+    if (entry)
+    {
+        // Replace in place, the key does not change.
+        void *oldValue = entry->value;
+
+        RMLRUCacheUnlinkEntry(cache, entry);
+        entry->value = value;
+        entry->cost = cost;
+        RMLRUCacheLinkEntryAtHead(cache, entry);
+
+        if (cache->callbacks.release)
+            cache->callbacks.release(oldValue);
+    }
+    else
+    {
+        size_t keyLength = strlen(cacheKey);
+
+        entry = malloc(sizeof(RMLRUCacheEntry) + keyLength + 1);
+
+        if ( ! entry)
+        {
+            if (cache->callbacks.release)
+                cache->callbacks.release(value);
+
+            return false;
+        }
+
+        entry->tileKey = tileKey;
+        entry->hash = hash;
+        entry->value = value;
+        entry->cost = cost;
+        entry->referenced = 0;
+        entry->inWindow = (cache->admission == RMLRUCacheAdmissionTinyLFU);
+        memcpy(entry->cacheKey, cacheKey, keyLength + 1);
+
+        entry->hashNext = NULL;
+        *slot = entry;
+        RMLRUCacheLinkEntryAtHead(cache, entry);
+
+        if (cache->main.count + cache->window.count > cache->bucketMask + 1)
+            RMLRUCacheGrow(cache);
+    }
+
+    // The new entry is at the head of its list, so it is the last candidate for
+    // eviction and, as its cost fits the limit, it survives the trim. Under
+    // W-TinyLFU it may still lose against more frequently used entries later,
+    // when it leaves the window.
+    RMLRUCacheTrim(cache);
+
+    return true;
+}
+
+bool RMLRUCacheRemove(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey)
+{
+    RMLRUCacheEntry **slot = RMLRUCacheFindSlot(cache, RMCacheKeyHash(tileKey, cacheKey), tileKey, cacheKey);
+
+    if ( ! *slot)
+        return false;
+
+    RMLRUCacheDeleteEntry(cache, slot);
+
+    return true;
+}
+
+size_t RMLRUCacheRemoveTile(RMLRUCache *cache, uint64_t tileKey)
+{
+    // The cache key is part of the hash, so the entries for one tile are spread
+    // over the table. Different cache keys per tile are rare, walk the lists.
+    RMLRUCacheList *lists[] = { &cache->window, &cache->main };
+    size_t removed = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        RMLRUCacheEntry *entry = lists[i]->head;
+
+        while (entry)
+        {
+            RMLRUCacheEntry *next = entry->next;
+
+            if (entry->tileKey == tileKey)
+            {
+                RMLRUCacheDeleteEntry(cache, RMLRUCacheSlotForEntry(cache, entry));
+                removed++;
+            }
+
+            entry = next;
+        }
+    }
+
+    return removed;
+}
+
+bool RMLRUCacheEvictOldest(RMLRUCache *cache)
+{
+    RMLRUCacheEntry *entry = RMLRUCacheMainVictim(cache);
+
+    if ( ! entry)
+        entry = cache->window.tail;
+
+    if ( ! entry)
+        return false;
+
+    RMLRUCacheDeleteEntry(cache, RMLRUCacheSlotForEntry(cache, entry));
+
+    return true;
+}
+
+bool RMLRUCachePeekOldest(RMLRUCache *cache, uint64_t *tileKey, const char **cacheKey)
+{
+    RMLRUCacheEntry *entry = (cache->main.tail ? cache->main.tail : cache->window.tail);
+
+    if ( ! entry)
+        return false;
+
+    *tileKey = entry->tileKey;
+    *cacheKey = entry->cacheKey;
+
+    return true;
+}
+
+void RMLRUCacheRemoveAll(RMLRUCache *cache)
+{
+    RMLRUCacheList *lists[] = { &cache->window, &cache->main };
+
+    for (int i = 0; i < 2; i++)
+    {
+        RMLRUCacheEntry *entry = lists[i]->head;
+
+        while (entry)
+        {
+            RMLRUCacheEntry *next = entry->next;
+
+            if (cache->callbacks.release)
+                cache->callbacks.release(entry->value);
+
+            free(entry);
+            entry = next;
+        }
+
+        memset(lists[i], 0, sizeof(RMLRUCacheList));
+    }
+
+    memset(cache->buckets, 0, (cache->bucketMask + 1) * sizeof(RMLRUCacheEntry *));
+}
+
+void RMLRUCacheSetLimits(RMLRUCache *cache, size_t costLimit, size_t countLimit)
+{
+    cache->costLimit = costLimit;
+    cache->countLimit = countLimit;
+
+    RMLRUCacheTrim(cache);
+}
+
+size_t RMLRUCacheCount(const RMLRUCache *cache)
+{
+    return cache->main.count + cache->window.count;
+}
+
+size_t RMLRUCacheTotalCost(const RMLRUCache *cache)
+{
+    return cache->main.cost + cache->window.cost;
+}
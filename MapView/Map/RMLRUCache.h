@@ -0,0 +1,119 @@
+//
+//  RMLRUCache.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _RMLRUCACHE_H_
+#define _RMLRUCACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A least-recently-used cache of opaque values keyed by a tile key (see RMTileKey())
+// and a cache key string. Lookups, insertions and evictions are O(1): entries live in
+// a chained hash table and on an intrusive doubly-linked list ordered by last use.
+//
+// The cache is bounded by a total cost, typically the decoded size of the tile images
+// in bytes, and optionally by an entry count. It does no locking of its own.
+//
+// Optionally the cache can use the W-TinyLFU admission policy, which keeps tiles that
+// were requested often from being flushed by a burst of tiles requested only once,
+// such as a fast pan across a continent.
+
+typedef struct RMLRUCache RMLRUCache;
+
+// Value ownership callbacks. The cache calls retain when a value is inserted and
+// release when it is removed, replaced or evicted. Either may be NULL.
+typedef struct {
+    void *(*retain)(void *value);
+    void (*release)(void *value);
+} RMLRUCacheCallbacks;
+
+typedef enum {
+    // Every inserted entry is kept, evicting the least recently used ones as needed.
+    RMLRUCacheAdmissionAlways,
+    // W-TinyLFU: new entries go to an LRU window (20% of the limits). An entry
+    // leaving the window only replaces the least recently used entry of the rest of
+    // the cache if its key was looked up more often recently, as estimated by an
+    // RMFrequencySketch fed by RMLRUCacheGet() and RMLRUCacheGetShared().
+    RMLRUCacheAdmissionTinyLFU,
+} RMLRUCacheAdmission;
+
+// Create a cache holding at most costLimit total cost and at most countLimit entries.
+// A limit of 0 means unlimited. Returns NULL if memory could not be allocated.
+RMLRUCache *RMLRUCacheCreate(size_t costLimit, size_t countLimit, const RMLRUCacheCallbacks *callbacks);
+
+// Release all values and free the cache.
+void RMLRUCacheDestroy(RMLRUCache *cache);
+
+// Change the admission policy. expectedEntries, the number of entries the cache is
+// expected to hold, sizes the frequency sketch of W-TinyLFU, 0 meaning the count
+// limit. Returns false if memory could not be allocated.
+bool RMLRUCacheSetAdmission(RMLRUCache *cache, RMLRUCacheAdmission admission, size_t expectedEntries);
+
+// Return the value for the key and mark it most recently used, or NULL if it is not
+// cached. The value is not retained; it stays valid until the entry is removed.
+void *RMLRUCacheGet(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey);
+
+// Return the value without changing its position in the LRU order.
+void *RMLRUCachePeek(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey);
+
+// Return the value without reordering, but mark it referenced so that eviction gives
+// it a second chance (CLOCK) instead of removing it. Unlike RMLRUCacheGet() this may
+// run concurrently with other lookups, under a shared lock; it must still not overlap
+// calls that modify the cache.
+void *RMLRUCacheGetShared(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey);
+
+// Insert or replace the value for the key, then evict least recently used entries
+// until the cache is within its limits again. Returns false, leaving the cache
+// unchanged, if the cost alone exceeds the cost limit or memory could not be allocated.
+bool RMLRUCachePut(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey, void *value, size_t cost);
+
+// Remove the value for the key. Returns true if an entry was removed.
+bool RMLRUCacheRemove(RMLRUCache *cache, uint64_t tileKey, const char *cacheKey);
+
+// Remove every entry for the tile key, whatever its cache key. Returns the number removed.
+size_t RMLRUCacheRemoveTile(RMLRUCache *cache, uint64_t tileKey);
+
+// Remove the least recently used entry, skipping (and clearing) the ones marked by
+// RMLRUCacheGetShared() since they were last considered. Returns false if the cache is empty.
+bool RMLRUCacheEvictOldest(RMLRUCache *cache);
+
+// The key of the least recently used entry, without the second chance given by
+// RMLRUCacheEvictOldest(). The cache key stays valid until the entry is removed.
+// Returns false if the cache is empty.
+bool RMLRUCachePeekOldest(RMLRUCache *cache, uint64_t *tileKey, const char **cacheKey);
+
+// Remove every entry.
+void RMLRUCacheRemoveAll(RMLRUCache *cache);
+
+// Change the limits, evicting entries as needed. A limit of 0 means unlimited.
+void RMLRUCacheSetLimits(RMLRUCache *cache, size_t costLimit, size_t countLimit);
+
+size_t RMLRUCacheCount(const RMLRUCache *cache);
+size_t RMLRUCacheTotalCost(const RMLRUCache *cache);
+
+#endif
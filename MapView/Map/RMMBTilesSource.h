@@ -63,4 +63,11 @@
 /** Any available HTML-formatted map legend data for the tile source, suitable for display in a UIWebView. */
 - (NSString *)legend;
 
+/** @name Reading Tiles in Bulk */
+
+/** Read the tiles of a rectangle with one index range scan per column on a single connection, rather than with a query per tile.
+*   @param tileRect The tiles to read, rounded out to whole tiles.
+*   @return The encoded image data of every tile found, keyed by its RMTileKey() as an NSNumber. */
+- (NSDictionary *)tileDataInRect:(RMTileRect)tileRect;
+
 @end
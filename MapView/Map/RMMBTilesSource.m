@@ -38,10 +38,79 @@
 
 #import "FMDatabase.h"
 #import "FMDatabaseQueue.h"
+#import "RMSQLiteReaderPool.h"
+
+#include <sys/stat.h>
+
+// Tile reads go through a pool of read-only connections with up to this much of the file mapped
+#define kMBTilesMemoryMapSize (128 * 1024 * 1024)
+
+static const char kMBTilesTileQuery[] = "select tile_data from tiles where zoom_level = ? and tile_column = ? and tile_row = ?";
+static const char kMBTilesTileRangeQuery[] = "select tile_row, tile_data from tiles where zoom_level = ? and tile_column = ? and tile_row between ? and ? order by tile_row";
+
+// The metadata is read at open, and read again only if the file has been modified,
+// which is checked at most this often (in seconds)
+#define kMBTilesMetadataCheckInterval 5.0
+
+// The metadata table and the zoom range of the tiles, which never change while the file does not
+typedef struct {
+    float minZoom, maxZoom;
+    RMSphericalTrapezium bounds;
+    NSString *name;
+    NSString *description;
+    NSString *attribution;
+    NSString *legend;
+} RMMBTilesMetadata;
+
+// MBTiles numbers rows from the south (TMS), RMTile from the north
+static inline int64_t RMMBTilesRow(uint32_t y, short zoom)
+{
+    return ((int64_t)1 << zoom) - 1 - y;
+}
+
+static void RMMBTilesAddTileData(NSMutableDictionary *tileData, RMTile tile, sqlite3_stmt *statement, int column)
+{
+    NSData *data = [NSData dataWithBytes:sqlite3_column_blob(statement, column) length:sqlite3_column_bytes(statement, column)];
+
+    [tileData setObject:data forKey:[NSNumber numberWithUnsignedLongLong:RMTileKey(tile)]];
+}
+
+// Read the tiles of zoom between the given columns and rows. Every column is one range
+// of the (zoom_level, tile_column, tile_row) index: SQLite would not seek to the rows
+// of each column of a single query over a range of columns.
+static void RMMBTilesReadRange(RMSQLiteReader *reader, short zoom, uint32_t minX, uint32_t maxX, uint32_t minY, uint32_t maxY, NSMutableDictionary *tileData)
+{
+    for (int64_t x = minX; x <= maxX; x++)
+    {
+        sqlite3_stmt *statement = RMSQLiteReaderStatement(reader, kMBTilesTileRangeQuery);
+
+        if ( ! statement)
+            return;
+
+        sqlite3_bind_int(statement, 1, zoom);
+        sqlite3_bind_int64(statement, 2, x);
+        sqlite3_bind_int64(statement, 3, RMMBTilesRow(maxY, zoom));
+        sqlite3_bind_int64(statement, 4, RMMBTilesRow(minY, zoom));
+
+        while (sqlite3_step(statement) == SQLITE_ROW)
+        {
+            RMTile tile = RMTileMake((uint32_t)x, (uint32_t)RMMBTilesRow((uint32_t)sqlite3_column_int64(statement, 0), zoom), zoom);
+            RMMBTilesAddTileData(tileData, tile, statement, 1);
+        }
+
+        sqlite3_reset(statement);
+    }
+}
 
 @implementation RMMBTilesSource
 {
     RMFractalTileProjection *tileProjection;
+    RMSQLiteReaderPool *readerPool;
+
+    RMMBTilesMetadata metadata;
+    time_t metadataModificationTime;
+    off_t metadataFileSize;
+    CFAbsoluteTime metadataCheckTime;
 }
 
 - (id)initWithTileSetURL:(NSURL *)tileSetURL
@@ -63,6 +132,16 @@
         [db setShouldCacheStatements:YES];
     }];
 
+    readerPool = RMSQLiteReaderPoolCreate([[tileSetURL path] fileSystemRepresentation], 0, kMBTilesMemoryMapSize);
+
+    if ( ! readerPool)
+    {
+        [self release];
+        return nil;
+    }
+
+    [self loadMetadata];
+
 	return self;
 }
 
@@ -75,6 +154,11 @@
 {
 	[tileProjection release]; tileProjection = nil;
     [queue release]; queue = nil;
+    RMSQLiteReaderPoolDestroy(readerPool); readerPool = NULL;
+    [metadata.name release]; metadata.name = nil;
+    [metadata.description release]; metadata.description = nil;
+    [metadata.attribution release]; metadata.attribution = nil;
+    [metadata.legend release]; metadata.legend = nil;
 	[super dealloc];
 }
 
@@ -98,29 +182,17 @@
         [[NSNotificationCenter defaultCenter] postNotificationName:RMTileRequested object:[NSNumber numberWithUnsignedLongLong:RMTileKey(tile)]];
     });
     
-    __block UIImage *image;
-
-    [queue inDatabase:^(FMDatabase *db)
-    {
-        FMResultSet *results = [db executeQuery:@"select tile_data from tiles where zoom_level = ? and tile_column = ? and tile_row = ?", 
-                                   [NSNumber numberWithShort:zoom], 
-                                   [NSNumber numberWithUnsignedInt:x], 
-                                   [NSNumber numberWithUnsignedInt:y]];
+    UIImage *image;
 
-        if ([db hadError])
-            image = [RMTileImage errorTile];
+    // Read on a connection of this thread's own, so tiles load in parallel
+    int64_t arguments[3] = { zoom, x, y };
+    size_t length = 0;
+    void *data = RMSQLiteReaderPoolCopyBlob(readerPool, kMBTilesTileQuery, arguments, 3, &length);
 
-        [results next];
-
-        NSData *data = [results dataForColumn:@"tile_data"];
-
-        if ( ! data)
-            image = [RMTileImage errorTile];
-        else
-            image = [UIImage imageWithData:data];
-
-        [results close];
-    }];
+    if ( ! data)
+        image = [RMTileImage errorTile];
+    else
+        image = [UIImage imageWithData:[NSData dataWithBytesNoCopy:data length:length freeWhenDone:YES]];
 
     dispatch_async(dispatch_get_main_queue(), ^(void)
     {
@@ -130,6 +202,37 @@
     return image;
 }
 
+- (NSDictionary *)tileDataInRect:(RMTileRect)tileRect
+{
+    NSMutableDictionary *tileData = [NSMutableDictionary dictionary];
+
+    tileRect = RMTileRectRound(tileRect);
+
+    RMTile origin = tileRect.origin.tile;
+
+    if (origin.zoom < 0 || origin.zoom > kMBTilesDefaultMaxTileZoom || tileRect.size.width < 1 || tileRect.size.height < 1)
+        return tileData;
+
+    uint32_t lastTile = (1 << origin.zoom) - 1;
+
+    if (origin.x > lastTile || origin.y > lastTile)
+        return tileData;
+
+    uint32_t maxX = (uint32_t)MIN((double)origin.x + tileRect.size.width - 1, lastTile);
+    uint32_t maxY = (uint32_t)MIN((double)origin.y + tileRect.size.height - 1, lastTile);
+
+    RMSQLiteReader *reader = RMSQLiteReaderPoolAcquire(readerPool);
+
+    if ( ! reader)
+        return tileData;
+
+    RMMBTilesReadRange(reader, origin.zoom, origin.x, maxX, origin.y, maxY, tileData);
+
+    RMSQLiteReaderPoolRelease(readerPool, reader);
+
+    return tileData;
+}
+
 - (NSString *)tileURL:(RMTile)tile
 {
     return nil;
@@ -155,46 +258,127 @@
 	return [RMProjection googleProjection];
 }
 
-- (float)minZoom
+#pragma mark -
+
+- (void)loadMetadata
 {
-    __block double minZoom;
+    struct stat fileStatus;
+
+    if (stat([queue.path fileSystemRepresentation], &fileStatus) == 0)
+    {
+        metadataModificationTime = fileStatus.st_mtime;
+        metadataFileSize = fileStatus.st_size;
+    }
+
+    metadataCheckTime = CFAbsoluteTimeGetCurrent();
+
+    __block RMMBTilesMetadata newMetadata = {
+        .minZoom = kMBTilesDefaultMinTileZoom,
+        .maxZoom = kMBTilesDefaultMaxTileZoom,
+        .bounds = kMBTilesDefaultLatLonBoundingBox
+    };
 
     [queue inDatabase:^(FMDatabase *db)
     {
+        // Separate queries, since SQLite only answers a lone min() or max() from the index
         FMResultSet *results = [db executeQuery:@"select min(zoom_level) from tiles"];
 
-        if ([db hadError])
-            minZoom = kMBTilesDefaultMinTileZoom;
+        if ([results next] && ! [results columnIndexIsNull:0])
+            newMetadata.minZoom = [results doubleForColumnIndex:0];
 
-        [results next];
+        [results close];
 
-        minZoom = [results doubleForColumnIndex:0];
+        results = [db executeQuery:@"select max(zoom_level) from tiles"];
+
+        if ([results next] && ! [results columnIndexIsNull:0])
+            newMetadata.maxZoom = [results doubleForColumnIndex:0];
+
+        [results close];
+
+        results = [db executeQuery:@"select name, value from metadata"];
+
+        while ([results next])
+        {
+            NSString *name  = [results stringForColumnIndex:0];
+            NSString *value = [results stringForColumnIndex:1];
+
+            if ([name isEqualToString:@"name"])
+                newMetadata.name = value;
+            else if ([name isEqualToString:@"description"])
+                newMetadata.description = value;
+            else if ([name isEqualToString:@"attribution"])
+                newMetadata.attribution = value;
+            else if ([name isEqualToString:@"legend"])
+                newMetadata.legend = value;
+            else if ([name isEqualToString:@"bounds"])
+            {
+                NSArray *parts = [value componentsSeparatedByString:@","];
+
+                if ([parts count] == 4)
+                {
+                    newMetadata.bounds.southWest.longitude = [[parts objectAtIndex:0] doubleValue];
+                    newMetadata.bounds.southWest.latitude  = [[parts objectAtIndex:1] doubleValue];
+                    newMetadata.bounds.northEast.longitude = [[parts objectAtIndex:2] doubleValue];
+                    newMetadata.bounds.northEast.latitude  = [[parts objectAtIndex:3] doubleValue];
+                }
+            }
+        }
 
         [results close];
     }];
 
-    return minZoom;
+    [metadata.name release];
+    [metadata.description release];
+    [metadata.attribution release];
+    [metadata.legend release];
+
+    metadata = newMetadata;
+
+    [metadata.name retain];
+    [metadata.description retain];
+    [metadata.attribution retain];
+    [metadata.legend retain];
 }
 
-- (float)maxZoom
+// A copy of the metadata, read again first if the file has changed since it was read
+- (RMMBTilesMetadata)currentMetadata
 {
-    __block double maxZoom;
+    RMMBTilesMetadata metadataCopy;
 
-    [queue inDatabase:^(FMDatabase *db)
+    @synchronized (self)
     {
-        FMResultSet *results = [db executeQuery:@"select max(zoom_level) from tiles"];
+        if (CFAbsoluteTimeGetCurrent() - metadataCheckTime >= kMBTilesMetadataCheckInterval)
+        {
+            struct stat fileStatus;
 
-        if ([db hadError])
-            maxZoom = kMBTilesDefaultMaxTileZoom;
+            metadataCheckTime = CFAbsoluteTimeGetCurrent();
 
-        [results next];
+            if (stat([queue.path fileSystemRepresentation], &fileStatus) == 0 &&
+                (fileStatus.st_mtime != metadataModificationTime || fileStatus.st_size != metadataFileSize))
+            {
+                [self loadMetadata];
+            }
+        }
 
-        maxZoom = [results doubleForColumnIndex:0];
+        metadataCopy = metadata;
 
-        [results close];
-    }];
+        [[metadataCopy.name retain] autorelease];
+        [[metadataCopy.description retain] autorelease];
+        [[metadataCopy.attribution retain] autorelease];
+        [[metadataCopy.legend retain] autorelease];
+    }
+
+    return metadataCopy;
+}
 
-    return maxZoom;
+- (float)minZoom
+{
+    return [self currentMetadata].minZoom;
+}
+
+- (float)maxZoom
+{
+    return [self currentMetadata].maxZoom;
 }
 
 - (void)setMinZoom:(float)aMinZoom
@@ -209,33 +393,7 @@
 
 - (RMSphericalTrapezium)latitudeLongitudeBoundingBox
 {
-    __block RMSphericalTrapezium bounds = kMBTilesDefaultLatLonBoundingBox;
-
-    [queue inDatabase:^(FMDatabase *db)
-    {
-        FMResultSet *results = [db executeQuery:@"select value from metadata where name = 'bounds'"];
-
-        [results next];
-
-        NSString *boundsString = [results stringForColumnIndex:0];
-
-        [results close];
-
-        if (boundsString)
-        {
-            NSArray *parts = [boundsString componentsSeparatedByString:@","];
-
-            if ([parts count] == 4)
-            {
-                bounds.southWest.longitude = [[parts objectAtIndex:0] doubleValue];
-                bounds.southWest.latitude  = [[parts objectAtIndex:1] doubleValue];
-                bounds.northEast.longitude = [[parts objectAtIndex:2] doubleValue];
-                bounds.northEast.latitude  = [[parts objectAtIndex:3] doubleValue];
-            }
-        }
-    }];
-
-    return bounds;
+    return [self currentMetadata].bounds;
 }
 
 - (BOOL)coversFullWorld
@@ -252,23 +410,7 @@
 
 - (NSString *)legend
 {
-    __block NSString *legend;
-
-    [queue inDatabase:^(FMDatabase *db)
-    {
-        FMResultSet *results = [db executeQuery:@"select value from metadata where name = 'legend'"];
-
-        if ([db hadError])
-            legend = nil;
-
-        [results next];
-
-        legend = [results stringForColumn:@"value"];
-
-        [results close];
-    }];
-
-    return legend;
+    return [self currentMetadata].legend;
 }
 
 - (void)didReceiveMemoryWarning
@@ -283,65 +425,19 @@
 
 - (NSString *)shortName
 {
-    __block NSString *shortName;
-
-    [queue inDatabase:^(FMDatabase *db)
-    {
-        FMResultSet *results = [db executeQuery:@"select value from metadata where name = 'name'"];
-
-        if ([db hadError])
-            shortName = nil;
-
-        [results next];
-
-        shortName = [results stringForColumnIndex:0];
-
-        [results close];
-    }];
-
-    return shortName;
+    return [self currentMetadata].name;
 }
 
 - (NSString *)longDescription
 {
-    __block NSString *description;
-
-    [queue inDatabase:^(FMDatabase *db)
-    {
-        FMResultSet *results = [db executeQuery:@"select value from metadata where name = 'description'"];
-
-        if ([db hadError])
-            description = nil;
-
-        [results next];
+    RMMBTilesMetadata metadataCopy = [self currentMetadata];
 
-        description = [results stringForColumnIndex:0];
-
-        [results close];
-    }];
-
-    return [NSString stringWithFormat:@"%@ - %@", [self shortName], description];
+    return [NSString stringWithFormat:@"%@ - %@", metadataCopy.name, metadataCopy.description];
 }
 
 - (NSString *)shortAttribution
 {
-    __block NSString *attribution;
-
-    [queue inDatabase:^(FMDatabase *db)
-    {
-        FMResultSet *results = [db executeQuery:@"select value from metadata where name = 'attribution'"];
-
-        if ([db hadError])
-            attribution = @"Unknown MBTiles attribution";
-
-        [results next];
-
-        attribution = [results stringForColumnIndex:0];
-
-        [results close];
-    }];
-
-    return attribution;
+    return [self currentMetadata].attribution;
 }
 
 - (NSString *)longAttribution
@@ -14,6 +14,7 @@
 #import "RMTileCache.h"
 #import "RMMBTilesSource.h"
 #import "RMDBMapSource.h"
+#import "RMCoordinateGridSource.h"
 
 @implementation RMMapTiledLayerView
 {
@@ -95,11 +96,31 @@
         {
             UIGraphicsPushContext(context);
 
+            // An MBTiles file reads the whole snapshot with a range scan per column
+            NSDictionary *tileData = nil;
+
+            if ([_tileSource isKindOfClass:[RMMBTilesSource class]])
+            {
+                RMTileRect tileRect = { { RMTileMake(x1, y1, zoom), CGPointZero }, CGSizeMake(x2 - x1 + 1, y2 - y1 + 1) };
+                tileData = [(RMMBTilesSource *)_tileSource tileDataInRect:tileRect];
+            }
+
             for (int x=x1; x<=x2; ++x)
             {
                 for (int y=y1; y<=y2; ++y)
                 {
-                    UIImage *tileImage = [_tileSource imageForTile:RMTileMake(x, y, zoom) inCache:[_mapView tileCache]];
+                    UIImage *tileImage;
+
+                    if (tileData)
+                    {
+                        NSData *data = [tileData objectForKey:[NSNumber numberWithUnsignedLongLong:RMTileKey(RMTileMake(x, y, zoom))]];
+                        tileImage = (data ? [UIImage imageWithData:data] : [RMTileImage errorTile]);
+                    }
+                    else
+                    {
+                        tileImage = [_tileSource imageForTile:RMTileMake(x, y, zoom) inCache:[_mapView tileCache]];
+                    }
+
                     [tileImage drawInRect:CGRectMake(x * rectSize, y * rectSize, rectSize, rectSize)];
                 }
             }
@@ -120,9 +141,9 @@
 
         if (zoom >= _tileSource.minZoom && zoom <= _tileSource.maxZoom)
         {
-            if ([_tileSource isKindOfClass:[RMMBTilesSource class]] || [_tileSource isKindOfClass:[RMDBMapSource class]])
+            if ([_tileSource isKindOfClass:[RMMBTilesSource class]] || [_tileSource isKindOfClass:[RMDBMapSource class]] || [_tileSource isKindOfClass:[RMCoordinateGridSource class]])
             {
-                // for local tiles, query the source directly since trivial blocking
+                // for local and generated tiles, query the source directly since trivial blocking
                 //
                 tileImage = [_tileSource imageForTile:RMTileMake(x, y, zoom) inCache:[_mapView tileCache]];
             }
@@ -1192,6 +1192,7 @@
     [_mapScrollView addGestureRecognizer:panGestureRecognizer];
 
     [_visibleAnnotations removeAllObjects];
+    [self.quadTree invalidateVisibleAnnotations];
     [self correctPositionOfAllAnnotations];
 }
 
@@ -2381,6 +2382,62 @@
     [annotation setPosition:newPosition animated:animated];
 }
 
+// Same as -correctScreenPosition:animated: for every annotation, with the transform computed once
+- (void)correctScreenPositionOfAnnotations:(id <NSFastEnumeration>)annotations animated:(BOOL)animated
+{
+    RMProjectedRect planetBounds = _projection.planetBounds;
+    double offsetX = fabs(planetBounds.origin.x), offsetY = fabs(planetBounds.origin.y);
+    CGPoint contentOffset = _mapScrollView.contentOffset;
+    CGFloat contentHeight = _mapScrollView.contentSize.height;
+
+    for (RMAnnotation *annotation in annotations)
+    {
+        RMProjectedPoint projectedLocation = annotation.projectedLocation;
+
+        CGPoint newPosition = CGPointMake(((projectedLocation.x + offsetX) / _metersPerPixel) - contentOffset.x,
+                                          contentHeight - ((projectedLocation.y + offsetY) / _metersPerPixel) - contentOffset.y);
+
+        [annotation setPosition:newPosition animated:animated];
+    }
+}
+
+// Returns NO if the annotation has no layer to show
+- (BOOL)showLayerOfAnnotation:(RMAnnotation *)annotation
+{
+    if (annotation.layer == nil && _delegateHasLayerForAnnotation)
+        annotation.layer = [_delegate mapView:self layerForAnnotation:annotation];
+    if (annotation.layer == nil)
+        return NO;
+
+    if ([annotation.layer isKindOfClass:[RMMarker class]] && ! annotation.isUserLocationAnnotation)
+        annotation.layer.transform = _annotationTransform;
+
+    // Use the zPosition property to order the layer hierarchy
+    if ( ! [_visibleAnnotations containsObject:annotation])
+    {
+        [_overlayView addSublayer:annotation.layer];
+        [_visibleAnnotations addObject:annotation];
+    }
+
+    return YES;
+}
+
+- (void)hideLayerOfAnnotation:(RMAnnotation *)annotation
+{
+    if (annotation.isUserLocationAnnotation || ! [_visibleAnnotations containsObject:annotation])
+        return;
+
+    if (_delegateHasWillHideLayerForAnnotation)
+        [_delegate mapView:self willHideLayerForAnnotation:annotation];
+
+    annotation.layer = nil;
+
+    if (_delegateHasDidHideLayerForAnnotation)
+        [_delegate mapView:self didHideLayerForAnnotation:annotation];
+
+    [_visibleAnnotations removeObject:annotation];
+}
+
 - (void)correctPositionOfAllAnnotationsIncludingInvisibles:(BOOL)correctAllAnnotations animated:(BOOL)animated
 {
     RMLog(@"%s", __func__);
@@ -2403,12 +2460,13 @@
     _accumulatedDelta.y = 0.0;
     [_overlayView moveLayersBy:_accumulatedDelta];
 
+    BOOL visibleAnnotationsChanged = YES;
+
     if (self.quadTree)
     {
         if (!correctAllAnnotations || _mapScrollViewIsZooming)
         {
-            for (RMAnnotation *annotation in _visibleAnnotations)
-                [self correctScreenPosition:annotation animated:animated];
+            [self correctScreenPositionOfAnnotations:_visibleAnnotations animated:animated];
 
 //            RMLog(@"%d annotations corrected", [visibleAnnotations count]);
 
@@ -2425,52 +2483,60 @@
         boundingBox.size.width += (2.0 * boundingBoxBuffer);
         boundingBox.size.height += (2.0 * boundingBoxBuffer);
 
-        NSArray *annotationsToCorrect = [self.quadTree annotationsInProjectedRect:boundingBox
-                                                         createClusterAnnotations:self.enableClustering
-                                                         withProjectedClusterSize:RMProjectedSizeMake(self.clusterAreaSize.width * _metersPerPixel, self.clusterAreaSize.height * _metersPerPixel)
-                                                    andProjectedClusterMarkerSize:RMProjectedSizeMake(self.clusterMarkerSize.width * _metersPerPixel, self.clusterMarkerSize.height * _metersPerPixel)
-                                                                findGravityCenter:self.positionClusterMarkersAtTheGravityCenter];
-        NSMutableSet *previousVisibleAnnotations = [[NSMutableSet alloc] initWithSet:_visibleAnnotations];
-
-        for (RMAnnotation *annotation in annotationsToCorrect)
+        if ( ! self.enableClustering)
         {
-            if (annotation.layer == nil && _delegateHasLayerForAnnotation)
-                annotation.layer = [_delegate mapView:self layerForAnnotation:annotation];
-            if (annotation.layer == nil)
-                continue;
+            // Only the annotations entering and leaving the viewport since the last
+            // correction, the others just move with it
+            NSMutableArray *enteringAnnotations = [NSMutableArray array];
+            NSMutableArray *leavingAnnotations = [NSMutableArray array];
+            NSMutableArray *movedAnnotations = [NSMutableArray array];
 
-            if ([annotation.layer isKindOfClass:[RMMarker class]] && ! annotation.isUserLocationAnnotation)
-                annotation.layer.transform = _annotationTransform;
-
-            // Use the zPosition property to order the layer hierarchy
-            if ( ! [_visibleAnnotations containsObject:annotation])
+            if ( ! [self.quadTree updateVisibleAnnotationsInProjectedRect:boundingBox enteringAnnotations:enteringAnnotations leavingAnnotations:leavingAnnotations movedAnnotations:movedAnnotations])
             {
-                [_overlayView addSublayer:annotation.layer];
-                [_visibleAnnotations addObject:annotation];
+                NSMutableSet *previousVisibleAnnotations = [NSMutableSet setWithSet:_visibleAnnotations];
+
+                [previousVisibleAnnotations minusSet:[NSSet setWithArray:enteringAnnotations]];
+                [leavingAnnotations addObjectsFromArray:[previousVisibleAnnotations allObjects]];
             }
 
-            [self correctScreenPosition:annotation animated:animated];
+            for (RMAnnotation *annotation in enteringAnnotations)
+                [self showLayerOfAnnotation:annotation];
 
-            [previousVisibleAnnotations removeObject:annotation];
-        }
+            for (RMAnnotation *annotation in leavingAnnotations)
+                [self hideLayerOfAnnotation:annotation];
 
-        for (RMAnnotation *annotation in previousVisibleAnnotations)
+            [self correctScreenPositionOfAnnotations:_visibleAnnotations animated:animated];
+
+            // Moving and scaling the viewport keeps the order of the others
+            visibleAnnotationsChanged = ([enteringAnnotations count] || [leavingAnnotations count] || [movedAnnotations count]);
+        }
+        else
         {
-            if ( ! annotation.isUserLocationAnnotation)
-            {
-                if (_delegateHasWillHideLayerForAnnotation)
-                    [_delegate mapView:self willHideLayerForAnnotation:annotation];
+            // Cluster annotations come and go with every query, start over once they are gone
+            [self.quadTree invalidateVisibleAnnotations];
 
-                annotation.layer = nil;
+            NSArray *annotationsToCorrect = [self.quadTree annotationsInProjectedRect:boundingBox
+                                                             createClusterAnnotations:YES
+                                                             withProjectedClusterSize:RMProjectedSizeMake(self.clusterAreaSize.width * _metersPerPixel, self.clusterAreaSize.height * _metersPerPixel)
+                                                        andProjectedClusterMarkerSize:RMProjectedSizeMake(self.clusterMarkerSize.width * _metersPerPixel, self.clusterMarkerSize.height * _metersPerPixel)
+                                                                    findGravityCenter:self.positionClusterMarkersAtTheGravityCenter];
+            NSMutableSet *previousVisibleAnnotations = [[NSMutableSet alloc] initWithSet:_visibleAnnotations];
 
-                if (_delegateHasDidHideLayerForAnnotation)
-                    [_delegate mapView:self didHideLayerForAnnotation:annotation];
+            for (RMAnnotation *annotation in annotationsToCorrect)
+            {
+                if ( ! [self showLayerOfAnnotation:annotation])
+                    continue;
 
-                [_visibleAnnotations removeObject:annotation];
+                [self correctScreenPosition:annotation animated:animated];
+
+                [previousVisibleAnnotations removeObject:annotation];
             }
-        }
 
-        [previousVisibleAnnotations release];
+            for (RMAnnotation *annotation in previousVisibleAnnotations)
+                [self hideLayerOfAnnotation:annotation];
+
+            [previousVisibleAnnotations release];
+        }
 
 //        RMLog(@"%d annotations on screen, %d total", [overlayView sublayersCount], [annotations count]);
     }
@@ -2535,6 +2601,13 @@
         }
     }
 
+    if ( ! visibleAnnotationsChanged)
+    {
+        [CATransaction commit];
+
+        return;
+    }
+
     NSMutableArray *sortedAnnotations = [NSMutableArray arrayWithArray:[_visibleAnnotations allObjects]];
 
     [sortedAnnotations filterUsingPredicate:[NSPredicate predicateWithFormat:@"isUserLocationAnnotation = NO"]];
@@ -2606,6 +2679,9 @@
         {
             [_overlayView addSublayer:annotation.layer];
             [_visibleAnnotations addObject:annotation];
+
+            // Shown whether or not it is in the viewport, compare it all again next time
+            [self.quadTree invalidateVisibleAnnotations];
         }
     }
 }
@@ -29,7 +29,11 @@
 #import "RMTile.h"
 #import "RMTileCache.h"
 
-/** An RMMemoryCache object represents memory-based caching of map tile images. Since memory is constrained in the iOS environment, this cache is relatively small, but useful for increasing performance. */
+/** An RMMemoryCache object represents memory-based caching of map tile images. Since memory is constrained in the iOS environment, this cache is relatively small, but useful for increasing performance.
+*
+*   The cache can be bounded by a tile count, by the decoded size of the cached images in bytes, or both. Tiles are evicted in approximately least-recently used order.
+*
+*   The cache is safe to use from several threads at once. It is split into shards by tile, each with its own lock, and a cache hit only takes a shared lock. */
 @interface RMMemoryCache : NSObject <RMTileCache>
 
 /** @name Initializing Memory Caches */
@@ -39,6 +43,20 @@
 *   @return An initialized memory cache object or `nil` if the object couldn't be created. */
 - (id)initWithCapacity:(NSUInteger)aCapacity;
 
+/** Initializes and returns a newly allocated memory cache object with the specified tile count and byte capacities.
+*   @param aCapacity The maximum number of tiles to be held in the cache.
+*   @param aByteCapacity The maximum total size in bytes of the decoded tile images held in the cache, or `0` for no size limit.
+*   @return An initialized memory cache object or `nil` if the object couldn't be created. */
+- (id)initWithCapacity:(NSUInteger)aCapacity byteCapacity:(NSUInteger)aByteCapacity;
+
+/** @name Configuring Cache Behavior */
+
+/** Set the cache purge strategy to use for the memory cache.
+*
+*   With RMCachePurgeStrategyTinyLFU, a newly added tile only displaces a cached tile when it has been requested more often recently, so a burst of tiles seen only once, such as a fast pan at high zoom, does not flush the tiles in regular use. RMCachePurgeStrategyFIFO is treated like RMCachePurgeStrategyLRU, which is the default.
+*   @param theStrategy The cache strategy to use. */
+- (void)setPurgeStrategy:(RMCachePurgeStrategy)theStrategy;
+
 /** @name Making Space in the Cache */
 
 /** Remove the least-recently used image from the cache if the cache is at or over capacity. This removes a single image from the cache. */
@@ -27,32 +27,75 @@
 
 #import "RMMemoryCache.h"
 #import "RMTileImage.h"
+#import "RMShardedCache.h"
+
+static void *RMMemoryCacheRetainImage(void *image)
+{
+    return (void *)CFRetain((CFTypeRef)image);
+}
+
+static void RMMemoryCacheReleaseImage(void *image)
+{
+    CFRelease((CFTypeRef)image);
+}
+
+static const char *RMMemoryCacheKeyString(NSString *aCacheKey)
+{
+    const char *cacheKey = [aCacheKey UTF8String];
+
+    return (cacheKey ? cacheKey : "");
+}
+
+// The decoded size of the image, which is what it actually costs in memory.
+static size_t RMMemoryCacheImageCost(UIImage *image)
+{
+    CGImageRef imageRef = [image CGImage];
+
+    if (imageRef)
+        return CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
+
+    return (size_t)(image.size.width * image.scale * image.size.height * image.scale * 4);
+}
 
 @implementation RMMemoryCache
 {
-    NSMutableDictionary *_memoryCache;
-    dispatch_queue_t _memoryCacheQueue;
+    RMShardedCache *_memoryCache;
     NSUInteger _memoryCacheCapacity;
+    NSUInteger _memoryCacheByteCapacity;
 }
 
-- (id)initWithCapacity:(NSUInteger)aCapacity
+- (id)initWithCapacity:(NSUInteger)aCapacity byteCapacity:(NSUInteger)aByteCapacity
 {
     if (!(self = [super init]))
         return nil;
 
-    RMLog(@"initializing memory cache %@ with capacity %d", self, aCapacity);
-
-    _memoryCache = [[NSMutableDictionary alloc] initWithCapacity:aCapacity];
-    _memoryCacheQueue = dispatch_queue_create("routeme.memoryCacheQueue", DISPATCH_QUEUE_CONCURRENT);
+    RMLog(@"initializing memory cache %@ with capacity %d, byte capacity %d", self, aCapacity, aByteCapacity);
 
     if (aCapacity < 1)
         aCapacity = 1;
 
     _memoryCacheCapacity = aCapacity;
+    _memoryCacheByteCapacity = aByteCapacity;
+
+    // The cache does its own locking per shard, and a hit only takes a shared lock,
+    // so tiles rendered in parallel do not serialize on the memory cache.
+    RMLRUCacheCallbacks callbacks = { RMMemoryCacheRetainImage, RMMemoryCacheReleaseImage };
+    _memoryCache = RMShardedCacheCreate(RMShardedCacheSuggestedShardCount(_memoryCacheCapacity), _memoryCacheByteCapacity, _memoryCacheCapacity, RMShardedCachePolicyClock, &callbacks);
+
+    if ( ! _memoryCache)
+    {
+        [self release];
+        return nil;
+    }
 
     return self;
 }
 
+- (id)initWithCapacity:(NSUInteger)aCapacity
+{
+    return [self initWithCapacity:aCapacity byteCapacity:0];
+}
+
 - (id)init
 {
 	return [self initWithCapacity:32];
@@ -60,121 +103,73 @@
 
 - (void)dealloc
 {
-    dispatch_barrier_sync(_memoryCacheQueue, ^{
-        [_memoryCache removeAllObjects];
-        [_memoryCache release]; _memoryCache = nil;
-    });
+    RMShardedCacheDestroy(_memoryCache); _memoryCache = NULL;
 
 	[super dealloc];
 }
 
+- (void)setPurgeStrategy:(RMCachePurgeStrategy)theStrategy
+{
+    RMLRUCacheAdmission admission = (theStrategy == RMCachePurgeStrategyTinyLFU ? RMLRUCacheAdmissionTinyLFU : RMLRUCacheAdmissionAlways);
+
+    if ( ! RMShardedCacheSetAdmission(_memoryCache, admission, _memoryCacheCapacity))
+        RMLog(@"could not set the memory cache purge strategy");
+}
+
 - (void)didReceiveMemoryWarning
 {
 	LogMethod();
 
-    dispatch_barrier_async(_memoryCacheQueue, ^{
-        [_memoryCache removeAllObjects];
-    });
+    RMShardedCacheRemoveAll(_memoryCache);
 }
 
 - (void)removeTile:(RMTile)tile
 {
-    dispatch_barrier_async(_memoryCacheQueue, ^{
-        [_memoryCache removeObjectForKey:[RMTileCache tileHash:tile]];
-    });
+    RMShardedCacheRemoveTile(_memoryCache, RMTileKey(tile));
 }
 
 - (UIImage *)cachedImage:(RMTile)tile withCacheKey:(NSString *)aCacheKey
 {
 //    RMLog(@"Memory cache check  tile %d %d %d (%@)", tile.x, tile.y, tile.zoom, [RMTileCache tileHash:tile]);
 
-    __block RMCacheObject *cachedObject = nil;
-    NSNumber *tileHash = [RMTileCache tileHash:tile];
-
-    dispatch_sync(_memoryCacheQueue, ^{
-
-        cachedObject = [[_memoryCache objectForKey:tileHash] retain];
-
-        if (cachedObject)
-        {
-            if ([[cachedObject cacheKey] isEqualToString:aCacheKey])
-            {
-                [cachedObject touch];
-            }
-            else
-            {
-                dispatch_barrier_async(_memoryCacheQueue, ^{
-                    [_memoryCache removeObjectForKey:tileHash];
-                });
-
-                [cachedObject release]; cachedObject = nil;
-            }
-        }
-
-    });
+    UIImage *cachedImage = (UIImage *)RMShardedCacheCopy(_memoryCache, RMTileKey(tile), RMMemoryCacheKeyString(aCacheKey));
 
 //    RMLog(@"Memory cache hit    tile %d %d %d (%@)", tile.x, tile.y, tile.zoom, [RMTileCache tileHash:tile]);
 
-    [cachedObject autorelease];
-
-    return [cachedObject cachedObject];
+    return [cachedImage autorelease];
 }
 
 /// Remove the least-recently used image from cache, if cache is at or over capacity. Removes only 1 image.
 - (void)makeSpaceInCache
 {
-    dispatch_barrier_async(_memoryCacheQueue, ^{
-
-        while ([_memoryCache count] >= _memoryCacheCapacity)
-        {
-            // Rather than scanning I would really like to be using a priority queue
-            // backed by a heap here.
-
-            // Maybe deleting one random element would work as well.
-
-            NSEnumerator *enumerator = [_memoryCache objectEnumerator];
-            RMCacheObject *image;
-
-            NSDate *oldestDate = nil;
-            RMCacheObject *oldestImage = nil;
-
-            while ((image = (RMCacheObject *)[enumerator nextObject]))
-            {
-                if (oldestDate == nil || ([oldestDate timeIntervalSinceReferenceDate] > [[image timestamp] timeIntervalSinceReferenceDate]))
-                {
-                    oldestDate = [image timestamp];
-                    oldestImage = image;
-                }
-            }
-
-            if (oldestImage)
-            {
-                // RMLog(@"Memory cache delete tile %d %d %d (%@)", oldestImage.tile.x, oldestImage.tile.y, oldestImage.tile.zoom, [RMTileCache tileHash:oldestImage.tile]);
-                [_memoryCache removeObjectForKey:[RMTileCache tileHash:oldestImage.tile]];
-            }
-        }
-
-    });
+    while (RMShardedCacheCount(_memoryCache) >= _memoryCacheCapacity)
+    {
+        if ( ! RMShardedCacheEvictOldest(_memoryCache))
+            break;
+    }
 }
 
 - (void)addImage:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
 {
 //    RMLog(@"Memory cache insert tile %d %d %d (%@)", tile.x, tile.y, tile.zoom, [RMTileCache tileHash:tile]);
 
-	[self makeSpaceInCache];
+    if ( ! image)
+        return;
 
-    dispatch_barrier_async(_memoryCacheQueue, ^{
-        [_memoryCache setObject:[RMCacheObject cacheObject:image forTile:tile withCacheKey:aCacheKey] forKey:[RMTileCache tileHash:tile]];
-    });
+    // Inserting evicts least-recently used images as needed to stay within the capacities.
+    RMShardedCachePut(_memoryCache, RMTileKey(tile), RMMemoryCacheKeyString(aCacheKey), image, RMMemoryCacheImageCost(image));
+}
+
+- (void)removeImageForTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    RMShardedCacheRemove(_memoryCache, RMTileKey(tile), RMMemoryCacheKeyString(aCacheKey));
 }
 
 - (void)removeAllCachedImages
 {
     LogMethod();
 
-    dispatch_barrier_async(_memoryCacheQueue, ^{
-        [_memoryCache removeAllObjects];
-    });
+    RMShardedCacheRemoveAll(_memoryCache);
 }
 
 @end
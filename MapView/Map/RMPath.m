@@ -30,8 +30,29 @@
 #import "RMProjection.h"
 #import "RMMapView.h"
 #import "RMAnnotation.h"
+#import "RMPathPyramid.h"
+#import "RMPathClipper.h"
+
+static void RMPathAddPathElement(RMPathElementType type, RMProjectedPoint point, void *context)
+{
+    CGContextRef theContext = context;
+
+    if (type == RMPathElementMoveToPoint)
+        CGContextMoveToPoint(theContext, point.x, point.y);
+    else if (type == RMPathElementAddLineToPoint)
+        CGContextAddLineToPoint(theContext, point.x, point.y);
+    else
+        CGContextClosePath(theContext);
+}
 
 @implementation RMPath
+{
+    // The points of path, simplified for the scale they are drawn at
+    RMPathPyramid *pathPyramid;
+
+    // Clips them to the layer, which is itself clipped to the screen
+    RMPathClipper *pathClipper;
+}
 
 @synthesize scaleLineWidth;
 @synthesize lineDashPhase;
@@ -43,6 +64,9 @@
 
 #define kDefaultLineWidth 2.0
 
+// Points moving the path by less than this many pixels are not drawn
+#define kPathSimplificationTolerance 0.25
+
 - (id)initWithView:(RMMapView *)aMapView
 {
     if (!(self = [super init]))
@@ -51,6 +75,8 @@
     mapView = aMapView;
 
     path = CGPathCreateMutable();
+    pathPyramid = RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, kPathSimplificationTolerance);
+    pathClipper = RMPathClipperCreate();
     pathBoundingBox = CGRectZero;
     ignorePathUpdates = NO;
     previousBounds = CGRectZero;
@@ -87,6 +113,8 @@
 {
     mapView = nil;
     CGPathRelease(path); path = NULL;
+    RMPathPyramidDestroy(pathPyramid); pathPyramid = NULL;
+    RMPathClipperDestroy(pathClipper); pathClipper = NULL;
     [self setLineDashLengths:nil];
     [lineColor release]; lineColor = nil;
     [fillColor release]; fillColor = nil;
@@ -198,8 +226,26 @@
 
     CGContextScaleCTM(theContext, scale, scale);
 
+    // Only the part of the path in the layer, and a line width around it so that the
+    // lines the clipping adds along its edges do not show
+    CGRect clipBounds = CGRectInset(CGContextGetClipBoundingBox(theContext), -scaledLineWidth, -scaledLineWidth);
+    RMProjectedRect clipRect = RMProjectedRectMake(clipBounds.origin.x, clipBounds.origin.y, clipBounds.size.width, clipBounds.size.height);
+    BOOL isFilled = (drawingMode != kCGPathStroke);
+
     CGContextBeginPath(theContext);
-    CGContextAddPath(theContext, path);
+
+    // The dash pattern starts over with every subpath, so a dashed path is drawn whole:
+    // clipped, its dashes would start anew where it enters the layer, and shift with it.
+    if (_lineDashLengths)
+    {
+        RMPathPyramidEnumerate(pathPyramid, renderedScale, RMPathAddPathElement, theContext);
+    }
+    else
+    {
+        RMPathClipperBegin(pathClipper, clipRect, (isFilled ? RMPathClipperModeFill : RMPathClipperModeStroke), RMPathAddPathElement, theContext);
+        RMPathPyramidEnumerateInRect(pathPyramid, renderedScale, clipRect, isFilled, RMPathClipperAddElement, pathClipper);
+        RMPathClipperEnd(pathClipper);
+    }
 
     CGContextSetLineWidth(theContext, scaledLineWidth);
     CGContextSetLineCap(theContext, lineCap);
@@ -231,6 +277,7 @@
         self.position = [mapView projectedPointToPixel:projectedLocation];
         // RMLog(@"screen position set to %f %f", self.position.x, self.position.y);
         CGPathMoveToPoint(path, NULL, 0.0f, 0.0f);
+        RMPathPyramidMoveToPoint(pathPyramid, RMProjectedPointMake(0.0, 0.0));
     }
     else
     {
@@ -238,9 +285,15 @@
         point.y = point.y - projectedLocation.y;
 
         if (isDrawing)
+        {
             CGPathAddLineToPoint(path, NULL, point.x, -point.y);
+            RMPathPyramidAddLineToPoint(pathPyramid, RMProjectedPointMake(point.x, -point.y));
+        }
         else
+        {
             CGPathMoveToPoint(path, NULL, point.x, -point.y);
+            RMPathPyramidMoveToPoint(pathPyramid, RMProjectedPointMake(point.x, -point.y));
+        }
 
         [self recalculateGeometry];
     }
@@ -296,6 +349,7 @@
 - (void)closePath
 {
     CGPathCloseSubpath(path);
+    RMPathPyramidCloseSubpath(pathPyramid);
 }
 
 - (float)lineWidth
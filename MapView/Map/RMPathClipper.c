@@ -0,0 +1,461 @@
+//
+//  RMPathClipper.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMPathClipper.h"
+
+#include <stdlib.h>
+
+// Where the edge arriving at a clipped point of a filled subpath comes from
+#define kRMPathClipperEdgeOfPath 0     // a line of the path
+#define kRMPathClipperEdgeOfRect 1     // the rectangle, where the path is outside it
+#define kRMPathClipperEdgeClosing 2    // the line closing the subpath
+
+// The sides of the rectangle, one Sutherland-Hodgman stage each
+#define kRMPathClipperSides 4
+
+typedef struct {
+    RMProjectedPoint point;
+    unsigned char edge;
+} RMPathClipperVertex;
+
+typedef struct {
+    RMPathClipperVertex first, previous;
+    bool started, firstInside, previousInside;
+} RMPathClipperStage;
+
+struct RMPathClipper {
+    double minX, minY, maxX, maxY;
+    RMPathClipperMode mode;
+    RMPathPyramidVisitor visitor;
+    void *context;
+    size_t visited;
+
+    // Stroke mode: the last point of the path, and the last one passed on if the pen
+    // is still there
+    RMProjectedPoint current, subpathStart, lastVisited;
+    bool hasCurrent, penDown, subpathInside, subpathVisited;
+
+    // Fill mode: the stages and the clipped subpath they make
+    RMPathClipperStage stages[kRMPathClipperSides];
+    RMPathClipperVertex *ring;
+    size_t ringCount, ringCapacity;
+    bool inSubpath, ringFailed;
+};
+
+#pragma mark -
+
+static void RMPathClipperVisit(RMPathClipper *clipper, RMPathElementType type, RMProjectedPoint point)
+{
+    clipper->visitor(type, point, clipper->context);
+
+    if (type != RMPathElementCloseSubpath)
+        clipper->visited++;
+}
+
+static inline bool RMPathClipperIsInside(const RMPathClipper *clipper, int side, RMProjectedPoint point)
+{
+    switch (side)
+    {
+        case 0: return point.x >= clipper->minX;
+        case 1: return point.x <= clipper->maxX;
+        case 2: return point.y >= clipper->minY;
+        default: return point.y <= clipper->maxY;
+    }
+}
+
+// Where the segment from a to b, on both sides of it, crosses a side of the rectangle
+static RMProjectedPoint RMPathClipperIntersect(const RMPathClipper *clipper, int side, RMProjectedPoint a, RMProjectedPoint b)
+{
+    if (side < 2)
+    {
+        double x = (side == 0 ? clipper->minX : clipper->maxX);
+
+        return RMProjectedPointMake(x, a.y + (x - a.x) * (b.y - a.y) / (b.x - a.x));
+    }
+    else
+    {
+        double y = (side == 2 ? clipper->minY : clipper->maxY);
+
+        return RMProjectedPointMake(a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y), y);
+    }
+}
+
+#pragma mark - Liang-Barsky
+
+bool RMPathClipperClipSegment(RMProjectedRect rect, RMProjectedPoint *a, RMProjectedPoint *b)
+{
+    double x = a->x, y = a->y;
+    double dx = b->x - x, dy = b->y - y;
+    double p[4] = { -dx, dx, -dy, dy };
+    double q[4] = { x - rect.origin.x, rect.origin.x + rect.size.width - x, y - rect.origin.y, rect.origin.y + rect.size.height - y };
+    double t0 = 0.0, t1 = 1.0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0)
+        {
+            if (q[i] < 0.0)
+                return false;
+        }
+        else
+        {
+            double t = q[i] / p[i];
+
+            if (p[i] < 0.0)
+            {
+                if (t > t1)
+                    return false;
+                if (t > t0)
+                    t0 = t;
+            }
+            else
+            {
+                if (t < t0)
+                    return false;
+                if (t < t1)
+                    t1 = t;
+            }
+        }
+    }
+
+    // Ends inside are left exactly as they are, so that clipped segments still join
+    if (t1 < 1.0)
+        *b = RMProjectedPointMake(x + t1 * dx, y + t1 * dy);
+
+    if (t0 > 0.0)
+        *a = RMProjectedPointMake(x + t0 * dx, y + t0 * dy);
+
+    return true;
+}
+
+static void RMPathClipperStrokeLine(RMPathClipper *clipper, RMProjectedPoint point, bool closing)
+{
+    RMProjectedRect rect = RMProjectedRectMake(clipper->minX, clipper->minY, clipper->maxX - clipper->minX, clipper->maxY - clipper->minY);
+    RMProjectedPoint from = clipper->current, a = from, b = point;
+
+    clipper->current = point;
+
+    if ( ! RMPathClipperClipSegment(rect, &a, &b))
+    {
+        clipper->penDown = false;
+        clipper->subpathInside = false;
+        return;
+    }
+
+    bool startClipped = (a.x != from.x || a.y != from.y);
+    bool endClipped = (b.x != point.x || b.y != point.y);
+
+    // A subpath that never left the rectangle closes as it was
+    if (closing && clipper->subpathInside && clipper->subpathVisited && ! endClipped &&
+        point.x == clipper->subpathStart.x && point.y == clipper->subpathStart.y)
+    {
+        RMPathClipperVisit(clipper, RMPathElementCloseSubpath, point);
+        return;
+    }
+
+    if ( ! clipper->penDown || startClipped || a.x != clipper->lastVisited.x || a.y != clipper->lastVisited.y)
+    {
+        RMPathClipperVisit(clipper, RMPathElementMoveToPoint, a);
+
+        if (clipper->subpathVisited || startClipped)
+            clipper->subpathInside = false;
+    }
+
+    RMPathClipperVisit(clipper, RMPathElementAddLineToPoint, b);
+
+    clipper->lastVisited = b;
+    clipper->penDown = ! endClipped;
+    clipper->subpathVisited = true;
+
+    if (endClipped)
+        clipper->subpathInside = false;
+}
+
+static void RMPathClipperStrokeElement(RMPathClipper *clipper, RMPathElementType type, RMProjectedPoint point)
+{
+    if (type == RMPathElementCloseSubpath && ! clipper->hasCurrent)
+        return;
+
+    if (type == RMPathElementMoveToPoint || ! clipper->hasCurrent)
+    {
+        clipper->current = point;
+        clipper->subpathStart = point;
+        clipper->hasCurrent = true;
+        clipper->penDown = false;
+        clipper->subpathInside = true;
+        clipper->subpathVisited = false;
+
+        if (type == RMPathElementMoveToPoint)
+            return;
+    }
+
+    RMPathClipperStrokeLine(clipper, point, (type == RMPathElementCloseSubpath));
+
+    // As with CGPath, the path goes on from the start of a closed subpath
+    if (type == RMPathElementCloseSubpath)
+        clipper->penDown = false;
+}
+
+#pragma mark - Sutherland-Hodgman
+
+static void RMPathClipperAppendToRing(RMPathClipper *clipper, RMPathClipperVertex vertex)
+{
+    if (clipper->ringFailed)
+        return;
+
+    if (clipper->ringCount == clipper->ringCapacity)
+    {
+        size_t capacity = (clipper->ringCapacity ? 2 * clipper->ringCapacity : 64);
+        RMPathClipperVertex *ring = realloc(clipper->ring, capacity * sizeof(RMPathClipperVertex));
+
+        if ( ! ring)
+        {
+            clipper->ringFailed = true;
+            return;
+        }
+
+        clipper->ring = ring;
+        clipper->ringCapacity = capacity;
+    }
+
+    clipper->ring[clipper->ringCount++] = vertex;
+}
+
+// Pass a point of the subpath through the stages from side on. Each stage keeps the
+// part of the polygon on the inside of its side, emitting the first point as it comes
+// when inside, and the crossing of the edge back to it when the subpath ends.
+static void RMPathClipperPush(RMPathClipper *clipper, int side, RMPathClipperVertex vertex)
+{
+    for ( ; side < kRMPathClipperSides; side++)
+    {
+        RMPathClipperStage *stage = &clipper->stages[side];
+        bool inside = RMPathClipperIsInside(clipper, side, vertex.point);
+
+        if ( ! stage->started)
+        {
+            stage->started = true;
+            stage->first = vertex;
+            stage->firstInside = inside;
+            stage->previous = vertex;
+            stage->previousInside = inside;
+
+            if ( ! inside)
+                return;
+
+            continue;
+        }
+
+        RMPathClipperVertex previous = stage->previous;
+        bool previousInside = stage->previousInside;
+
+        stage->previous = vertex;
+        stage->previousInside = inside;
+
+        if (inside)
+        {
+            if ( ! previousInside)
+            {
+                RMPathClipperVertex entry = { RMPathClipperIntersect(clipper, side, previous.point, vertex.point), kRMPathClipperEdgeOfRect };
+
+                RMPathClipperPush(clipper, side + 1, entry);
+            }
+
+            continue;
+        }
+
+        if (previousInside)
+        {
+            vertex.point = RMPathClipperIntersect(clipper, side, previous.point, vertex.point);
+            continue;
+        }
+
+        return;
+    }
+
+    RMPathClipperAppendToRing(clipper, vertex);
+}
+
+static void RMPathClipperFinishStages(RMPathClipper *clipper)
+{
+    for (int side = 0; side < kRMPathClipperSides; side++)
+    {
+        RMPathClipperStage *stage = &clipper->stages[side];
+
+        if ( ! stage->started)
+            continue;
+
+        stage->started = false;
+
+        if (stage->firstInside && ! stage->previousInside)
+        {
+            RMPathClipperVertex entry = { RMPathClipperIntersect(clipper, side, stage->previous.point, stage->first.point), kRMPathClipperEdgeOfRect };
+
+            RMPathClipperPush(clipper, side + 1, entry);
+        }
+        else if ( ! stage->firstInside && stage->previousInside)
+        {
+            RMPathClipperVertex exit = { RMPathClipperIntersect(clipper, side, stage->previous.point, stage->first.point), stage->first.edge };
+
+            RMPathClipperPush(clipper, side + 1, exit);
+        }
+    }
+}
+
+static void RMPathClipperFinishRing(RMPathClipper *clipper, bool closed)
+{
+    if ( ! clipper->inSubpath)
+        return;
+
+    clipper->inSubpath = false;
+
+    RMPathClipperFinishStages(clipper);
+
+    size_t count = clipper->ringCount;
+    size_t start = 0;
+    bool close = true;
+
+    clipper->ringCount = 0;
+
+    if (clipper->ringFailed || count == 0)
+    {
+        clipper->ringFailed = false;
+        return;
+    }
+
+    // Start an open subpath after the part of the line closing it left in the
+    // rectangle, so that this part closes it again without being stroked
+    if ( ! closed)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (clipper->ring[i].edge == kRMPathClipperEdgeClosing)
+            {
+                start = i;
+                close = false;
+                break;
+            }
+        }
+    }
+
+    RMPathClipperVisit(clipper, RMPathElementMoveToPoint, clipper->ring[start].point);
+
+    for (size_t i = 1; i < count; i++)
+        RMPathClipperVisit(clipper, RMPathElementAddLineToPoint, clipper->ring[(start + i) % count].point);
+
+    if (close)
+        RMPathClipperVisit(clipper, RMPathElementCloseSubpath, clipper->ring[start].point);
+}
+
+static void RMPathClipperFillElement(RMPathClipper *clipper, RMPathElementType type, RMProjectedPoint point)
+{
+    if (type == RMPathElementCloseSubpath)
+    {
+        RMPathClipperFinishRing(clipper, true);
+
+        // As with CGPath, the path goes on from the start of a closed subpath
+        clipper->current = point;
+        return;
+    }
+
+    if (type == RMPathElementMoveToPoint || ! clipper->inSubpath)
+    {
+        RMPathClipperFinishRing(clipper, false);
+
+        clipper->inSubpath = true;
+
+        if (type == RMPathElementMoveToPoint || ! clipper->hasCurrent)
+        {
+            RMPathClipperPush(clipper, 0, (RMPathClipperVertex){ point, kRMPathClipperEdgeClosing });
+            clipper->current = point;
+            clipper->hasCurrent = true;
+            return;
+        }
+
+        RMPathClipperPush(clipper, 0, (RMPathClipperVertex){ clipper->current, kRMPathClipperEdgeClosing });
+    }
+
+    RMPathClipperPush(clipper, 0, (RMPathClipperVertex){ point, kRMPathClipperEdgeOfPath });
+    clipper->current = point;
+}
+
+#pragma mark -
+
+RMPathClipper *RMPathClipperCreate(void)
+{
+    return calloc(1, sizeof(RMPathClipper));
+}
+
+void RMPathClipperDestroy(RMPathClipper *clipper)
+{
+    if ( ! clipper)
+        return;
+
+    free(clipper->ring);
+    free(clipper);
+}
+
+void RMPathClipperBegin(RMPathClipper *clipper, RMProjectedRect rect, RMPathClipperMode mode, RMPathPyramidVisitor visitor, void *context)
+{
+    clipper->minX = rect.origin.x;
+    clipper->minY = rect.origin.y;
+    clipper->maxX = rect.origin.x + rect.size.width;
+    clipper->maxY = rect.origin.y + rect.size.height;
+    clipper->mode = mode;
+    clipper->visitor = visitor;
+    clipper->context = context;
+    clipper->visited = 0;
+
+    clipper->hasCurrent = false;
+    clipper->penDown = false;
+    clipper->inSubpath = false;
+    clipper->ringFailed = false;
+    clipper->ringCount = 0;
+
+    for (int side = 0; side < kRMPathClipperSides; side++)
+        clipper->stages[side].started = false;
+}
+
+void RMPathClipperAddElement(RMPathElementType type, RMProjectedPoint point, void *context)
+{
+    RMPathClipper *clipper = context;
+
+    if (clipper->mode == RMPathClipperModeFill)
+        RMPathClipperFillElement(clipper, type, point);
+    else
+        RMPathClipperStrokeElement(clipper, type, point);
+}
+
+size_t RMPathClipperEnd(RMPathClipper *clipper)
+{
+    if (clipper->mode == RMPathClipperModeFill)
+        RMPathClipperFinishRing(clipper, false);
+
+    clipper->hasCurrent = false;
+
+    return clipper->visited;
+}
@@ -0,0 +1,76 @@
+//
+//  RMPathClipper.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMPATHCLIPPER_H_
+#define _RMPATHCLIPPER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "RMFoundation.h"
+#include "RMPathPyramid.h"
+
+// Clips the elements of a path to a rectangle as they are visited, so that only the
+// part of a long path near the screen is handed to Core Graphics. It takes the same
+// elements as an RMPathPyramidVisitor and passes the clipped ones on to another.
+//
+// Lines are clipped segment by segment with Liang-Barsky, lifting the pen where the
+// path leaves the rectangle. Filled paths are clipped with Sutherland-Hodgman, each
+// subpath as the polygon it fills, which adds segments along the rectangle where
+// the path leaves it: the rectangle is meant to be larger than what shows, such as
+// the screen with the outset of RMShape or RMPath. The line that fills an open subpath
+// closes it without being stroked, and stays so once clipped.
+
+typedef struct RMPathClipper RMPathClipper;
+
+typedef enum {
+    // Liang-Barsky, for paths that are only stroked
+    RMPathClipperModeStroke,
+    // Sutherland-Hodgman, for paths that are filled, and maybe stroked
+    RMPathClipperModeFill,
+} RMPathClipperMode;
+
+// Returns NULL if memory could not be allocated.
+RMPathClipper *RMPathClipperCreate(void);
+
+void RMPathClipperDestroy(RMPathClipper *clipper);
+
+// Start clipping a path to rect, calling visitor with the clipped elements.
+void RMPathClipperBegin(RMPathClipper *clipper, RMProjectedRect rect, RMPathClipperMode mode, RMPathPyramidVisitor visitor, void *context);
+
+// Clip the next element of the path. An RMPathPyramidVisitor, the context being the
+// clipper. In fill mode, a subpath whose clipped points could not be allocated is left out.
+void RMPathClipperAddElement(RMPathElementType type, RMProjectedPoint point, void *clipper);
+
+// Finish the last subpath. Returns the number of points passed on since RMPathClipperBegin().
+size_t RMPathClipperEnd(RMPathClipper *clipper);
+
+// Clip the segment from a to b to rect. Returns false if no part of it is in rect.
+bool RMPathClipperClipSegment(RMProjectedRect rect, RMProjectedPoint *a, RMProjectedPoint *b);
+
+#endif
@@ -0,0 +1,803 @@
+//
+//  RMPathPyramid.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMPathPyramid.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Zoom levels simplified; past the last the whole path is drawn
+#define kRMPathPyramidMaximumLevels 32
+
+// Spherical mercator width in meters over a 256 pixel tile: the tolerance of level k
+// is the pixel tolerance at this scale divided by 2^k
+#define kRMPathPyramidMetersPerPixelAtZoomZero (2.0 * 20037508.342789244 / 256.0)
+
+// Flags of the points
+#define kRMPathPyramidStartsSubpath 0x01
+#define kRMPathPyramidClosesSubpath 0x02
+
+// Points in a leaf of the bounding box trees, children of their other nodes, and the
+// depth this gives for 2^32 points
+#define kRMPathPyramidLeafSize 32
+#define kRMPathPyramidTreeFanout 16
+#define kRMPathPyramidMaximumTreeDepth 8
+
+// The bounding box of a run of the points of a level, from first to last
+typedef struct {
+    double minX, minY, maxX, maxY;
+    uint32_t first, last;
+    // No subpath starts after first or closes up to last, so that the run can be
+    // left out as a whole
+    bool continuous;
+} RMPathPyramidNode;
+
+// Leaves first, up to a single root
+typedef struct {
+    RMPathPyramidNode *nodes[kRMPathPyramidMaximumTreeDepth];
+    size_t counts[kRMPathPyramidMaximumTreeDepth];
+    int depth;
+} RMPathPyramidTree;
+
+struct RMPathPyramid {
+    RMPathSimplification simplification;
+    double pixelTolerance;
+
+    RMProjectedPoint *points;
+    unsigned char *flags;
+    size_t count, capacity;
+    double minX, minY, maxX, maxY;
+
+    // First point of the last subpath
+    size_t subpathStart;
+    bool subpathClosed;
+
+    // Tolerance below which each point is kept, NULL until the path is drawn twice
+    double *tolerances;
+    bool drawnSinceChange;
+
+    // The points kept at each level, NULL until drawn at that level, and the first
+    // level keeping all of them
+    uint32_t *levels[kRMPathPyramidMaximumLevels];
+    size_t levelCounts[kRMPathPyramidMaximumLevels];
+    int completeLevel;
+
+    // The bounding box trees of the levels, and last of all the points, NULL until
+    // drawn in a rectangle
+    RMPathPyramidTree *trees[kRMPathPyramidMaximumLevels + 1];
+};
+
+// Visiting the points of a level in order
+typedef struct {
+    const RMPathPyramid *pyramid;
+    const uint32_t *indices;
+    RMPathPyramidVisitor visitor;
+    void *context;
+    size_t subpathStart;
+    size_t visited;
+} RMPathPyramidCursor;
+
+typedef struct {
+    size_t first, last;
+    double tolerance;
+} RMPathPyramidSpan;
+
+#pragma mark -
+
+static void RMPathPyramidDestroyTree(RMPathPyramidTree *tree)
+{
+    if ( ! tree)
+        return;
+
+    for (int depth = 0; depth < tree->depth; depth++)
+        free(tree->nodes[depth]);
+
+    free(tree);
+}
+
+static void RMPathPyramidDidChange(RMPathPyramid *pyramid)
+{
+    free(pyramid->tolerances);
+    pyramid->tolerances = NULL;
+    pyramid->drawnSinceChange = false;
+
+    for (int i = 0; i < kRMPathPyramidMaximumLevels; i++)
+    {
+        free(pyramid->levels[i]);
+        pyramid->levels[i] = NULL;
+    }
+
+    pyramid->completeLevel = kRMPathPyramidMaximumLevels;
+
+    for (int i = 0; i <= kRMPathPyramidMaximumLevels; i++)
+    {
+        RMPathPyramidDestroyTree(pyramid->trees[i]);
+        pyramid->trees[i] = NULL;
+    }
+}
+
+static bool RMPathPyramidAppend(RMPathPyramid *pyramid, RMProjectedPoint point, unsigned char flags)
+{
+    if (pyramid->count == pyramid->capacity)
+    {
+        size_t capacity = (pyramid->capacity ? 2 * pyramid->capacity : 64);
+
+        // Levels index the points with 32 bits
+        if (capacity > UINT32_MAX)
+            capacity = UINT32_MAX;
+
+        if (capacity <= pyramid->count)
+            return false;
+
+        RMProjectedPoint *points = realloc(pyramid->points, capacity * sizeof(RMProjectedPoint));
+        if (points) pyramid->points = points;
+        unsigned char *newFlags = realloc(pyramid->flags, capacity);
+        if (newFlags) pyramid->flags = newFlags;
+
+        if ( ! points || ! newFlags)
+            return false;
+
+        pyramid->capacity = capacity;
+    }
+
+    RMPathPyramidDidChange(pyramid);
+
+    if (pyramid->count == 0)
+    {
+        pyramid->minX = pyramid->maxX = point.x;
+        pyramid->minY = pyramid->maxY = point.y;
+    }
+    else
+    {
+        pyramid->minX = fmin(pyramid->minX, point.x);
+        pyramid->minY = fmin(pyramid->minY, point.y);
+        pyramid->maxX = fmax(pyramid->maxX, point.x);
+        pyramid->maxY = fmax(pyramid->maxY, point.y);
+    }
+
+    pyramid->points[pyramid->count] = point;
+    pyramid->flags[pyramid->count] = flags;
+    pyramid->count++;
+
+    return true;
+}
+
+// Distance from p to the segment from a to b
+static double RMPathPyramidSegmentDistance(RMProjectedPoint p, RMProjectedPoint a, RMProjectedPoint b)
+{
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double lengthSquared = dx * dx + dy * dy;
+    double t = 0.0;
+
+    if (lengthSquared > 0.0)
+        t = fmax(0.0, fmin(1.0, ((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared));
+
+    return hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+// Douglas-Peucker: a point is kept if it is the farthest of its span from the chord by
+// more than the tolerance, and so was every span it is part of. Its tolerance is thus
+// the smallest of these distances.
+static void RMPathPyramidDouglasPeucker(RMPathPyramid *pyramid, size_t first, size_t last, RMPathPyramidSpan *stack)
+{
+    const RMProjectedPoint *points = pyramid->points;
+    size_t depth = 0;
+
+    stack[depth++] = (RMPathPyramidSpan){ first, last, INFINITY };
+
+    while (depth > 0)
+    {
+        RMPathPyramidSpan span = stack[--depth];
+        double farthest = -1.0;
+        size_t farthestIndex = span.first;
+
+        if (span.last - span.first < 2)
+            continue;
+
+        for (size_t i = span.first + 1; i < span.last; i++)
+        {
+            double distance = RMPathPyramidSegmentDistance(points[i], points[span.first], points[span.last]);
+
+            if (distance > farthest)
+            {
+                farthest = distance;
+                farthestIndex = i;
+            }
+        }
+
+        double tolerance = fmin(farthest, span.tolerance);
+
+        pyramid->tolerances[farthestIndex] = tolerance;
+
+        stack[depth++] = (RMPathPyramidSpan){ span.first, farthestIndex, tolerance };
+        stack[depth++] = (RMPathPyramidSpan){ farthestIndex, span.last, tolerance };
+    }
+}
+
+#pragma mark -
+
+// Min-heap of points by the area of the triangle with their neighbors
+
+typedef struct {
+    size_t *items;
+    size_t *positions; // of every point in items, SIZE_MAX if not there
+    double *areas;
+    size_t count;
+} RMPathPyramidHeap;
+
+static void RMPathPyramidHeapSwap(RMPathPyramidHeap *heap, size_t i, size_t j)
+{
+    size_t item = heap->items[i];
+
+    heap->items[i] = heap->items[j];
+    heap->items[j] = item;
+    heap->positions[heap->items[i]] = i;
+    heap->positions[heap->items[j]] = j;
+}
+
+static void RMPathPyramidHeapUp(RMPathPyramidHeap *heap, size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+
+        if (heap->areas[heap->items[parent]] <= heap->areas[heap->items[i]])
+            break;
+
+        RMPathPyramidHeapSwap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static void RMPathPyramidHeapDown(RMPathPyramidHeap *heap, size_t i)
+{
+    for (;;)
+    {
+        size_t left = 2 * i + 1, right = left + 1, smallest = i;
+
+        if (left < heap->count && heap->areas[heap->items[left]] < heap->areas[heap->items[smallest]])
+            smallest = left;
+
+        if (right < heap->count && heap->areas[heap->items[right]] < heap->areas[heap->items[smallest]])
+            smallest = right;
+
+        if (smallest == i)
+            break;
+
+        RMPathPyramidHeapSwap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+static double RMPathPyramidTriangleArea(RMProjectedPoint a, RMProjectedPoint b, RMProjectedPoint c)
+{
+    return fabs((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) / 2.0;
+}
+
+// Visvalingam-Whyatt: repeatedly drop the point making the smallest triangle with its
+// neighbors. Its tolerance is the square root of that area, and never less than the
+// one of a point dropped before it, so that the levels are nested.
+static bool RMPathPyramidVisvalingam(RMPathPyramid *pyramid)
+{
+    const RMProjectedPoint *points = pyramid->points;
+    size_t count = pyramid->count;
+    size_t *previous = malloc(count * sizeof(size_t));
+    size_t *next = malloc(count * sizeof(size_t));
+    RMPathPyramidHeap heap = { malloc(count * sizeof(size_t)), malloc(count * sizeof(size_t)), malloc(count * sizeof(double)), 0 };
+    bool succeeded = (previous && next && heap.items && heap.positions && heap.areas);
+
+    if (succeeded)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            bool first = (pyramid->flags[i] & kRMPathPyramidStartsSubpath);
+            bool last = (i + 1 == count || (pyramid->flags[i + 1] & kRMPathPyramidStartsSubpath));
+
+            previous[i] = (first ? SIZE_MAX : i - 1);
+            next[i] = (last ? SIZE_MAX : i + 1);
+            heap.positions[i] = SIZE_MAX;
+
+            if (first || last)
+                continue;
+
+            heap.areas[i] = RMPathPyramidTriangleArea(points[i - 1], points[i], points[i + 1]);
+            heap.items[heap.count] = i;
+            heap.positions[i] = heap.count++;
+        }
+
+        for (size_t i = heap.count / 2; i-- > 0; )
+            RMPathPyramidHeapDown(&heap, i);
+
+        double largestArea = 0.0;
+
+        while (heap.count > 0)
+        {
+            size_t i = heap.items[0];
+
+            RMPathPyramidHeapSwap(&heap, 0, --heap.count);
+            heap.positions[i] = SIZE_MAX;
+            RMPathPyramidHeapDown(&heap, 0);
+
+            largestArea = fmax(largestArea, heap.areas[i]);
+            pyramid->tolerances[i] = sqrt(largestArea);
+
+            size_t before = previous[i], after = next[i];
+
+            next[before] = after;
+            previous[after] = before;
+
+            // The neighbors now make other triangles
+            size_t neighbors[2] = { before, after };
+
+            for (int n = 0; n < 2; n++)
+            {
+                size_t j = neighbors[n];
+
+                if (heap.positions[j] == SIZE_MAX)
+                    continue;
+
+                heap.areas[j] = RMPathPyramidTriangleArea(points[previous[j]], points[j], points[next[j]]);
+                RMPathPyramidHeapUp(&heap, heap.positions[j]);
+                RMPathPyramidHeapDown(&heap, heap.positions[j]);
+            }
+        }
+    }
+
+    free(previous);
+    free(next);
+    free(heap.items);
+    free(heap.positions);
+    free(heap.areas);
+
+    return succeeded;
+}
+
+#pragma mark -
+
+static bool RMPathPyramidComputeTolerances(RMPathPyramid *pyramid)
+{
+    size_t count = pyramid->count;
+
+    pyramid->tolerances = malloc(count * sizeof(double));
+
+    if ( ! pyramid->tolerances)
+        return false;
+
+    // The ends of the subpaths are always kept
+    for (size_t i = 0; i < count; i++)
+    {
+        bool first = (pyramid->flags[i] & kRMPathPyramidStartsSubpath);
+        bool last = (i + 1 == count || (pyramid->flags[i + 1] & kRMPathPyramidStartsSubpath));
+
+        pyramid->tolerances[i] = (first || last ? INFINITY : 0.0);
+    }
+
+    bool succeeded = true;
+
+    if (pyramid->simplification == RMPathSimplificationVisvalingam)
+    {
+        succeeded = RMPathPyramidVisvalingam(pyramid);
+    }
+    else
+    {
+        RMPathPyramidSpan *stack = malloc(count * sizeof(RMPathPyramidSpan));
+
+        succeeded = (stack != NULL);
+
+        for (size_t first = 0; first < count && succeeded; )
+        {
+            size_t last = first;
+
+            while (last + 1 < count && ! (pyramid->flags[last + 1] & kRMPathPyramidStartsSubpath))
+                last++;
+
+            RMPathPyramidDouglasPeucker(pyramid, first, last, stack);
+
+            first = last + 1;
+        }
+
+        free(stack);
+    }
+
+    if ( ! succeeded)
+    {
+        free(pyramid->tolerances);
+        pyramid->tolerances = NULL;
+    }
+
+    return succeeded;
+}
+
+static bool RMPathPyramidBuildLevel(RMPathPyramid *pyramid, int level)
+{
+    double tolerance = pyramid->pixelTolerance * kRMPathPyramidMetersPerPixelAtZoomZero / pow(2.0, level);
+    size_t kept = 0;
+
+    for (size_t i = 0; i < pyramid->count; i++)
+    {
+        if (pyramid->tolerances[i] > tolerance)
+            kept++;
+    }
+
+    if (kept == pyramid->count)
+    {
+        if (level < pyramid->completeLevel)
+            pyramid->completeLevel = level;
+
+        return true;
+    }
+
+    uint32_t *indices = malloc(kept * sizeof(uint32_t));
+
+    if ( ! indices)
+        return false;
+
+    kept = 0;
+
+    for (size_t i = 0; i < pyramid->count; i++)
+    {
+        if (pyramid->tolerances[i] > tolerance)
+            indices[kept++] = (uint32_t)i;
+    }
+
+    pyramid->levels[level] = indices;
+    pyramid->levelCounts[level] = kept;
+
+    return true;
+}
+
+static void RMPathPyramidVisitPoint(RMPathPyramidCursor *cursor, size_t position)
+{
+    const RMPathPyramid *pyramid = cursor->pyramid;
+    size_t i = (cursor->indices ? cursor->indices[position] : position);
+
+    if (pyramid->flags[i] & kRMPathPyramidStartsSubpath)
+    {
+        cursor->subpathStart = i;
+        cursor->visitor(RMPathElementMoveToPoint, pyramid->points[i], cursor->context);
+    }
+    else
+    {
+        cursor->visitor(RMPathElementAddLineToPoint, pyramid->points[i], cursor->context);
+    }
+
+    if (pyramid->flags[i] & kRMPathPyramidClosesSubpath)
+        cursor->visitor(RMPathElementCloseSubpath, pyramid->points[cursor->subpathStart], cursor->context);
+
+    cursor->visited++;
+}
+
+// Visit the points of indices, or all of them if NULL
+static size_t RMPathPyramidVisit(const RMPathPyramid *pyramid, const uint32_t *indices, size_t count, RMPathPyramidVisitor visitor, void *context)
+{
+    RMPathPyramidCursor cursor = { pyramid, indices, visitor, context, 0, 0 };
+
+    for (size_t j = 0; j < count; j++)
+        RMPathPyramidVisitPoint(&cursor, j);
+
+    return cursor.visited;
+}
+
+// The level of the points to draw at metersPerPixel, kRMPathPyramidMaximumLevels for
+// all of them, or -1 for all of them when the path is not simplified (yet)
+static int RMPathPyramidLevelForScale(RMPathPyramid *pyramid, double metersPerPixel)
+{
+    // Simplified only once drawn twice without changes in between
+    if ( ! pyramid->drawnSinceChange)
+    {
+        pyramid->drawnSinceChange = true;
+        return -1;
+    }
+
+    if ( ! (metersPerPixel > 0.0) || ! (pyramid->pixelTolerance > 0.0))
+        return kRMPathPyramidMaximumLevels;
+
+    if ( ! pyramid->tolerances && ! RMPathPyramidComputeTolerances(pyramid))
+        return -1;
+
+    // The coarsest level whose tolerance is within the one at this scale
+    double level = ceil(log2(kRMPathPyramidMetersPerPixelAtZoomZero / metersPerPixel));
+    int k = (int)fmax(0.0, fmin(level, kRMPathPyramidMaximumLevels));
+
+    if (k < kRMPathPyramidMaximumLevels && k < pyramid->completeLevel && ! pyramid->levels[k])
+        RMPathPyramidBuildLevel(pyramid, k);
+
+    // Past the levels, or at one keeping every point, or out of memory
+    if (k >= kRMPathPyramidMaximumLevels || ! pyramid->levels[k])
+        return kRMPathPyramidMaximumLevels;
+
+    return k;
+}
+
+#pragma mark -
+
+static RMPathPyramidTree *RMPathPyramidBuildTree(const RMPathPyramid *pyramid, const uint32_t *indices, size_t count)
+{
+    RMPathPyramidTree *tree = calloc(1, sizeof(RMPathPyramidTree));
+    size_t nodeCount = (count + kRMPathPyramidLeafSize - 1) / kRMPathPyramidLeafSize;
+
+    if ( ! tree)
+        return NULL;
+
+    for (int depth = 0; depth < kRMPathPyramidMaximumTreeDepth; depth++)
+    {
+        RMPathPyramidNode *nodes = malloc(nodeCount * sizeof(RMPathPyramidNode));
+
+        if ( ! nodes)
+        {
+            RMPathPyramidDestroyTree(tree);
+            return NULL;
+        }
+
+        tree->nodes[depth] = nodes;
+        tree->counts[depth] = nodeCount;
+        tree->depth = depth + 1;
+
+        for (size_t n = 0; n < nodeCount; n++)
+        {
+            RMPathPyramidNode *node = &nodes[n];
+
+            if (depth == 0)
+            {
+                size_t first = n * kRMPathPyramidLeafSize;
+                size_t last = (first + kRMPathPyramidLeafSize < count ? first + kRMPathPyramidLeafSize : count) - 1;
+
+                node->first = (uint32_t)first;
+                node->last = (uint32_t)last;
+                node->minX = node->minY = INFINITY;
+                node->maxX = node->maxY = -INFINITY;
+                node->continuous = true;
+
+                for (size_t j = first; j <= last; j++)
+                {
+                    size_t i = (indices ? indices[j] : j);
+                    RMProjectedPoint point = pyramid->points[i];
+
+                    node->minX = fmin(node->minX, point.x);
+                    node->minY = fmin(node->minY, point.y);
+                    node->maxX = fmax(node->maxX, point.x);
+                    node->maxY = fmax(node->maxY, point.y);
+
+                    if ((pyramid->flags[i] & kRMPathPyramidClosesSubpath) || (j > first && (pyramid->flags[i] & kRMPathPyramidStartsSubpath)))
+                        node->continuous = false;
+                }
+            }
+            else
+            {
+                const RMPathPyramidNode *children = tree->nodes[depth - 1];
+                size_t first = n * kRMPathPyramidTreeFanout;
+                size_t last = (first + kRMPathPyramidTreeFanout < tree->counts[depth - 1] ? first + kRMPathPyramidTreeFanout : tree->counts[depth - 1]) - 1;
+
+                *node = children[first];
+
+                for (size_t c = first + 1; c <= last; c++)
+                {
+                    const RMPathPyramidNode *child = &children[c];
+                    size_t i = (indices ? indices[child->first] : child->first);
+
+                    node->minX = fmin(node->minX, child->minX);
+                    node->minY = fmin(node->minY, child->minY);
+                    node->maxX = fmax(node->maxX, child->maxX);
+                    node->maxY = fmax(node->maxY, child->maxY);
+                    node->last = child->last;
+                    node->continuous = node->continuous && child->continuous && ! (pyramid->flags[i] & kRMPathPyramidStartsSubpath);
+                }
+            }
+        }
+
+        if (nodeCount == 1)
+            return tree;
+
+        nodeCount = (nodeCount + kRMPathPyramidTreeFanout - 1) / kRMPathPyramidTreeFanout;
+    }
+
+    RMPathPyramidDestroyTree(tree);
+
+    return NULL;
+}
+
+typedef struct {
+    RMPathPyramidCursor cursor;
+    const RMPathPyramidTree *tree;
+    double minX, minY, maxX, maxY;
+    bool filled;
+} RMPathPyramidClipping;
+
+static void RMPathPyramidVisitNode(RMPathPyramidClipping *clipping, int depth, size_t n)
+{
+    const RMPathPyramidNode *node = &clipping->tree->nodes[depth][n];
+    RMPathPyramidCursor *cursor = &clipping->cursor;
+
+    // A run outside the rectangle: its lines are all on the same side of it, so they
+    // can be left out of a stroke, and make no more of a fill than a line from its
+    // first point to its last. Either way what joins the run to the rest of the path
+    // is still visited.
+    if (node->continuous && (node->maxX < clipping->minX || node->minX > clipping->maxX ||
+                             node->maxY < clipping->minY || node->minY > clipping->maxY))
+    {
+        RMPathPyramidVisitPoint(cursor, node->first);
+
+        if (node->last != node->first)
+        {
+            size_t i = (cursor->indices ? cursor->indices[node->last] : node->last);
+
+            cursor->visitor((clipping->filled ? RMPathElementAddLineToPoint : RMPathElementMoveToPoint), cursor->pyramid->points[i], cursor->context);
+            cursor->visited++;
+        }
+
+        return;
+    }
+
+    if (depth == 0)
+    {
+        for (size_t j = node->first; j <= node->last; j++)
+            RMPathPyramidVisitPoint(cursor, j);
+
+        return;
+    }
+
+    size_t first = n * kRMPathPyramidTreeFanout;
+    size_t last = first + kRMPathPyramidTreeFanout;
+
+    if (last > clipping->tree->counts[depth - 1])
+        last = clipping->tree->counts[depth - 1];
+
+    for (size_t c = first; c < last; c++)
+        RMPathPyramidVisitNode(clipping, depth - 1, c);
+}
+
+#pragma mark -
+
+RMPathPyramid *RMPathPyramidCreate(RMPathSimplification simplification, double pixelTolerance)
+{
+    RMPathPyramid *pyramid = calloc(1, sizeof(RMPathPyramid));
+
+    if ( ! pyramid)
+        return NULL;
+
+    pyramid->simplification = simplification;
+    pyramid->pixelTolerance = pixelTolerance;
+    pyramid->subpathClosed = true;
+    pyramid->completeLevel = kRMPathPyramidMaximumLevels;
+
+    return pyramid;
+}
+
+void RMPathPyramidDestroy(RMPathPyramid *pyramid)
+{
+    if ( ! pyramid)
+        return;
+
+    RMPathPyramidDidChange(pyramid);
+
+    free(pyramid->points);
+    free(pyramid->flags);
+    free(pyramid);
+}
+
+bool RMPathPyramidMoveToPoint(RMPathPyramid *pyramid, RMProjectedPoint point)
+{
+    if ( ! RMPathPyramidAppend(pyramid, point, kRMPathPyramidStartsSubpath))
+        return false;
+
+    pyramid->subpathStart = pyramid->count - 1;
+    pyramid->subpathClosed = false;
+
+    return true;
+}
+
+bool RMPathPyramidAddLineToPoint(RMPathPyramid *pyramid, RMProjectedPoint point)
+{
+    if (pyramid->count == 0)
+        return RMPathPyramidMoveToPoint(pyramid, point);
+
+    // As with CGPath, a line after closing a subpath starts another one where it started
+    if (pyramid->subpathClosed && ! RMPathPyramidMoveToPoint(pyramid, pyramid->points[pyramid->subpathStart]))
+        return false;
+
+    return RMPathPyramidAppend(pyramid, point, 0);
+}
+
+void RMPathPyramidCloseSubpath(RMPathPyramid *pyramid)
+{
+    if (pyramid->count == 0 || pyramid->subpathClosed)
+        return;
+
+    RMPathPyramidDidChange(pyramid);
+
+    pyramid->flags[pyramid->count - 1] |= kRMPathPyramidClosesSubpath;
+    pyramid->subpathClosed = true;
+}
+
+void RMPathPyramidRemoveAllPoints(RMPathPyramid *pyramid)
+{
+    RMPathPyramidDidChange(pyramid);
+
+    pyramid->count = 0;
+    pyramid->subpathStart = 0;
+    pyramid->subpathClosed = true;
+}
+
+size_t RMPathPyramidEnumerate(RMPathPyramid *pyramid, double metersPerPixel, RMPathPyramidVisitor visitor, void *context)
+{
+    if (pyramid->count == 0)
+        return 0;
+
+    int level = RMPathPyramidLevelForScale(pyramid, metersPerPixel);
+
+    if (level < 0 || level == kRMPathPyramidMaximumLevels)
+        return RMPathPyramidVisit(pyramid, NULL, pyramid->count, visitor, context);
+
+    return RMPathPyramidVisit(pyramid, pyramid->levels[level], pyramid->levelCounts[level], visitor, context);
+}
+
+size_t RMPathPyramidEnumerateInRect(RMPathPyramid *pyramid, double metersPerPixel, RMProjectedRect rect, bool filled, RMPathPyramidVisitor visitor, void *context)
+{
+    if (pyramid->count == 0)
+        return 0;
+
+    int level = RMPathPyramidLevelForScale(pyramid, metersPerPixel);
+
+    // Not worth a tree while the path changes between drawings
+    if (level < 0)
+        return RMPathPyramidVisit(pyramid, NULL, pyramid->count, visitor, context);
+
+    const uint32_t *indices = (level < kRMPathPyramidMaximumLevels ? pyramid->levels[level] : NULL);
+    size_t count = (indices ? pyramid->levelCounts[level] : pyramid->count);
+
+    if ( ! pyramid->trees[level])
+        pyramid->trees[level] = RMPathPyramidBuildTree(pyramid, indices, count);
+
+    if ( ! pyramid->trees[level])
+        return RMPathPyramidVisit(pyramid, indices, count, visitor, context);
+
+    RMPathPyramidClipping clipping = {
+        { pyramid, indices, visitor, context, 0, 0 },
+        pyramid->trees[level],
+        rect.origin.x, rect.origin.y, rect.origin.x + rect.size.width, rect.origin.y + rect.size.height,
+        filled
+    };
+
+    RMPathPyramidVisitNode(&clipping, clipping.tree->depth - 1, 0);
+
+    return clipping.cursor.visited;
+}
+
+RMProjectedRect RMPathPyramidBoundingBox(const RMPathPyramid *pyramid)
+{
+    if (pyramid->count == 0)
+        return RMProjectedRectMake(0.0, 0.0, 0.0, 0.0);
+
+    return RMProjectedRectMake(pyramid->minX, pyramid->minY, pyramid->maxX - pyramid->minX, pyramid->maxY - pyramid->minY);
+}
+
+size_t RMPathPyramidPointCount(const RMPathPyramid *pyramid)
+{
+    return pyramid->count;
+}
@@ -0,0 +1,106 @@
+//
+//  RMPathPyramid.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMPATHPYRAMID_H_
+#define _RMPATHPYRAMID_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+
+// The vertices of a path of polylines and polygons, with simplified versions of it
+// for every zoom level: at each level only the vertices that move the path by more
+// than a fraction of a pixel are kept.
+//
+// Every vertex is first given the tolerance below which it is kept, in one pass of
+// Douglas-Peucker or Visvalingam-Whyatt over the path, so that the simplification at
+// any tolerance is the vertices above it. The list of vertices of a zoom level is made
+// the first time that level is drawn. Changing the path discards all of it, and it is
+// only computed again once the same path is drawn twice, so that a path drawn after
+// every point added costs no more than before.
+//
+// Coordinates are projected meters, or any other unit the metersPerPixel values given
+// to RMPathPyramidEnumerate() are in. It does no locking of its own.
+
+typedef struct RMPathPyramid RMPathPyramid;
+
+typedef enum {
+    // Vertices are dropped when closer than the tolerance to the chord of their span,
+    // which keeps sharp turns
+    RMPathSimplificationDouglasPeucker,
+    // Vertices are dropped when the triangle they make with their neighbors is smaller
+    // than the square of the tolerance, which keeps the area and overall shape
+    RMPathSimplificationVisvalingam,
+} RMPathSimplification;
+
+typedef enum {
+    RMPathElementMoveToPoint,
+    RMPathElementAddLineToPoint,
+    RMPathElementCloseSubpath, // the point is the start of the subpath
+} RMPathElementType;
+
+typedef void (*RMPathPyramidVisitor)(RMPathElementType type, RMProjectedPoint point, void *context);
+
+// Vertices moving the path by less than pixelTolerance pixels are dropped. Returns NULL
+// if memory could not be allocated.
+RMPathPyramid *RMPathPyramidCreate(RMPathSimplification simplification, double pixelTolerance);
+
+void RMPathPyramidDestroy(RMPathPyramid *pyramid);
+
+// Start a new subpath at the point. Returns false if memory could not be allocated.
+bool RMPathPyramidMoveToPoint(RMPathPyramid *pyramid, RMProjectedPoint point);
+
+// Add a line from the last point, starting a subpath if there is none. Returns false
+// if memory could not be allocated.
+bool RMPathPyramidAddLineToPoint(RMPathPyramid *pyramid, RMProjectedPoint point);
+
+// Close the current subpath with a line back to its start.
+void RMPathPyramidCloseSubpath(RMPathPyramid *pyramid);
+
+void RMPathPyramidRemoveAllPoints(RMPathPyramid *pyramid);
+
+// Call visitor with the elements of the path simplified for metersPerPixel, the ends of
+// every subpath being always kept. Returns the number of points visited.
+size_t RMPathPyramidEnumerate(RMPathPyramid *pyramid, double metersPerPixel, RMPathPyramidVisitor visitor, void *context);
+
+// As RMPathPyramidEnumerate(), but leaving out most of the path outside rect, using a
+// tree of the bounding boxes of runs of points made the first time a level is drawn
+// this way: a run outside rect is visited as its first point and a move to its last
+// one, or a line to it if the path is filled. What is left outside is for the visitor
+// to clip, such as RMPathClipperAddElement() with the same rect, which makes the cost
+// of drawing a long path depend on the part of it in rect more than on its length.
+size_t RMPathPyramidEnumerateInRect(RMPathPyramid *pyramid, double metersPerPixel, RMProjectedRect rect, bool filled, RMPathPyramidVisitor visitor, void *context);
+
+// The bounding box of all the points, simplified or not.
+RMProjectedRect RMPathPyramidBoundingBox(const RMPathPyramid *pyramid);
+
+size_t RMPathPyramidPointCount(const RMPathPyramid *pyramid);
+
+#endif
@@ -37,29 +37,21 @@ typedef enum : short {
 
 #define kRMClusterAnnotationTypeName @"RMClusterAnnotation"
 
-#pragma mark - RMQuadTree nodes
+#pragma mark - RMQuadTree cluster nodes
 
+// The userInfo of a cluster annotation: a leaf that stands for one cluster of the
+// current zoom level, whose clusteredAnnotations are the annotations in it
 @interface RMQuadTreeNode : NSObject
 
 @property (nonatomic, readonly) NSArray *annotations;
 @property (nonatomic, readonly) RMQuadTreeNodeType nodeType;
 
+// The bounding box of the locations of the annotations
 @property (nonatomic, readonly) RMProjectedRect boundingBox;
-@property (nonatomic, readonly) RMProjectedRect northWestBoundingBox;
-@property (nonatomic, readonly) RMProjectedRect northEastBoundingBox;
-@property (nonatomic, readonly) RMProjectedRect southWestBoundingBox;
-@property (nonatomic, readonly) RMProjectedRect southEastBoundingBox;
-
-@property (nonatomic, readonly) RMQuadTreeNode *parentNode;
-@property (nonatomic, readonly) RMQuadTreeNode *northWest;
-@property (nonatomic, readonly) RMQuadTreeNode *northEast;
-@property (nonatomic, readonly) RMQuadTreeNode *southWest;
-@property (nonatomic, readonly) RMQuadTreeNode *southEast;
 
 @property (nonatomic, readonly) RMAnnotation *clusterAnnotation;
 @property (nonatomic, readonly) NSArray *clusteredAnnotations;
 
-// Operations on this node and all subnodes
 @property (nonatomic, readonly) NSArray *enclosedAnnotations;
 @property (nonatomic, readonly) NSArray *unclusteredAnnotations;
 
@@ -77,7 +69,13 @@ typedef enum : short {
 
 - (void)removeAllObjects;
 
-// Returns all annotations that are either inside of or intersect with boundingBox
+// Moves the index entry of the annotation to its new projectedBoundingBox
+- (void)annotationDidChangeBoundingBox:(RMAnnotation *)annotation;
+
+// Returns all annotations that are either inside of or intersect with boundingBox. With
+// createClusterAnnotations, those with clustering enabled are returned as the clusters
+// of the current zoom level of the map, about clusterSize wide, which are computed for
+// every zoom level at once the first time after the annotations changed.
 - (NSArray *)annotationsInProjectedRect:(RMProjectedRect)boundingBox;
 - (NSArray *)annotationsInProjectedRect:(RMProjectedRect)boundingBox
                createClusterAnnotations:(BOOL)createClusterAnnotations
@@ -85,4 +83,17 @@ typedef enum : short {
           andProjectedClusterMarkerSize:(RMProjectedSize)clusterMarkerSize
                       findGravityCenter:(BOOL)findGravityCenter;
 
+// Moves the viewport to boundingBox and fills the arrays with the annotations that
+// started or stopped intersecting it since the previous call, and those still in it
+// that moved, without clustering. Returns NO if there was no previous viewport to
+// compare with, the first time or after -invalidateVisibleAnnotations, in which case
+// enteringAnnotations holds every annotation intersecting boundingBox.
+- (BOOL)updateVisibleAnnotationsInProjectedRect:(RMProjectedRect)boundingBox
+                            enteringAnnotations:(NSMutableArray *)enteringAnnotations
+                             leavingAnnotations:(NSMutableArray *)leavingAnnotations
+                               movedAnnotations:(NSMutableArray *)movedAnnotations;
+
+// Forgets the viewport, so that the next update reports every annotation in it
+- (void)invalidateVisibleAnnotations;
+
 @end
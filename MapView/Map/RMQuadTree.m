@@ -31,582 +31,328 @@
 #import "RMProjection.h"
 #import "RMMapView.h"
 
-#pragma mark -
-#pragma mark RMQuadTreeNode implementation
-
-#define kMinimumQuadTreeElementWidth 200.0 // projected meters
-#define kMaxAnnotationsPerLeaf 4
-#define kMinPixelDistanceForLeafClustering 100.0
+#import "RMClusterIndex.h"
+#import "RMSpatialIndex.h"
+#import "RMVisibleSet.h"
 
-@interface RMQuadTreeNode ()
+#define kMaxClusteredZoom 30 // the deepest zoom level RMClusterIndex clusters
 
-- (id)initWithMapView:(RMMapView *)aMapView forParent:(RMQuadTreeNode *)aParentNode inBoundingBox:(RMProjectedRect)aBoundingBox;
+#pragma mark - RMQuadTree clusters
 
-- (void)addAnnotation:(RMAnnotation *)annotation;
-- (void)removeAnnotation:(RMAnnotation *)annotation;
+// The cluster index of the annotations with clustering enabled, and the others, which
+// are never clustered. The annotations are retained, so that the cluster nodes made
+// from an index may still enumerate them after the tree has changed.
+@interface RMQuadTreeClusters : NSObject
 
-- (void)addAnnotationsInBoundingBox:(RMProjectedRect)aBoundingBox
-                     toMutableArray:(NSMutableArray *)someArray
-           createClusterAnnotations:(BOOL)createClusterAnnotations
-           withProjectedClusterSize:(RMProjectedSize)clusterSize
-      andProjectedClusterMarkerSize:(RMProjectedSize)clusterMarkerSize
-                  findGravityCenter:(BOOL)findGravityCenter;
+- (id)initWithAnnotations:(NSArray *)someAnnotations options:(RMClusterIndexOptions)someOptions;
 
-- (void)removeUpwardsAllCachedClusterAnnotations;
-
-- (void)precreateQuadTreeInBounds:(RMProjectedRect)quadTreeBounds withDepth:(NSUInteger)quadTreeDepth;
+@property (nonatomic, readonly) RMClusterIndex *index;
+@property (nonatomic, readonly) RMClusterIndexOptions options;
+@property (nonatomic, readonly) NSMutableArray *unclusteredAnnotations;
 
 @end
 
-@implementation RMQuadTreeNode
+@implementation RMQuadTreeClusters
 {
-    RMProjectedRect _boundingBox, _northWestBoundingBox, _northEastBoundingBox, _southWestBoundingBox, _southEastBoundingBox;
-    NSMutableArray *_annotations;
-    RMQuadTreeNode *_parentNode, *_northWest, *_northEast, *_southWest, *_southEast;
-    RMQuadTreeNodeType _nodeType;
-    RMMapView *_mapView;
-
-    RMAnnotation *_cachedClusterAnnotation;
-    NSArray *_cachedClusterEnclosedAnnotations;
-    NSMutableArray *_cachedEnclosedAnnotations, *_cachedUnclusteredAnnotations;
+    RMClusterIndex *_index;
+    RMClusterIndexOptions _options;
+    NSArray *_clusteredAnnotations;
+    NSMutableArray *_unclusteredAnnotations;
 }
 
-@synthesize nodeType = _nodeType;
-@synthesize boundingBox = _boundingBox;
-@synthesize northWestBoundingBox = _northWestBoundingBox, northEastBoundingBox = _northEastBoundingBox;
-@synthesize southWestBoundingBox = _southWestBoundingBox, southEastBoundingBox = _southEastBoundingBox;
-@synthesize parentNode = _parentNode;
-@synthesize northWest = _northWest, northEast = _northEast;
-@synthesize southWest = _southWest, southEast = _southEast;
+@synthesize index = _index;
+@synthesize options = _options;
+@synthesize unclusteredAnnotations = _unclusteredAnnotations;
 
-- (id)initWithMapView:(RMMapView *)aMapView forParent:(RMQuadTreeNode *)aParentNode inBoundingBox:(RMProjectedRect)aBoundingBox
+- (id)initWithAnnotations:(NSArray *)someAnnotations options:(RMClusterIndexOptions)someOptions
 {
     if (!(self = [super init]))
         return nil;
 
-//    RMLog(@"New quadtree node at {(%.0f,%.0f),(%.0f,%.0f)}", aBoundingBox.origin.easting, aBoundingBox.origin.northing, aBoundingBox.size.width, aBoundingBox.size.height);
+    NSUInteger count = [someAnnotations count], clustered = 0;
+    uintptr_t *items = malloc((count ? count : 1) * sizeof(uintptr_t));
+    RMProjectedPoint *points = malloc((count ? count : 1) * sizeof(RMProjectedPoint));
+    NSMutableArray *clusteredAnnotations = [NSMutableArray arrayWithCapacity:count];
 
-    _mapView = aMapView;
-    _parentNode = [aParentNode retain];
-    _northWest = _northEast = _southWest = _southEast = nil;
-    _annotations = [NSMutableArray new];
-    _boundingBox = aBoundingBox;
-    _cachedClusterAnnotation = nil;
-    _cachedClusterEnclosedAnnotations = nil;
-    _cachedEnclosedAnnotations = _cachedUnclusteredAnnotations = nil;
-
-    double halfWidth = _boundingBox.size.width / 2.0, halfHeight = _boundingBox.size.height / 2.0;
-    _northWestBoundingBox = RMProjectedRectMake(_boundingBox.origin.x, _boundingBox.origin.y + halfHeight, halfWidth, halfHeight);
-    _northEastBoundingBox = RMProjectedRectMake(_boundingBox.origin.x + halfWidth, _boundingBox.origin.y + halfHeight, halfWidth, halfHeight);
-    _southWestBoundingBox = RMProjectedRectMake(_boundingBox.origin.x, _boundingBox.origin.y, halfWidth, halfHeight);
-    _southEastBoundingBox = RMProjectedRectMake(_boundingBox.origin.x + halfWidth, _boundingBox.origin.y, halfWidth, halfHeight);
-
-    _nodeType = nodeTypeLeaf;
+    _options = someOptions;
+    _unclusteredAnnotations = [NSMutableArray new];
 
-    return self;
-}
-
-- (void)dealloc
-{
-    _mapView = nil;
-
-    @synchronized (_cachedClusterAnnotation)
+    for (RMAnnotation *annotation in someAnnotations)
     {
-        [_cachedClusterEnclosedAnnotations release]; _cachedClusterEnclosedAnnotations = nil;
-        [_cachedClusterAnnotation release]; _cachedClusterAnnotation = nil;
-    }
-
-    @synchronized (_annotations)
-    {
-        for (RMAnnotation *annotation in _annotations)
+        if ( ! annotation.clusteringEnabled)
         {
-            annotation.quadTreeNode = nil;
+            [_unclusteredAnnotations addObject:annotation];
+            continue;
         }
-    }
 
-    [_annotations release]; _annotations = nil;
-    [_cachedEnclosedAnnotations release]; _cachedEnclosedAnnotations = nil;
-    [_cachedUnclusteredAnnotations release]; _cachedUnclusteredAnnotations = nil;
+        [clusteredAnnotations addObject:annotation];
 
-    [_northWest release]; _northWest = nil;
-    [_northEast release]; _northEast = nil;
-    [_southWest release]; _southWest = nil;
-    [_southEast release]; _southEast = nil;
-    [_parentNode release]; _parentNode = nil;
-
-    [super dealloc];
-}
-
-- (NSArray *)annotations
-{
-    NSArray *immutableAnnotations = nil;
-
-    @synchronized (_annotations)
-    {
-        immutableAnnotations = [NSArray arrayWithArray:_annotations];
+        if (items && points)
+        {
+            items[clustered] = (uintptr_t)annotation;
+            points[clustered++] = annotation.projectedLocation;
+        }
     }
 
-    return immutableAnnotations;
-}
+    if (items && points)
+        _index = RMClusterIndexCreate(&_options, items, points, clustered);
 
-- (void)addAnnotationToChildNodes:(RMAnnotation *)annotation
-{
-    RMProjectedRect projectedRect = annotation.projectedBoundingBox;
+    _clusteredAnnotations = [clusteredAnnotations retain];
 
-    if (RMProjectedRectContainsProjectedRect(_northWestBoundingBox, projectedRect))
-    {
-        if (!_northWest)
-            _northWest = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_northWestBoundingBox];
+    free(items);
+    free(points);
 
-        [_northWest addAnnotation:annotation];
-    }
-    else if (RMProjectedRectContainsProjectedRect(_northEastBoundingBox, projectedRect))
+    if ( ! _index)
     {
-        if (!_northEast)
-            _northEast = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_northEastBoundingBox];
-
-        [_northEast addAnnotation:annotation];
-    }
-    else if (RMProjectedRectContainsProjectedRect(_southWestBoundingBox, projectedRect))
-    {
-        if (!_southWest)
-            _southWest = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_southWestBoundingBox];
-
-        [_southWest addAnnotation:annotation];
+        [self release];
+        return nil;
     }
-    else if (RMProjectedRectContainsProjectedRect(_southEastBoundingBox, projectedRect))
-    {
-        if (!_southEast)
-            _southEast = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_southEastBoundingBox];
 
-        [_southEast addAnnotation:annotation];
-    }
-    else
-    {
-        @synchronized (_annotations)
-        {
-            [_annotations addObject:annotation];
-        }
-
-        annotation.quadTreeNode = self;
-        [self removeUpwardsAllCachedClusterAnnotations];
-    }
+    return self;
 }
 
-- (void)precreateQuadTreeInBounds:(RMProjectedRect)quadTreeBounds withDepth:(NSUInteger)quadTreeDepth
+- (void)dealloc
 {
-    if (quadTreeDepth == 0 || _boundingBox.size.width < (kMinimumQuadTreeElementWidth * 2.0))
-        return;
+    RMClusterIndexDestroy(_index); _index = NULL;
+    [_clusteredAnnotations release]; _clusteredAnnotations = nil;
+    [_unclusteredAnnotations release]; _unclusteredAnnotations = nil;
+    [super dealloc];
+}
 
-//    RMLog(@"node in {%.0f,%.0f},{%.0f,%.0f} depth %d", boundingBox.origin.x, boundingBox.origin.y, boundingBox.size.width, boundingBox.size.height, quadTreeDepth);
+@end
 
-    @synchronized (_cachedClusterAnnotation)
-    {
-        [_cachedClusterEnclosedAnnotations release]; _cachedClusterEnclosedAnnotations = nil;
-        [_cachedClusterAnnotation release]; _cachedClusterAnnotation = nil;
-    }
+#pragma mark - RMQuadTreeNode implementation
 
-    if (RMProjectedRectIntersectsProjectedRect(quadTreeBounds, _northWestBoundingBox))
-    {
-        if (!_northWest)
-            _northWest = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_northWestBoundingBox];
+@interface RMQuadTreeNode ()
 
-        [_northWest precreateQuadTreeInBounds:quadTreeBounds withDepth:quadTreeDepth-1];
-    }
+- (id)initWithMapView:(RMMapView *)aMapView clusters:(RMQuadTreeClusters *)someClusters cluster:(const RMCluster *)aCluster findGravityCenter:(BOOL)findGravityCenter;
 
-    if (RMProjectedRectIntersectsProjectedRect(quadTreeBounds, _northEastBoundingBox))
-    {
-        if (!_northEast)
-            _northEast = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_northEastBoundingBox];
+// Breaks the cycle with the userInfo of the cluster annotation once the tree drops the node
+- (void)releaseClusterAnnotation;
 
-        [_northEast precreateQuadTreeInBounds:quadTreeBounds withDepth:quadTreeDepth-1];
-    }
+@end
 
-    if (RMProjectedRectIntersectsProjectedRect(quadTreeBounds, _southWestBoundingBox))
-    {
-        if (!_southWest)
-            _southWest = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_southWestBoundingBox];
+typedef struct {
+    RMProjectedPoint min, max;
+} RMQuadTreeClusterExtent;
 
-        [_southWest precreateQuadTreeInBounds:quadTreeBounds withDepth:quadTreeDepth-1];
-    }
+static bool RMQuadTreeExtendCluster(uintptr_t item, void *context)
+{
+    RMQuadTreeClusterExtent *extent = context;
+    RMProjectedPoint location = ((RMAnnotation *)item).projectedLocation;
 
-    if (RMProjectedRectIntersectsProjectedRect(quadTreeBounds, _southEastBoundingBox))
-    {
-        if (!_southEast)
-            _southEast = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:self inBoundingBox:_southEastBoundingBox];
+    extent->min.x = fmin(extent->min.x, location.x);
+    extent->min.y = fmin(extent->min.y, location.y);
+    extent->max.x = fmax(extent->max.x, location.x);
+    extent->max.y = fmax(extent->max.y, location.y);
 
-        [_southEast precreateQuadTreeInBounds:quadTreeBounds withDepth:quadTreeDepth-1];
-    }
+    return true;
+}
 
-    if (_nodeType == nodeTypeLeaf && [_annotations count])
-    {
-        NSArray *immutableAnnotations = nil;
+static bool RMQuadTreeCollectAnnotation(uintptr_t item, void *context)
+{
+    [(NSMutableArray *)context addObject:(RMAnnotation *)item];
 
-        @synchronized (_annotations)
-        {
-            immutableAnnotations = [NSArray arrayWithArray:_annotations];
-            [_annotations removeAllObjects];
-        }
+    return true;
+}
 
-        for (RMAnnotation *annotationToMove in immutableAnnotations)
-        {
-            [self addAnnotationToChildNodes:annotationToMove];
-        }
-    }
+@implementation RMQuadTreeNode
+{
+    RMProjectedRect _boundingBox;
+    RMQuadTreeClusters *_clusters;
+    uint32_t _clusterID;
+    size_t _clusterCount;
 
-    _nodeType = nodeTypeNode;
+    RMAnnotation *_clusterAnnotation;
+    NSMutableArray *_clusteredAnnotations;
 }
 
-- (void)addAnnotation:(RMAnnotation *)annotation
+- (id)initWithMapView:(RMMapView *)aMapView clusters:(RMQuadTreeClusters *)someClusters cluster:(const RMCluster *)aCluster findGravityCenter:(BOOL)findGravityCenter
 {
-    if (_nodeType == nodeTypeLeaf)
-    {
-        @synchronized (_annotations)
-        {
-            [_annotations addObject:annotation];
-        }
+    RMQuadTreeClusterExtent extent = { aCluster->center, aCluster->center };
 
-        annotation.quadTreeNode = self;
+    RMClusterIndexEnumerateItems(someClusters.index, aCluster->clusterID, RMQuadTreeExtendCluster, &extent);
 
-        if ([_annotations count] <= kMaxAnnotationsPerLeaf || _boundingBox.size.width < (kMinimumQuadTreeElementWidth * 2.0))
-        {
-            [self removeUpwardsAllCachedClusterAnnotations];
-            return;
-        }
+    RMProjectedRect boundingBox = RMProjectedRectMake(extent.min.x, extent.min.y, extent.max.x - extent.min.x, extent.max.y - extent.min.y);
 
-        _nodeType = nodeTypeNode;
+    if (!(self = [super init]))
+        return nil;
 
-        // problem: all annotations that cross two quadrants will always be re-added here, which
-        // might be a problem depending on kMaxAnnotationsPerLeaf
+    _boundingBox = boundingBox;
+    _clusters = [someClusters retain];
+    _clusterID = aCluster->clusterID;
+    _clusterCount = aCluster->count;
+    _clusteredAnnotations = nil;
 
-        NSArray *immutableAnnotations = nil;
+    RMProjectedPoint clusterMarkerPosition;
 
-        @synchronized (_annotations)
-        {
-            immutableAnnotations = [NSArray arrayWithArray:_annotations];
-            [_annotations removeAllObjects];
-        }
+    if (findGravityCenter)
+        clusterMarkerPosition = aCluster->center;
+    else
+        clusterMarkerPosition = RMProjectedPointMake(boundingBox.origin.x + (boundingBox.size.width / 2.0), boundingBox.origin.y + (boundingBox.size.height / 2.0));
 
-        for (RMAnnotation *annotationToMove in immutableAnnotations)
-        {
-            [self addAnnotationToChildNodes:annotationToMove];
-        }
+    CLLocationCoordinate2D clusterMarkerCoordinate = [[aMapView projection] projectedPointToCoordinate:clusterMarkerPosition];
 
-        return;
-    }
+    _clusterAnnotation = [[RMAnnotation alloc] initWithMapView:aMapView
+                                                    coordinate:clusterMarkerCoordinate
+                                                      andTitle:[NSString stringWithFormat:@"%lu", (unsigned long)_clusterCount]];
+    _clusterAnnotation.annotationType = kRMClusterAnnotationTypeName;
+    _clusterAnnotation.userInfo = self;
 
-    [self addAnnotationToChildNodes:annotation];
+    return self;
 }
 
-- (void)removeAnnotation:(RMAnnotation *)annotation
+- (void)dealloc
 {
-    if (!annotation.quadTreeNode)
-        return;
-
-    annotation.quadTreeNode = nil;
-
-    @synchronized (_annotations)
-    {
-        [_annotations removeObject:annotation];
-    }
-
-    [self removeUpwardsAllCachedClusterAnnotations];
+    [_clusterAnnotation release]; _clusterAnnotation = nil;
+    [_clusteredAnnotations release]; _clusteredAnnotations = nil;
+    [_clusters release]; _clusters = nil;
+    [super dealloc];
 }
 
-- (void)annotationDidChangeBoundingBox:(RMAnnotation *)annotation
+- (void)releaseClusterAnnotation
 {
-    if (RMProjectedRectContainsProjectedRect(_boundingBox, annotation.projectedBoundingBox))
-        return;
-
-    [annotation retain];
-
-    [self removeAnnotation:annotation];
-
-    RMQuadTreeNode *nextParentNode = self;
-
-    while ((nextParentNode = [nextParentNode parentNode]))
+    @synchronized (self)
     {
-        if (RMProjectedRectContainsProjectedRect(nextParentNode.boundingBox, annotation.projectedBoundingBox))
-        {
-            [nextParentNode addAnnotationToChildNodes:annotation];
-            break;
-        }
+        [_clusterAnnotation autorelease]; _clusterAnnotation = nil;
     }
-
-    [annotation release];
 }
 
-- (NSArray *)enclosedAnnotations
+- (RMAnnotation *)clusterAnnotation
 {
-    if (!_cachedEnclosedAnnotations)
+    RMAnnotation *clusterAnnotation = nil;
+
+    @synchronized (self)
     {
-        _cachedEnclosedAnnotations = [[NSMutableArray alloc] initWithArray:self.annotations];
-        if (_northWest) [_cachedEnclosedAnnotations addObjectsFromArray:_northWest.enclosedAnnotations];
-        if (_northEast) [_cachedEnclosedAnnotations addObjectsFromArray:_northEast.enclosedAnnotations];
-        if (_southWest) [_cachedEnclosedAnnotations addObjectsFromArray:_southWest.enclosedAnnotations];
-        if (_southEast) [_cachedEnclosedAnnotations addObjectsFromArray:_southEast.enclosedAnnotations];
+        clusterAnnotation = [[_clusterAnnotation retain] autorelease];
     }
 
-    return _cachedEnclosedAnnotations;
+    return clusterAnnotation;
 }
 
-- (NSArray *)unclusteredAnnotations
+- (NSArray *)clusteredAnnotations
 {
-    if (!_cachedUnclusteredAnnotations)
+    @synchronized (self)
     {
-        _cachedUnclusteredAnnotations = [NSMutableArray new];
-
-        @synchronized (_annotations)
+        if ( ! _clusteredAnnotations)
         {
-            for (RMAnnotation *annotation in _annotations)
-            {
-                if (!annotation.clusteringEnabled)
-                    [_cachedUnclusteredAnnotations addObject:annotation];
-            }
-        }
+            _clusteredAnnotations = [[NSMutableArray alloc] initWithCapacity:_clusterCount];
 
-        if (_northWest) [_cachedUnclusteredAnnotations addObjectsFromArray:[_northWest unclusteredAnnotations]];
-        if (_northEast) [_cachedUnclusteredAnnotations addObjectsFromArray:[_northEast unclusteredAnnotations]];
-        if (_southWest) [_cachedUnclusteredAnnotations addObjectsFromArray:[_southWest unclusteredAnnotations]];
-        if (_southEast) [_cachedUnclusteredAnnotations addObjectsFromArray:[_southEast unclusteredAnnotations]];
+            RMClusterIndexEnumerateItems(_clusters.index, _clusterID, RMQuadTreeCollectAnnotation, _clusteredAnnotations);
+        }
     }
 
-    return _cachedUnclusteredAnnotations;
+    return [NSArray arrayWithArray:_clusteredAnnotations];
 }
 
-- (NSArray *)enclosedWithoutUnclusteredAnnotations
+- (NSArray *)annotations
 {
-    NSArray *unclusteredAnnotations = self.unclusteredAnnotations;
-    if (!unclusteredAnnotations || [unclusteredAnnotations count] == 0)
-        return self.enclosedAnnotations;
+    return self.clusteredAnnotations;
+}
 
-    NSMutableArray *enclosedAnnotations = [NSMutableArray arrayWithArray:self.enclosedAnnotations];
-    [enclosedAnnotations removeObjectsInArray:unclusteredAnnotations];
+- (RMQuadTreeNodeType)nodeType
+{
+    return nodeTypeLeaf;
+}
 
-    return enclosedAnnotations;
+- (RMProjectedRect)boundingBox
+{
+    return _boundingBox;
 }
 
-- (RMAnnotation *)clusterAnnotation
+- (NSArray *)enclosedAnnotations
 {
-    return _cachedClusterAnnotation;
+    return self.clusteredAnnotations;
 }
 
-- (NSArray *)clusteredAnnotations
+- (NSArray *)unclusteredAnnotations
 {
-    NSArray *clusteredAnnotations = nil;
+    return [NSArray array];
+}
 
-    @synchronized (_cachedClusterAnnotation)
-    {
-        clusteredAnnotations = [NSArray arrayWithArray:_cachedClusterEnclosedAnnotations];
-    }
+@end
 
-    return clusteredAnnotations;
-}
+#pragma mark - RMQuadTree implementation
 
-- (void)addAnnotationsInBoundingBox:(RMProjectedRect)aBoundingBox
-                     toMutableArray:(NSMutableArray *)someArray
-           createClusterAnnotations:(BOOL)createClusterAnnotations
-           withProjectedClusterSize:(RMProjectedSize)clusterSize
-      andProjectedClusterMarkerSize:(RMProjectedSize)clusterMarkerSize
-                  findGravityCenter:(BOOL)findGravityCenter
-{
-    if (createClusterAnnotations)
-    {
-        double halfWidth     = _boundingBox.size.width / 2.0;
-        BOOL forceClustering = (_boundingBox.size.width >= clusterSize.width && halfWidth < clusterSize.width);
+@interface RMQuadTree ()
 
-        NSArray *enclosedAnnotations = nil;
+- (void)invalidateClusters;
+- (void)clustersDidAddAnnotation:(RMAnnotation *)annotation;
+- (void)clustersDidMoveAnnotation:(RMAnnotation *)annotation;
+- (void)clustersDidRemoveAnnotation:(RMAnnotation *)annotation;
 
-        // Leaf clustering
-        if (forceClustering == NO && _nodeType == nodeTypeLeaf && [_annotations count] > 1)
-        {
-            NSMutableArray *annotationsToCheck = [NSMutableArray arrayWithArray:[self enclosedWithoutUnclusteredAnnotations]];
-
-            for (NSInteger i=[annotationsToCheck count]-1; i>0; --i)
-            {
-                BOOL mustBeClustered = NO;
-                RMAnnotation *currentAnnotation = [annotationsToCheck objectAtIndex:i];
-
-                for (NSInteger j=i-1; j>=0; --j)
-                {
-                    RMAnnotation *secondAnnotation = [annotationsToCheck objectAtIndex:j];
-
-                    // This is of course not very accurate but is good enough for this use case
-                    double distance = RMEuclideanDistanceBetweenProjectedPoints(currentAnnotation.projectedLocation, secondAnnotation.projectedLocation) / _mapView.metersPerPixel;
-                    if (distance < kMinPixelDistanceForLeafClustering)
-                    {
-                        mustBeClustered = YES;
-                        break;
-                    }
-                }
-
-                if (!mustBeClustered)
-                {
-                    [someArray addObject:currentAnnotation];
-                    [annotationsToCheck removeObjectAtIndex:i];
-                }
-            }
-
-            forceClustering = ([annotationsToCheck count] > 0);
-
-            if (forceClustering)
-            {
-                @synchronized (_cachedClusterAnnotation)
-                {
-                    [_cachedClusterEnclosedAnnotations release]; _cachedClusterEnclosedAnnotations = nil;
-                    [_cachedClusterAnnotation release]; _cachedClusterAnnotation = nil;
-                }
-
-                enclosedAnnotations = [NSArray arrayWithArray:annotationsToCheck];
-            }
-        }
+- (RMAnnotation *)clusterAnnotationForCluster:(const RMCluster *)cluster inClusters:(RMQuadTreeClusters *)clusters findGravityCenter:(BOOL)findGravityCenter;
 
-        if (forceClustering)
-        {
-            if (!enclosedAnnotations)
-                enclosedAnnotations = [self enclosedWithoutUnclusteredAnnotations];
-
-            @synchronized (_cachedClusterAnnotation)
-            {
-                if (_cachedClusterAnnotation && [enclosedAnnotations count] != [_cachedClusterEnclosedAnnotations count])
-                {
-                    [_cachedClusterEnclosedAnnotations release]; _cachedClusterEnclosedAnnotations = nil;
-                    [_cachedClusterAnnotation release]; _cachedClusterAnnotation = nil;
-                }
-            }
-
-            if (!_cachedClusterAnnotation)
-            {
-                NSUInteger enclosedAnnotationsCount = [enclosedAnnotations count];
-
-                if (enclosedAnnotationsCount < 2)
-                {
-                    @synchronized (_annotations)
-                    {
-                        [someArray addObjectsFromArray:enclosedAnnotations];
-                        [someArray addObjectsFromArray:[self unclusteredAnnotations]];
-                    }
-
-                    return;
-                }
-
-                RMProjectedPoint clusterMarkerPosition;
-
-                if (findGravityCenter)
-                {
-                    double averageX = 0.0, averageY = 0.0;
-
-                    for (RMAnnotation *annotation in enclosedAnnotations)
-                    {
-                        averageX += annotation.projectedLocation.x;
-                        averageY += annotation.projectedLocation.y;
-                    }
-
-                    averageX /= (double)enclosedAnnotationsCount;
-                    averageY /= (double)enclosedAnnotationsCount;
-
-                    double halfClusterMarkerWidth = clusterMarkerSize.width / 2.0,
-                           halfClusterMarkerHeight = clusterMarkerSize.height / 2.0;
-
-                    if (averageX - halfClusterMarkerWidth < _boundingBox.origin.x)
-                        averageX = _boundingBox.origin.x + halfClusterMarkerWidth;
-                    if (averageX + halfClusterMarkerWidth > _boundingBox.origin.x + _boundingBox.size.width)
-                        averageX = _boundingBox.origin.x + _boundingBox.size.width - halfClusterMarkerWidth;
-                    if (averageY - halfClusterMarkerHeight < _boundingBox.origin.y)
-                        averageY = _boundingBox.origin.y + halfClusterMarkerHeight;
-                    if (averageY + halfClusterMarkerHeight > _boundingBox.origin.y + _boundingBox.size.height)
-                        averageY = _boundingBox.origin.y + _boundingBox.size.height - halfClusterMarkerHeight;
-
-                    // TODO: anchorPoint
-                    clusterMarkerPosition = RMProjectedPointMake(averageX, averageY);
-                }
-                else
-                {
-                    clusterMarkerPosition = RMProjectedPointMake(_boundingBox.origin.x + halfWidth, _boundingBox.origin.y + (_boundingBox.size.height / 2.0));
-                }
-
-                CLLocationCoordinate2D clusterMarkerCoordinate = [[_mapView projection] projectedPointToCoordinate:clusterMarkerPosition];
-
-                _cachedClusterAnnotation = [[RMAnnotation alloc] initWithMapView:_mapView
-                                                                     coordinate:clusterMarkerCoordinate
-                                                                       andTitle:[NSString stringWithFormat:@"%d", enclosedAnnotationsCount]];
-                _cachedClusterAnnotation.annotationType = kRMClusterAnnotationTypeName;
-                _cachedClusterAnnotation.userInfo = self;
-
-                _cachedClusterEnclosedAnnotations = [[NSArray alloc] initWithArray:enclosedAnnotations];
-            }
-
-            [someArray addObject:_cachedClusterAnnotation];
-            [someArray addObjectsFromArray:[self unclusteredAnnotations]];
+@end
 
-            return;
-        }
+typedef struct {
+    RMQuadTree *quadTree;
+    RMQuadTreeClusters *clusters;
+    NSMutableArray *annotations;
+    BOOL findGravityCenter;
+} RMQuadTreeClusterQuery;
 
-        if (_nodeType == nodeTypeLeaf)
-        {
-            @synchronized (_annotations)
-            {
-                [someArray addObjectsFromArray:_annotations];
-            }
+static bool RMQuadTreeAddCluster(const RMCluster *cluster, void *context)
+{
+    RMQuadTreeClusterQuery *query = context;
 
-            return;
-        }
-    }
+    if (cluster->clusterID == 0)
+        [query->annotations addObject:(RMAnnotation *)cluster->item];
     else
-    {
-        if (_nodeType == nodeTypeLeaf)
-        {
-            @synchronized (_annotations)
-            {
-                [someArray addObjectsFromArray:_annotations];
-            }
-
-            return;
-        }
-    }
+        [query->annotations addObject:[query->quadTree clusterAnnotationForCluster:cluster inClusters:query->clusters findGravityCenter:query->findGravityCenter]];
 
-    if (RMProjectedRectIntersectsProjectedRect(aBoundingBox, _northWestBoundingBox))
-        [_northWest addAnnotationsInBoundingBox:aBoundingBox toMutableArray:someArray createClusterAnnotations:createClusterAnnotations withProjectedClusterSize:clusterSize andProjectedClusterMarkerSize:clusterMarkerSize findGravityCenter:findGravityCenter];
-    if (RMProjectedRectIntersectsProjectedRect(aBoundingBox, _northEastBoundingBox))
-        [_northEast addAnnotationsInBoundingBox:aBoundingBox toMutableArray:someArray createClusterAnnotations:createClusterAnnotations withProjectedClusterSize:clusterSize andProjectedClusterMarkerSize:clusterMarkerSize findGravityCenter:findGravityCenter];
-    if (RMProjectedRectIntersectsProjectedRect(aBoundingBox, _southWestBoundingBox))
-        [_southWest addAnnotationsInBoundingBox:aBoundingBox toMutableArray:someArray createClusterAnnotations:createClusterAnnotations withProjectedClusterSize:clusterSize andProjectedClusterMarkerSize:clusterMarkerSize findGravityCenter:findGravityCenter];
-    if (RMProjectedRectIntersectsProjectedRect(aBoundingBox, _southEastBoundingBox))
-        [_southEast addAnnotationsInBoundingBox:aBoundingBox toMutableArray:someArray createClusterAnnotations:createClusterAnnotations withProjectedClusterSize:clusterSize andProjectedClusterMarkerSize:clusterMarkerSize findGravityCenter:findGravityCenter];
+    return true;
+}
 
-    @synchronized (_annotations)
-    {
-        for (RMAnnotation *annotation in _annotations)
-        {
-            if (RMProjectedRectIntersectsProjectedRect(aBoundingBox, annotation.projectedBoundingBox))
-                [someArray addObject:annotation];
-        }
-    }
+static BOOL RMQuadTreeClusterOptionsEqual(RMClusterIndexOptions options1, RMClusterIndexOptions options2)
+{
+    return (options1.radius == options2.radius &&
+            options1.metersPerPixelAtZoomZero == options2.metersPerPixelAtZoomZero &&
+            options1.minZoom == options2.minZoom &&
+            options1.maxZoom == options2.maxZoom &&
+            options1.minPoints == options2.minPoints);
 }
 
-- (void)removeUpwardsAllCachedClusterAnnotations
+static void RMQuadTreeAppendAnnotation(uintptr_t item, void *context)
 {
-    if (_parentNode)
-        [_parentNode removeUpwardsAllCachedClusterAnnotations];
+    [(NSMutableArray *)context addObject:(RMAnnotation *)item];
+}
 
-    @synchronized (_cachedClusterAnnotation)
-    {
-        [_cachedClusterEnclosedAnnotations release]; _cachedClusterEnclosedAnnotations = nil;
-        [_cachedClusterAnnotation release]; _cachedClusterAnnotation = nil;
-    }
+typedef struct {
+    NSMutableArray *entering, *leaving, *moved;
+} RMQuadTreeVisibilityChanges;
 
-    [_cachedEnclosedAnnotations release]; _cachedEnclosedAnnotations = nil;
-    [_cachedUnclusteredAnnotations release]; _cachedUnclusteredAnnotations = nil;
+static void RMQuadTreeAnnotationEntered(uintptr_t item, void *context)
+{
+    RMQuadTreeAppendAnnotation(item, ((RMQuadTreeVisibilityChanges *)context)->entering);
 }
 
-@end
+static void RMQuadTreeAnnotationLeft(uintptr_t item, void *context)
+{
+    RMQuadTreeAppendAnnotation(item, ((RMQuadTreeVisibilityChanges *)context)->leaving);
+}
 
-#pragma mark - RMQuadTree implementation
+static void RMQuadTreeAnnotationMoved(uintptr_t item, void *context)
+{
+    RMQuadTreeAppendAnnotation(item, ((RMQuadTreeVisibilityChanges *)context)->moved);
+}
 
 @implementation RMQuadTree
 {
-    RMQuadTreeNode *_rootNode;
     RMMapView *_mapView;
+
+    // Every annotation by its bounding box, the only place they are kept
+    RMSpatialIndex *_annotationIndex;
+
+    // The annotations of the index in the last viewport given to the visibility updates
+    RMVisibleSet *_visibleSet;
+
+    // The clusters for the clustered queries, built by the first one after an annotation
+    // with clustering enabled was added, moved or removed, and the nodes of the clusters
+    // returned since, by cluster ID
+    RMQuadTreeClusters *_clusters;
+    NSMutableDictionary *_clusterNodes;
+    BOOL _clusterNodesFindGravityCenter;
 }
 
 - (id)initWithMapView:(RMMapView *)aMapView
@@ -615,45 +361,118 @@
         return nil;
 
     _mapView = aMapView;
-    _rootNode = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:nil inBoundingBox:[[RMProjection googleProjection] planetBounds]];
+    _annotationIndex = RMSpatialIndexCreate(RMSpatialIndexOrderMorton);
+    _visibleSet = RMVisibleSetCreate();
+    _clusters = nil;
+    _clusterNodes = [NSMutableDictionary new];
+
+    if ( ! _annotationIndex || ! _visibleSet)
+    {
+        [self release];
+        return nil;
+    }
 
     return self;
 }
 
 - (void)dealloc
 {
+    [self invalidateClusters];
+    [_clusterNodes release]; _clusterNodes = nil;
+
     _mapView = nil;
-    [_rootNode release]; _rootNode = nil;
+    RMSpatialIndexDestroy(_annotationIndex); _annotationIndex = NULL;
+    RMVisibleSetDestroy(_visibleSet); _visibleSet = NULL;
     [super dealloc];
 }
 
+- (BOOL)containsAnnotation:(RMAnnotation *)annotation
+{
+    RMProjectedRect boundingBox;
+
+    return RMSpatialIndexGetBoundingBox(_annotationIndex, (uintptr_t)annotation, &boundingBox);
+}
+
 - (void)addAnnotation:(RMAnnotation *)annotation
 {
     @synchronized (self)
     {
-        [_rootNode addAnnotation:annotation];
+        if ([self containsAnnotation:annotation])
+        {
+            [self annotationDidChangeBoundingBox:annotation];
+            return;
+        }
+
+        if ( ! RMSpatialIndexInsert(_annotationIndex, (uintptr_t)annotation, annotation.projectedBoundingBox))
+            return;
+
+        RMVisibleSetItemDidChange(_visibleSet, (uintptr_t)annotation);
+        [self clustersDidAddAnnotation:annotation];
     }
 }
 
 - (void)addAnnotations:(NSArray *)annotations
 {
-//    RMLog(@"Prepare tree");
-//    [rootNode precreateQuadTreeInBounds:[[RMProjection googleProjection] planetBounds] withDepth:5];
+    NSUInteger count = [annotations count], indexed = 0;
+    uintptr_t *items = malloc(count * sizeof(uintptr_t));
+    RMProjectedRect *boundingBoxes = malloc(count * sizeof(RMProjectedRect));
+
+    if ( ! items || ! boundingBoxes)
+    {
+        free(items);
+        free(boundingBoxes);
+
+        for (RMAnnotation *annotation in annotations)
+            [self addAnnotation:annotation];
+
+        return;
+    }
 
     @synchronized (self)
     {
         for (RMAnnotation *annotation in annotations)
         {
-            [_rootNode addAnnotation:annotation];
+            items[indexed] = (uintptr_t)annotation;
+            boundingBoxes[indexed++] = annotation.projectedBoundingBox;
+
+            [self clustersDidAddAnnotation:annotation];
         }
+
+        // Sorted and packed in one pass rather than one insert at a time
+        if (indexed)
+            RMSpatialIndexInsertMany(_annotationIndex, items, boundingBoxes, indexed);
+
+        // Only a few are checked one by one, more invalidate the visible set
+        for (NSUInteger i = 0; i < indexed; i++)
+            RMVisibleSetItemDidChange(_visibleSet, items[i]);
     }
+
+    free(items);
+    free(boundingBoxes);
 }
 
 - (void)removeAnnotation:(RMAnnotation *)annotation
 {
     @synchronized (self)
     {
-        [annotation.quadTreeNode removeAnnotation:annotation];
+        if ( ! RMSpatialIndexRemove(_annotationIndex, (uintptr_t)annotation))
+            return;
+
+        RMVisibleSetRemove(_visibleSet, (uintptr_t)annotation);
+        [self clustersDidRemoveAnnotation:annotation];
+    }
+}
+
+- (void)annotationDidChangeBoundingBox:(RMAnnotation *)annotation
+{
+    @synchronized (self)
+    {
+        if ( ! [self containsAnnotation:annotation])
+            return;
+
+        RMSpatialIndexInsert(_annotationIndex, (uintptr_t)annotation, annotation.projectedBoundingBox);
+        RMVisibleSetItemDidChange(_visibleSet, (uintptr_t)annotation);
+        [self clustersDidMoveAnnotation:annotation];
     }
 }
 
@@ -661,9 +480,110 @@
 {
     @synchronized (self)
     {
-        [_rootNode release];
-        _rootNode = [[RMQuadTreeNode alloc] initWithMapView:_mapView forParent:nil inBoundingBox:[[RMProjection googleProjection] planetBounds]];
+        RMSpatialIndexRemoveAll(_annotationIndex);
+        RMVisibleSetInvalidate(_visibleSet);
+        [self invalidateClusters];
+    }
+}
+
+#pragma mark - Clusters
+
+- (void)invalidateClusterNodes
+{
+    for (RMQuadTreeNode *clusterNode in [_clusterNodes objectEnumerator])
+        [clusterNode releaseClusterAnnotation];
+
+    [_clusterNodes removeAllObjects];
+}
+
+- (void)invalidateClusters
+{
+    [self invalidateClusterNodes];
+    [_clusters release]; _clusters = nil;
+}
+
+- (void)clustersDidAddAnnotation:(RMAnnotation *)annotation
+{
+    if ( ! _clusters)
+        return;
+
+    if (annotation.clusteringEnabled)
+        [self invalidateClusters];
+    else
+        [_clusters.unclusteredAnnotations addObject:annotation];
+}
+
+// By what was built, in case clusteringEnabled changed since
+- (BOOL)clustersHaveUnclusteredAnnotation:(RMAnnotation *)annotation
+{
+    return ([_clusters.unclusteredAnnotations indexOfObjectIdenticalTo:annotation] != NSNotFound);
+}
+
+- (void)clustersDidMoveAnnotation:(RMAnnotation *)annotation
+{
+    // The unclustered annotations are looked up where they are at every query
+    if (_clusters && ! [self clustersHaveUnclusteredAnnotation:annotation])
+        [self invalidateClusters];
+}
+
+- (void)clustersDidRemoveAnnotation:(RMAnnotation *)annotation
+{
+    if ( ! _clusters)
+        return;
+
+    if ([self clustersHaveUnclusteredAnnotation:annotation])
+        [_clusters.unclusteredAnnotations removeObjectIdenticalTo:annotation];
+    else
+        [self invalidateClusters];
+}
+
+// Returns the clusters for the projected cluster size at the current zoom level of the
+// map, building them if needed, or nil if they cannot be built
+- (RMQuadTreeClusters *)clustersWithProjectedClusterSize:(RMProjectedSize)clusterSize zoom:(double *)zoom
+{
+    double metersPerPixel = _mapView.metersPerPixel;
+    NSUInteger tileSideLength = _mapView.tileSourcesContainer.tileSideLength;
+
+    if (metersPerPixel <= 0.0 || clusterSize.width <= 0.0 || tileSideLength == 0)
+        return nil;
+
+    // Clusters about as wide as clusterSize on the screen, for every zoom level of the map
+    RMClusterIndexOptions options = RMClusterIndexDefaultOptions();
+    options.radius = fmax(1.0, round(clusterSize.width / metersPerPixel / 2.0));
+    options.metersPerPixelAtZoomZero = [[RMProjection googleProjection] planetBounds].size.width / tileSideLength;
+    options.minZoom = MAX(0, (int)floorf(_mapView.minZoom));
+    options.maxZoom = MIN(kMaxClusteredZoom, MAX(options.minZoom, (int)ceilf(_mapView.maxZoom)));
+
+    // So that a zoom right at a level is not rounded down to the one below
+    *zoom = log2(options.metersPerPixelAtZoomZero / metersPerPixel) + 1e-6;
+
+    if (_clusters && RMQuadTreeClusterOptionsEqual(_clusters.options, options))
+        return _clusters;
+
+    [self invalidateClusters];
+
+    NSMutableArray *annotations = [NSMutableArray arrayWithCapacity:RMSpatialIndexCount(_annotationIndex)];
+
+    RMSpatialIndexQuery(_annotationIndex, [[RMProjection googleProjection] planetBounds], RMQuadTreeCollectAnnotation, annotations);
+
+    _clusters = [[RMQuadTreeClusters alloc] initWithAnnotations:annotations options:options];
+
+    return _clusters;
+}
+
+- (RMAnnotation *)clusterAnnotationForCluster:(const RMCluster *)cluster inClusters:(RMQuadTreeClusters *)clusters findGravityCenter:(BOOL)findGravityCenter
+{
+    NSNumber *clusterID = [NSNumber numberWithUnsignedInt:cluster->clusterID];
+    RMQuadTreeNode *clusterNode = [_clusterNodes objectForKey:clusterID];
+
+    if ( ! clusterNode)
+    {
+        clusterNode = [[RMQuadTreeNode alloc] initWithMapView:_mapView clusters:clusters cluster:cluster findGravityCenter:findGravityCenter];
+        [_clusterNodes setObject:clusterNode forKey:clusterID];
+        [clusterNode release];
     }
+
+    return clusterNode.clusterAnnotation;
 }
 
 #pragma mark -
@@ -679,10 +599,78 @@
 
     @synchronized (self)
     {
-        [_rootNode addAnnotationsInBoundingBox:boundingBox toMutableArray:annotations createClusterAnnotations:createClusterAnnotations withProjectedClusterSize:clusterSize andProjectedClusterMarkerSize:clusterMarkerSize findGravityCenter:findGravityCenter];
+        // Without clustering, only the annotations in the box
+        if ( ! createClusterAnnotations)
+        {
+            RMSpatialIndexQuery(_annotationIndex, boundingBox, RMQuadTreeCollectAnnotation, annotations);
+
+            return annotations;
+        }
+
+        double zoom;
+        RMQuadTreeClusters *clusters = [self clustersWithProjectedClusterSize:clusterSize zoom:&zoom];
+
+        if ( ! clusters)
+        {
+            RMSpatialIndexQuery(_annotationIndex, boundingBox, RMQuadTreeCollectAnnotation, annotations);
+
+            return annotations;
+        }
+
+        if (findGravityCenter != _clusterNodesFindGravityCenter)
+        {
+            [self invalidateClusterNodes];
+            _clusterNodesFindGravityCenter = findGravityCenter;
+        }
+
+        // Also the clusters just outside of the box whose markers reach into it
+        RMProjectedRect clusterRect = RMProjectedRectMake(boundingBox.origin.x - (clusterMarkerSize.width / 2.0),
+                                                          boundingBox.origin.y - (clusterMarkerSize.height / 2.0),
+                                                          boundingBox.size.width + clusterMarkerSize.width,
+                                                          boundingBox.size.height + clusterMarkerSize.height);
+
+        RMQuadTreeClusterQuery query = { self, clusters, annotations, findGravityCenter };
+
+        RMClusterIndexQuery(clusters.index, clusterRect, zoom, RMQuadTreeAddCluster, &query);
+
+        for (RMAnnotation *annotation in clusters.unclusteredAnnotations)
+        {
+            if (RMProjectedRectIntersectsProjectedRect(boundingBox, annotation.projectedBoundingBox))
+                [annotations addObject:annotation];
+        }
     }
 
     return annotations;
 }
 
+- (BOOL)updateVisibleAnnotationsInProjectedRect:(RMProjectedRect)boundingBox enteringAnnotations:(NSMutableArray *)enteringAnnotations leavingAnnotations:(NSMutableArray *)leavingAnnotations movedAnnotations:(NSMutableArray *)movedAnnotations
+{
+    RMQuadTreeVisibilityChanges changes = { enteringAnnotations, leavingAnnotations, movedAnnotations };
+
+    @synchronized (self)
+    {
+        BOOL incremental = RMVisibleSetHasViewport(_visibleSet);
+
+        if (RMVisibleSetUpdate(_visibleSet, _annotationIndex, boundingBox, RMQuadTreeAnnotationEntered, RMQuadTreeAnnotationLeft, RMQuadTreeAnnotationMoved, &changes))
+            return incremental;
+
+        // Out of memory: start over with everything in the viewport
+        [enteringAnnotations removeAllObjects];
+        [leavingAnnotations removeAllObjects];
+        [movedAnnotations removeAllObjects];
+
+        RMSpatialIndexQuery(_annotationIndex, boundingBox, RMQuadTreeCollectAnnotation, enteringAnnotations);
+    }
+
+    return NO;
+}
+
+- (void)invalidateVisibleAnnotations
+{
+    @synchronized (self)
+    {
+        RMVisibleSetInvalidate(_visibleSet);
+    }
+}
+
 @end
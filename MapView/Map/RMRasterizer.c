@@ -0,0 +1,672 @@
+//
+//  RMRasterizer.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMRasterizer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Define as 0 to use the scalar code, as with compilers without vector extensions
+#ifndef RM_RASTERIZER_VECTORS
+#if defined(__GNUC__) && defined(__has_builtin)
+#if __has_builtin(__builtin_shufflevector)
+#define RM_RASTERIZER_VECTORS 1
+#endif
+#endif
+#endif
+
+// How far, in pixels, the polygons of round joins and caps may be from the circle
+#define kRMRasterizerRoundTolerance 0.1
+
+#define kRMRasterizerMaximumRoundSegments 128
+
+#if RM_RASTERIZER_VECTORS
+typedef float RMRasterizerVector __attribute__((vector_size(16)));
+#endif
+
+struct RMRasterizer {
+    int width, height;
+
+    // The area covered in each pixel by the lines of the path, signed by their
+    // direction, in rows of width + 2 cells for lines on the right edge
+    float *cells;
+    size_t stride;
+
+    // The cells touched in each row, and the rows touched
+    int *rowFirst, *rowLast;
+    int firstRow, lastRow;
+
+    // The coverage of a row
+    float *coverage;
+
+    double scaleX, scaleY, offsetX, offsetY;
+
+    // The path, in pixels
+    bool stroking;
+    RMRasterizerStrokeStyle style;
+    bool hasCurrent;
+    RMProjectedPoint start, current;
+
+    // Stroking: the directions of the first and last segments of the subpath
+    RMProjectedPoint firstDirection, lastDirection;
+    size_t segments;
+};
+
+#pragma mark - Lines
+
+// Add a line between the left and right edges, x0 and x1 in [0, width]
+static void RMRasterizerDrawLine(RMRasterizer *rasterizer, double x0, double y0, double x1, double y1)
+{
+    float direction = 1.0f;
+
+    if (y0 == y1)
+        return;
+
+    if (y0 > y1)
+    {
+        double x = x0, y = y0;
+
+        x0 = x1; y0 = y1;
+        x1 = x; y1 = y;
+        direction = -1.0f;
+    }
+
+    if (y1 <= 0.0 || y0 >= rasterizer->height)
+        return;
+
+    double dxdy = (x1 - x0) / (y1 - y0);
+    double x = x0;
+
+    if (y0 < 0.0)
+    {
+        x -= y0 * dxdy;
+        y0 = 0.0;
+    }
+
+    int firstRow = (int)y0;
+    int lastRow = (int)ceil(y1) - 1;
+    double width = rasterizer->width;
+
+    if (lastRow >= rasterizer->height)
+        lastRow = rasterizer->height - 1;
+
+    if (firstRow < rasterizer->firstRow)
+        rasterizer->firstRow = firstRow;
+    if (lastRow > rasterizer->lastRow)
+        rasterizer->lastRow = lastRow;
+
+    for (int y = firstRow; y <= lastRow; y++)
+    {
+        float *row = rasterizer->cells + y * rasterizer->stride;
+        double dy = fmin(y + 1.0, y1) - fmax(y, y0);
+        double xNext = fmin(fmax(x + dxdy * dy, 0.0), width);
+        float d = (float)dy * direction;
+        double left = fmin(x, xNext), right = fmax(x, xNext);
+        double leftFloor = floor(left);
+        int i0 = (int)leftFloor;
+        int i1 = (int)ceil(right);
+
+        if (i1 <= i0 + 1)
+        {
+            // Within one pixel: the part of it right of the line, and the next ones
+            float middle = (float)(0.5 * (x + xNext) - leftFloor);
+
+            row[i0] += d - d * middle;
+            row[i0 + 1] += d * middle;
+        }
+        else
+        {
+            // Across pixels: the triangles in the first and last ones, and the same
+            // share of the area in each one in between
+            float s = (float)(1.0 / (right - left));
+            float leftFraction = (float)(left - leftFloor);
+            float first = 0.5f * s * (1.0f - leftFraction) * (1.0f - leftFraction);
+            float rightFraction = (float)(right - i1 + 1.0);
+            float last = 0.5f * s * rightFraction * rightFraction;
+
+            row[i0] += d * first;
+
+            if (i1 == i0 + 2)
+            {
+                row[i0 + 1] += d * (1.0f - first - last);
+            }
+            else
+            {
+                float second = s * (1.5f - leftFraction);
+
+                row[i0 + 1] += d * (second - first);
+
+                for (int i = i0 + 2; i < i1 - 1; i++)
+                    row[i] += d * s;
+
+                row[i1 - 1] += d * (1.0f - second - (i1 - i0 - 3) * s - last);
+            }
+
+            row[i1] += d * last;
+        }
+
+        if (i0 < rasterizer->rowFirst[y])
+            rasterizer->rowFirst[y] = i0;
+        if (i1 + 1 > rasterizer->rowLast[y])
+            rasterizer->rowLast[y] = i1 + 1;
+
+        x = xNext;
+    }
+}
+
+// Add a line in pixels. What is left of the bitmap covers the rest of the row as a
+// line on its left edge would, and what is right of it nothing: the line is split
+// where it crosses the edges and its parts outside moved onto them.
+static void RMRasterizerAddLine(RMRasterizer *rasterizer, RMProjectedPoint a, RMProjectedPoint b)
+{
+    double width = rasterizer->width;
+    double crossings[2];
+    int count = 0;
+
+    if (a.y == b.y || (a.y <= 0.0 && b.y <= 0.0) || (a.y >= rasterizer->height && b.y >= rasterizer->height))
+        return;
+
+    if ((a.x < 0.0) != (b.x < 0.0))
+        crossings[count++] = -a.x / (b.x - a.x);
+
+    if ((a.x > width) != (b.x > width))
+        crossings[count++] = (width - a.x) / (b.x - a.x);
+
+    if (count == 2 && crossings[0] > crossings[1])
+    {
+        double t = crossings[0];
+
+        crossings[0] = crossings[1];
+        crossings[1] = t;
+    }
+
+    RMProjectedPoint from = a;
+
+    for (int i = 0; i <= count; i++)
+    {
+        RMProjectedPoint to = b;
+
+        if (i < count)
+        {
+            to.x = a.x + crossings[i] * (b.x - a.x);
+            to.y = a.y + crossings[i] * (b.y - a.y);
+        }
+
+        double x0 = fmin(fmax(from.x, 0.0), width), x1 = fmin(fmax(to.x, 0.0), width);
+
+        if (x0 < width || x1 < width)
+            RMRasterizerDrawLine(rasterizer, x0, from.y, x1, to.y);
+
+        from = to;
+    }
+}
+
+// Add a polygon, oriented so that it adds to every other one added this way
+static void RMRasterizerAddPolygon(RMRasterizer *rasterizer, const RMProjectedPoint *points, int count)
+{
+    double area = 0.0;
+
+    for (int i = 0; i < count; i++)
+    {
+        RMProjectedPoint a = points[i], b = points[(i + 1) % count];
+
+        area += a.x * b.y - b.x * a.y;
+    }
+
+    if (area == 0.0)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (area > 0.0)
+            RMRasterizerAddLine(rasterizer, points[i], points[(i + 1) % count]);
+        else
+            RMRasterizerAddLine(rasterizer, points[(i + 1) % count], points[i]);
+    }
+}
+
+#pragma mark - Stroking
+
+static RMProjectedPoint RMRasterizerOffset(RMProjectedPoint point, RMProjectedPoint vector, double length)
+{
+    return RMProjectedPointMake(point.x + vector.x * length, point.y + vector.y * length);
+}
+
+static void RMRasterizerAddCircle(RMRasterizer *rasterizer, RMProjectedPoint center, double radius)
+{
+    RMProjectedPoint points[kRMRasterizerMaximumRoundSegments];
+    int count = kRMRasterizerMaximumRoundSegments;
+
+    if (radius > kRMRasterizerRoundTolerance)
+        count = (int)ceil(M_PI / acos(1.0 - kRMRasterizerRoundTolerance / radius));
+
+    if (count < 8)
+        count = 8;
+    else if (count > kRMRasterizerMaximumRoundSegments)
+        count = kRMRasterizerMaximumRoundSegments;
+
+    for (int i = 0; i < count; i++)
+    {
+        double angle = 2.0 * M_PI * i / count;
+
+        points[i] = RMProjectedPointMake(center.x + radius * cos(angle), center.y + radius * sin(angle));
+    }
+
+    RMRasterizerAddPolygon(rasterizer, points, count);
+}
+
+// The join at point from a segment going in direction to one going in next
+static void RMRasterizerAddJoin(RMRasterizer *rasterizer, RMProjectedPoint point, RMProjectedPoint direction, RMProjectedPoint next)
+{
+    double halfWidth = rasterizer->style.lineWidth / 2.0;
+    double cross = direction.x * next.y - direction.y * next.x;
+    double dot = direction.x * next.x + direction.y * next.y;
+
+    if (cross == 0.0 && dot > 0.0)
+        return;
+
+    // A round join within the tolerance of a bevel is drawn as one
+    if (rasterizer->style.lineJoin == RMRasterizerLineJoinRound && halfWidth * (1.0 - sqrt((1.0 + dot) / 2.0)) > kRMRasterizerRoundTolerance)
+    {
+        RMRasterizerAddCircle(rasterizer, point, halfWidth);
+        return;
+    }
+
+    // The normals on the outer side of the turn
+    double side = (cross > 0.0 ? -1.0 : 1.0);
+    RMProjectedPoint normal = RMProjectedPointMake(-direction.y * side, direction.x * side);
+    RMProjectedPoint nextNormal = RMProjectedPointMake(-next.y * side, next.x * side);
+    RMProjectedPoint points[4] = {
+        point,
+        RMRasterizerOffset(point, normal, halfWidth),
+        point,
+        RMRasterizerOffset(point, nextNormal, halfWidth),
+    };
+
+    if (rasterizer->style.lineJoin == RMRasterizerLineJoinMiter)
+    {
+        RMProjectedPoint miter = RMProjectedPointMake(normal.x + nextNormal.x, normal.y + nextNormal.y);
+        double miterLength = hypot(miter.x, miter.y);
+
+        // The miter is 1 / sin(angle / 2) line widths long, which is also 2 / miterLength
+        if (miterLength > 0.0 && 2.0 / miterLength <= rasterizer->style.miterLimit)
+        {
+            points[2] = RMRasterizerOffset(point, miter, 2.0 * halfWidth / (miterLength * miterLength));
+            RMRasterizerAddPolygon(rasterizer, points, 4);
+            return;
+        }
+    }
+
+    points[2] = points[3];
+    RMRasterizerAddPolygon(rasterizer, points, 3);
+}
+
+// The cap at point of a line going out in direction
+static void RMRasterizerAddCap(RMRasterizer *rasterizer, RMProjectedPoint point, RMProjectedPoint direction)
+{
+    double halfWidth = rasterizer->style.lineWidth / 2.0;
+
+    if (rasterizer->style.lineCap == RMRasterizerLineCapRound)
+    {
+        RMRasterizerAddCircle(rasterizer, point, halfWidth);
+    }
+    else if (rasterizer->style.lineCap == RMRasterizerLineCapSquare)
+    {
+        RMProjectedPoint normal = RMProjectedPointMake(-direction.y, direction.x);
+        RMProjectedPoint end = RMRasterizerOffset(point, direction, halfWidth);
+        RMProjectedPoint points[4] = {
+            RMRasterizerOffset(point, normal, halfWidth),
+            RMRasterizerOffset(end, normal, halfWidth),
+            RMRasterizerOffset(end, normal, -halfWidth),
+            RMRasterizerOffset(point, normal, -halfWidth),
+        };
+
+        RMRasterizerAddPolygon(rasterizer, points, 4);
+    }
+}
+
+static void RMRasterizerStrokeSegment(RMRasterizer *rasterizer, RMProjectedPoint point)
+{
+    RMProjectedPoint from = rasterizer->current;
+    double length = hypot(point.x - from.x, point.y - from.y);
+
+    if (length == 0.0)
+        return;
+
+    RMProjectedPoint direction = RMProjectedPointMake((point.x - from.x) / length, (point.y - from.y) / length);
+    RMProjectedPoint normal = RMProjectedPointMake(-direction.y, direction.x);
+    double halfWidth = rasterizer->style.lineWidth / 2.0;
+
+    if (rasterizer->segments == 0)
+        rasterizer->firstDirection = direction;
+    else
+        RMRasterizerAddJoin(rasterizer, from, rasterizer->lastDirection, direction);
+
+    RMProjectedPoint points[4] = {
+        RMRasterizerOffset(from, normal, halfWidth),
+        RMRasterizerOffset(point, normal, halfWidth),
+        RMRasterizerOffset(point, normal, -halfWidth),
+        RMRasterizerOffset(from, normal, -halfWidth),
+    };
+
+    RMRasterizerAddPolygon(rasterizer, points, 4);
+
+    rasterizer->lastDirection = direction;
+    rasterizer->current = point;
+    rasterizer->segments++;
+}
+
+static void RMRasterizerFinishSubpath(RMRasterizer *rasterizer, bool closed)
+{
+    if ( ! rasterizer->hasCurrent)
+        return;
+
+    if ( ! rasterizer->stroking)
+    {
+        RMRasterizerAddLine(rasterizer, rasterizer->current, rasterizer->start);
+    }
+    else if (closed)
+    {
+        RMRasterizerStrokeSegment(rasterizer, rasterizer->start);
+
+        if (rasterizer->segments > 0)
+            RMRasterizerAddJoin(rasterizer, rasterizer->start, rasterizer->lastDirection, rasterizer->firstDirection);
+    }
+    else if (rasterizer->segments > 0)
+    {
+        RMProjectedPoint backwards = RMProjectedPointMake(-rasterizer->firstDirection.x, -rasterizer->firstDirection.y);
+
+        RMRasterizerAddCap(rasterizer, rasterizer->start, backwards);
+        RMRasterizerAddCap(rasterizer, rasterizer->current, rasterizer->lastDirection);
+    }
+
+    rasterizer->current = rasterizer->start;
+    rasterizer->segments = 0;
+}
+
+#pragma mark - Blending
+
+// The coverage of a running sum of cells
+static inline float RMRasterizerCoverage(float area, RMRasterizerFillRule fillRule)
+{
+    area = fabsf(area);
+
+    if (fillRule == RMRasterizerFillRuleEvenOdd)
+    {
+        area = fmodf(area, 2.0f);
+
+        if (area > 1.0f)
+            area = 2.0f - area;
+    }
+
+    return (area < 1.0f ? area : 1.0f);
+}
+
+// Sum the cells from first to last into coverage, returning the sum
+static float RMRasterizerSumCells(const float *cells, float *coverage, int first, int last)
+{
+    float sum = 0.0f;
+    int i = first;
+
+#if RM_RASTERIZER_VECTORS
+    RMRasterizerVector carry = { 0.0f, 0.0f, 0.0f, 0.0f };
+    RMRasterizerVector zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    for ( ; i + 4 <= last + 1; i += 4)
+    {
+        RMRasterizerVector v;
+
+        memcpy(&v, cells + i, sizeof(v));
+
+        // Prefix sum within the vector, then carried over from the previous one
+        v += __builtin_shufflevector(zero, v, 0, 4, 5, 6);
+        v += __builtin_shufflevector(zero, v, 0, 1, 4, 5);
+        v += carry;
+        carry = __builtin_shufflevector(v, v, 3, 3, 3, 3);
+
+        memcpy(coverage + i, &v, sizeof(v));
+    }
+
+    sum = carry[0];
+#endif
+
+    for ( ; i <= last; i++)
+    {
+        sum += cells[i];
+        coverage[i] = sum;
+    }
+
+    return sum;
+}
+
+// Blend color, premultiplied, over count pixels with the coverage of the sums, or with
+// the coverage of sum if sums is NULL
+static void RMRasterizerBlend(uint8_t *pixels, const float *sums, float sum, int count, const float color[4], RMRasterizerFillRule fillRule)
+{
+#if RM_RASTERIZER_VECTORS
+    RMRasterizerVector source = { color[0], color[1], color[2], color[3] };
+#endif
+    float coverage = RMRasterizerCoverage(sum, fillRule);
+
+    for (int i = 0; i < count; i++, pixels += 4)
+    {
+        if (sums)
+            coverage = RMRasterizerCoverage(sums[i], fillRule);
+
+        if (coverage <= 0.0f)
+            continue;
+
+#if RM_RASTERIZER_VECTORS
+        RMRasterizerVector destination = { pixels[0], pixels[1], pixels[2], pixels[3] };
+        RMRasterizerVector blended = source * (255.0f * coverage) + destination * (1.0f - color[3] * coverage) + 0.5f;
+
+        pixels[0] = (uint8_t)blended[0];
+        pixels[1] = (uint8_t)blended[1];
+        pixels[2] = (uint8_t)blended[2];
+        pixels[3] = (uint8_t)blended[3];
+#else
+        float remaining = 1.0f - color[3] * coverage;
+
+        for (int c = 0; c < 4; c++)
+            pixels[c] = (uint8_t)(color[c] * 255.0f * coverage + pixels[c] * remaining + 0.5f);
+#endif
+    }
+}
+
+static void RMRasterizerClear(RMRasterizer *rasterizer)
+{
+    for (int y = rasterizer->firstRow; y <= rasterizer->lastRow; y++)
+    {
+        int first = rasterizer->rowFirst[y], last = rasterizer->rowLast[y];
+
+        if (first <= last)
+            memset(rasterizer->cells + y * rasterizer->stride + first, 0, (last - first + 1) * sizeof(float));
+
+        rasterizer->rowFirst[y] = rasterizer->width + 1;
+        rasterizer->rowLast[y] = -1;
+    }
+
+    rasterizer->firstRow = rasterizer->height;
+    rasterizer->lastRow = -1;
+}
+
+static void RMRasterizerBegin(RMRasterizer *rasterizer, bool stroking)
+{
+    RMRasterizerClear(rasterizer);
+
+    rasterizer->stroking = stroking;
+    rasterizer->hasCurrent = false;
+    rasterizer->segments = 0;
+}
+
+#pragma mark -
+
+RMRasterizer *RMRasterizerCreate(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    RMRasterizer *rasterizer = calloc(1, sizeof(RMRasterizer));
+
+    if ( ! rasterizer)
+        return NULL;
+
+    rasterizer->width = width;
+    rasterizer->height = height;
+    rasterizer->stride = width + 2;
+    rasterizer->cells = calloc(rasterizer->stride * height, sizeof(float));
+    rasterizer->rowFirst = malloc(height * sizeof(int));
+    rasterizer->rowLast = malloc(height * sizeof(int));
+    rasterizer->coverage = malloc(rasterizer->stride * sizeof(float));
+
+    if ( ! rasterizer->cells || ! rasterizer->rowFirst || ! rasterizer->rowLast || ! rasterizer->coverage)
+    {
+        RMRasterizerDestroy(rasterizer);
+        return NULL;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        rasterizer->rowFirst[y] = width + 1;
+        rasterizer->rowLast[y] = -1;
+    }
+
+    rasterizer->firstRow = height;
+    rasterizer->lastRow = -1;
+    rasterizer->scaleX = rasterizer->scaleY = 1.0;
+
+    return rasterizer;
+}
+
+void RMRasterizerDestroy(RMRasterizer *rasterizer)
+{
+    if ( ! rasterizer)
+        return;
+
+    free(rasterizer->cells);
+    free(rasterizer->rowFirst);
+    free(rasterizer->rowLast);
+    free(rasterizer->coverage);
+    free(rasterizer);
+}
+
+void RMRasterizerSetTransform(RMRasterizer *rasterizer, double scaleX, double scaleY, double offsetX, double offsetY)
+{
+    rasterizer->scaleX = scaleX;
+    rasterizer->scaleY = scaleY;
+    rasterizer->offsetX = offsetX;
+    rasterizer->offsetY = offsetY;
+}
+
+void RMRasterizerBeginFill(RMRasterizer *rasterizer)
+{
+    RMRasterizerBegin(rasterizer, false);
+}
+
+void RMRasterizerBeginStroke(RMRasterizer *rasterizer, const RMRasterizerStrokeStyle *style)
+{
+    RMRasterizerBegin(rasterizer, true);
+
+    rasterizer->style = *style;
+}
+
+void RMRasterizerAddElement(RMPathElementType type, RMProjectedPoint point, void *context)
+{
+    RMRasterizer *rasterizer = context;
+
+    point.x = point.x * rasterizer->scaleX + rasterizer->offsetX;
+    point.y = point.y * rasterizer->scaleY + rasterizer->offsetY;
+
+    if (type == RMPathElementCloseSubpath)
+    {
+        RMRasterizerFinishSubpath(rasterizer, true);
+        return;
+    }
+
+    if (type == RMPathElementMoveToPoint || ! rasterizer->hasCurrent)
+    {
+        RMRasterizerFinishSubpath(rasterizer, false);
+
+        rasterizer->start = rasterizer->current = point;
+        rasterizer->hasCurrent = true;
+        rasterizer->segments = 0;
+
+        if (type == RMPathElementMoveToPoint)
+            return;
+    }
+
+    if (rasterizer->stroking)
+    {
+        RMRasterizerStrokeSegment(rasterizer, point);
+    }
+    else
+    {
+        RMRasterizerAddLine(rasterizer, rasterizer->current, point);
+        rasterizer->current = point;
+    }
+}
+
+bool RMRasterizerDraw(RMRasterizer *rasterizer, RMRasterizerFillRule fillRule, RMRasterizerColor color, uint8_t *pixels, size_t bytesPerRow)
+{
+    float premultiplied[4] = { color.red * color.alpha, color.green * color.alpha, color.blue * color.alpha, color.alpha };
+    bool drawn = false;
+
+    RMRasterizerFinishSubpath(rasterizer, false);
+    rasterizer->hasCurrent = false;
+
+    if (rasterizer->stroking)
+        fillRule = RMRasterizerFillRuleNonZero;
+
+    for (int y = rasterizer->firstRow; y <= rasterizer->lastRow; y++)
+    {
+        int first = rasterizer->rowFirst[y];
+        int last = rasterizer->rowLast[y];
+
+        if (first > last)
+            continue;
+
+        if (last >= rasterizer->width)
+            last = rasterizer->width - 1;
+
+        uint8_t *row = pixels + y * bytesPerRow;
+        float sum = RMRasterizerSumCells(rasterizer->cells + y * rasterizer->stride, rasterizer->coverage, first, last);
+
+        RMRasterizerBlend(row + 4 * first, rasterizer->coverage + first, 0.0f, last - first + 1, premultiplied, fillRule);
+
+        // Past the last line the coverage stays the same to the right edge
+        if (last + 1 < rasterizer->width && RMRasterizerCoverage(sum, fillRule) > 0.0f)
+            RMRasterizerBlend(row + 4 * (last + 1), NULL, sum, rasterizer->width - last - 1, premultiplied, fillRule);
+
+        drawn = true;
+    }
+
+    RMRasterizerClear(rasterizer);
+
+    return drawn;
+}
@@ -0,0 +1,106 @@
+//
+//  RMRasterizer.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMRASTERIZER_H_
+#define _RMRASTERIZER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+#include "RMPathPyramid.h"
+
+// An anti-aliased scanline rasterizer filling and stroking paths into RGBA bitmaps,
+// such as tile images, without Core Graphics.
+//
+// Every line of a path adds the area it covers in each pixel, signed by its direction,
+// to a buffer of cells; the running sum of a row gives the coverage of its pixels,
+// which is blended into the bitmap with the color of the path. Lines are stroked as
+// the union of a quadrilateral per segment and polygons for the joins and caps, all of
+// the same orientation so that they add up. Only the rows and columns a path touches
+// are summed and blended, four channels at a time with the vector extensions of GCC
+// and Clang where available.
+//
+// Bitmaps are 8 bits per channel, red, green, blue then alpha premultiplied, as with
+// kCGImageAlphaPremultipliedLast. It does no locking of its own.
+
+typedef struct RMRasterizer RMRasterizer;
+
+typedef struct {
+    float red, green, blue, alpha; // 0 to 1, not premultiplied
+} RMRasterizerColor;
+
+typedef enum {
+    RMRasterizerFillRuleNonZero,
+    RMRasterizerFillRuleEvenOdd,
+} RMRasterizerFillRule;
+
+typedef enum {
+    RMRasterizerLineCapButt,
+    RMRasterizerLineCapRound,
+    RMRasterizerLineCapSquare,
+} RMRasterizerLineCap;
+
+typedef enum {
+    RMRasterizerLineJoinMiter,
+    RMRasterizerLineJoinRound,
+    RMRasterizerLineJoinBevel,
+} RMRasterizerLineJoin;
+
+typedef struct {
+    double lineWidth; // in pixels
+    RMRasterizerLineCap lineCap;
+    RMRasterizerLineJoin lineJoin;
+    double miterLimit; // as with CGContextSetMiterLimit()
+} RMRasterizerStrokeStyle;
+
+// Create a rasterizer for bitmaps of width by height pixels. Returns NULL if memory
+// could not be allocated.
+RMRasterizer *RMRasterizerCreate(int width, int height);
+
+void RMRasterizerDestroy(RMRasterizer *rasterizer);
+
+// The transform from the coordinates of the paths to pixels, y pointing down:
+// x * scaleX + offsetX and y * scaleY + offsetY. Identity by default.
+void RMRasterizerSetTransform(RMRasterizer *rasterizer, double scaleX, double scaleY, double offsetX, double offsetY);
+
+// Start filling, or stroking with style, a path given by RMRasterizerAddElement().
+void RMRasterizerBeginFill(RMRasterizer *rasterizer);
+void RMRasterizerBeginStroke(RMRasterizer *rasterizer, const RMRasterizerStrokeStyle *style);
+
+// Add the next element of the path. An RMPathPyramidVisitor, the context being the
+// rasterizer, so that RMPathPyramidEnumerate() and RMPathClipper can draw into it.
+void RMRasterizerAddElement(RMPathElementType type, RMProjectedPoint point, void *rasterizer);
+
+// Blend the path in color over pixels, whose rows are bytesPerRow apart, and get ready
+// for the next one. Filled subpaths are closed; lines are always filled by the nonzero
+// rule. Returns false if the path covers no pixel.
+bool RMRasterizerDraw(RMRasterizer *rasterizer, RMRasterizerFillRule fillRule, RMRasterizerColor color, uint8_t *pixels, size_t bytesPerRow);
+
+#endif
@@ -0,0 +1,289 @@
+//
+//  RMSQLiteReaderPool.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMSQLiteReaderPool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define kRMSQLiteReaderPoolMaximumReaders 16
+#define kRMSQLiteReaderStatementCount 8
+
+typedef struct {
+    const char *sql;
+    sqlite3_stmt *statement;
+} RMSQLiteReaderStatementEntry;
+
+struct RMSQLiteReader {
+    sqlite3 *db;
+    RMSQLiteReader *next;
+    RMSQLiteReaderStatementEntry statements[kRMSQLiteReaderStatementCount];
+    unsigned int statementCount;
+};
+
+struct RMSQLiteReaderPool {
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    char *path;
+    int64_t mmapSize;
+    unsigned int maxReaders;
+    // Connections opened, all in readers, and those being opened outside the lock,
+    // which count towards maxReaders until they are
+    unsigned int readerCount, openingCount;
+    RMSQLiteReader *idle;
+    RMSQLiteReader *readers[kRMSQLiteReaderPoolMaximumReaders];
+};
+
+static RMSQLiteReader *RMSQLiteReaderOpen(RMSQLiteReaderPool *pool)
+{
+    RMSQLiteReader *reader = calloc(1, sizeof(RMSQLiteReader));
+
+    if ( ! reader)
+        return NULL;
+
+    if (sqlite3_open_v2(pool->path, &reader->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+    {
+        sqlite3_close(reader->db);
+        free(reader);
+        return NULL;
+    }
+
+    if (pool->mmapSize > 0)
+    {
+        char pragma[64];
+
+        snprintf(pragma, sizeof(pragma), "PRAGMA mmap_size=%lld", (long long)pool->mmapSize);
+        sqlite3_exec(reader->db, pragma, NULL, NULL, NULL);
+    }
+
+    return reader;
+}
+
+static void RMSQLiteReaderClose(RMSQLiteReader *reader)
+{
+    for (unsigned int i = 0; i < reader->statementCount; i++)
+        sqlite3_finalize(reader->statements[i].statement);
+
+    sqlite3_close(reader->db);
+    free(reader);
+}
+
+#pragma mark -
+
+RMSQLiteReaderPool *RMSQLiteReaderPoolCreate(const char *path, unsigned int maxReaders, int64_t mmapSize)
+{
+    RMSQLiteReaderPool *pool = calloc(1, sizeof(RMSQLiteReaderPool));
+
+    if ( ! pool)
+        return NULL;
+
+    if (maxReaders == 0)
+    {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+        maxReaders = (processors > 0 ? (unsigned int)processors : 1);
+    }
+
+    pool->path = strdup(path);
+    pool->mmapSize = mmapSize;
+    pool->maxReaders = (maxReaders < kRMSQLiteReaderPoolMaximumReaders ? maxReaders : kRMSQLiteReaderPoolMaximumReaders);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    // Open the first connection now, to report a file that cannot be read.
+    RMSQLiteReader *reader = (pool->path ? RMSQLiteReaderOpen(pool) : NULL);
+
+    if ( ! reader)
+    {
+        RMSQLiteReaderPoolDestroy(pool);
+        return NULL;
+    }
+
+    pool->readers[pool->readerCount++] = reader;
+    pool->idle = reader;
+
+    return pool;
+}
+
+void RMSQLiteReaderPoolDestroy(RMSQLiteReaderPool *pool)
+{
+    if ( ! pool)
+        return;
+
+    for (unsigned int i = 0; i < pool->readerCount; i++)
+        RMSQLiteReaderClose(pool->readers[i]);
+
+    pthread_cond_destroy(&pool->available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->path);
+    free(pool);
+}
+
+RMSQLiteReader *RMSQLiteReaderPoolAcquire(RMSQLiteReaderPool *pool)
+{
+    RMSQLiteReader *reader = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while ( ! pool->idle && pool->readerCount + pool->openingCount >= pool->maxReaders)
+        pthread_cond_wait(&pool->available, &pool->lock);
+
+    if (pool->idle)
+    {
+        reader = pool->idle;
+        pool->idle = reader->next;
+        reader->next = NULL;
+    }
+    else
+    {
+        // Reserve a place, then open outside the lock.
+        pool->openingCount++;
+
+        pthread_mutex_unlock(&pool->lock);
+        reader = RMSQLiteReaderOpen(pool);
+        pthread_mutex_lock(&pool->lock);
+
+        pool->openingCount--;
+
+        if (reader)
+            pool->readers[pool->readerCount++] = reader;
+        else
+            pthread_cond_signal(&pool->available); // give the place back
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return reader;
+}
+
+void RMSQLiteReaderPoolRelease(RMSQLiteReaderPool *pool, RMSQLiteReader *reader)
+{
+    if ( ! reader)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+
+    reader->next = pool->idle;
+    pool->idle = reader;
+
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+sqlite3 *RMSQLiteReaderDatabase(RMSQLiteReader *reader)
+{
+    return reader->db;
+}
+
+sqlite3_stmt *RMSQLiteReaderStatement(RMSQLiteReader *reader, const char *sql)
+{
+    for (unsigned int i = 0; i < reader->statementCount; i++)
+    {
+        if (reader->statements[i].sql == sql)
+        {
+            sqlite3_stmt *statement = reader->statements[i].statement;
+
+            sqlite3_reset(statement);
+            sqlite3_clear_bindings(statement);
+
+            return statement;
+        }
+    }
+
+    sqlite3_stmt *statement = NULL;
+
+    if (sqlite3_prepare_v2(reader->db, sql, -1, &statement, NULL) != SQLITE_OK)
+    {
+        sqlite3_finalize(statement);
+        return NULL;
+    }
+
+    // Beyond the cache, statements are prepared every time and replace the oldest one.
+    if (reader->statementCount == kRMSQLiteReaderStatementCount)
+    {
+        sqlite3_finalize(reader->statements[0].statement);
+        memmove(&reader->statements[0], &reader->statements[1], (kRMSQLiteReaderStatementCount - 1) * sizeof(RMSQLiteReaderStatementEntry));
+        reader->statementCount--;
+    }
+
+    reader->statements[reader->statementCount].sql = sql;
+    reader->statements[reader->statementCount].statement = statement;
+    reader->statementCount++;
+
+    return statement;
+}
+
+void *RMSQLiteReaderPoolCopyBlob(RMSQLiteReaderPool *pool, const char *sql, const int64_t *arguments, int argumentCount, size_t *length)
+{
+    RMSQLiteReader *reader = RMSQLiteReaderPoolAcquire(pool);
+    void *data = NULL;
+
+    if ( ! reader)
+        return NULL;
+
+    sqlite3_stmt *statement = RMSQLiteReaderStatement(reader, sql);
+
+    if (statement)
+    {
+        for (int i = 0; i < argumentCount; i++)
+            sqlite3_bind_int64(statement, i + 1, arguments[i]);
+
+        if (sqlite3_step(statement) == SQLITE_ROW && sqlite3_column_type(statement, 0) != SQLITE_NULL)
+        {
+            const void *blob = sqlite3_column_blob(statement, 0);
+            size_t size = (size_t)sqlite3_column_bytes(statement, 0);
+
+            // An empty blob is still a row; return a valid pointer for it.
+            data = malloc(size ? size : 1);
+
+            if (data)
+            {
+                if (size)
+                    memcpy(data, blob, size);
+
+                if (length)
+                    *length = size;
+            }
+        }
+
+        sqlite3_reset(statement);
+    }
+
+    RMSQLiteReaderPoolRelease(pool, reader);
+
+    return data;
+}
+
+unsigned int RMSQLiteReaderPoolMaximumReaders(RMSQLiteReaderPool *pool)
+{
+    return pool->maxReaders;
+}
@@ -0,0 +1,76 @@
+//
+//  RMSQLiteReaderPool.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMSQLITEREADERPOOL_H_
+#define _RMSQLITEREADERPOOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+// A pool of read-only connections to one SQLite file, for tile sets such as MBTiles
+// files that are only ever read. Each thread reading a tile takes a connection of its
+// own, so reads run in parallel instead of queueing on one connection.
+//
+// Connections are opened on demand, up to the maximum, with SQLITE_OPEN_READONLY and
+// SQLITE_OPEN_NOMUTEX since a connection is only used by one thread at a time, and
+// with the file memory-mapped. Every connection keeps its prepared statements.
+
+typedef struct RMSQLiteReaderPool RMSQLiteReaderPool;
+typedef struct RMSQLiteReader RMSQLiteReader;
+
+// Create a pool for the file at path, checking that it can be opened. Up to
+// maxReaders connections are opened, 0 meaning one per processor; mmapSize is the
+// mmap_size of each connection, 0 meaning SQLite's default. Returns NULL on error.
+RMSQLiteReaderPool *RMSQLiteReaderPoolCreate(const char *path, unsigned int maxReaders, int64_t mmapSize);
+
+// Close all connections. None may be in use.
+void RMSQLiteReaderPoolDestroy(RMSQLiteReaderPool *pool);
+
+// Take a connection, waiting for one if all are in use. Returns NULL if none could be opened.
+RMSQLiteReader *RMSQLiteReaderPoolAcquire(RMSQLiteReaderPool *pool);
+
+// Give the connection back to the pool.
+void RMSQLiteReaderPoolRelease(RMSQLiteReaderPool *pool, RMSQLiteReader *reader);
+
+sqlite3 *RMSQLiteReaderDatabase(RMSQLiteReader *reader);
+
+// The statement for sql, prepared on first use by this connection and reset, with
+// its bindings cleared, on every later one. sql must be a string constant: it is
+// remembered by address. Returns NULL if it could not be prepared.
+sqlite3_stmt *RMSQLiteReaderStatement(RMSQLiteReader *reader, const char *sql);
+
+// Run sql, a query with argumentCount integer parameters, and return a malloc()ed
+// copy of the blob in the first column of its first row, or NULL if there is none.
+// Takes and gives back a connection of its own.
+void *RMSQLiteReaderPoolCopyBlob(RMSQLiteReaderPool *pool, const char *sql, const int64_t *arguments, int argumentCount, size_t *length);
+
+unsigned int RMSQLiteReaderPoolMaximumReaders(RMSQLiteReaderPool *pool);
+
+#endif
@@ -30,6 +30,26 @@
 #import "RMProjection.h"
 #import "RMMapView.h"
 #import "RMAnnotation.h"
+#import "RMPathPyramid.h"
+#import "RMPathClipper.h"
+
+typedef struct {
+    UIBezierPath *path;
+    CGFloat scale;
+} RMShapeScaledPath;
+
+static void RMShapeAddPathElement(RMPathElementType type, RMProjectedPoint point, void *context)
+{
+    RMShapeScaledPath *scaledPath = context;
+    CGPoint scaledPoint = CGPointMake(point.x * scaledPath->scale, point.y * scaledPath->scale);
+
+    if (type == RMPathElementMoveToPoint)
+        [scaledPath->path moveToPoint:scaledPoint];
+    else if (type == RMPathElementAddLineToPoint)
+        [scaledPath->path addLineToPoint:scaledPoint];
+    else
+        [scaledPath->path closePath];
+}
 
 @implementation RMShape
 {
@@ -40,7 +60,14 @@
     CGRect previousBounds;
 
     CAShapeLayer *shapeLayer;
-    UIBezierPath *bezierPath;
+
+    // The points in projected meters relative to the first one, y pointing down,
+    // simplified for the scale they are drawn at
+    RMPathPyramid *pathPyramid;
+
+    // The path is clipped to this rect around the screen, in pixels
+    RMPathClipper *pathClipper;
+    CGRect clippedPathRect;
 
     RMMapView *mapView;
 }
@@ -55,6 +82,9 @@
 
 #define kDefaultLineWidth 2.0
 
+// Points moving the path by less than this many pixels are not drawn
+#define kPathSimplificationTolerance 0.25
+
 - (id)initWithView:(RMMapView *)aMapView
 {
     if (!(self = [super init]))
@@ -62,7 +92,9 @@
 
     mapView = aMapView;
 
-    bezierPath = [[UIBezierPath alloc] init];
+    pathPyramid = RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, kPathSimplificationTolerance);
+    pathClipper = RMPathClipperCreate();
+    clippedPathRect = CGRectNull;
     lineWidth = kDefaultLineWidth;
     ignorePathUpdates = NO;
 
@@ -97,7 +129,8 @@
 - (void)dealloc
 {
     mapView = nil;
-    [bezierPath release]; bezierPath = nil;
+    RMPathPyramidDestroy(pathPyramid); pathPyramid = NULL;
+    RMPathClipperDestroy(pathClipper); pathClipper = NULL;
     [shapeLayer release]; shapeLayer = nil;
     [super dealloc];
 }
@@ -149,13 +182,46 @@
     // we are about to overwrite nonClippedBounds, therefore we save the old value
     CGRect previousNonClippedBounds = nonClippedBounds;
 
-    if (scale != lastScale)
+    CGRect screenBounds = [mapView frame];
+    CGPoint newPosition = self.annotation.position;
+
+    float offset;
+    const float outset = 150.0f; // provides a buffer off screen edges for when path is scaled or moved
+
+    // The screen and the outset around it, relative to the first point of the path
+    CGRect visibleRect = CGRectOffset(CGRectInset(screenBounds, -outset, -outset), -newPosition.x, -newPosition.y);
+
+    if (scale != lastScale || ! CGRectContainsRect(clippedPathRect, visibleRect))
     {
+        BOOL scaleChanged = (scale != lastScale);
         lastScale = scale;
 
-        CGAffineTransform scaling = CGAffineTransformMakeScale(scale, scale);
-        UIBezierPath *scaledPath = [bezierPath copy];
-        [scaledPath applyTransform:scaling];
+        // Clip the path with another outset, so that it can be moved that far before
+        // it has to be clipped again
+        clippedPathRect = CGRectInset(visibleRect, -outset, -outset);
+
+        RMProjectedRect clipRect = RMProjectedRectMake(clippedPathRect.origin.x / scale, clippedPathRect.origin.y / scale,
+                                                       clippedPathRect.size.width / scale, clippedPathRect.size.height / scale);
+        BOOL isFilled = (CGColorGetAlpha(shapeLayer.fillColor) > 0.0);
+
+        // Only the points that show at this scale and near the screen, scaled as they are added
+        UIBezierPath *scaledPath = [[UIBezierPath alloc] init];
+        RMShapeScaledPath context = { scaledPath, scale };
+
+        // The dash pattern starts over with every subpath, so a dashed path is not
+        // clipped: its dashes would start anew where it enters the clipping rect, and
+        // move with it. It is only made again when the scale changes.
+        if ([lineDashLengths count])
+        {
+            clippedPathRect = CGRectInfinite;
+            RMPathPyramidEnumerate(pathPyramid, [mapView metersPerPixel], RMShapeAddPathElement, &context);
+        }
+        else
+        {
+            RMPathClipperBegin(pathClipper, clipRect, (isFilled ? RMPathClipperModeFill : RMPathClipperModeStroke), RMShapeAddPathElement, &context);
+            RMPathPyramidEnumerateInRect(pathPyramid, [mapView metersPerPixel], clipRect, isFilled, RMPathClipperAddElement, pathClipper);
+            RMPathClipperEnd(pathClipper);
+        }
 
         if (animated)
         {
@@ -170,9 +236,14 @@
 
         shapeLayer.path = scaledPath.CGPath;
 
-        // calculate the bounds of the scaled path
-        CGRect boundsInMercators = scaledPath.bounds;
-        nonClippedBounds = CGRectInset(boundsInMercators, -scaledLineWidth - (2 * shapeLayer.shadowRadius), -scaledLineWidth - (2 * shapeLayer.shadowRadius));
+        // calculate the bounds of the scaled path, all of it
+        if (scaleChanged)
+        {
+            RMProjectedRect boundingBox = RMPathPyramidBoundingBox(pathPyramid);
+            CGRect boundsInMercators = CGRectMake(boundingBox.origin.x * scale, boundingBox.origin.y * scale,
+                                                  boundingBox.size.width * scale, boundingBox.size.height * scale);
+            nonClippedBounds = CGRectInset(boundsInMercators, -scaledLineWidth - (2 * shapeLayer.shadowRadius), -scaledLineWidth - (2 * shapeLayer.shadowRadius));
+        }
 
         [scaledPath release];
     }
@@ -182,16 +253,9 @@
     // Clip bound rect to screen bounds.
     // If bounds are not clipped, they won't display when you zoom in too much.
 
-    CGRect screenBounds = [mapView frame];
-
     // we start with the non-clipped bounds and clip them
     CGRect clippedBounds = nonClippedBounds;
 
-    float offset;
-    const float outset = 150.0f; // provides a buffer off screen edges for when path is scaled or moved
-
-    CGPoint newPosition = self.annotation.position;
-
 //    RMLog(@"x:%f y:%f screen bounds: %f %f %f %f", newPosition.x, newPosition.y,  screenBounds.origin.x, screenBounds.origin.y, screenBounds.size.width, screenBounds.size.height);
 
     // Clip top
@@ -286,7 +350,7 @@
 
         self.position = [mapView projectedPointToPixel:projectedLocation];
 
-        [bezierPath moveToPoint:CGPointMake(0.0f, 0.0f)];
+        RMPathPyramidMoveToPoint(pathPyramid, RMProjectedPointMake(0.0, 0.0));
     }
     else
     {
@@ -294,9 +358,9 @@
         point.y = point.y - projectedLocation.y;
 
         if (isDrawing)
-            [bezierPath addLineToPoint:CGPointMake(point.x, -point.y)];
+            RMPathPyramidAddLineToPoint(pathPyramid, RMProjectedPointMake(point.x, -point.y));
         else
-            [bezierPath moveToPoint:CGPointMake(point.x, -point.y)];
+            RMPathPyramidMoveToPoint(pathPyramid, RMProjectedPointMake(point.x, -point.y));
 
         lastScale = 0.0;
         [self recalculateGeometryAnimated:NO];
@@ -353,7 +417,7 @@
 
 - (void)closePath
 {
-    [bezierPath closePath];
+    RMPathPyramidCloseSubpath(pathPyramid);
 }
 
 - (float)lineWidth
@@ -405,6 +469,15 @@
     }
 }
 
+- (void)setLineDashLengths:(NSArray *)newLineDashLengths
+{
+    lineDashLengths = newLineDashLengths;
+
+    // dashed paths are not clipped
+    clippedPathRect = CGRectNull;
+    [self recalculateGeometryAnimated:NO];
+}
+
 - (UIColor *)fillColor
 {
     return [UIColor colorWithCGColor:shapeLayer.fillColor];
@@ -415,6 +488,11 @@
     if (shapeLayer.fillColor != aFillColor.CGColor)
     {
         shapeLayer.fillColor = aFillColor.CGColor;
+
+        // filled paths are clipped differently
+        clippedPathRect = CGRectNull;
+        [self recalculateGeometryAnimated:NO];
+
         [self setNeedsDisplay];
     }
 }
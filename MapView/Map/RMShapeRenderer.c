@@ -0,0 +1,310 @@
+//
+//  RMShapeRenderer.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMShapeRenderer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RMPathClipper.h"
+#include "RMSpatialIndex.h"
+
+typedef struct {
+    uint32_t identifier;
+    RMPathPyramid *path;
+    RMShapeRendererStyle style;
+    double padding; // pixels around the path its line may cover
+} RMShapeRendererShape;
+
+struct RMShapeRenderer {
+    RMProjectedRect planetBounds;
+    int tileSideLength;
+
+    // By identifier, which is the order they are drawn in
+    RMShapeRendererShape **shapes;
+    size_t count, capacity;
+    uint32_t nextIdentifier;
+
+    RMSpatialIndex *index;
+    double maximumPadding;
+
+    // The shapes in the tile being drawn
+    RMShapeRendererShape **visible;
+    size_t visibleCount, visibleCapacity;
+
+    RMRasterizer *rasterizer;
+    RMPathClipper *clipper;
+};
+
+#pragma mark -
+
+static double RMShapeRendererPadding(const RMShapeRendererStyle *style)
+{
+    if (style->lineColor.alpha <= 0.0f || style->line.lineWidth <= 0.0)
+        return 1.0;
+
+    // Square caps and bevels reach half the width from the path on the diagonal, and
+    // miters up to the miter limit
+    double reach = M_SQRT2;
+
+    if (style->line.lineJoin == RMRasterizerLineJoinMiter && style->line.miterLimit > reach)
+        reach = style->line.miterLimit;
+
+    return style->line.lineWidth / 2.0 * reach + 1.0;
+}
+
+static void RMShapeRendererShapeFree(RMShapeRendererShape *shape)
+{
+    RMPathPyramidDestroy(shape->path);
+    free(shape);
+}
+
+static size_t RMShapeRendererFind(const RMShapeRenderer *renderer, uint32_t identifier)
+{
+    size_t low = 0, high = renderer->count;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (renderer->shapes[middle]->identifier < identifier)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+static bool RMShapeRendererCollect(uintptr_t item, void *context)
+{
+    RMShapeRenderer *renderer = context;
+
+    if (renderer->visibleCount == renderer->visibleCapacity)
+    {
+        size_t capacity = (renderer->visibleCapacity ? renderer->visibleCapacity * 2 : 64);
+        RMShapeRendererShape **visible = realloc(renderer->visible, capacity * sizeof(RMShapeRendererShape *));
+
+        if ( ! visible)
+            return false;
+
+        renderer->visible = visible;
+        renderer->visibleCapacity = capacity;
+    }
+
+    renderer->visible[renderer->visibleCount++] = (RMShapeRendererShape *)item;
+
+    return true;
+}
+
+static int RMShapeRendererCompareShapes(const void *a, const void *b)
+{
+    uint32_t first = (*(RMShapeRendererShape * const *)a)->identifier;
+    uint32_t second = (*(RMShapeRendererShape * const *)b)->identifier;
+
+    return (first < second ? -1 : first > second);
+}
+
+static RMProjectedRect RMShapeRendererOutset(RMProjectedRect rect, double outset)
+{
+    return RMProjectedRectMake(rect.origin.x - outset, rect.origin.y - outset, rect.size.width + 2.0 * outset, rect.size.height + 2.0 * outset);
+}
+
+#pragma mark -
+
+RMShapeRenderer *RMShapeRendererCreate(RMProjectedRect planetBounds, int tileSideLength)
+{
+    RMShapeRenderer *renderer = calloc(1, sizeof(RMShapeRenderer));
+
+    if ( ! renderer)
+        return NULL;
+
+    renderer->planetBounds = planetBounds;
+    renderer->tileSideLength = tileSideLength;
+    renderer->nextIdentifier = 1;
+    renderer->index = RMSpatialIndexCreate(RMSpatialIndexOrderSTR);
+    renderer->rasterizer = RMRasterizerCreate(tileSideLength, tileSideLength);
+    renderer->clipper = RMPathClipperCreate();
+
+    if ( ! renderer->index || ! renderer->rasterizer || ! renderer->clipper)
+    {
+        RMShapeRendererDestroy(renderer);
+        return NULL;
+    }
+
+    return renderer;
+}
+
+void RMShapeRendererDestroy(RMShapeRenderer *renderer)
+{
+    if ( ! renderer)
+        return;
+
+    RMShapeRendererRemoveAllShapes(renderer);
+
+    RMSpatialIndexDestroy(renderer->index);
+    RMRasterizerDestroy(renderer->rasterizer);
+    RMPathClipperDestroy(renderer->clipper);
+    free(renderer->shapes);
+    free(renderer->visible);
+    free(renderer);
+}
+
+uint32_t RMShapeRendererAddShape(RMShapeRenderer *renderer, RMPathPyramid *path, const RMShapeRendererStyle *style)
+{
+    if (renderer->nextIdentifier == 0)
+        return 0;
+
+    if (renderer->count == renderer->capacity)
+    {
+        size_t capacity = (renderer->capacity ? renderer->capacity * 2 : 16);
+        RMShapeRendererShape **shapes = realloc(renderer->shapes, capacity * sizeof(RMShapeRendererShape *));
+
+        if ( ! shapes)
+            return 0;
+
+        renderer->shapes = shapes;
+        renderer->capacity = capacity;
+    }
+
+    RMShapeRendererShape *shape = malloc(sizeof(RMShapeRendererShape));
+
+    if ( ! shape)
+        return 0;
+
+    shape->identifier = renderer->nextIdentifier;
+    shape->path = path;
+    shape->style = *style;
+    shape->padding = RMShapeRendererPadding(style);
+
+    if ( ! RMSpatialIndexInsert(renderer->index, (uintptr_t)shape, RMPathPyramidBoundingBox(path)))
+    {
+        free(shape);
+        return 0;
+    }
+
+    renderer->shapes[renderer->count++] = shape;
+    renderer->nextIdentifier++;
+
+    if (shape->padding > renderer->maximumPadding)
+        renderer->maximumPadding = shape->padding;
+
+    return shape->identifier;
+}
+
+bool RMShapeRendererRemoveShape(RMShapeRenderer *renderer, uint32_t identifier)
+{
+    size_t i = RMShapeRendererFind(renderer, identifier);
+
+    if (i == renderer->count || renderer->shapes[i]->identifier != identifier)
+        return false;
+
+    RMShapeRendererShape *shape = renderer->shapes[i];
+
+    RMSpatialIndexRemove(renderer->index, (uintptr_t)shape);
+    RMShapeRendererShapeFree(shape);
+
+    memmove(renderer->shapes + i, renderer->shapes + i + 1, (renderer->count - i - 1) * sizeof(RMShapeRendererShape *));
+    renderer->count--;
+
+    return true;
+}
+
+void RMShapeRendererRemoveAllShapes(RMShapeRenderer *renderer)
+{
+    for (size_t i = 0; i < renderer->count; i++)
+        RMShapeRendererShapeFree(renderer->shapes[i]);
+
+    renderer->count = 0;
+    renderer->maximumPadding = 0.0;
+
+    RMSpatialIndexRemoveAll(renderer->index);
+}
+
+size_t RMShapeRendererShapeCount(const RMShapeRenderer *renderer)
+{
+    return renderer->count;
+}
+
+size_t RMShapeRendererDrawTile(RMShapeRenderer *renderer, uint32_t x, uint32_t y, int zoom, uint8_t *pixels, size_t bytesPerRow)
+{
+    double metersPerPixel = renderer->planetBounds.size.width / ((double)renderer->tileSideLength * (1 << zoom));
+    double tileSize = renderer->tileSideLength * metersPerPixel;
+    double left = renderer->planetBounds.origin.x + x * tileSize;
+    double top = renderer->planetBounds.origin.y + renderer->planetBounds.size.height - y * tileSize;
+    RMProjectedRect tileRect = RMProjectedRectMake(left, top - tileSize, tileSize, tileSize);
+
+    renderer->visibleCount = 0;
+
+    RMSpatialIndexQuery(renderer->index, RMShapeRendererOutset(tileRect, renderer->maximumPadding * metersPerPixel), RMShapeRendererCollect, renderer);
+
+    if (renderer->visibleCount == 0)
+        return 0;
+
+    qsort(renderer->visible, renderer->visibleCount, sizeof(RMShapeRendererShape *), RMShapeRendererCompareShapes);
+
+    RMRasterizerSetTransform(renderer->rasterizer, 1.0 / metersPerPixel, -1.0 / metersPerPixel, -left / metersPerPixel, top / metersPerPixel);
+
+    size_t drawn = 0;
+
+    for (size_t i = 0; i < renderer->visibleCount; i++)
+    {
+        RMShapeRendererShape *shape = renderer->visible[i];
+        RMProjectedRect clipRect = RMShapeRendererOutset(tileRect, shape->padding * metersPerPixel);
+        bool visible = false;
+
+        if ( ! RMProjectedRectIntersectsProjectedRect(clipRect, RMPathPyramidBoundingBox(shape->path)))
+            continue;
+
+        if (shape->style.fillColor.alpha > 0.0f)
+        {
+            RMRasterizerBeginFill(renderer->rasterizer);
+            RMPathClipperBegin(renderer->clipper, clipRect, RMPathClipperModeFill, RMRasterizerAddElement, renderer->rasterizer);
+            RMPathPyramidEnumerateInRect(shape->path, metersPerPixel, clipRect, true, RMPathClipperAddElement, renderer->clipper);
+            RMPathClipperEnd(renderer->clipper);
+
+            visible |= RMRasterizerDraw(renderer->rasterizer, shape->style.fillRule, shape->style.fillColor, pixels, bytesPerRow);
+        }
+
+        if (shape->style.lineColor.alpha > 0.0f && shape->style.line.lineWidth > 0.0)
+        {
+            RMRasterizerBeginStroke(renderer->rasterizer, &shape->style.line);
+            RMPathClipperBegin(renderer->clipper, clipRect, RMPathClipperModeStroke, RMRasterizerAddElement, renderer->rasterizer);
+            RMPathPyramidEnumerateInRect(shape->path, metersPerPixel, clipRect, false, RMPathClipperAddElement, renderer->clipper);
+            RMPathClipperEnd(renderer->clipper);
+
+            visible |= RMRasterizerDraw(renderer->rasterizer, RMRasterizerFillRuleNonZero, shape->style.lineColor, pixels, bytesPerRow);
+        }
+
+        if (visible)
+            drawn++;
+    }
+
+    return drawn;
+}
@@ -0,0 +1,86 @@
+//
+//  RMShapeRenderer.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMSHAPERENDERER_H_
+#define _RMSHAPERENDERER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+#include "RMPathPyramid.h"
+#include "RMRasterizer.h"
+
+// Draws a collection of filled and stroked paths into tile bitmaps with RMRasterizer,
+// so that shapes can be shown as a tile source: what it costs to draw them depends on
+// the tiles on screen rather than on the size of the shapes, and the tiles can be
+// cached like any others.
+//
+// The shapes are kept in an RMSpatialIndex by their bounding boxes, and only those near
+// a tile are drawn into it, in the order they were added. Each one is drawn from its
+// RMPathPyramid at the scale of the tile and clipped by RMPathClipper to the tile with
+// room for its line, so that a tile of a long path costs little more than the part of
+// it in the tile.
+//
+// Tiles are numbered as RMTile, y from the north. Drawing simplifies the paths the
+// first time they are drawn at a zoom, so it must not be done on two threads at
+// once; it does no locking of its own.
+
+typedef struct RMShapeRenderer RMShapeRenderer;
+
+typedef struct {
+    RMRasterizerColor fillColor; // no fill if the alpha is 0
+    RMRasterizerFillRule fillRule;
+    RMRasterizerColor lineColor; // no line if the alpha is 0
+    RMRasterizerStrokeStyle line; // in pixels, whatever the zoom
+} RMShapeRendererStyle;
+
+// Tiles are tileSideLength pixels wide, the zoom 0 one covering planetBounds. Returns
+// NULL if memory could not be allocated.
+RMShapeRenderer *RMShapeRendererCreate(RMProjectedRect planetBounds, int tileSideLength);
+
+void RMShapeRendererDestroy(RMShapeRenderer *renderer);
+
+// Add a shape drawn above the others, taking ownership of the path, which must not be
+// changed afterwards. Returns the identifier of the shape, never 0, or 0 if memory
+// could not be allocated, in which case the path is left to the caller.
+uint32_t RMShapeRendererAddShape(RMShapeRenderer *renderer, RMPathPyramid *path, const RMShapeRendererStyle *style);
+
+// Returns true if the shape was there.
+bool RMShapeRendererRemoveShape(RMShapeRenderer *renderer, uint32_t identifier);
+
+void RMShapeRendererRemoveAllShapes(RMShapeRenderer *renderer);
+
+size_t RMShapeRendererShapeCount(const RMShapeRenderer *renderer);
+
+// Blend the shapes in the tile into pixels, tileSideLength rows of premultiplied RGBA
+// as with RMRasterizerDraw(). Returns the number of shapes drawn.
+size_t RMShapeRendererDrawTile(RMShapeRenderer *renderer, uint32_t x, uint32_t y, int zoom, uint8_t *pixels, size_t bytesPerRow);
+
+#endif
@@ -0,0 +1,55 @@
+//
+//  RMShapeTileSource.h
+//  MapView
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#import "RMAbstractMercatorTileSource.h"
+
+// Draws lines and polygons into its tiles with RMShapeRenderer, without Core Graphics,
+// so that large overlays cost what the tiles on screen cost, and are kept in the
+// memory cache instead of being one layer drawn again on every zoom. Add it above a
+// map with -[RMMapView addTileSource:]. After changing its shapes, call
+// -[RMMapView reloadTileSource:] with it to show them; the tiles drawn before are
+// not used again, and are dropped from the memory cache as it fills.
+//
+// Lines are drawn with round caps and joins, with a width in pixels whatever the zoom.
+
+@interface RMShapeTileSource : RMAbstractMercatorTileSource
+
+// Returns an identifier for -removeShape:, or 0 if there are fewer than two coordinates.
+- (NSUInteger)addLineWithCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count lineColor:(UIColor *)lineColor lineWidth:(CGFloat)lineWidth;
+
+// A polygon is closed by a line from its last coordinate to its first one. Either color
+// may be nil or clear. Returns an identifier for -removeShape:, or 0 if there are fewer
+// than three coordinates.
+- (NSUInteger)addPolygonWithCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count fillColor:(UIColor *)fillColor lineColor:(UIColor *)lineColor lineWidth:(CGFloat)lineWidth;
+
+- (void)removeShape:(NSUInteger)identifier;
+- (void)removeAllShapes;
+
+@property (nonatomic, readonly) NSUInteger shapeCount;
+
+@end
@@ -0,0 +1,275 @@
+//
+//  RMShapeTileSource.m
+//  MapView
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#import "RMShapeTileSource.h"
+
+#import "RMTileCache.h"
+#import "RMProjection.h"
+#import "RMShapeRenderer.h"
+
+// As in RMShape
+#define kPathSimplificationTolerance 0.25
+
+static RMRasterizerColor RMShapeTileSourceColor(UIColor *color)
+{
+    CGFloat red = 0.0, green = 0.0, blue = 0.0, alpha = 0.0;
+    RMRasterizerColor rasterizerColor;
+
+    // Pattern colors and those of other color spaces are left out
+    if ( ! [color getRed:&red green:&green blue:&blue alpha:&alpha])
+        alpha = 0.0;
+
+    rasterizerColor.red = red;
+    rasterizerColor.green = green;
+    rasterizerColor.blue = blue;
+    rasterizerColor.alpha = alpha;
+
+    return rasterizerColor;
+}
+
+#pragma mark -
+
+@implementation RMShapeTileSource
+{
+    RMShapeRenderer *_renderer;
+
+    // Changed with the shapes, so that tiles drawn before are not taken from the cache.
+    // They are only kept in the memory cache, which drops them as they go unused.
+    NSString *_cacheIdentifier;
+    NSUInteger _generation;
+}
+
+- (id)init
+{
+    if (!(self = [super init]))
+        return nil;
+
+    _renderer = RMShapeRendererCreate(self.projection.planetBounds, self.tileSideLength);
+
+    if ( ! _renderer)
+    {
+        [self release];
+        return nil;
+    }
+
+    CFUUIDRef uuid = CFUUIDCreate(NULL);
+    _cacheIdentifier = (NSString *)CFUUIDCreateString(NULL, uuid);
+    CFRelease(uuid);
+
+    _generation = 0;
+
+    return self;
+}
+
+- (void)dealloc
+{
+    RMShapeRendererDestroy(_renderer); _renderer = NULL;
+    [_cacheIdentifier release]; _cacheIdentifier = nil;
+    [super dealloc];
+}
+
+#pragma mark -
+
+- (NSUInteger)addShapeWithCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count closed:(BOOL)closed fillColor:(UIColor *)fillColor lineColor:(UIColor *)lineColor lineWidth:(CGFloat)lineWidth
+{
+    RMPathPyramid *path = RMPathPyramidCreate(RMPathSimplificationDouglasPeucker, kPathSimplificationTolerance);
+
+    if ( ! path)
+        return 0;
+
+    RMProjection *projection = self.projection;
+    BOOL added = YES;
+
+    for (NSUInteger i = 0; i < count && added; i++)
+    {
+        RMProjectedPoint point = [projection coordinateToProjectedPoint:coordinates[i]];
+
+        added = (i == 0 ? RMPathPyramidMoveToPoint(path, point) : RMPathPyramidAddLineToPoint(path, point));
+    }
+
+    if ( ! added)
+    {
+        RMPathPyramidDestroy(path);
+        return 0;
+    }
+
+    if (closed)
+        RMPathPyramidCloseSubpath(path);
+
+    RMShapeRendererStyle style;
+    style.fillColor = RMShapeTileSourceColor(fillColor);
+    style.fillRule = RMRasterizerFillRuleNonZero;
+    style.lineColor = RMShapeTileSourceColor(lineColor);
+    style.line.lineWidth = lineWidth;
+    style.line.lineCap = RMRasterizerLineCapRound;
+    style.line.lineJoin = RMRasterizerLineJoinRound;
+    style.line.miterLimit = 10.0;
+
+    uint32_t identifier;
+
+    @synchronized (self)
+    {
+        identifier = RMShapeRendererAddShape(_renderer, path, &style);
+
+        if (identifier)
+            _generation++;
+    }
+
+    if ( ! identifier)
+        RMPathPyramidDestroy(path);
+
+    return identifier;
+}
+
+- (NSUInteger)addLineWithCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count lineColor:(UIColor *)lineColor lineWidth:(CGFloat)lineWidth
+{
+    if (count < 2)
+        return 0;
+
+    return [self addShapeWithCoordinates:coordinates count:count closed:NO fillColor:nil lineColor:lineColor lineWidth:lineWidth];
+}
+
+- (NSUInteger)addPolygonWithCoordinates:(const CLLocationCoordinate2D *)coordinates count:(NSUInteger)count fillColor:(UIColor *)fillColor lineColor:(UIColor *)lineColor lineWidth:(CGFloat)lineWidth
+{
+    if (count < 3)
+        return 0;
+
+    return [self addShapeWithCoordinates:coordinates count:count closed:YES fillColor:fillColor lineColor:lineColor lineWidth:lineWidth];
+}
+
+- (void)removeShape:(NSUInteger)identifier
+{
+    if (identifier > UINT32_MAX)
+        return;
+
+    @synchronized (self)
+    {
+        if (RMShapeRendererRemoveShape(_renderer, (uint32_t)identifier))
+            _generation++;
+    }
+}
+
+- (void)removeAllShapes
+{
+    @synchronized (self)
+    {
+        RMShapeRendererRemoveAllShapes(_renderer);
+        _generation++;
+    }
+}
+
+- (NSUInteger)shapeCount
+{
+    @synchronized (self)
+    {
+        return RMShapeRendererShapeCount(_renderer);
+    }
+}
+
+#pragma mark -
+
+- (UIImage *)imageForTile:(RMTile)tile inCache:(RMTileCache *)tileCache
+{
+    if (tile.zoom < 0 || tile.zoom > self.maxZoom)
+        return nil;
+
+    UIImage *image = nil;
+
+    tile = [[self mercatorToTileProjection] normaliseTile:tile];
+
+    NSString *cacheKey = [self uniqueTilecacheKey];
+    image = [tileCache cachedImage:tile withCacheKey:cacheKey];
+
+    if (image)
+        return image;
+
+    size_t sideLength = self.tileSideLength;
+    size_t bytesPerRow = sideLength * 4;
+    uint8_t *pixels = calloc(sideLength, bytesPerRow);
+
+    if ( ! pixels)
+        return nil;
+
+    @synchronized (self)
+    {
+        // Drawn for the shapes as they are now, which may have changed since the key
+        cacheKey = [self uniqueTilecacheKey];
+        RMShapeRendererDrawTile(_renderer, tile.x, tile.y, tile.zoom, pixels, bytesPerRow);
+    }
+
+    // Blank tiles are made and cached too, as no image would have the tile asked again
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(pixels, sideLength, sideLength, 8, bytesPerRow, colorSpace, kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+
+    if (context)
+    {
+        CGImageRef imageRef = CGBitmapContextCreateImage(context);
+        image = [UIImage imageWithCGImage:imageRef];
+        CGImageRelease(imageRef);
+        CGContextRelease(context);
+    }
+
+    free(pixels);
+
+    // Not on disk, where the tiles of every generation would be left behind
+    if (image)
+        [tileCache addImageToMemoryCache:image forTile:tile withCacheKey:cacheKey];
+
+    return image;
+}
+
+- (NSString *)uniqueTilecacheKey
+{
+    @synchronized (self)
+    {
+        return [NSString stringWithFormat:@"RMShapeTileSource-%@-%lu", _cacheIdentifier, (unsigned long)_generation];
+    }
+}
+
+- (NSString *)shortName
+{
+    return @"Shapes";
+}
+
+- (NSString *)longDescription
+{
+    return [self shortName];
+}
+
+- (NSString *)shortAttribution
+{
+    return @"n/a";
+}
+
+- (NSString *)longAttribution
+{
+    return @"n/a";
+}
+
+@end
@@ -0,0 +1,313 @@
+//
+//  RMShardedCache.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "RMShardedCache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Keep neighbouring shards, and their locks, on separate cache lines.
+#define kRMShardedCacheLineSize 64
+
+// Fewest entries per shard RMShardedCacheSuggestedShardCount() goes down to.
+#define kRMShardedCacheMinimumShardEntries 16
+
+typedef struct {
+    pthread_rwlock_t lock;
+    RMLRUCache *cache;
+} RMCacheShard;
+
+typedef union {
+    RMCacheShard shard;
+    char padding[(sizeof(RMCacheShard) + kRMShardedCacheLineSize - 1) / kRMShardedCacheLineSize * kRMShardedCacheLineSize];
+} RMPaddedCacheShard;
+
+struct RMShardedCache {
+    RMPaddedCacheShard *shards;
+    unsigned int shardMask;
+    RMShardedCachePolicy policy;
+    RMLRUCacheCallbacks callbacks;
+};
+
+#pragma mark -
+
+static RMCacheShard *RMShardedCacheShardForTile(RMShardedCache *cache, uint64_t tileKey)
+{
+    // RMTileKey() packs zoom, x and y into separate bit ranges; mix them so that
+    // the tiles of one viewport spread over all shards.
+    uint64_t hash = tileKey;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return &cache->shards[hash & cache->shardMask].shard;
+}
+
+static size_t RMShardedCacheShardLimit(size_t limit, unsigned int shardCount)
+{
+    if (limit == 0)
+        return 0;
+
+    return (limit + shardCount - 1) / shardCount;
+}
+
+#pragma mark -
+
+RMShardedCache *RMShardedCacheCreate(unsigned int shardCount, size_t costLimit, size_t countLimit, RMShardedCachePolicy policy, const RMLRUCacheCallbacks *callbacks)
+{
+    unsigned int count = 1;
+
+    while (count < shardCount && count < (1U << 16))
+        count <<= 1;
+
+    RMShardedCache *cache = calloc(1, sizeof(RMShardedCache));
+
+    if ( ! cache)
+        return NULL;
+
+    if (posix_memalign((void **)&cache->shards, kRMShardedCacheLineSize, count * sizeof(RMPaddedCacheShard)) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    cache->shardMask = count - 1;
+    cache->policy = policy;
+
+    if (callbacks)
+        cache->callbacks = *callbacks;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        RMCacheShard *shard = &cache->shards[i].shard;
+
+        shard->cache = RMLRUCacheCreate(RMShardedCacheShardLimit(costLimit, count), RMShardedCacheShardLimit(countLimit, count), callbacks);
+
+        if ( ! shard->cache)
+        {
+            while (i-- > 0)
+            {
+                pthread_rwlock_destroy(&cache->shards[i].shard.lock);
+                RMLRUCacheDestroy(cache->shards[i].shard.cache);
+            }
+
+            free(cache->shards);
+            free(cache);
+            return NULL;
+        }
+
+        pthread_rwlock_init(&shard->lock, NULL);
+    }
+
+    return cache;
+}
+
+void RMShardedCacheDestroy(RMShardedCache *cache)
+{
+    if ( ! cache)
+        return;
+
+    for (unsigned int i = 0; i <= cache->shardMask; i++)
+    {
+        pthread_rwlock_destroy(&cache->shards[i].shard.lock);
+        RMLRUCacheDestroy(cache->shards[i].shard.cache);
+    }
+
+    free(cache->shards);
+    free(cache);
+}
+
+bool RMShardedCacheSetAdmission(RMShardedCache *cache, RMLRUCacheAdmission admission, size_t expectedEntries)
+{
+    bool success = true;
+
+    for (unsigned int i = 0; i <= cache->shardMask; i++)
+    {
+        RMCacheShard *shard = &cache->shards[i].shard;
+
+        pthread_rwlock_wrlock(&shard->lock);
+        success &= RMLRUCacheSetAdmission(shard->cache, admission, RMShardedCacheShardLimit(expectedEntries, cache->shardMask + 1));
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    return success;
+}
+
+void *RMShardedCacheCopy(RMShardedCache *cache, uint64_t tileKey, const char *cacheKey)
+{
+    RMCacheShard *shard = RMShardedCacheShardForTile(cache, tileKey);
+    void *value;
+
+    if (cache->policy == RMShardedCachePolicyClock)
+    {
+        pthread_rwlock_rdlock(&shard->lock);
+        value = RMLRUCacheGetShared(shard->cache, tileKey, cacheKey);
+    }
+    else
+    {
+        pthread_rwlock_wrlock(&shard->lock);
+        value = RMLRUCacheGet(shard->cache, tileKey, cacheKey);
+    }
+
+    if (value && cache->callbacks.retain)
+        value = cache->callbacks.retain(value);
+
+    pthread_rwlock_unlock(&shard->lock);
+
+    return value;
+}
+
+bool RMShardedCachePut(RMShardedCache *cache, uint64_t tileKey, const char *cacheKey, void *value, size_t cost)
+{
+    RMCacheShard *shard = RMShardedCacheShardForTile(cache, tileKey);
+    bool added;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    added = RMLRUCachePut(shard->cache, tileKey, cacheKey, value, cost);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return added;
+}
+
+bool RMShardedCacheRemove(RMShardedCache *cache, uint64_t tileKey, const char *cacheKey)
+{
+    RMCacheShard *shard = RMShardedCacheShardForTile(cache, tileKey);
+    bool removed;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    removed = RMLRUCacheRemove(shard->cache, tileKey, cacheKey);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return removed;
+}
+
+size_t RMShardedCacheRemoveTile(RMShardedCache *cache, uint64_t tileKey)
+{
+    RMCacheShard *shard = RMShardedCacheShardForTile(cache, tileKey);
+    size_t removed;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    removed = RMLRUCacheRemoveTile(shard->cache, tileKey);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return removed;
+}
+
+bool RMShardedCacheEvictOldest(RMShardedCache *cache)
+{
+    RMCacheShard *fullest = NULL;
+    size_t fullestCount = 0;
+
+    // The counts may change before the eviction, which is fine for a heuristic.
+    for (unsigned int i = 0; i <= cache->shardMask; i++)
+    {
+        RMCacheShard *shard = &cache->shards[i].shard;
+        size_t count;
+
+        pthread_rwlock_rdlock(&shard->lock);
+        count = RMLRUCacheCount(shard->cache);
+        pthread_rwlock_unlock(&shard->lock);
+
+        if (count > fullestCount)
+        {
+            fullest = shard;
+            fullestCount = count;
+        }
+    }
+
+    if ( ! fullest)
+        return false;
+
+    bool evicted;
+
+    pthread_rwlock_wrlock(&fullest->lock);
+    evicted = RMLRUCacheEvictOldest(fullest->cache);
+    pthread_rwlock_unlock(&fullest->lock);
+
+    return evicted;
+}
+
+void RMShardedCacheRemoveAll(RMShardedCache *cache)
+{
+    for (unsigned int i = 0; i <= cache->shardMask; i++)
+    {
+        RMCacheShard *shard = &cache->shards[i].shard;
+
+        pthread_rwlock_wrlock(&shard->lock);
+        RMLRUCacheRemoveAll(shard->cache);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
+
+size_t RMShardedCacheCount(RMShardedCache *cache)
+{
+    size_t count = 0;
+
+    for (unsigned int i = 0; i <= cache->shardMask; i++)
+    {
+        RMCacheShard *shard = &cache->shards[i].shard;
+
+        pthread_rwlock_rdlock(&shard->lock);
+        count += RMLRUCacheCount(shard->cache);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    return count;
+}
+
+size_t RMShardedCacheTotalCost(RMShardedCache *cache)
+{
+    size_t totalCost = 0;
+
+    for (unsigned int i = 0; i <= cache->shardMask; i++)
+    {
+        RMCacheShard *shard = &cache->shards[i].shard;
+
+        pthread_rwlock_rdlock(&shard->lock);
+        totalCost += RMLRUCacheTotalCost(shard->cache);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    return totalCost;
+}
+
+unsigned int RMShardedCacheSuggestedShardCount(size_t countLimit)
+{
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int shardCount = 1;
+
+    if (processors < 1)
+        processors = 1;
+
+    // About four shards per processor keeps two threads on the same shard unlikely.
+    while (shardCount < (unsigned long)processors * 4 && (countLimit == 0 || shardCount * 2 * kRMShardedCacheMinimumShardEntries <= countLimit))
+        shardCount <<= 1;
+
+    return shardCount;
+}
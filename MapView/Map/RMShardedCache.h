@@ -0,0 +1,87 @@
+//
+//  RMShardedCache.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _RMSHARDEDCACHE_H_
+#define _RMSHARDEDCACHE_H_
+
+#include "RMLRUCache.h"
+
+// A thread-safe tile cache made of independent RMLRUCache shards, each behind its own
+// lock. A tile always maps to the same shard, so threads working on different tiles
+// rarely contend. The limits are divided evenly between the shards, which makes the
+// eviction order approximately, not exactly, least recently used overall.
+
+typedef struct RMShardedCache RMShardedCache;
+
+typedef enum {
+    // A hit moves the entry to the head of its shard's list, under the shard's exclusive lock.
+    RMShardedCachePolicyLRU,
+    // A hit only sets a reference bit under a shared lock, so concurrent hits on the
+    // same shard do not serialize. Eviction gives referenced entries a second chance.
+    RMShardedCachePolicyClock,
+} RMShardedCachePolicy;
+
+// Create a cache of shardCount shards (rounded up to a power of two) holding at most
+// costLimit total cost and countLimit entries, 0 meaning unlimited. The callbacks must
+// be thread-safe. Returns NULL if memory could not be allocated.
+RMShardedCache *RMShardedCacheCreate(unsigned int shardCount, size_t costLimit, size_t countLimit, RMShardedCachePolicy policy, const RMLRUCacheCallbacks *callbacks);
+
+void RMShardedCacheDestroy(RMShardedCache *cache);
+
+// Change the admission policy of every shard, see RMLRUCacheSetAdmission(). The
+// expected entries are divided between the shards. Returns false if memory could
+// not be allocated, in which case some shards may have changed.
+bool RMShardedCacheSetAdmission(RMShardedCache *cache, RMLRUCacheAdmission admission, size_t expectedEntries);
+
+// Return the value for the key, retained with the retain callback while the shard is
+// still locked, or NULL. The caller owns the returned reference.
+void *RMShardedCacheCopy(RMShardedCache *cache, uint64_t tileKey, const char *cacheKey);
+
+// Insert or replace the value for the key. See RMLRUCachePut().
+bool RMShardedCachePut(RMShardedCache *cache, uint64_t tileKey, const char *cacheKey, void *value, size_t cost);
+
+// Remove the entry for the key. Returns true if there was one.
+bool RMShardedCacheRemove(RMShardedCache *cache, uint64_t tileKey, const char *cacheKey);
+
+// Remove every entry for the tile key. Returns the number removed.
+size_t RMShardedCacheRemoveTile(RMShardedCache *cache, uint64_t tileKey);
+
+// Evict the oldest entry of the fullest shard. Returns false if the cache is empty.
+bool RMShardedCacheEvictOldest(RMShardedCache *cache);
+
+void RMShardedCacheRemoveAll(RMShardedCache *cache);
+
+// Sums over all shards; with concurrent writers they are only a snapshot.
+size_t RMShardedCacheCount(RMShardedCache *cache);
+size_t RMShardedCacheTotalCost(RMShardedCache *cache);
+
+// A shard count suited to a cache of countLimit entries: enough shards for the
+// available processors, without making shards so small that per-shard eviction
+// drifts far from global LRU order.
+unsigned int RMShardedCacheSuggestedShardCount(size_t countLimit);
+
+#endif
@@ -0,0 +1,787 @@
+//
+//  RMSpatialIndex.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMSpatialIndex.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Children per node. 16 boxes of 4 doubles are 8 cache lines, tested in one loop.
+#define kRMSpatialIndexNodeSize 16
+
+// Enough levels for 2^64 items
+#define kRMSpatialIndexMaximumLevels 16
+
+// Items inserted one at a time are packed into the tree by the next query once there
+// are more than a sixteenth of the packed ones, within these bounds, since every
+// query scans them.
+#define kRMSpatialIndexMinimumPending 256
+#define kRMSpatialIndexMaximumPending 16384
+
+// Locations of items in the pending list rather than the tree
+#define kRMSpatialIndexPendingBit ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+#define kRMSpatialIndexInitialSlots 64
+
+typedef struct {
+    double *minX, *minY, *maxX, *maxY;
+    uintptr_t *items; // NULL for the boxes of nodes
+    size_t count, capacity;
+} RMSpatialIndexBoxes;
+
+struct RMSpatialIndex {
+    RMSpatialIndexOrder order;
+
+    // Packed items in tree order, removed ones having item 0 and an empty box
+    RMSpatialIndexBoxes entries;
+    size_t removedCount;
+
+    // Every level of nodes, from the parents of the entries up to the root. The
+    // children of node i of a level are i * kRMSpatialIndexNodeSize and on of the
+    // level below.
+    RMSpatialIndexBoxes nodes;
+    size_t levelStart[kRMSpatialIndexMaximumLevels];
+    unsigned int levelCount;
+
+    RMSpatialIndexBoxes pending;
+
+    // Open addressing table from every item to its location in entries or pending
+    uintptr_t *slotItems;
+    size_t *slotLocations;
+    size_t slotMask;
+    size_t slotCount;
+};
+
+typedef struct {
+    double key;
+    size_t position;
+} RMSpatialIndexSortKey;
+
+#pragma mark -
+
+static bool RMSpatialIndexBoxesReserve(RMSpatialIndexBoxes *boxes, size_t capacity, bool withItems)
+{
+    if (capacity <= boxes->capacity)
+        return true;
+
+    if (capacity < 2 * boxes->capacity)
+        capacity = 2 * boxes->capacity;
+
+    double *minX = realloc(boxes->minX, capacity * sizeof(double));
+    if (minX) boxes->minX = minX;
+    double *minY = realloc(boxes->minY, capacity * sizeof(double));
+    if (minY) boxes->minY = minY;
+    double *maxX = realloc(boxes->maxX, capacity * sizeof(double));
+    if (maxX) boxes->maxX = maxX;
+    double *maxY = realloc(boxes->maxY, capacity * sizeof(double));
+    if (maxY) boxes->maxY = maxY;
+
+    uintptr_t *items = boxes->items;
+
+    if (withItems)
+    {
+        items = realloc(boxes->items, capacity * sizeof(uintptr_t));
+        if (items) boxes->items = items;
+    }
+
+    if ( ! minX || ! minY || ! maxX || ! maxY || (withItems && ! items))
+        return false;
+
+    boxes->capacity = capacity;
+
+    return true;
+}
+
+static void RMSpatialIndexBoxesFree(RMSpatialIndexBoxes *boxes)
+{
+    free(boxes->minX);
+    free(boxes->minY);
+    free(boxes->maxX);
+    free(boxes->maxY);
+    free(boxes->items);
+
+    memset(boxes, 0, sizeof(RMSpatialIndexBoxes));
+}
+
+static void RMSpatialIndexBoxesSet(RMSpatialIndexBoxes *boxes, size_t i, RMProjectedRect rect)
+{
+    double x1 = rect.origin.x, x2 = rect.origin.x + rect.size.width;
+    double y1 = rect.origin.y, y2 = rect.origin.y + rect.size.height;
+
+    boxes->minX[i] = fmin(x1, x2);
+    boxes->maxX[i] = fmax(x1, x2);
+    boxes->minY[i] = fmin(y1, y2);
+    boxes->maxY[i] = fmax(y1, y2);
+}
+
+static void RMSpatialIndexBoxesCopy(RMSpatialIndexBoxes *to, size_t i, const RMSpatialIndexBoxes *from, size_t j)
+{
+    to->minX[i] = from->minX[j];
+    to->minY[i] = from->minY[j];
+    to->maxX[i] = from->maxX[j];
+    to->maxY[i] = from->maxY[j];
+
+    if (to->items)
+        to->items[i] = from->items[j];
+}
+
+// The union of the boxes first to last - 1, stored as box i of nodes
+static void RMSpatialIndexBoxesUnion(RMSpatialIndexBoxes *nodes, size_t i, const RMSpatialIndexBoxes *boxes, size_t first, size_t last)
+{
+    double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+
+    for (size_t j = first; j < last; j++)
+    {
+        minX = fmin(minX, boxes->minX[j]);
+        minY = fmin(minY, boxes->minY[j]);
+        maxX = fmax(maxX, boxes->maxX[j]);
+        maxY = fmax(maxY, boxes->maxY[j]);
+    }
+
+    nodes->minX[i] = minX;
+    nodes->minY[i] = minY;
+    nodes->maxX[i] = maxX;
+    nodes->maxY[i] = maxY;
+}
+
+#pragma mark -
+
+static size_t RMSpatialIndexHashItem(uintptr_t item)
+{
+    uint64_t hash = (uint64_t)item * 0x9E3779B97F4A7C15ULL;
+
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+// The slot of the item, or of the empty slot where it would go
+static size_t RMSpatialIndexFindSlot(const RMSpatialIndex *index, uintptr_t item)
+{
+    size_t slot = RMSpatialIndexHashItem(item) & index->slotMask;
+
+    while (index->slotItems[slot] && index->slotItems[slot] != item)
+        slot = (slot + 1) & index->slotMask;
+
+    return slot;
+}
+
+static bool RMSpatialIndexGrowSlots(RMSpatialIndex *index)
+{
+    size_t oldMask = index->slotMask;
+    uintptr_t *oldItems = index->slotItems;
+    size_t *oldLocations = index->slotLocations;
+    size_t slotTotal = 2 * (oldMask + 1);
+
+    uintptr_t *items = calloc(slotTotal, sizeof(uintptr_t));
+    size_t *locations = malloc(slotTotal * sizeof(size_t));
+
+    if ( ! items || ! locations)
+    {
+        free(items);
+        free(locations);
+        return false;
+    }
+
+    index->slotItems = items;
+    index->slotLocations = locations;
+    index->slotMask = slotTotal - 1;
+
+    for (size_t i = 0; i <= oldMask; i++)
+    {
+        if ( ! oldItems[i])
+            continue;
+
+        size_t slot = RMSpatialIndexFindSlot(index, oldItems[i]);
+
+        items[slot] = oldItems[i];
+        locations[slot] = oldLocations[i];
+    }
+
+    free(oldItems);
+    free(oldLocations);
+
+    return true;
+}
+
+static bool RMSpatialIndexSetLocation(RMSpatialIndex *index, uintptr_t item, size_t location)
+{
+    size_t slot = RMSpatialIndexFindSlot(index, item);
+
+    if ( ! index->slotItems[slot])
+    {
+        // At most half full, to keep the probes short
+        if (2 * (index->slotCount + 1) > index->slotMask + 1)
+        {
+            if ( ! RMSpatialIndexGrowSlots(index))
+                return false;
+
+            slot = RMSpatialIndexFindSlot(index, item);
+        }
+
+        index->slotItems[slot] = item;
+        index->slotCount++;
+    }
+
+    index->slotLocations[slot] = location;
+
+    return true;
+}
+
+// Backward shift deletion: later entries of the probe sequence move up into the hole
+static void RMSpatialIndexDeleteSlot(RMSpatialIndex *index, size_t slot)
+{
+    size_t hole = slot;
+
+    index->slotItems[hole] = 0;
+    index->slotCount--;
+
+    for (size_t next = (hole + 1) & index->slotMask; index->slotItems[next]; next = (next + 1) & index->slotMask)
+    {
+        size_t home = RMSpatialIndexHashItem(index->slotItems[next]) & index->slotMask;
+
+        // Move the entry if its home is not cyclically within (hole, next]
+        if ((next > hole && (home <= hole || home > next)) || (next < hole && home <= hole && home > next))
+        {
+            index->slotItems[hole] = index->slotItems[next];
+            index->slotLocations[hole] = index->slotLocations[next];
+            index->slotItems[next] = 0;
+            hole = next;
+        }
+    }
+}
+
+#pragma mark -
+
+// Spread the 16 low bits of value to the even bits
+static uint32_t RMSpatialIndexSpreadBits(uint32_t value)
+{
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+
+    return value;
+}
+
+// Order by the Morton code of the box centers, with a radix sort of (code, position) pairs
+static bool RMSpatialIndexMortonOrder(const RMSpatialIndexBoxes *boxes, size_t *order)
+{
+    size_t count = boxes->count;
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    uint64_t *sorted = malloc(count * sizeof(uint64_t));
+
+    if ( ! keys || ! sorted)
+    {
+        free(keys);
+        free(sorted);
+        return false;
+    }
+
+    double minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double x = (boxes->minX[i] + boxes->maxX[i]) / 2.0, y = (boxes->minY[i] + boxes->maxY[i]) / 2.0;
+
+        minX = fmin(minX, x);
+        minY = fmin(minY, y);
+        maxX = fmax(maxX, x);
+        maxY = fmax(maxY, y);
+    }
+
+    double scaleX = (maxX > minX ? 65535.0 / (maxX - minX) : 0.0);
+    double scaleY = (maxY > minY ? 65535.0 / (maxY - minY) : 0.0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t x = (uint32_t)(((boxes->minX[i] + boxes->maxX[i]) / 2.0 - minX) * scaleX);
+        uint32_t y = (uint32_t)(((boxes->minY[i] + boxes->maxY[i]) / 2.0 - minY) * scaleY);
+        uint32_t code = RMSpatialIndexSpreadBits(x) | (RMSpatialIndexSpreadBits(y) << 1);
+
+        keys[i] = ((uint64_t)code << 32) | (uint64_t)i;
+    }
+
+    // Positions fit the low 32 bits: sorting on the high ones keeps ties in order
+    for (unsigned int shift = 32; shift < 64; shift += 8)
+    {
+        size_t offsets[256] = { 0 };
+
+        for (size_t i = 0; i < count; i++)
+            offsets[(keys[i] >> shift) & 0xFF]++;
+
+        for (size_t digit = 0, total = 0; digit < 256; digit++)
+        {
+            size_t digitCount = offsets[digit];
+
+            offsets[digit] = total;
+            total += digitCount;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            sorted[offsets[(keys[i] >> shift) & 0xFF]++] = keys[i];
+
+        uint64_t *swap = keys;
+        keys = sorted;
+        sorted = swap;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        order[i] = (size_t)(keys[i] & 0xFFFFFFFF);
+
+    free(keys);
+    free(sorted);
+
+    return true;
+}
+
+static int RMSpatialIndexCompareSortKeys(const void *a, const void *b)
+{
+    const RMSpatialIndexSortKey *one = a, *two = b;
+
+    if (one->key != two->key)
+        return (one->key < two->key ? -1 : 1);
+
+    return (one->position < two->position ? -1 : (one->position > two->position));
+}
+
+// Sort-tile-recursive: sort the centers by x, cut them into about sqrt(leaf count)
+// vertical slices of whole leaves, and sort every slice by y
+static bool RMSpatialIndexSTROrder(const RMSpatialIndexBoxes *boxes, size_t *order)
+{
+    size_t count = boxes->count;
+    RMSpatialIndexSortKey *keys = malloc(count * sizeof(RMSpatialIndexSortKey));
+
+    if ( ! keys)
+        return false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i].key = (boxes->minX[i] + boxes->maxX[i]) / 2.0;
+        keys[i].position = i;
+    }
+
+    qsort(keys, count, sizeof(RMSpatialIndexSortKey), RMSpatialIndexCompareSortKeys);
+
+    size_t leafCount = (count + kRMSpatialIndexNodeSize - 1) / kRMSpatialIndexNodeSize;
+    size_t sliceCount = (size_t)ceil(sqrt((double)leafCount));
+    size_t sliceSize = ((leafCount + sliceCount - 1) / sliceCount) * kRMSpatialIndexNodeSize;
+
+    for (size_t first = 0; first < count; first += sliceSize)
+    {
+        size_t last = (first + sliceSize < count ? first + sliceSize : count);
+
+        for (size_t i = first; i < last; i++)
+            keys[i].key = (boxes->minY[keys[i].position] + boxes->maxY[keys[i].position]) / 2.0;
+
+        qsort(keys + first, last - first, sizeof(RMSpatialIndexSortKey), RMSpatialIndexCompareSortKeys);
+    }
+
+    for (size_t i = 0; i < count; i++)
+        order[i] = keys[i].position;
+
+    free(keys);
+
+    return true;
+}
+
+// Sort every item, packed or pending, into a new tree. Leaves the index unchanged if
+// memory could not be allocated.
+static bool RMSpatialIndexPack(RMSpatialIndex *index)
+{
+    size_t count = index->entries.count - index->removedCount + index->pending.count;
+    RMSpatialIndexBoxes gathered = { 0 }, packed = { 0 }, nodes = { 0 };
+    size_t *order = NULL;
+
+    if (count == 0)
+    {
+        RMSpatialIndexRemoveAll(index);
+        return true;
+    }
+
+    if ( ! RMSpatialIndexBoxesReserve(&gathered, count, true) || ! RMSpatialIndexBoxesReserve(&packed, count, true) || ! (order = malloc(count * sizeof(size_t))))
+        goto fail;
+
+    for (size_t i = 0; i < index->entries.count; i++)
+    {
+        if (index->entries.items[i])
+            RMSpatialIndexBoxesCopy(&gathered, gathered.count++, &index->entries, i);
+    }
+
+    for (size_t i = 0; i < index->pending.count; i++)
+        RMSpatialIndexBoxesCopy(&gathered, gathered.count++, &index->pending, i);
+
+    if ( ! (index->order == RMSpatialIndexOrderSTR ? RMSpatialIndexSTROrder(&gathered, order) : RMSpatialIndexMortonOrder(&gathered, order)))
+        goto fail;
+
+    for (size_t i = 0; i < count; i++)
+        RMSpatialIndexBoxesCopy(&packed, i, &gathered, order[i]);
+
+    packed.count = count;
+
+    // Every level of nodes up to a single root
+    size_t levelStart[kRMSpatialIndexMaximumLevels];
+    unsigned int levelCount = 0;
+    size_t nodeCount = 0;
+
+    for (size_t levelSize = count; levelSize > 1 || levelCount == 0; )
+    {
+        levelSize = (levelSize + kRMSpatialIndexNodeSize - 1) / kRMSpatialIndexNodeSize;
+        levelStart[levelCount++] = nodeCount;
+        nodeCount += levelSize;
+    }
+
+    if ( ! RMSpatialIndexBoxesReserve(&nodes, nodeCount + 1, false))
+        goto fail;
+
+    for (unsigned int level = 0; level < levelCount; level++)
+    {
+        const RMSpatialIndexBoxes *children = (level == 0 ? &packed : &nodes);
+        size_t childStart = (level == 0 ? 0 : levelStart[level - 1]);
+        size_t childEnd = (level == 0 ? count : levelStart[level]);
+        size_t levelEnd = (level + 1 < levelCount ? levelStart[level + 1] : nodeCount);
+
+        for (size_t node = levelStart[level], child = childStart; node < levelEnd; node++, child += kRMSpatialIndexNodeSize)
+        {
+            size_t last = (child + kRMSpatialIndexNodeSize < childEnd ? child + kRMSpatialIndexNodeSize : childEnd);
+
+            RMSpatialIndexBoxesUnion(&nodes, node, children, child, last);
+        }
+    }
+
+    nodes.count = nodeCount;
+
+    // Every location changes
+    for (size_t i = 0; i < count; i++)
+    {
+        if ( ! RMSpatialIndexSetLocation(index, packed.items[i], i))
+            goto fail;
+    }
+
+    RMSpatialIndexBoxesFree(&gathered);
+    RMSpatialIndexBoxesFree(&index->entries);
+    RMSpatialIndexBoxesFree(&index->nodes);
+    free(order);
+
+    index->entries = packed;
+    index->nodes = nodes;
+    index->removedCount = 0;
+    index->pending.count = 0;
+    index->levelCount = levelCount;
+    memcpy(index->levelStart, levelStart, sizeof(levelStart));
+
+    return true;
+
+fail:
+    // Items already given their new location get their old one back
+    for (size_t i = 0; i < index->entries.count; i++)
+    {
+        if (index->entries.items[i])
+            RMSpatialIndexSetLocation(index, index->entries.items[i], i);
+    }
+
+    for (size_t i = 0; i < index->pending.count; i++)
+        RMSpatialIndexSetLocation(index, index->pending.items[i], i | kRMSpatialIndexPendingBit);
+
+    RMSpatialIndexBoxesFree(&gathered);
+    RMSpatialIndexBoxesFree(&packed);
+    RMSpatialIndexBoxesFree(&nodes);
+    free(order);
+
+    return false;
+}
+
+static size_t RMSpatialIndexPendingLimit(const RMSpatialIndex *index)
+{
+    size_t limit = index->entries.count / 16;
+
+    if (limit < kRMSpatialIndexMinimumPending)
+        return kRMSpatialIndexMinimumPending;
+
+    if (limit > kRMSpatialIndexMaximumPending)
+        return kRMSpatialIndexMaximumPending;
+
+    return limit;
+}
+
+// Mark the packed entry removed: item 0 and a box that intersects nothing
+static void RMSpatialIndexRemoveEntry(RMSpatialIndex *index, size_t i)
+{
+    index->entries.items[i] = 0;
+    index->entries.minX[i] = index->entries.minY[i] = INFINITY;
+    index->entries.maxX[i] = index->entries.maxY[i] = -INFINITY;
+    index->removedCount++;
+}
+
+static void RMSpatialIndexRemovePending(RMSpatialIndex *index, size_t i)
+{
+    size_t last = --index->pending.count;
+
+    if (i == last)
+        return;
+
+    RMSpatialIndexBoxesCopy(&index->pending, i, &index->pending, last);
+    RMSpatialIndexSetLocation(index, index->pending.items[i], i | kRMSpatialIndexPendingBit);
+}
+
+// Add or move the item without packing
+static bool RMSpatialIndexAdd(RMSpatialIndex *index, uintptr_t item, RMProjectedRect boundingBox)
+{
+    size_t slot = RMSpatialIndexFindSlot(index, item);
+
+    if (index->slotItems[slot])
+    {
+        size_t location = index->slotLocations[slot];
+
+        if (location & kRMSpatialIndexPendingBit)
+        {
+            RMSpatialIndexBoxesSet(&index->pending, location & ~kRMSpatialIndexPendingBit, boundingBox);
+            return true;
+        }
+
+        RMSpatialIndexRemoveEntry(index, location);
+        RMSpatialIndexDeleteSlot(index, slot);
+    }
+
+    if ( ! RMSpatialIndexBoxesReserve(&index->pending, index->pending.count + 1, true))
+        return false;
+
+    size_t i = index->pending.count;
+
+    index->pending.items[i] = item;
+    RMSpatialIndexBoxesSet(&index->pending, i, boundingBox);
+
+    if ( ! RMSpatialIndexSetLocation(index, item, i | kRMSpatialIndexPendingBit))
+        return false;
+
+    index->pending.count++;
+
+    return true;
+}
+
+#pragma mark -
+
+RMSpatialIndex *RMSpatialIndexCreate(RMSpatialIndexOrder order)
+{
+    RMSpatialIndex *index = calloc(1, sizeof(RMSpatialIndex));
+
+    if ( ! index)
+        return NULL;
+
+    index->order = order;
+    index->slotItems = calloc(kRMSpatialIndexInitialSlots, sizeof(uintptr_t));
+    index->slotLocations = malloc(kRMSpatialIndexInitialSlots * sizeof(size_t));
+    index->slotMask = kRMSpatialIndexInitialSlots - 1;
+
+    if ( ! index->slotItems || ! index->slotLocations)
+    {
+        RMSpatialIndexDestroy(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+void RMSpatialIndexDestroy(RMSpatialIndex *index)
+{
+    if ( ! index)
+        return;
+
+    RMSpatialIndexBoxesFree(&index->entries);
+    RMSpatialIndexBoxesFree(&index->nodes);
+    RMSpatialIndexBoxesFree(&index->pending);
+    free(index->slotItems);
+    free(index->slotLocations);
+    free(index);
+}
+
+bool RMSpatialIndexInsert(RMSpatialIndex *index, uintptr_t item, RMProjectedRect boundingBox)
+{
+    if ( ! item)
+        return false;
+
+    return RMSpatialIndexAdd(index, item, boundingBox);
+}
+
+bool RMSpatialIndexInsertMany(RMSpatialIndex *index, const uintptr_t *items, const RMProjectedRect *boundingBoxes, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if ( ! items[i] || ! RMSpatialIndexAdd(index, items[i], boundingBoxes[i]))
+            return false;
+    }
+
+    if (index->pending.count > 0 || index->removedCount > 0)
+        RMSpatialIndexPack(index);
+
+    return true;
+}
+
+bool RMSpatialIndexRemove(RMSpatialIndex *index, uintptr_t item)
+{
+    if ( ! item)
+        return false;
+
+    size_t slot = RMSpatialIndexFindSlot(index, item);
+
+    if ( ! index->slotItems[slot])
+        return false;
+
+    size_t location = index->slotLocations[slot];
+
+    RMSpatialIndexDeleteSlot(index, slot);
+
+    if (location & kRMSpatialIndexPendingBit)
+        RMSpatialIndexRemovePending(index, location & ~kRMSpatialIndexPendingBit);
+    else
+        RMSpatialIndexRemoveEntry(index, location);
+
+    return true;
+}
+
+void RMSpatialIndexRemoveAll(RMSpatialIndex *index)
+{
+    index->entries.count = 0;
+    index->nodes.count = 0;
+    index->pending.count = 0;
+    index->removedCount = 0;
+    index->levelCount = 0;
+
+    memset(index->slotItems, 0, (index->slotMask + 1) * sizeof(uintptr_t));
+    index->slotCount = 0;
+}
+
+bool RMSpatialIndexGetBoundingBox(const RMSpatialIndex *index, uintptr_t item, RMProjectedRect *boundingBox)
+{
+    if ( ! item)
+        return false;
+
+    size_t slot = RMSpatialIndexFindSlot(index, item);
+
+    if ( ! index->slotItems[slot])
+        return false;
+
+    size_t location = index->slotLocations[slot];
+    const RMSpatialIndexBoxes *boxes = &index->entries;
+
+    if (location & kRMSpatialIndexPendingBit)
+    {
+        boxes = &index->pending;
+        location &= ~kRMSpatialIndexPendingBit;
+    }
+
+    *boundingBox = RMProjectedRectMake(boxes->minX[location], boxes->minY[location],
+                                       boxes->maxX[location] - boxes->minX[location],
+                                       boxes->maxY[location] - boxes->minY[location]);
+
+    return true;
+}
+
+size_t RMSpatialIndexQuery(RMSpatialIndex *index, RMProjectedRect rect, RMSpatialIndexVisitor visitor, void *context)
+{
+    // Failing to pack only leaves the query slower
+    if (index->pending.count > RMSpatialIndexPendingLimit(index) || index->removedCount > index->entries.count / 4 + kRMSpatialIndexMinimumPending)
+        RMSpatialIndexPack(index);
+
+    double minX = fmin(rect.origin.x, rect.origin.x + rect.size.width), maxX = fmax(rect.origin.x, rect.origin.x + rect.size.width);
+    double minY = fmin(rect.origin.y, rect.origin.y + rect.size.height), maxY = fmax(rect.origin.y, rect.origin.y + rect.size.height);
+    size_t visited = 0;
+
+    if (index->levelCount > 0 && index->entries.count > index->removedCount)
+    {
+        // Depth first; a level never has more than a node's children pending
+        unsigned int stackLevels[kRMSpatialIndexMaximumLevels * kRMSpatialIndexNodeSize];
+        size_t stackNodes[kRMSpatialIndexMaximumLevels * kRMSpatialIndexNodeSize];
+        size_t depth = 0;
+
+        stackLevels[depth] = index->levelCount - 1;
+        stackNodes[depth++] = 0;
+
+        while (depth > 0)
+        {
+            unsigned int level = stackLevels[--depth];
+            size_t node = stackNodes[depth];
+            size_t first = node * kRMSpatialIndexNodeSize;
+
+            if (level == 0)
+            {
+                const RMSpatialIndexBoxes *entries = &index->entries;
+                size_t last = (first + kRMSpatialIndexNodeSize < entries->count ? first + kRMSpatialIndexNodeSize : entries->count);
+
+                for (size_t i = first; i < last; i++)
+                {
+                    if (entries->minX[i] <= maxX && minX <= entries->maxX[i] && entries->minY[i] <= maxY && minY <= entries->maxY[i])
+                    {
+                        visited++;
+
+                        if ( ! visitor(entries->items[i], context))
+                            return visited;
+                    }
+                }
+            }
+            else
+            {
+                const RMSpatialIndexBoxes *nodes = &index->nodes;
+                size_t childStart = index->levelStart[level - 1];
+                size_t childCount = index->levelStart[level] - childStart;
+                size_t last = (first + kRMSpatialIndexNodeSize < childCount ? first + kRMSpatialIndexNodeSize : childCount);
+
+                for (size_t child = first; child < last; child++)
+                {
+                    size_t i = childStart + child;
+
+                    if (nodes->minX[i] <= maxX && minX <= nodes->maxX[i] && nodes->minY[i] <= maxY && minY <= nodes->maxY[i])
+                    {
+                        stackLevels[depth] = level - 1;
+                        stackNodes[depth++] = child;
+                    }
+                }
+            }
+        }
+    }
+
+    const RMSpatialIndexBoxes *pending = &index->pending;
+
+    for (size_t i = 0; i < pending->count; i++)
+    {
+        if (pending->minX[i] <= maxX && minX <= pending->maxX[i] && pending->minY[i] <= maxY && minY <= pending->maxY[i])
+        {
+            visited++;
+
+            if ( ! visitor(pending->items[i], context))
+                return visited;
+        }
+    }
+
+    return visited;
+}
+
+size_t RMSpatialIndexCount(const RMSpatialIndex *index)
+{
+    return index->entries.count - index->removedCount + index->pending.count;
+}
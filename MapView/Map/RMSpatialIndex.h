@@ -0,0 +1,93 @@
+//
+//  RMSpatialIndex.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMSPATIALINDEX_H_
+#define _RMSPATIALINDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+
+// An index of items by their projected bounding boxes, answering which items intersect
+// a rectangle. It is a packed R-tree: the items are sorted along a space-filling curve
+// (or by sort-tile-recursive slices) and grouped 16 to a node, every level of nodes is
+// one flat array, and boxes are kept as separate arrays of minimum and maximum x and y
+// so that a node's children are tested in one pass over contiguous memory.
+//
+// The tree is built in one pass by RMSpatialIndexInsertMany(). Items inserted one at a
+// time wait in an unsorted list, scanned by every query, and removed items are only
+// marked, until a query finds enough of either to pack the tree again first.
+//
+// Items are opaque non-zero values, such as object pointers, which the index does not
+// retain. It does no locking of its own.
+
+typedef struct RMSpatialIndex RMSpatialIndex;
+
+typedef enum {
+    // Sort by the Morton code (Z-order) of the box centers: fast, and good for points.
+    RMSpatialIndexOrderMorton,
+    // Sort-tile-recursive: vertical slices of the centers sorted by x, each sorted by y.
+    // Slower to build but gives tighter nodes for boxes of varied sizes.
+    RMSpatialIndexOrderSTR,
+} RMSpatialIndexOrder;
+
+// Return false to stop the query.
+typedef bool (*RMSpatialIndexVisitor)(uintptr_t item, void *context);
+
+// Returns NULL if memory could not be allocated.
+RMSpatialIndex *RMSpatialIndexCreate(RMSpatialIndexOrder order);
+
+void RMSpatialIndexDestroy(RMSpatialIndex *index);
+
+// Add the item, or move it if it is already in the index. Returns false if memory
+// could not be allocated.
+bool RMSpatialIndexInsert(RMSpatialIndex *index, uintptr_t item, RMProjectedRect boundingBox);
+
+// Add or move count items, then pack the whole tree once. Returns false if memory could
+// not be allocated, in which case some of the items may have been added.
+bool RMSpatialIndexInsertMany(RMSpatialIndex *index, const uintptr_t *items, const RMProjectedRect *boundingBoxes, size_t count);
+
+// Returns true if the item was in the index.
+bool RMSpatialIndexRemove(RMSpatialIndex *index, uintptr_t item);
+
+void RMSpatialIndexRemoveAll(RMSpatialIndex *index);
+
+// The bounding box of the item, with a positive size. Returns false if the item is
+// not in the index.
+bool RMSpatialIndexGetBoundingBox(const RMSpatialIndex *index, uintptr_t item, RMProjectedRect *boundingBox);
+
+// Call visitor with every item whose bounding box intersects rect, edges included as
+// in RMProjectedRectIntersectsProjectedRect(), in no particular order. The index must
+// not be modified from the visitor. Returns the number of items visited.
+size_t RMSpatialIndexQuery(RMSpatialIndex *index, RMProjectedRect rect, RMSpatialIndexVisitor visitor, void *context);
+
+size_t RMSpatialIndexCount(const RMSpatialIndex *index);
+
+#endif
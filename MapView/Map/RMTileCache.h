@@ -35,6 +35,7 @@
 typedef enum : short {
 	RMCachePurgeStrategyLRU,
 	RMCachePurgeStrategyFIFO,
+	RMCachePurgeStrategyTinyLFU,
 } RMCachePurgeStrategy;
 
 #pragma mark -
@@ -62,8 +63,22 @@ typedef enum : short {
 *   @param cacheKey The key representing a certain cache. */
 - (void)addImage:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)cacheKey;
 
+/** Adds a tile image to specified cache along with the encoded data it was decoded from.
+*
+*   Disk caches store the data as is, in its original format and size, instead of encoding the image again. The format is recognized from the data itself when the tile is read back.
+*   @param image A tile image to be cached.
+*   @param data The encoded image data, for example PNG or JPEG bytes as received from a tile server.
+*   @param tile The RMTile describing the map location of the image.
+*   @param cacheKey The key representing a certain cache. */
+- (void)addImage:(UIImage *)image withData:(NSData *)data forTile:(RMTile)tile withCacheKey:(NSString *)cacheKey;
+
 /** @name Clearing the Cache */
 
+/** Removes the image of a tile from a cache, such as one a tile source has to draw again.
+*   @param tile The RMTile describing the map location of the image.
+*   @param cacheKey The key representing a certain cache. */
+- (void)removeImageForTile:(RMTile)tile withCacheKey:(NSString *)cacheKey;
+
 /** Removes all tile images from a cache. */
 - (void)removeAllCachedImages;
 
@@ -99,6 +114,20 @@ typedef enum : short {
 *   @param cache A memory-based or disk-based cache. */
 - (void)addCache:(id <RMTileCache>)cache;
 
+/** @name Caching Drawn Tiles */
+
+/** Adds a tile image to the memory cache only, for tiles a tile source draws itself that are not worth keeping on disk, such as those of points that are not kept across launches.
+*   @param image A tile image to be cached.
+*   @param tile The RMTile describing the map location of the image.
+*   @param cacheKey The key representing a certain cache. */
+- (void)addImageToMemoryCache:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)cacheKey;
+
+/** Removes the images of tiles added with addImageToMemoryCache:forTile:withCacheKey: from the memory cache.
+*   @param tiles The RMTiles describing the map locations of the images.
+*   @param count The number of tiles.
+*   @param cacheKey The key representing a certain cache. */
+- (void)removeImagesFromMemoryCacheForTiles:(const RMTile *)tiles count:(NSUInteger)count withCacheKey:(NSString *)cacheKey;
+
 - (void)didReceiveMemoryWarning;
 
 @end
@@ -30,6 +30,7 @@
 #import "RMTileCache.h"
 #import "RMMemoryCache.h"
 #import "RMDatabaseCache.h"
+#import "RMTileStoreCache.h"
 
 #import "RMConfiguration.h"
 #import "RMTileSource.h"
@@ -38,6 +39,7 @@
 
 - (id <RMTileCache>)memoryCacheWithConfig:(NSDictionary *)cfg;
 - (id <RMTileCache>)databaseCacheWithConfig:(NSDictionary *)cfg;
+- (id <RMTileCache>)tileStoreCacheWithConfig:(NSDictionary *)cfg;
 
 @end
 
@@ -89,6 +91,9 @@
             if ([@"db-cache" isEqualToString:type])
                 newCache = [self databaseCacheWithConfig:cfg];
 
+            if ([@"store-cache" isEqualToString:type])
+                newCache = [self tileStoreCacheWithConfig:cfg];
+
             if (newCache)
                 [_tileCaches addObject:newCache];
             else
@@ -160,6 +165,11 @@
 }
 
 - (void)addImage:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    [self addImage:image withData:nil forTile:tile withCacheKey:aCacheKey];
+}
+
+- (void)addImage:(UIImage *)image withData:(NSData *)data forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
 {
     if (!image || !aCacheKey)
         return;
@@ -170,13 +180,32 @@
 
         for (id <RMTileCache> cache in _tileCaches)
         {	
-            if ([cache respondsToSelector:@selector(addImage:forTile:withCacheKey:)])
+            if (data && [cache respondsToSelector:@selector(addImage:withData:forTile:withCacheKey:)])
+                [cache addImage:image withData:data forTile:tile withCacheKey:aCacheKey];
+            else if ([cache respondsToSelector:@selector(addImage:forTile:withCacheKey:)])
                 [cache addImage:image forTile:tile withCacheKey:aCacheKey];
         }
 
     });
 }
 
+- (void)addImageToMemoryCache:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    if (!image || !aCacheKey)
+        return;
+
+    [_memoryCache addImage:image forTile:tile withCacheKey:aCacheKey];
+}
+
+- (void)removeImagesFromMemoryCacheForTiles:(const RMTile *)tiles count:(NSUInteger)count withCacheKey:(NSString *)aCacheKey
+{
+    if (!aCacheKey)
+        return;
+
+    for (NSUInteger i = 0; i < count; i++)
+        [_memoryCache removeImageForTile:tiles[i] withCacheKey:aCacheKey];
+}
+
 - (void)didReceiveMemoryWarning
 {
 	LogMethod();
@@ -193,6 +222,25 @@
     });
 }
 
+- (void)removeImageForTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    if (!aCacheKey)
+        return;
+
+    dispatch_sync(_tileCacheQueue, ^{
+
+        for (id <RMTileCache> cache in _tileCaches)
+        {
+            if ([cache respondsToSelector:@selector(removeImageForTile:withCacheKey:)])
+                [cache removeImageForTile:tile withCacheKey:aCacheKey];
+        }
+
+    });
+
+    // Last, so that a copy still read from another cache meanwhile is not left in memory
+    [_memoryCache removeImageForTile:tile withCacheKey:aCacheKey];
+}
+
 - (void)removeAllCachedImages
 {
     [_memoryCache removeAllCachedImages];
@@ -260,11 +308,19 @@ static NSMutableDictionary *predicateValues = nil;
 - (id <RMTileCache>)memoryCacheWithConfig:(NSDictionary *)cfg
 {
     NSUInteger capacity = 32;
+    NSUInteger byteCapacity = 0;
+    RMCachePurgeStrategy strategy = RMCachePurgeStrategyLRU;
 
 	NSNumber *capacityNumber = [cfg objectForKey:@"capacity"];
 	if (capacityNumber != nil)
         capacity = [capacityNumber unsignedIntegerValue];
 
+    NSNumber *byteCapacityNumber = [cfg objectForKey:@"byteCapacity"];
+    if (byteCapacityNumber != nil)
+        byteCapacity = [byteCapacityNumber unsignedIntegerValue];
+
+    NSString *strategyStr = [cfg objectForKey:@"strategy"];
+
     NSArray *predicates = [cfg objectForKey:@"predicates"];
 
     if (predicates)
@@ -283,12 +339,32 @@ static NSMutableDictionary *predicateValues = nil;
             capacityNumber = [predicateDescription objectForKey:@"capacity"];
             if (capacityNumber != nil)
                 capacity = [capacityNumber unsignedIntegerValue];
+
+            byteCapacityNumber = [predicateDescription objectForKey:@"byteCapacity"];
+            if (byteCapacityNumber != nil)
+                byteCapacity = [byteCapacityNumber unsignedIntegerValue];
+
+            if ([predicateDescription objectForKey:@"strategy"])
+                strategyStr = [predicateDescription objectForKey:@"strategy"];
         }
     }
 
-    RMLog(@"Memory cache configuration: {capacity : %d}", capacity);
+    if (strategyStr != nil)
+    {
+        if ([strategyStr caseInsensitiveCompare:@"LRU"] == NSOrderedSame) strategy = RMCachePurgeStrategyLRU;
+        if ([strategyStr caseInsensitiveCompare:@"TinyLFU"] == NSOrderedSame) strategy = RMCachePurgeStrategyTinyLFU;
+    }
+    else
+    {
+        strategyStr = @"LRU";
+    }
+
+    RMLog(@"Memory cache configuration: {capacity : %d, byteCapacity : %d, strategy : %@}", capacity, byteCapacity, strategyStr);
 
-	return [[[RMMemoryCache alloc] initWithCapacity:capacity] autorelease];
+    RMMemoryCache *memoryCache = [[[RMMemoryCache alloc] initWithCapacity:capacity byteCapacity:byteCapacity] autorelease];
+    [memoryCache setPurgeStrategy:strategy];
+
+	return memoryCache;
 }
 
 - (id <RMTileCache>)databaseCacheWithConfig:(NSDictionary *)cfg
@@ -364,6 +440,7 @@ static NSMutableDictionary *predicateValues = nil;
     {
         if ([strategyStr caseInsensitiveCompare:@"FIFO"] == NSOrderedSame) strategy = RMCachePurgeStrategyFIFO;
         if ([strategyStr caseInsensitiveCompare:@"LRU"] == NSOrderedSame) strategy = RMCachePurgeStrategyLRU;
+        if ([strategyStr caseInsensitiveCompare:@"TinyLFU"] == NSOrderedSame) strategy = RMCachePurgeStrategyTinyLFU;
     }
     else
     {
@@ -397,4 +474,46 @@ static NSMutableDictionary *predicateValues = nil;
     return dbCache;
 }
 
+- (id <RMTileCache>)tileStoreCacheWithConfig:(NSDictionary *)cfg
+{
+    BOOL useCacheDir = NO;
+    unsigned long long byteCapacity = 128 * 1024 * 1024;
+
+    NSNumber *byteCapacityNumber = [cfg objectForKey:@"byteCapacity"];
+    NSNumber *useCacheDirNumber = [cfg objectForKey:@"useCachesDirectory"];
+
+    NSArray *predicates = [cfg objectForKey:@"predicates"];
+
+    if (predicates)
+    {
+        NSDictionary *predicateValues = [self predicateValues];
+
+        for (NSDictionary *predicateDescription in predicates)
+        {
+            NSString *predicate = [predicateDescription objectForKey:@"predicate"];
+            if ( ! predicate)
+                continue;
+
+            if ( ! [[NSPredicate predicateWithFormat:predicate] evaluateWithObject:predicateValues])
+                continue;
+
+            if ([predicateDescription objectForKey:@"byteCapacity"])
+                byteCapacityNumber = [predicateDescription objectForKey:@"byteCapacity"];
+            if ([predicateDescription objectForKey:@"useCachesDirectory"])
+                useCacheDirNumber = [predicateDescription objectForKey:@"useCachesDirectory"];
+        }
+    }
+
+    // 0 is valid: it means no capacity limit
+    if (byteCapacityNumber != nil)
+        byteCapacity = [byteCapacityNumber unsignedLongLongValue];
+
+    if (useCacheDirNumber != nil)
+        useCacheDir = [useCacheDirNumber boolValue];
+
+    RMLog(@"Tile store cache configuration: {byteCapacity : %llu, useCacheDir : %@}", byteCapacity, useCacheDir ? @"YES" : @"NO");
+
+    return [[[RMTileStoreCache alloc] initUsingCacheDir:useCacheDir byteCapacity:byteCapacity] autorelease];
+}
+
 @end
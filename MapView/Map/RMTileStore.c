@@ -0,0 +1,1127 @@
+//
+//  RMTileStore.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMTileStore.h"
+#include "RMCacheKey.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kRMTileStoreIndexMagic 0x49544d52 // "RMTI"
+#define kRMTileStoreIndexVersion 1
+#define kRMTileStoreRecordMagic 0x52544d52 // "RMTR"
+#define kRMTileStoreTombstoneMagic 0x44544d52 // "RMTD"
+
+#define kRMTileStoreMinimumSlots 1024
+#define kRMTileStoreMaximumKeyLength 1024
+#define kRMTileStoreMaximumRecordLength 0x7fffffff
+#define kRMTileStoreRecordAlignment 8
+
+// Slot hashes below 2 are reserved for empty and deleted slots.
+#define kRMTileStoreEmptySlot 0
+#define kRMTileStoreDeletedSlot 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t clean;
+    uint32_t reserved;
+    uint64_t capacity; // slots, a power of two
+    uint64_t count;    // live slots
+    uint64_t used;     // live and deleted slots
+    uint64_t padding[3];
+} RMTileStoreIndexHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t segment;
+    uint32_t offset;
+    uint32_t dataLength;
+    uint32_t recordLength;
+} RMTileStoreSlot;
+
+// Followed by the cache key, without its terminating NUL, the data and padding.
+typedef struct {
+    uint32_t magic;
+    uint32_t dataLength;
+    uint64_t tileKey;
+    uint32_t cacheKeyLength;
+    uint32_t checksum; // of the cache key and the data
+} RMTileStoreRecord;
+
+typedef struct {
+    uint32_t id;
+    int fd;
+    uint64_t size;
+    uint64_t liveBytes;
+} RMTileStoreSegment;
+
+struct RMTileStore {
+    pthread_rwlock_t lock;
+    char *directory;
+    size_t segmentSize;
+    uint64_t byteLimit;
+
+    int indexFD;
+    size_t indexSize;
+    RMTileStoreIndexHeader *index;
+
+    // Ordered by id; records are appended to the last one.
+    RMTileStoreSegment *segments;
+    size_t segmentCount, segmentCapacity;
+    uint64_t totalBytes;
+
+    uint8_t *recordBuffer;
+    size_t recordBufferSize;
+
+    // Set while RMTileStoreCompact() runs, which it does mostly without the lock.
+    bool compacting;
+
+    // Changed by RMTileStoreRemoveAll(), after which segment ids are used again.
+    uint64_t generation;
+};
+
+// A segment being compacted, read through a descriptor of its own so that it stays
+// readable if the segment is dropped meanwhile.
+typedef struct {
+    uint32_t id;
+    int fd;
+    uint64_t size;
+    bool copied;
+} RMTileStoreVictim;
+
+#pragma mark -
+
+static RMTileStoreSlot *RMTileStoreSlots(RMTileStore *store)
+{
+    return (RMTileStoreSlot *)(store->index + 1);
+}
+
+static uint64_t RMTileStoreHash(uint64_t tileKey, const char *cacheKey)
+{
+    uint64_t hash = RMCacheKeyHash(tileKey, cacheKey);
+
+    return (hash <= kRMTileStoreDeletedSlot ? hash + 2 : hash);
+}
+
+static size_t RMTileStoreRecordLength(size_t cacheKeyLength, size_t dataLength)
+{
+    size_t length = sizeof(RMTileStoreRecord) + cacheKeyLength + dataLength;
+
+    return (length + kRMTileStoreRecordAlignment - 1) & ~(size_t)(kRMTileStoreRecordAlignment - 1);
+}
+
+static uint64_t RMTileStoreChecksumBytes(uint64_t hash, const uint8_t *bytes, size_t length)
+{
+    size_t i = 0;
+
+    for ( ; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+
+    for ( ; i < length; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+
+    return hash;
+}
+
+static uint32_t RMTileStoreChecksum(const void *cacheKey, size_t cacheKeyLength, const void *data, size_t dataLength)
+{
+    // FNV-1a taken a word at a time, enough to tell a record cut short by a crash
+    // from a complete one at a fraction of the cost of the bytewise version.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    hash = RMTileStoreChecksumBytes(hash, cacheKey, cacheKeyLength);
+    hash = RMTileStoreChecksumBytes(hash, data, dataLength);
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static void RMTileStorePath(RMTileStore *store, const char *name, char *path)
+{
+    snprintf(path, PATH_MAX, "%s/%s", store->directory, name);
+}
+
+static void RMTileStoreSegmentPath(RMTileStore *store, uint32_t segmentID, char *path)
+{
+    snprintf(path, PATH_MAX, "%s/segment-%08x", store->directory, segmentID);
+}
+
+static bool RMTileStoreReserveBuffer(uint8_t **buffer, size_t *bufferSize, size_t length)
+{
+    if (length <= *bufferSize)
+        return true;
+
+    uint8_t *newBuffer = realloc(*buffer, length);
+
+    if ( ! newBuffer)
+        return false;
+
+    *buffer = newBuffer;
+    *bufferSize = length;
+
+    return true;
+}
+
+// Read the record at offset of a segment of size bytes into *buffer. Returns its length,
+// or 0 at the end of the segment or if the record was only partly written.
+static size_t RMTileStoreReadRecord(int fd, uint64_t offset, uint64_t size, uint8_t **buffer, size_t *bufferSize)
+{
+    RMTileStoreRecord record;
+
+    if (offset + sizeof(RMTileStoreRecord) > size || pread(fd, &record, sizeof(record), (off_t)offset) != sizeof(record))
+        return 0;
+
+    if ((record.magic != kRMTileStoreRecordMagic && record.magic != kRMTileStoreTombstoneMagic) || record.cacheKeyLength > kRMTileStoreMaximumKeyLength)
+        return 0;
+
+    size_t length = RMTileStoreRecordLength(record.cacheKeyLength, record.dataLength);
+
+    if (length > kRMTileStoreMaximumRecordLength || offset + length > size || ! RMTileStoreReserveBuffer(buffer, bufferSize, length))
+        return 0;
+
+    if (pread(fd, *buffer, length, (off_t)offset) != (ssize_t)length)
+        return 0;
+
+    const uint8_t *cacheKey = *buffer + sizeof(RMTileStoreRecord);
+
+    if (RMTileStoreChecksum(cacheKey, record.cacheKeyLength, cacheKey + record.cacheKeyLength, record.dataLength) != record.checksum)
+        return 0;
+
+    return length;
+}
+
+#pragma mark -
+#pragma mark Segments
+
+static RMTileStoreSegment *RMTileStoreFindSegment(RMTileStore *store, uint32_t segmentID)
+{
+    size_t low = 0, high = store->segmentCount;
+
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+
+        if (store->segments[middle].id < segmentID)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low < store->segmentCount && store->segments[low].id == segmentID)
+        return &store->segments[low];
+
+    return NULL;
+}
+
+static RMTileStoreSegment *RMTileStoreAddSegment(RMTileStore *store, uint32_t segmentID, int fd, uint64_t size)
+{
+    if (store->segmentCount == store->segmentCapacity)
+    {
+        size_t capacity = (store->segmentCapacity ? store->segmentCapacity * 2 : 16);
+        RMTileStoreSegment *segments = realloc(store->segments, capacity * sizeof(RMTileStoreSegment));
+
+        if ( ! segments)
+            return NULL;
+
+        store->segments = segments;
+        store->segmentCapacity = capacity;
+    }
+
+    RMTileStoreSegment *segment = &store->segments[store->segmentCount++];
+
+    segment->id = segmentID;
+    segment->fd = fd;
+    segment->size = size;
+    segment->liveBytes = 0;
+
+    store->totalBytes += size;
+
+    return segment;
+}
+
+static RMTileStoreSegment *RMTileStoreStartSegment(RMTileStore *store)
+{
+    uint32_t segmentID = (store->segmentCount ? store->segments[store->segmentCount - 1].id + 1 : 1);
+    char path[PATH_MAX];
+
+    RMTileStoreSegmentPath(store, segmentID, path);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return NULL;
+
+    RMTileStoreSegment *segment = RMTileStoreAddSegment(store, segmentID, fd, 0);
+
+    if ( ! segment)
+    {
+        close(fd);
+        unlink(path);
+    }
+
+    return segment;
+}
+
+// Delete the segment at position i; clearSlots removes the index entries still pointing into it.
+static void RMTileStoreDropSegment(RMTileStore *store, size_t i, bool clearSlots)
+{
+    RMTileStoreSegment *segment = &store->segments[i];
+    char path[PATH_MAX];
+
+    if (clearSlots && segment->liveBytes > 0)
+    {
+        RMTileStoreSlot *slots = RMTileStoreSlots(store);
+
+        for (uint64_t s = 0; s < store->index->capacity; s++)
+        {
+            if (slots[s].hash > kRMTileStoreDeletedSlot && slots[s].segment == segment->id)
+            {
+                slots[s].hash = kRMTileStoreDeletedSlot;
+                store->index->count--;
+            }
+        }
+    }
+
+    RMTileStoreSegmentPath(store, segment->id, path);
+    close(segment->fd);
+    unlink(path);
+
+    store->totalBytes -= segment->size;
+
+    memmove(&store->segments[i], &store->segments[i + 1], (store->segmentCount - i - 1) * sizeof(RMTileStoreSegment));
+    store->segmentCount--;
+}
+
+// Append length bytes as one record.
+static bool RMTileStoreWriteRecord(RMTileStore *store, const uint8_t *bytes, size_t length, uint32_t *segmentID, uint32_t *offset)
+{
+    RMTileStoreSegment *segment = (store->segmentCount ? &store->segments[store->segmentCount - 1] : NULL);
+
+    if ( ! segment || (segment->size > 0 && segment->size + length > store->segmentSize))
+        segment = RMTileStoreStartSegment(store);
+
+    if ( ! segment)
+        return false;
+
+    if (pwrite(segment->fd, bytes, length, (off_t)segment->size) != (ssize_t)length)
+    {
+        // Unknown content, left as dead space if it cannot be cut off.
+        if (ftruncate(segment->fd, (off_t)segment->size) != 0)
+        {
+            segment->size += length;
+            store->totalBytes += length;
+        }
+
+        return false;
+    }
+
+    *segmentID = segment->id;
+    *offset = (uint32_t)segment->size;
+
+    segment->size += length;
+    store->totalBytes += length;
+
+    return true;
+}
+
+static bool RMTileStoreAppend(RMTileStore *store, uint32_t magic, uint64_t tileKey, const char *cacheKey, size_t cacheKeyLength, const void *data, size_t dataLength, uint32_t *segmentID, uint32_t *offset)
+{
+    size_t length = RMTileStoreRecordLength(cacheKeyLength, dataLength);
+
+    if ( ! RMTileStoreReserveBuffer(&store->recordBuffer, &store->recordBufferSize, length))
+        return false;
+
+    RMTileStoreRecord *record = (RMTileStoreRecord *)store->recordBuffer;
+    uint8_t *bytes = store->recordBuffer + sizeof(RMTileStoreRecord);
+
+    record->magic = magic;
+    record->dataLength = (uint32_t)dataLength;
+    record->tileKey = tileKey;
+    record->cacheKeyLength = (uint32_t)cacheKeyLength;
+    record->checksum = RMTileStoreChecksum(cacheKey, cacheKeyLength, data, dataLength);
+
+    memcpy(bytes, cacheKey, cacheKeyLength);
+
+    if (dataLength)
+        memcpy(bytes + cacheKeyLength, data, dataLength);
+
+    memset(bytes + cacheKeyLength + dataLength, 0, length - sizeof(RMTileStoreRecord) - cacheKeyLength - dataLength);
+
+    return RMTileStoreWriteRecord(store, store->recordBuffer, length, segmentID, offset);
+}
+
+#pragma mark -
+#pragma mark Index
+
+static RMTileStoreIndexHeader *RMTileStoreMapIndex(const char *path, uint64_t capacity, int *fd, size_t *size)
+{
+    *size = sizeof(RMTileStoreIndexHeader) + capacity * sizeof(RMTileStoreSlot);
+    *fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (*fd < 0)
+        return NULL;
+
+    RMTileStoreIndexHeader *index = MAP_FAILED;
+
+    // A new file reads as zeros: every slot empty.
+    if (ftruncate(*fd, (off_t)*size) == 0)
+        index = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+
+    if (index == MAP_FAILED)
+    {
+        close(*fd);
+        unlink(path);
+        return NULL;
+    }
+
+    index->magic = kRMTileStoreIndexMagic;
+    index->version = kRMTileStoreIndexVersion;
+    index->capacity = capacity;
+
+    return index;
+}
+
+static bool RMTileStoreRecordMatches(RMTileStore *store, const RMTileStoreSlot *slot, uint64_t tileKey, const char *cacheKey, size_t cacheKeyLength)
+{
+    RMTileStoreSegment *segment = RMTileStoreFindSegment(store, slot->segment);
+    uint8_t buffer[sizeof(RMTileStoreRecord) + kRMTileStoreMaximumKeyLength];
+    size_t length = sizeof(RMTileStoreRecord) + cacheKeyLength;
+
+    if ( ! segment || pread(segment->fd, buffer, length, slot->offset) != (ssize_t)length)
+        return false;
+
+    const RMTileStoreRecord *record = (const RMTileStoreRecord *)buffer;
+
+    return (record->tileKey == tileKey && record->cacheKeyLength == cacheKeyLength && memcmp(buffer + sizeof(RMTileStoreRecord), cacheKey, cacheKeyLength) == 0);
+}
+
+// The slot holding the tile, or NULL. freeSlot, if not NULL, is set to the slot a new
+// entry for the tile would go to.
+static RMTileStoreSlot *RMTileStoreFindSlot(RMTileStore *store, uint64_t hash, uint64_t tileKey, const char *cacheKey, size_t cacheKeyLength, RMTileStoreSlot **freeSlot)
+{
+    RMTileStoreSlot *slots = RMTileStoreSlots(store);
+    uint64_t mask = store->index->capacity - 1;
+
+    if (freeSlot)
+        *freeSlot = NULL;
+
+    // The load factor stays below 70%, so the probe always ends at an empty slot.
+    for (uint64_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        RMTileStoreSlot *slot = &slots[i];
+
+        if (slot->hash == kRMTileStoreEmptySlot || slot->hash == kRMTileStoreDeletedSlot)
+        {
+            if (freeSlot && ! *freeSlot)
+                *freeSlot = slot;
+
+            if (slot->hash == kRMTileStoreEmptySlot)
+                return NULL;
+        }
+        else if (slot->hash == hash && RMTileStoreRecordMatches(store, slot, tileKey, cacheKey, cacheKeyLength))
+        {
+            return slot;
+        }
+    }
+}
+
+static bool RMTileStoreRehash(RMTileStore *store, uint64_t capacity)
+{
+    char path[PATH_MAX], newPath[PATH_MAX];
+    int fd;
+    size_t size;
+
+    RMTileStorePath(store, "index", path);
+    RMTileStorePath(store, "index.new", newPath);
+
+    RMTileStoreIndexHeader *index = RMTileStoreMapIndex(newPath, capacity, &fd, &size);
+
+    if ( ! index)
+        return false;
+
+    RMTileStoreSlot *slots = (RMTileStoreSlot *)(index + 1);
+
+    if (store->index)
+    {
+        RMTileStoreSlot *oldSlots = RMTileStoreSlots(store);
+
+        for (uint64_t i = 0; i < store->index->capacity; i++)
+        {
+            if (oldSlots[i].hash <= kRMTileStoreDeletedSlot)
+                continue;
+
+            uint64_t s = oldSlots[i].hash & (capacity - 1);
+
+            while (slots[s].hash != kRMTileStoreEmptySlot)
+                s = (s + 1) & (capacity - 1);
+
+            slots[s] = oldSlots[i];
+            index->count++;
+        }
+    }
+
+    index->used = index->count;
+
+    if (rename(newPath, path) != 0)
+    {
+        munmap(index, size);
+        close(fd);
+        unlink(newPath);
+        return false;
+    }
+
+    if (store->index)
+    {
+        munmap(store->index, store->indexSize);
+        close(store->indexFD);
+    }
+
+    store->index = index;
+    store->indexFD = fd;
+    store->indexSize = size;
+
+    return true;
+}
+
+// Make room for one more entry, growing the index or clearing out deleted slots.
+static bool RMTileStoreReserveSlot(RMTileStore *store)
+{
+    if ((store->index->used + 1) * 10 <= store->index->capacity * 7)
+        return true;
+
+    uint64_t capacity = kRMTileStoreMinimumSlots;
+
+    while ((store->index->count + 1) * 2 > capacity)
+        capacity <<= 1;
+
+    return RMTileStoreRehash(store, capacity);
+}
+
+static void RMTileStoreIndexPut(RMTileStore *store, uint64_t hash, uint64_t tileKey, const char *cacheKey, size_t cacheKeyLength, uint32_t segmentID, uint32_t offset, uint32_t dataLength, uint32_t recordLength)
+{
+    RMTileStoreSlot *freeSlot;
+    RMTileStoreSlot *slot = RMTileStoreFindSlot(store, hash, tileKey, cacheKey, cacheKeyLength, &freeSlot);
+
+    if (slot)
+    {
+        RMTileStoreSegment *segment = RMTileStoreFindSegment(store, slot->segment);
+
+        if (segment)
+            segment->liveBytes -= slot->recordLength;
+    }
+    else
+    {
+        slot = freeSlot;
+
+        if (slot->hash == kRMTileStoreEmptySlot)
+            store->index->used++;
+
+        store->index->count++;
+    }
+
+    slot->hash = hash;
+    slot->segment = segmentID;
+    slot->offset = offset;
+    slot->dataLength = dataLength;
+    slot->recordLength = recordLength;
+
+    RMTileStoreFindSegment(store, segmentID)->liveBytes += recordLength;
+}
+
+static bool RMTileStoreIndexRemove(RMTileStore *store, uint64_t hash, uint64_t tileKey, const char *cacheKey, size_t cacheKeyLength)
+{
+    RMTileStoreSlot *slot = RMTileStoreFindSlot(store, hash, tileKey, cacheKey, cacheKeyLength, NULL);
+
+    if ( ! slot)
+        return false;
+
+    RMTileStoreSegment *segment = RMTileStoreFindSegment(store, slot->segment);
+
+    if (segment)
+        segment->liveBytes -= slot->recordLength;
+
+    slot->hash = kRMTileStoreDeletedSlot;
+    store->index->count--;
+
+    return true;
+}
+
+static void RMTileStoreEnforceLimit(RMTileStore *store)
+{
+    while (store->byteLimit && store->totalBytes > store->byteLimit && store->segmentCount > 1)
+        RMTileStoreDropSegment(store, 0, true);
+}
+
+// Append again a record read from a segment being compacted, if it is still needed: a
+// tile the index points to there, or a tombstone while an older segment may still hold
+// the tile it removed, which rebuilding the index would otherwise bring back. Returns
+// false if it could not be written.
+static bool RMTileStoreMoveRecord(RMTileStore *store, uint32_t segmentID, uint32_t offset, const uint8_t *bytes, size_t length)
+{
+    const RMTileStoreRecord *record = (const RMTileStoreRecord *)bytes;
+    char key[kRMTileStoreMaximumKeyLength + 1];
+    uint32_t newSegmentID, newOffset;
+
+    memcpy(key, bytes + sizeof(RMTileStoreRecord), record->cacheKeyLength);
+    key[record->cacheKeyLength] = '\0';
+
+    RMTileStoreSlot *slot = RMTileStoreFindSlot(store, RMTileStoreHash(record->tileKey, key), record->tileKey, key, record->cacheKeyLength, NULL);
+
+    if (record->magic == kRMTileStoreTombstoneMagic)
+    {
+        // The tile was stored again since, or every segment it could be in is gone.
+        if (slot || store->segmentCount == 0 || store->segments[0].id >= segmentID)
+            return true;
+
+        return RMTileStoreWriteRecord(store, bytes, length, &newSegmentID, &newOffset);
+    }
+
+    if ( ! slot || slot->segment != segmentID || slot->offset != offset)
+        return true;
+
+    if ( ! RMTileStoreWriteRecord(store, bytes, length, &newSegmentID, &newOffset))
+        return false;
+
+    // Writing may have started a segment and moved the array.
+    RMTileStoreFindSegment(store, segmentID)->liveBytes -= slot->recordLength;
+    RMTileStoreFindSegment(store, newSegmentID)->liveBytes += slot->recordLength;
+
+    slot->segment = newSegmentID;
+    slot->offset = newOffset;
+
+    return true;
+}
+
+#pragma mark -
+#pragma mark Opening
+
+static int RMTileStoreCompareSegments(const void *a, const void *b)
+{
+    uint32_t idA = ((const RMTileStoreSegment *)a)->id, idB = ((const RMTileStoreSegment *)b)->id;
+
+    return (idA < idB ? -1 : idA > idB);
+}
+
+static bool RMTileStoreOpenSegments(RMTileStore *store)
+{
+    DIR *directory = opendir(store->directory);
+    struct dirent *entry;
+
+    if ( ! directory)
+        return false;
+
+    while ((entry = readdir(directory)))
+    {
+        unsigned int segmentID;
+        int length = 0;
+        char path[PATH_MAX];
+        struct stat info;
+
+        if (sscanf(entry->d_name, "segment-%8x%n", &segmentID, &length) != 1 || entry->d_name[length] != '\0' || segmentID == 0)
+            continue;
+
+        RMTileStoreSegmentPath(store, segmentID, path);
+
+        int fd = open(path, O_RDWR);
+
+        if (fd < 0)
+            continue;
+
+        if (fstat(fd, &info) != 0 || ! RMTileStoreAddSegment(store, segmentID, fd, (uint64_t)info.st_size))
+            close(fd);
+    }
+
+    closedir(directory);
+
+    if (store->segmentCount)
+        qsort(store->segments, store->segmentCount, sizeof(RMTileStoreSegment), RMTileStoreCompareSegments);
+
+    return true;
+}
+
+// Use the index left by RMTileStoreClose(), if there is one and it is consistent
+// with the segments.
+static bool RMTileStoreLoadIndex(RMTileStore *store)
+{
+    char path[PATH_MAX];
+    struct stat info;
+
+    RMTileStorePath(store, "index", path);
+
+    int fd = open(path, O_RDWR);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(RMTileStoreIndexHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)info.st_size;
+    RMTileStoreIndexHeader *index = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (index == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    bool valid = (index->magic == kRMTileStoreIndexMagic &&
+                  index->version == kRMTileStoreIndexVersion &&
+                  index->clean &&
+                  index->capacity >= kRMTileStoreMinimumSlots &&
+                  (index->capacity & (index->capacity - 1)) == 0 &&
+                  size == sizeof(RMTileStoreIndexHeader) + index->capacity * sizeof(RMTileStoreSlot));
+
+    if (valid)
+    {
+        store->index = index;
+        store->indexFD = fd;
+        store->indexSize = size;
+
+        RMTileStoreSlot *slots = RMTileStoreSlots(store);
+        uint64_t count = 0, used = 0;
+
+        for (uint64_t i = 0; valid && i < index->capacity; i++)
+        {
+            if (slots[i].hash == kRMTileStoreEmptySlot)
+                continue;
+
+            used++;
+
+            if (slots[i].hash == kRMTileStoreDeletedSlot)
+                continue;
+
+            RMTileStoreSegment *segment = RMTileStoreFindSegment(store, slots[i].segment);
+
+            valid = (segment && (uint64_t)slots[i].offset + slots[i].recordLength <= segment->size);
+
+            if (valid)
+                segment->liveBytes += slots[i].recordLength;
+
+            count++;
+        }
+
+        valid = (valid && count == index->count && used == index->used && used * 10 <= index->capacity * 7);
+    }
+
+    if ( ! valid)
+    {
+        for (size_t i = 0; i < store->segmentCount; i++)
+            store->segments[i].liveBytes = 0;
+
+        store->index = NULL;
+        munmap(index, size);
+        close(fd);
+    }
+
+    return valid;
+}
+
+// Recreate the index from the segments, oldest first so that later records win.
+static bool RMTileStoreRebuildIndex(RMTileStore *store)
+{
+    if ( ! RMTileStoreRehash(store, kRMTileStoreMinimumSlots))
+        return false;
+
+    for (size_t i = 0; i < store->segmentCount; i++)
+    {
+        uint32_t segmentID = store->segments[i].id;
+        uint64_t size = store->segments[i].size, offset = 0;
+        size_t length;
+
+        while ((length = RMTileStoreReadRecord(store->segments[i].fd, offset, size, &store->recordBuffer, &store->recordBufferSize)) > 0)
+        {
+            RMTileStoreRecord record = *(const RMTileStoreRecord *)store->recordBuffer;
+
+            // The cache key is only looked at up to its length; terminate it for the hash.
+            char key[kRMTileStoreMaximumKeyLength + 1];
+
+            memcpy(key, store->recordBuffer + sizeof(RMTileStoreRecord), record.cacheKeyLength);
+            key[record.cacheKeyLength] = '\0';
+
+            uint64_t hash = RMTileStoreHash(record.tileKey, key);
+
+            if (record.magic == kRMTileStoreRecordMagic)
+            {
+                if ( ! RMTileStoreReserveSlot(store))
+                    return false;
+
+                RMTileStoreIndexPut(store, hash, record.tileKey, key, record.cacheKeyLength, segmentID, (uint32_t)offset, record.dataLength, (uint32_t)length);
+            }
+            else
+            {
+                RMTileStoreIndexRemove(store, hash, record.tileKey, key, record.cacheKeyLength);
+            }
+
+            offset += length;
+        }
+
+        // Whatever follows the last complete record was cut short.
+        if (offset < size && ftruncate(store->segments[i].fd, (off_t)offset) == 0)
+        {
+            store->totalBytes -= size - offset;
+            store->segments[i].size = offset;
+        }
+    }
+
+    return true;
+}
+
+#pragma mark -
+
+RMTileStore *RMTileStoreOpen(const char *directory, size_t segmentSize, uint64_t byteLimit)
+{
+    RMTileStore *store = calloc(1, sizeof(RMTileStore));
+
+    if ( ! store)
+        return NULL;
+
+    store->directory = strdup(directory);
+    store->segmentSize = (segmentSize > 0 && segmentSize < kRMTileStoreMaximumRecordLength ? segmentSize : kRMTileStoreMaximumRecordLength);
+    store->byteLimit = byteLimit;
+    store->indexFD = -1;
+
+    pthread_rwlock_init(&store->lock, NULL);
+
+    mkdir(directory, 0755);
+
+    if ( ! store->directory || ! RMTileStoreOpenSegments(store) || ( ! RMTileStoreLoadIndex(store) && ! RMTileStoreRebuildIndex(store)))
+    {
+        RMTileStoreClose(store);
+        return NULL;
+    }
+
+    // Until RMTileStoreClose(), the index on disk may not match the segments.
+    store->index->clean = 0;
+    msync(store->index, sizeof(RMTileStoreIndexHeader), MS_SYNC);
+
+    RMTileStoreEnforceLimit(store);
+
+    return store;
+}
+
+void RMTileStoreClose(RMTileStore *store)
+{
+    if ( ! store)
+        return;
+
+    pthread_rwlock_wrlock(&store->lock);
+
+    if (store->index)
+    {
+        if (store->segmentCount)
+            fsync(store->segments[store->segmentCount - 1].fd);
+
+        msync(store->index, store->indexSize, MS_SYNC);
+        store->index->clean = 1;
+        msync(store->index, sizeof(RMTileStoreIndexHeader), MS_SYNC);
+
+        munmap(store->index, store->indexSize);
+        close(store->indexFD);
+    }
+
+    pthread_rwlock_unlock(&store->lock);
+    pthread_rwlock_destroy(&store->lock);
+
+    for (size_t i = 0; i < store->segmentCount; i++)
+        close(store->segments[i].fd);
+
+    free(store->segments);
+    free(store->recordBuffer);
+    free(store->directory);
+    free(store);
+}
+
+bool RMTileStorePut(RMTileStore *store, uint64_t tileKey, const char *cacheKey, const void *data, size_t length)
+{
+    size_t cacheKeyLength = strlen(cacheKey);
+    uint32_t segmentID, offset;
+    bool result;
+
+    if (cacheKeyLength > kRMTileStoreMaximumKeyLength || RMTileStoreRecordLength(cacheKeyLength, length) > kRMTileStoreMaximumRecordLength)
+        return false;
+
+    pthread_rwlock_wrlock(&store->lock);
+
+    result = (RMTileStoreReserveSlot(store) && RMTileStoreAppend(store, kRMTileStoreRecordMagic, tileKey, cacheKey, cacheKeyLength, data, length, &segmentID, &offset));
+
+    if (result)
+    {
+        RMTileStoreIndexPut(store, RMTileStoreHash(tileKey, cacheKey), tileKey, cacheKey, cacheKeyLength, segmentID, offset, (uint32_t)length, (uint32_t)RMTileStoreRecordLength(cacheKeyLength, length));
+        RMTileStoreEnforceLimit(store);
+    }
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return result;
+}
+
+void *RMTileStoreCopy(RMTileStore *store, uint64_t tileKey, const char *cacheKey, size_t *length)
+{
+    size_t cacheKeyLength = strlen(cacheKey);
+    uint64_t hash = RMTileStoreHash(tileKey, cacheKey);
+    uint8_t *data = NULL;
+
+    if (cacheKeyLength > kRMTileStoreMaximumKeyLength)
+        return NULL;
+
+    pthread_rwlock_rdlock(&store->lock);
+
+    RMTileStoreSlot *slots = RMTileStoreSlots(store);
+    uint64_t mask = store->index->capacity - 1;
+
+    // The probe of RMTileStoreFindSlot(), but reading each candidate whole, so that a
+    // hit costs one pread().
+    for (uint64_t i = hash & mask; ! data && slots[i].hash != kRMTileStoreEmptySlot; i = (i + 1) & mask)
+    {
+        RMTileStoreSlot slot = slots[i];
+        RMTileStoreSegment *segment;
+
+        if (slot.hash != hash || ! (segment = RMTileStoreFindSegment(store, slot.segment)))
+            continue;
+
+        uint8_t *buffer = malloc(slot.recordLength);
+        RMTileStoreRecord *record = (RMTileStoreRecord *)buffer;
+
+        if (buffer &&
+            pread(segment->fd, buffer, slot.recordLength, slot.offset) == (ssize_t)slot.recordLength &&
+            record->tileKey == tileKey &&
+            record->dataLength == slot.dataLength &&
+            record->cacheKeyLength == cacheKeyLength &&
+            memcmp(buffer + sizeof(RMTileStoreRecord), cacheKey, cacheKeyLength) == 0)
+        {
+            memmove(buffer, buffer + sizeof(RMTileStoreRecord) + cacheKeyLength, slot.dataLength);
+
+            if (length)
+                *length = slot.dataLength;
+
+            data = buffer;
+        }
+        else
+        {
+            free(buffer);
+        }
+    }
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return data;
+}
+
+bool RMTileStoreContains(RMTileStore *store, uint64_t tileKey, const char *cacheKey)
+{
+    size_t cacheKeyLength = strlen(cacheKey);
+
+    if (cacheKeyLength > kRMTileStoreMaximumKeyLength)
+        return false;
+
+    pthread_rwlock_rdlock(&store->lock);
+
+    bool found = (RMTileStoreFindSlot(store, RMTileStoreHash(tileKey, cacheKey), tileKey, cacheKey, cacheKeyLength, NULL) != NULL);
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return found;
+}
+
+bool RMTileStoreRemove(RMTileStore *store, uint64_t tileKey, const char *cacheKey)
+{
+    size_t cacheKeyLength = strlen(cacheKey);
+    uint32_t segmentID, offset;
+
+    if (cacheKeyLength > kRMTileStoreMaximumKeyLength)
+        return false;
+
+    pthread_rwlock_wrlock(&store->lock);
+
+    bool removed = RMTileStoreIndexRemove(store, RMTileStoreHash(tileKey, cacheKey), tileKey, cacheKey, cacheKeyLength);
+
+    // So that rebuilding the index does not bring the tile back.
+    if (removed)
+        RMTileStoreAppend(store, kRMTileStoreTombstoneMagic, tileKey, cacheKey, cacheKeyLength, NULL, 0, &segmentID, &offset);
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return removed;
+}
+
+void RMTileStoreRemoveAll(RMTileStore *store)
+{
+    pthread_rwlock_wrlock(&store->lock);
+
+    while (store->segmentCount)
+        RMTileStoreDropSegment(store, store->segmentCount - 1, false);
+
+    memset(RMTileStoreSlots(store), 0, store->index->capacity * sizeof(RMTileStoreSlot));
+    store->index->count = store->index->used = 0;
+    store->generation++;
+
+    RMTileStoreRehash(store, kRMTileStoreMinimumSlots);
+
+    pthread_rwlock_unlock(&store->lock);
+}
+
+size_t RMTileStoreCompact(RMTileStore *store, double liveRatio)
+{
+    RMTileStoreVictim *victims = NULL;
+    size_t victimCount = 0, compacted = 0;
+    uint64_t generation;
+
+    pthread_rwlock_wrlock(&store->lock);
+
+    if (store->compacting || store->segmentCount < 2 || ! (victims = malloc(store->segmentCount * sizeof(RMTileStoreVictim))))
+    {
+        pthread_rwlock_unlock(&store->lock);
+        return 0;
+    }
+
+    store->compacting = true;
+    generation = store->generation;
+
+    for (size_t i = 0; i + 1 < store->segmentCount; i++)
+    {
+        RMTileStoreSegment *segment = &store->segments[i];
+        int fd;
+
+        if (segment->liveBytes < segment->size * liveRatio && (fd = dup(segment->fd)) >= 0)
+        {
+            victims[victimCount].id = segment->id;
+            victims[victimCount].fd = fd;
+            victims[victimCount].size = segment->size;
+            victims[victimCount].copied = false;
+            victimCount++;
+        }
+    }
+
+    pthread_rwlock_unlock(&store->lock);
+
+    // Records are read without the lock, which is only taken to append the ones still
+    // needed and point the index at them, so that tiles can be read and added meanwhile.
+    uint8_t *buffer = NULL;
+    size_t bufferSize = 0;
+
+    for (size_t v = 0; v < victimCount; v++)
+    {
+        RMTileStoreVictim *victim = &victims[v];
+        uint64_t offset = 0;
+        size_t length;
+        bool moved = true;
+
+        while (moved && (length = RMTileStoreReadRecord(victim->fd, offset, victim->size, &buffer, &bufferSize)) > 0)
+        {
+            pthread_rwlock_wrlock(&store->lock);
+
+            moved = (store->generation == generation && RMTileStoreMoveRecord(store, victim->id, (uint32_t)offset, buffer, length));
+
+            pthread_rwlock_unlock(&store->lock);
+
+            offset += length;
+        }
+
+        victim->copied = (moved && offset == victim->size);
+    }
+
+    free(buffer);
+
+    pthread_rwlock_wrlock(&store->lock);
+
+    for (size_t v = 0; v < victimCount; v++)
+    {
+        RMTileStoreSegment *segment = (store->generation == generation ? RMTileStoreFindSegment(store, victims[v].id) : NULL);
+
+        if (segment && victims[v].copied && segment->liveBytes == 0)
+        {
+            RMTileStoreDropSegment(store, (size_t)(segment - store->segments), false);
+            compacted++;
+        }
+
+        close(victims[v].fd);
+    }
+
+    store->compacting = false;
+
+    pthread_rwlock_unlock(&store->lock);
+
+    free(victims);
+
+    return compacted;
+}
+
+bool RMTileStoreSync(RMTileStore *store)
+{
+    bool result = true;
+
+    pthread_rwlock_rdlock(&store->lock);
+
+    if (store->segmentCount)
+        result = (fsync(store->segments[store->segmentCount - 1].fd) == 0);
+
+    result = (msync(store->index, store->indexSize, MS_SYNC) == 0 && result);
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return result;
+}
+
+size_t RMTileStoreCount(RMTileStore *store)
+{
+    pthread_rwlock_rdlock(&store->lock);
+
+    size_t count = (size_t)store->index->count;
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return count;
+}
+
+uint64_t RMTileStoreSize(RMTileStore *store)
+{
+    pthread_rwlock_rdlock(&store->lock);
+
+    uint64_t size = store->totalBytes;
+
+    pthread_rwlock_unlock(&store->lock);
+
+    return size;
+}
@@ -0,0 +1,93 @@
+//
+//  RMTileStore.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMTILESTORE_H_
+#define _RMTILESTORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A persistent store of encoded tiles keyed by a tile key (see RMTileKey()) and a
+// cache key string, kept in a directory of its own:
+//
+//   segment-NNNNNNNN   append-only logs of tile records, written one after another
+//   index              an open-addressing hash table of record locations, mmap()ed
+//
+// Adding a tile appends one record to the newest segment and updates one index slot;
+// reading one is an index probe and a single pread(). Replaced and removed tiles stay
+// in their segment as dead space until RMTileStoreCompact() copies the live records
+// of mostly dead segments forward and deletes them. When the store grows beyond its
+// byte limit the oldest segment is dropped whole, so eviction is first in, first out.
+//
+// The index is marked dirty while the store is open. If the application dies before
+// RMTileStoreClose(), the next open rebuilds it by scanning the segments, dropping any
+// record that was only partly written.
+//
+// All functions are thread-safe; reads run concurrently with each other.
+
+typedef struct RMTileStore RMTileStore;
+
+// Open or create the store in directory. Segments are started anew once they reach
+// segmentSize bytes; byteLimit bounds the total size of all segments, 0 meaning no
+// limit. Returns NULL if the directory or the index could not be opened.
+RMTileStore *RMTileStoreOpen(const char *directory, size_t segmentSize, uint64_t byteLimit);
+
+// Write out the index, mark it clean and free the store.
+void RMTileStoreClose(RMTileStore *store);
+
+// Add or replace the tile's data. Returns false if it could not be written.
+bool RMTileStorePut(RMTileStore *store, uint64_t tileKey, const char *cacheKey, const void *data, size_t length);
+
+// A malloc()ed copy of the tile's data, or NULL if it is not stored.
+void *RMTileStoreCopy(RMTileStore *store, uint64_t tileKey, const char *cacheKey, size_t *length);
+
+bool RMTileStoreContains(RMTileStore *store, uint64_t tileKey, const char *cacheKey);
+
+// Remove the tile. Returns true if it was stored.
+bool RMTileStoreRemove(RMTileStore *store, uint64_t tileKey, const char *cacheKey);
+
+// Delete every segment and empty the index.
+void RMTileStoreRemoveAll(RMTileStore *store);
+
+// Copy the live records of every segment but the newest whose live bytes are less
+// than liveRatio of its size to the newest segment, then delete those segments.
+// Tombstones are copied too while an older segment remains. The records are read
+// without holding the lock, so the store stays usable meanwhile; a call made while
+// another one runs returns at once. Returns the number of segments deleted.
+size_t RMTileStoreCompact(RMTileStore *store, double liveRatio);
+
+// Flush the newest segment and the index to disk.
+bool RMTileStoreSync(RMTileStore *store);
+
+size_t RMTileStoreCount(RMTileStore *store);
+
+// Total size of the segments, live and dead records included.
+uint64_t RMTileStoreSize(RMTileStore *store);
+
+#endif
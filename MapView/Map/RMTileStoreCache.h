@@ -0,0 +1,59 @@
+//
+//  RMTileStoreCache.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#import <UIKit/UIKit.h>
+#import "RMTileCache.h"
+
+/** An RMTileStoreCache object is a disk-based cache of map tile images, an alternative to RMDatabaseCache for long-term and offline storage.
+*
+*   Tiles are appended to log files and found through a memory-mapped hash index, without SQL parsing, B-tree updates or vacuuming. Tiles are stored in the encoded form they were received in. Once the cache reaches its byte capacity the oldest tiles are removed first, a log file at a time. */
+@interface RMTileStoreCache : NSObject <RMTileCache>
+
+/** @name Initializing Tile Store Caches */
+
+/** Initializes and returns a newly allocated tile store cache in the given directory, which is created if needed.
+*   @param path The directory holding the cache files.
+*   @param byteCapacity The disk space the cache may use, in bytes. 0 means no limit.
+*   @return An initialized cache object or `nil` if the object couldn't be created. */
+- (id)initWithDirectory:(NSString *)path byteCapacity:(unsigned long long)byteCapacity;
+
+/** Initializes and returns a newly allocated tile store cache.
+*   @param useCacheDir If YES, use the temporary cache space for the application, meaning that the cache files can be removed when the system deems it necessary to free up space. If NO, use the application's document storage space, meaning that the cache will not be automatically removed and will be backed up during device backups.
+*   @param byteCapacity The disk space the cache may use, in bytes. 0 means no limit.
+*   @return An initialized cache object or `nil` if the object couldn't be created. */
+- (id)initUsingCacheDir:(BOOL)useCacheDir byteCapacity:(unsigned long long)byteCapacity;
+
+/** The directory of the cache files for the given storage space. */
++ (NSString *)directoryUsingCacheDir:(BOOL)useCacheDir;
+
+/** @name Getting the Cache Directory */
+
+/** The directory holding the cache files. */
+@property (nonatomic, readonly) NSString *directory;
+
+@end
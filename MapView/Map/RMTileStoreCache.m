@@ -0,0 +1,168 @@
+//
+//  RMTileStoreCache.m
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#import "RMTileStoreCache.h"
+#import "RMTileStore.h"
+
+// Size at which a new log file is started; also the granularity of eviction.
+#define kTileStoreSegmentSize (4 * 1024 * 1024)
+
+// Segments with less live data than this are compacted, checked every kTileStoreCompactionInterval tiles added.
+#define kTileStoreCompactionRatio 0.5
+#define kTileStoreCompactionInterval 512
+
+@implementation RMTileStoreCache
+{
+    RMTileStore *_store;
+    dispatch_queue_t _compactionQueue;
+    NSUInteger _tilesSinceCompaction;
+}
+
+@synthesize directory = _directory;
+
++ (NSString *)directoryUsingCacheDir:(BOOL)useCacheDir
+{
+    NSArray *paths = NSSearchPathForDirectoriesInDomains(useCacheDir ? NSCachesDirectory : NSDocumentDirectory, NSUserDomainMask, YES);
+
+    if ([paths count] == 0)
+        return nil;
+
+    return [[paths objectAtIndex:0] stringByAppendingPathComponent:@"RMTileStore"];
+}
+
+- (id)initWithDirectory:(NSString *)path byteCapacity:(unsigned long long)byteCapacity
+{
+    if (!(self = [super init]))
+        return nil;
+
+    RMLog(@"Opening tile store at %@", path);
+
+    [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    _store = RMTileStoreOpen([path fileSystemRepresentation], kTileStoreSegmentSize, byteCapacity);
+
+    if ( ! _store)
+    {
+        RMLog(@"Could not open the tile store");
+
+        [self release];
+        return nil;
+    }
+
+    _directory = [path copy];
+    _compactionQueue = dispatch_queue_create("routeme.tileStoreCompactionQueue", DISPATCH_QUEUE_SERIAL);
+
+    return self;
+}
+
+- (id)initUsingCacheDir:(BOOL)useCacheDir byteCapacity:(unsigned long long)byteCapacity
+{
+    return [self initWithDirectory:[RMTileStoreCache directoryUsingCacheDir:useCacheDir] byteCapacity:byteCapacity];
+}
+
+- (void)dealloc
+{
+    if (_compactionQueue)
+    {
+        dispatch_sync(_compactionQueue, ^{});
+        dispatch_release(_compactionQueue); _compactionQueue = NULL;
+    }
+
+    RMTileStoreClose(_store); _store = NULL;
+    [_directory release]; _directory = nil;
+    [super dealloc];
+}
+
+- (UIImage *)cachedImage:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    size_t length = 0;
+    void *data = RMTileStoreCopy(_store, RMTileKey(tile), [aCacheKey UTF8String], &length);
+
+    if ( ! data)
+        return nil;
+
+//    RMLog(@"Tile store   hit    tile %d %d %d (%@)", tile.x, tile.y, tile.zoom, [RMTileCache tileHash:tile]);
+
+    return [UIImage imageWithData:[NSData dataWithBytesNoCopy:data length:length freeWhenDone:YES]];
+}
+
+- (void)addImage:(UIImage *)image forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    [self addImage:image withData:UIImagePNGRepresentation(image) forTile:tile withCacheKey:aCacheKey];
+}
+
+- (void)addImage:(UIImage *)image withData:(NSData *)data forTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    if ( ! data)
+        return;
+
+    if ( ! RMTileStorePut(_store, RMTileKey(tile), [aCacheKey UTF8String], [data bytes], [data length]))
+    {
+        RMLog(@"Error occured adding data to the tile store");
+        return;
+    }
+
+    BOOL compact = NO;
+
+    @synchronized (self)
+    {
+        if (++_tilesSinceCompaction >= kTileStoreCompactionInterval)
+        {
+            _tilesSinceCompaction = 0;
+            compact = YES;
+        }
+    }
+
+    if (compact)
+    {
+        RMTileStore *store = _store;
+
+        dispatch_async(_compactionQueue, ^{
+            RMTileStoreCompact(store, kTileStoreCompactionRatio);
+        });
+    }
+}
+
+- (void)removeImageForTile:(RMTile)tile withCacheKey:(NSString *)aCacheKey
+{
+    RMTileStoreRemove(_store, RMTileKey(tile), [aCacheKey UTF8String]);
+}
+
+- (void)removeAllCachedImages
+{
+    RMLog(@"removing all tiles from the tile store");
+
+    RMTileStoreRemoveAll(_store);
+}
+
+- (void)didReceiveMemoryWarning
+{
+    // Nothing is held in memory beyond the mapped index, which the system can page out.
+}
+
+@end
@@ -0,0 +1,478 @@
+//
+//  RMTileWriteBuffer.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "RMTileWriteBuffer.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kRMTileWriteListMinimumBuckets 64
+
+typedef struct RMTileWrite {
+    struct RMTileWrite *next;
+    struct RMTileWrite *hashNext; // in the same bucket of the index
+    size_t hash;
+    int64_t tileHash;
+    double lastUsed;
+    void *data; // NULL for a last_used update
+    size_t length;
+    char cacheKey[];
+} RMTileWrite;
+
+// Writes in queue order, with an index of them by tile and cache key, so that touches
+// and reads of queued tiles do not scan the whole queue. Without memory for the index,
+// the list is scanned instead.
+typedef struct {
+    RMTileWrite *head;
+    RMTileWrite *tail;
+    size_t count;
+    size_t bytes;
+    RMTileWrite **buckets;
+    size_t bucketCount;
+} RMTileWriteList;
+
+struct RMTileWriteBuffer {
+    pthread_mutex_t lock;       // protects pending and inFlight
+    pthread_mutex_t flushLock;  // serializes flushes
+
+    RMTileWriteList pending;
+    RMTileWriteList inFlight;   // taken by the running flush, still readable
+
+    size_t batchSize;
+    size_t byteLimit;
+};
+
+#pragma mark -
+
+static size_t RMTileWriteHash(int64_t tileHash, const char *cacheKey)
+{
+    uint64_t hash = (uint64_t)tileHash * 0x9E3779B97F4A7C15ULL;
+
+    for (const unsigned char *c = (const unsigned char *)cacheKey; *c; c++)
+        hash = (hash ^ *c) * 0x100000001B3ULL;
+
+    return (size_t)(hash ^ (hash >> 29));
+}
+
+static bool RMTileWriteMatches(const RMTileWrite *write, size_t hash, int64_t tileHash, const char *cacheKey, bool wantData)
+{
+    return (write->hash == hash && write->tileHash == tileHash && (write->data != NULL) == wantData && strcmp(write->cacheKey, cacheKey) == 0);
+}
+
+static RMTileWrite *RMTileWriteListFind(RMTileWriteList *list, int64_t tileHash, const char *cacheKey, bool wantData)
+{
+    size_t hash = RMTileWriteHash(tileHash, cacheKey);
+
+    if ( ! list->buckets)
+    {
+        for (RMTileWrite *write = list->head; write; write = write->next)
+        {
+            if (RMTileWriteMatches(write, hash, tileHash, cacheKey, wantData))
+                return write;
+        }
+
+        return NULL;
+    }
+
+    for (RMTileWrite *write = list->buckets[hash & (list->bucketCount - 1)]; write; write = write->hashNext)
+    {
+        if (RMTileWriteMatches(write, hash, tileHash, cacheKey, wantData))
+            return write;
+    }
+
+    return NULL;
+}
+
+// Index every write of the list in bucketCount buckets, a power of two. Keeps the
+// current index if memory could not be allocated.
+static void RMTileWriteListReindex(RMTileWriteList *list, size_t bucketCount)
+{
+    RMTileWrite **buckets = calloc(bucketCount, sizeof(RMTileWrite *));
+
+    if ( ! buckets)
+        return;
+
+    free(list->buckets);
+    list->buckets = buckets;
+    list->bucketCount = bucketCount;
+
+    for (RMTileWrite *write = list->head; write; write = write->next)
+    {
+        size_t bucket = write->hash & (bucketCount - 1);
+
+        write->hashNext = buckets[bucket];
+        buckets[bucket] = write;
+    }
+}
+
+static void RMTileWriteListAppend(RMTileWriteList *list, RMTileWrite *write)
+{
+    write->next = NULL;
+
+    if (list->tail)
+        list->tail->next = write;
+    else
+        list->head = write;
+
+    list->tail = write;
+    list->count++;
+    list->bytes += write->length;
+
+    if (list->count > list->bucketCount)
+    {
+        size_t bucketCount = (list->bucketCount ? 2 * list->bucketCount : kRMTileWriteListMinimumBuckets);
+
+        RMTileWriteListReindex(list, bucketCount);
+
+        // Indexed with all the others
+        if (list->bucketCount == bucketCount)
+            return;
+    }
+
+    if (list->buckets)
+    {
+        size_t bucket = write->hash & (list->bucketCount - 1);
+
+        write->hashNext = list->buckets[bucket];
+        list->buckets[bucket] = write;
+    }
+}
+
+// Put the writes of front back ahead of those of list, keeping both in order, and
+// leave front empty.
+static void RMTileWriteListPrepend(RMTileWriteList *list, RMTileWriteList *front)
+{
+    if ( ! front->head)
+        return;
+
+    front->tail->next = list->head;
+
+    if ( ! list->tail)
+        list->tail = front->tail;
+
+    list->head = front->head;
+    list->count += front->count;
+    list->bytes += front->bytes;
+
+    free(front->buckets);
+    memset(front, 0, sizeof(RMTileWriteList));
+
+    size_t bucketCount = kRMTileWriteListMinimumBuckets;
+
+    while (bucketCount < list->count)
+        bucketCount *= 2;
+
+    // Without memory for a new index the old one misses the writes put back, so it goes.
+    RMTileWriteListReindex(list, bucketCount);
+
+    if (list->bucketCount != bucketCount)
+    {
+        free(list->buckets);
+        list->buckets = NULL;
+        list->bucketCount = 0;
+    }
+}
+
+static void RMTileWriteListFree(RMTileWriteList *list)
+{
+    RMTileWrite *write = list->head;
+
+    while (write)
+    {
+        RMTileWrite *next = write->next;
+
+        free(write->data);
+        free(write);
+        write = next;
+    }
+
+    free(list->buckets);
+    memset(list, 0, sizeof(RMTileWriteList));
+}
+
+static RMTileWriteBufferState RMTileWriteBufferCurrentState(RMTileWriteBuffer *buffer)
+{
+    if (buffer->byteLimit && buffer->pending.bytes >= buffer->byteLimit)
+        return RMTileWriteBufferFull;
+
+    if (buffer->pending.count >= buffer->batchSize)
+        return RMTileWriteBufferBatchReady;
+
+    return RMTileWriteBufferQueued;
+}
+
+static RMTileWrite *RMTileWriteCreate(int64_t tileHash, const char *cacheKey, double lastUsed)
+{
+    size_t keyLength = strlen(cacheKey);
+    RMTileWrite *write = malloc(sizeof(RMTileWrite) + keyLength + 1);
+
+    if ( ! write)
+        return NULL;
+
+    write->hash = RMTileWriteHash(tileHash, cacheKey);
+    write->tileHash = tileHash;
+    write->lastUsed = lastUsed;
+    write->data = NULL;
+    write->length = 0;
+    memcpy(write->cacheKey, cacheKey, keyLength + 1);
+
+    return write;
+}
+
+#pragma mark -
+
+RMTileWriteBuffer *RMTileWriteBufferCreate(size_t batchSize, size_t byteLimit)
+{
+    RMTileWriteBuffer *buffer = calloc(1, sizeof(RMTileWriteBuffer));
+
+    if ( ! buffer)
+        return NULL;
+
+    pthread_mutex_init(&buffer->lock, NULL);
+    pthread_mutex_init(&buffer->flushLock, NULL);
+
+    buffer->batchSize = (batchSize ? batchSize : 1);
+    buffer->byteLimit = byteLimit;
+
+    return buffer;
+}
+
+void RMTileWriteBufferDestroy(RMTileWriteBuffer *buffer)
+{
+    if ( ! buffer)
+        return;
+
+    RMTileWriteListFree(&buffer->pending);
+    RMTileWriteListFree(&buffer->inFlight);
+
+    pthread_mutex_destroy(&buffer->flushLock);
+    pthread_mutex_destroy(&buffer->lock);
+
+    free(buffer);
+}
+
+RMTileWriteBufferState RMTileWriteBufferAddTile(RMTileWriteBuffer *buffer, int64_t tileHash, const char *cacheKey, double lastUsed, const void *data, size_t length)
+{
+    RMTileWrite *write = RMTileWriteCreate(tileHash, cacheKey, lastUsed);
+    RMTileWriteBufferState state;
+
+    if (write)
+    {
+        // An empty blob still has to be told apart from a last_used update.
+        write->data = malloc(length ? length : 1);
+        write->length = length;
+
+        if (write->data)
+        {
+            memcpy(write->data, data, length);
+        }
+        else
+        {
+            free(write);
+            write = NULL;
+        }
+    }
+
+    pthread_mutex_lock(&buffer->lock);
+
+    // Out of memory, the tile is simply not cached, but have the buffer flushed.
+    if (write)
+        RMTileWriteListAppend(&buffer->pending, write);
+
+    state = (write ? RMTileWriteBufferCurrentState(buffer) : RMTileWriteBufferFull);
+
+    pthread_mutex_unlock(&buffer->lock);
+
+    return state;
+}
+
+RMTileWriteBufferState RMTileWriteBufferTouchTile(RMTileWriteBuffer *buffer, int64_t tileHash, const char *cacheKey, double lastUsed)
+{
+    RMTileWriteBufferState state;
+
+    pthread_mutex_lock(&buffer->lock);
+
+    RMTileWrite *write = RMTileWriteListFind(&buffer->pending, tileHash, cacheKey, true);
+
+    if ( ! write)
+        write = RMTileWriteListFind(&buffer->pending, tileHash, cacheKey, false);
+
+    if (write)
+    {
+        write->lastUsed = lastUsed;
+    }
+    else if ((write = RMTileWriteCreate(tileHash, cacheKey, lastUsed)))
+    {
+        RMTileWriteListAppend(&buffer->pending, write);
+    }
+
+    state = RMTileWriteBufferCurrentState(buffer);
+
+    pthread_mutex_unlock(&buffer->lock);
+
+    return state;
+}
+
+void *RMTileWriteBufferCopyTileData(RMTileWriteBuffer *buffer, int64_t tileHash, const char *cacheKey, size_t *length)
+{
+    void *data = NULL;
+
+    pthread_mutex_lock(&buffer->lock);
+
+    RMTileWrite *write = RMTileWriteListFind(&buffer->pending, tileHash, cacheKey, true);
+
+    if ( ! write)
+        write = RMTileWriteListFind(&buffer->inFlight, tileHash, cacheKey, true);
+
+    if (write && (data = malloc(write->length ? write->length : 1)))
+    {
+        memcpy(data, write->data, write->length);
+        *length = write->length;
+    }
+
+    pthread_mutex_unlock(&buffer->lock);
+
+    return data;
+}
+
+size_t RMTileWriteBufferPendingCount(RMTileWriteBuffer *buffer)
+{
+    size_t count;
+
+    pthread_mutex_lock(&buffer->lock);
+    count = buffer->pending.count;
+    pthread_mutex_unlock(&buffer->lock);
+
+    return count;
+}
+
+void RMTileWriteBufferDiscard(RMTileWriteBuffer *buffer)
+{
+    pthread_mutex_lock(&buffer->lock);
+    RMTileWriteListFree(&buffer->pending);
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+long RMTileWriteBufferFlush(RMTileWriteBuffer *buffer, sqlite3 *db, long *failures)
+{
+    sqlite3_stmt *insertStatement = NULL, *touchStatement = NULL;
+    long inserted = 0, failed = 0;
+
+    pthread_mutex_lock(&buffer->flushLock);
+
+    pthread_mutex_lock(&buffer->lock);
+    buffer->inFlight = buffer->pending;
+    memset(&buffer->pending, 0, sizeof(RMTileWriteList));
+    pthread_mutex_unlock(&buffer->lock);
+
+    if ( ! buffer->inFlight.head)
+    {
+        pthread_mutex_unlock(&buffer->flushLock);
+
+        if (failures)
+            *failures = 0;
+
+        return 0;
+    }
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        inserted = -1;
+    }
+    else
+    {
+        sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO ZCACHE (tile_hash, cache_key, last_used, data) VALUES (?, ?, ?, ?)", -1, &insertStatement, NULL);
+        sqlite3_prepare_v2(db, "UPDATE ZCACHE SET last_used = ? WHERE tile_hash = ? AND cache_key = ?", -1, &touchStatement, NULL);
+
+        // In queue order, so an update queued after an insert finds the row.
+        for (RMTileWrite *write = buffer->inFlight.head; write; write = write->next)
+        {
+            sqlite3_stmt *statement = (write->data ? insertStatement : touchStatement);
+
+            if ( ! statement)
+            {
+                failed++;
+                continue;
+            }
+
+            if (write->data)
+            {
+                sqlite3_bind_int64(statement, 1, write->tileHash);
+                sqlite3_bind_text(statement, 2, write->cacheKey, -1, SQLITE_STATIC);
+                sqlite3_bind_double(statement, 3, write->lastUsed);
+                sqlite3_bind_blob(statement, 4, write->data, (int)write->length, SQLITE_STATIC);
+            }
+            else
+            {
+                sqlite3_bind_double(statement, 1, write->lastUsed);
+                sqlite3_bind_int64(statement, 2, write->tileHash);
+                sqlite3_bind_text(statement, 3, write->cacheKey, -1, SQLITE_STATIC);
+            }
+
+            if (sqlite3_step(statement) == SQLITE_DONE)
+            {
+                if (write->data)
+                    inserted += sqlite3_changes(db);
+            }
+            else
+            {
+                failed++;
+            }
+
+            sqlite3_reset(statement);
+            sqlite3_clear_bindings(statement);
+        }
+
+        sqlite3_finalize(insertStatement);
+        sqlite3_finalize(touchStatement);
+
+        if (sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+        {
+            sqlite3_exec(db, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+            inserted = -1;
+        }
+    }
+
+    pthread_mutex_lock(&buffer->lock);
+
+    // A transaction that did not go through wrote nothing: its tiles are queued again,
+    // ahead of those added meanwhile, for the next flush.
+    if (inserted < 0)
+        RMTileWriteListPrepend(&buffer->pending, &buffer->inFlight);
+    else
+        RMTileWriteListFree(&buffer->inFlight);
+
+    pthread_mutex_unlock(&buffer->lock);
+
+    pthread_mutex_unlock(&buffer->flushLock);
+
+    if (failures)
+        *failures = failed;
+
+    return inserted;
+}
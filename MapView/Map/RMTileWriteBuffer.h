@@ -0,0 +1,90 @@
+//
+//  RMTileWriteBuffer.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _RMTILEWRITEBUFFER_H_
+#define _RMTILEWRITEBUFFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+// A write-behind buffer for the RMDatabaseCache table
+//
+//   ZCACHE (tile_hash INTEGER, cache_key VARCHAR, last_used DOUBLE, data BLOB)
+//
+// Tile inserts and last_used updates are queued in memory and written together in
+// one transaction per flush, instead of one implicit transaction per statement.
+// Queued tiles can be read back before they are written. The buffer is bounded in
+// bytes: once it is full the caller is expected to flush before adding more, which
+// slows producers down to the speed of the database rather than dropping tiles.
+//
+// All functions are thread-safe. Flushes are serialized with each other, but the
+// caller must make sure nothing else uses the database connection meanwhile.
+
+typedef struct RMTileWriteBuffer RMTileWriteBuffer;
+
+typedef enum {
+    // Queued, nothing to do yet.
+    RMTileWriteBufferQueued,
+    // A full batch is pending, the buffer should be flushed soon.
+    RMTileWriteBufferBatchReady,
+    // The byte limit is reached, the buffer must be flushed before adding more.
+    RMTileWriteBufferFull,
+} RMTileWriteBufferState;
+
+// Create a buffer that asks to be flushed every batchSize operations and once
+// byteLimit bytes of tile data are pending, 0 meaning no byte limit. Returns NULL if
+// memory could not be allocated.
+RMTileWriteBuffer *RMTileWriteBufferCreate(size_t batchSize, size_t byteLimit);
+
+// Free the buffer and drop anything not yet flushed.
+void RMTileWriteBufferDestroy(RMTileWriteBuffer *buffer);
+
+// Queue an INSERT OR IGNORE of the tile. The data is copied.
+RMTileWriteBufferState RMTileWriteBufferAddTile(RMTileWriteBuffer *buffer, int64_t tileHash, const char *cacheKey, double lastUsed, const void *data, size_t length);
+
+// Queue an update of the tile's last_used time. Repeated updates of the same tile,
+// or of a tile still waiting to be inserted, are merged.
+RMTileWriteBufferState RMTileWriteBufferTouchTile(RMTileWriteBuffer *buffer, int64_t tileHash, const char *cacheKey, double lastUsed);
+
+// A malloc()ed copy of the data of a tile that is queued or being written, or NULL.
+void *RMTileWriteBufferCopyTileData(RMTileWriteBuffer *buffer, int64_t tileHash, const char *cacheKey, size_t *length);
+
+// Operations queued and not yet being written.
+size_t RMTileWriteBufferPendingCount(RMTileWriteBuffer *buffer);
+
+// Drop everything queued and not yet being written.
+void RMTileWriteBufferDiscard(RMTileWriteBuffer *buffer);
+
+// Write everything queued in one transaction. Returns the number of tiles actually
+// inserted, or -1 if the transaction could not be started or committed, in which case
+// everything stays queued for the next flush. Statements that fail in a committed
+// transaction are skipped and counted in failures, which may be NULL.
+long RMTileWriteBufferFlush(RMTileWriteBuffer *buffer, sqlite3 *db, long *failures);
+
+#endif
@@ -0,0 +1,366 @@
+//
+//  RMVisibleSet.c
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "RMVisibleSet.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kRMVisibleSetInitialSlots 64
+
+// Changed items checked one by one by the next update; past that, comparing a full
+// query against the visible items is about as fast
+#define kRMVisibleSetMaximumChanged 512
+
+struct RMVisibleSet {
+    RMProjectedRect viewport;
+    bool hasViewport;
+
+    // Open addressing table of the visible items
+    uintptr_t *slots;
+    size_t slotMask;
+    size_t count;
+
+    uintptr_t changed[kRMVisibleSetMaximumChanged];
+    size_t changedCount;
+};
+
+typedef struct {
+    RMVisibleSet *set;
+    RMSpatialIndex *index;
+    RMProjectedRect viewport;
+    RMVisibleSetVisitor visitor;
+    void *context;
+    bool failed;
+} RMVisibleSetUpdateContext;
+
+#pragma mark -
+
+static size_t RMVisibleSetHashItem(uintptr_t item)
+{
+    uint64_t hash = (uint64_t)item * 0x9E3779B97F4A7C15ULL;
+
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+// The slot of the item, or of the empty slot where it would go
+static size_t RMVisibleSetFindSlot(const RMVisibleSet *set, uintptr_t item)
+{
+    size_t slot = RMVisibleSetHashItem(item) & set->slotMask;
+
+    while (set->slots[slot] && set->slots[slot] != item)
+        slot = (slot + 1) & set->slotMask;
+
+    return slot;
+}
+
+static bool RMVisibleSetGrowSlots(RMVisibleSet *set)
+{
+    size_t oldMask = set->slotMask;
+    uintptr_t *oldSlots = set->slots;
+    size_t slotTotal = 2 * (oldMask + 1);
+    uintptr_t *slots = calloc(slotTotal, sizeof(uintptr_t));
+
+    if ( ! slots)
+        return false;
+
+    set->slots = slots;
+    set->slotMask = slotTotal - 1;
+
+    for (size_t i = 0; i <= oldMask; i++)
+    {
+        if (oldSlots[i])
+            slots[RMVisibleSetFindSlot(set, oldSlots[i])] = oldSlots[i];
+    }
+
+    free(oldSlots);
+
+    return true;
+}
+
+static bool RMVisibleSetAdd(RMVisibleSet *set, uintptr_t item)
+{
+    // At most half full, to keep the probes short
+    if (2 * (set->count + 1) > set->slotMask + 1 && ! RMVisibleSetGrowSlots(set))
+        return false;
+
+    size_t slot = RMVisibleSetFindSlot(set, item);
+
+    if ( ! set->slots[slot])
+    {
+        set->slots[slot] = item;
+        set->count++;
+    }
+
+    return true;
+}
+
+// Backward shift deletion: later entries of the probe sequence move up into the hole
+static bool RMVisibleSetDelete(RMVisibleSet *set, uintptr_t item)
+{
+    size_t hole = RMVisibleSetFindSlot(set, item);
+
+    if ( ! set->slots[hole])
+        return false;
+
+    set->slots[hole] = 0;
+    set->count--;
+
+    for (size_t next = (hole + 1) & set->slotMask; set->slots[next]; next = (next + 1) & set->slotMask)
+    {
+        size_t home = RMVisibleSetHashItem(set->slots[next]) & set->slotMask;
+
+        // Move the entry if its home is not cyclically within (hole, next]
+        if ((next > hole && (home <= hole || home > next)) || (next < hole && home <= hole && home > next))
+        {
+            set->slots[hole] = set->slots[next];
+            set->slots[next] = 0;
+            hole = next;
+        }
+    }
+
+    return true;
+}
+
+// The parts of rect outside of outside, as at most four rectangles sharing their
+// edges with it, so that every box intersecting rect and not outside intersects one.
+static unsigned int RMVisibleSetSubtract(RMProjectedRect rect, RMProjectedRect outside, RMProjectedRect parts[4])
+{
+    if ( ! RMProjectedRectIntersectsProjectedRect(rect, outside))
+    {
+        parts[0] = rect;
+        return 1;
+    }
+
+    double minX = rect.origin.x, maxX = rect.origin.x + rect.size.width;
+    double minY = rect.origin.y, maxY = rect.origin.y + rect.size.height;
+    double outsideMinX = outside.origin.x, outsideMaxX = outside.origin.x + outside.size.width;
+    double outsideMinY = outside.origin.y, outsideMaxY = outside.origin.y + outside.size.height;
+    double middleMinX = fmax(minX, outsideMinX), middleMaxX = fmin(maxX, outsideMaxX);
+    unsigned int count = 0;
+
+    if (outsideMinX > minX)
+        parts[count++] = RMProjectedRectMake(minX, minY, outsideMinX - minX, maxY - minY);
+
+    if (outsideMaxX < maxX)
+        parts[count++] = RMProjectedRectMake(outsideMaxX, minY, maxX - outsideMaxX, maxY - minY);
+
+    if (outsideMinY > minY)
+        parts[count++] = RMProjectedRectMake(middleMinX, minY, middleMaxX - middleMinX, outsideMinY - minY);
+
+    if (outsideMaxY < maxY)
+        parts[count++] = RMProjectedRectMake(middleMinX, outsideMaxY, middleMaxX - middleMinX, maxY - outsideMaxY);
+
+    return count;
+}
+
+static bool RMVisibleSetVisitEntering(uintptr_t item, void *context)
+{
+    RMVisibleSetUpdateContext *update = context;
+
+    if (RMVisibleSetContains(update->set, item))
+        return true;
+
+    if ( ! RMVisibleSetAdd(update->set, item))
+    {
+        update->failed = true;
+        return false;
+    }
+
+    update->visitor(item, update->context);
+
+    return true;
+}
+
+static bool RMVisibleSetVisitLeaving(uintptr_t item, void *context)
+{
+    RMVisibleSetUpdateContext *update = context;
+    RMProjectedRect boundingBox;
+
+    if ( ! RMVisibleSetContains(update->set, item))
+        return true;
+
+    // Found in the part of the old viewport outside of the new one, but maybe also
+    // intersecting the new one
+    if (RMSpatialIndexGetBoundingBox(update->index, item, &boundingBox) && RMProjectedRectIntersectsProjectedRect(boundingBox, update->viewport))
+        return true;
+
+    RMVisibleSetDelete(update->set, item);
+    update->visitor(item, update->context);
+
+    return true;
+}
+
+#pragma mark -
+
+RMVisibleSet *RMVisibleSetCreate(void)
+{
+    RMVisibleSet *set = calloc(1, sizeof(RMVisibleSet));
+
+    if ( ! set)
+        return NULL;
+
+    set->slots = calloc(kRMVisibleSetInitialSlots, sizeof(uintptr_t));
+    set->slotMask = kRMVisibleSetInitialSlots - 1;
+
+    if ( ! set->slots)
+    {
+        free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+void RMVisibleSetDestroy(RMVisibleSet *set)
+{
+    if ( ! set)
+        return;
+
+    free(set->slots);
+    free(set);
+}
+
+bool RMVisibleSetUpdate(RMVisibleSet *set, RMSpatialIndex *index, RMProjectedRect rect, RMVisibleSetVisitor entered, RMVisibleSetVisitor exited, RMVisibleSetVisitor changed, void *context)
+{
+    RMVisibleSetUpdateContext update = { set, index, rect, entered, context, false };
+    RMProjectedRect parts[4];
+    unsigned int partCount;
+
+    if ( ! set->hasViewport)
+    {
+        RMVisibleSetInvalidate(set);
+        RMSpatialIndexQuery(index, rect, RMVisibleSetVisitEntering, &update);
+    }
+    else
+    {
+        // Changed items may have entered or left anywhere. Checked first, they are
+        // then in the set if and only if visible, so the parts below skip them.
+        for (size_t i = 0; i < set->changedCount && ! update.failed; i++)
+        {
+            uintptr_t item = set->changed[i];
+            RMProjectedRect boundingBox;
+            bool visible = (RMSpatialIndexGetBoundingBox(index, item, &boundingBox) && RMProjectedRectIntersectsProjectedRect(boundingBox, rect));
+            bool wasVisible = RMVisibleSetContains(set, item);
+
+            if (visible && ! wasVisible)
+            {
+                RMVisibleSetVisitEntering(item, &update);
+            }
+            else if ( ! visible && wasVisible)
+            {
+                RMVisibleSetDelete(set, item);
+                exited(item, context);
+            }
+            else if (visible && changed)
+            {
+                changed(item, context);
+            }
+        }
+
+        // Entering through the parts of the new viewport outside of the old one
+        partCount = RMVisibleSetSubtract(rect, set->viewport, parts);
+
+        for (unsigned int i = 0; i < partCount && ! update.failed; i++)
+            RMSpatialIndexQuery(index, parts[i], RMVisibleSetVisitEntering, &update);
+
+        // Leaving through the parts of the old viewport outside of the new one
+        update.visitor = exited;
+        partCount = RMVisibleSetSubtract(set->viewport, rect, parts);
+
+        for (unsigned int i = 0; i < partCount && ! update.failed; i++)
+            RMSpatialIndexQuery(index, parts[i], RMVisibleSetVisitLeaving, &update);
+    }
+
+    if (update.failed)
+    {
+        RMVisibleSetInvalidate(set);
+        return false;
+    }
+
+    set->viewport = rect;
+    set->hasViewport = true;
+    set->changedCount = 0;
+
+    return true;
+}
+
+bool RMVisibleSetHasViewport(const RMVisibleSet *set)
+{
+    return set->hasViewport;
+}
+
+void RMVisibleSetInvalidate(RMVisibleSet *set)
+{
+    memset(set->slots, 0, (set->slotMask + 1) * sizeof(uintptr_t));
+    set->count = 0;
+    set->hasViewport = false;
+    set->changedCount = 0;
+}
+
+void RMVisibleSetItemDidChange(RMVisibleSet *set, uintptr_t item)
+{
+    if ( ! set->hasViewport || ! item)
+        return;
+
+    for (size_t i = 0; i < set->changedCount; i++)
+    {
+        if (set->changed[i] == item)
+            return;
+    }
+
+    if (set->changedCount == kRMVisibleSetMaximumChanged)
+    {
+        RMVisibleSetInvalidate(set);
+        return;
+    }
+
+    set->changed[set->changedCount++] = item;
+}
+
+bool RMVisibleSetRemove(RMVisibleSet *set, uintptr_t item)
+{
+    if ( ! item)
+        return false;
+
+    return RMVisibleSetDelete(set, item);
+}
+
+bool RMVisibleSetContains(const RMVisibleSet *set, uintptr_t item)
+{
+    if ( ! item)
+        return false;
+
+    return (set->slots[RMVisibleSetFindSlot(set, item)] != 0);
+}
+
+size_t RMVisibleSetCount(const RMVisibleSet *set)
+{
+    return set->count;
+}
@@ -0,0 +1,88 @@
+//
+//  RMVisibleSet.h
+//
+// Copyright (c) 2008-2012, Route-Me Contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef _RMVISIBLESET_H_
+#define _RMVISIBLESET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RMFoundation.h"
+#include "RMSpatialIndex.h"
+
+// The items of an RMSpatialIndex intersecting the viewport, kept up to date as the
+// viewport moves by reporting only the items entering and leaving it.
+//
+// Moving the viewport from rect A to rect B only queries the index for the parts of
+// B outside A, where items may enter, and the parts of A outside B, where they may
+// leave, so the work follows the number of changes rather than the number of items
+// on screen. Items that changed in the index meanwhile are passed to
+// RMVisibleSetItemDidChange() and checked on their own by the next update.
+//
+// It does no locking of its own, and the index must not be modified during an update.
+
+typedef struct RMVisibleSet RMVisibleSet;
+
+typedef void (*RMVisibleSetVisitor)(uintptr_t item, void *context);
+
+// Returns NULL if memory could not be allocated.
+RMVisibleSet *RMVisibleSetCreate(void);
+
+void RMVisibleSetDestroy(RMVisibleSet *set);
+
+// Move the viewport to rect, calling entered for every item of the index intersecting
+// it that did not intersect the previous one, exited for every item that did and no
+// longer does, and changed, unless NULL, for the items that stay visible and were passed
+// to RMVisibleSetItemDidChange(). Each item is reported at most once. Without a
+// previous viewport, see RMVisibleSetHasViewport(), every item intersecting rect is
+// reported entered. Returns false if memory could not be allocated, in which case the
+// set is invalidated, having maybe reported some of the changes.
+bool RMVisibleSetUpdate(RMVisibleSet *set, RMSpatialIndex *index, RMProjectedRect rect, RMVisibleSetVisitor entered, RMVisibleSetVisitor exited, RMVisibleSetVisitor changed, void *context);
+
+// Whether the next update will be relative to a previous viewport.
+bool RMVisibleSetHasViewport(const RMVisibleSet *set);
+
+// Forget the viewport and the visible items, without reporting them, for instance
+// after many items of the index changed.
+void RMVisibleSetInvalidate(RMVisibleSet *set);
+
+// The item was added to the index, moved, or removed without RMVisibleSetRemove():
+// have the next update check it. Past a few hundred such items since the last update
+// the set is invalidated instead.
+void RMVisibleSetItemDidChange(RMVisibleSet *set, uintptr_t item);
+
+// Forget the item, without reporting it, because it is being removed from the index.
+// Returns true if it was visible.
+bool RMVisibleSetRemove(RMVisibleSet *set, uintptr_t item);
+
+bool RMVisibleSetContains(const RMVisibleSet *set, uintptr_t item);
+
+size_t RMVisibleSetCount(const RMVisibleSet *set);
+
+#endif
@@ -101,6 +101,85 @@ oblcon:
 	}
 	return (xy);
 }
+SPECIAL(fac) { /* ellipsoid & spheroid */
+	double coslam, sinlam, sinphi, cosphi, s, c, ds, dc, sinb1, cosb1;
+	double D, B, dB_l, dB_p, N, xmf, ymf, q;
+
+	coslam = cos(lp.lam);
+	sinlam = sin(lp.lam);
+	sinphi = sin(lp.phi);
+	cosphi = cos(lp.phi);
+	if (P->es) {
+		/* q is authalic, dq/dphi = 2(1-es)cos(phi)/(1-es sin^2(phi))^2 */
+		q = 1. - P->es * sinphi * sinphi;
+		ds = 2. * P->one_es * cosphi / (q * q);
+		q = pj_qsfn(sinphi, P->e, P->one_es);
+	} else {
+		q = 0.;
+		ds = cosphi;
+	}
+	switch (P->mode) {
+	case OBLIQ:
+	case EQUIT:
+		if (P->es) {
+			s = q / P->qp;
+			ds /= P->qp;
+			xmf = P->xmf;
+			ymf = P->ymf;
+		} else {
+			s = sinphi;
+			xmf = ymf = 1.;
+		}
+		if ((c = sqrt(1. - s * s)) < EPS10) return;
+		dc = - s * ds / c;
+		if (P->mode == OBLIQ) {
+			sinb1 = P->sinb1;
+			cosb1 = P->cosb1;
+		} else {
+			sinb1 = 0.;
+			cosb1 = 1.;
+		}
+		if ((D = 1. + sinb1 * s + cosb1 * c * coslam) < EPS10) return;
+		B = sqrt(2. / D);
+		/* dB = -B dD / 2D */
+		dB_l = B * cosb1 * c * sinlam / (D + D);
+		dB_p = - B * (sinb1 * ds + cosb1 * dc * coslam) / (D + D);
+		N = cosb1 * s - sinb1 * c * coslam;
+		fac->der.x_l = xmf * c * (dB_l * sinlam + B * coslam);
+		fac->der.x_p = - xmf * sinlam * (dB_p * c + B * dc);
+		fac->der.y_l = - ymf * (dB_l * N + B * sinb1 * c * sinlam);
+		fac->der.y_p = ymf * (dB_p * N + B * (cosb1 * ds - sinb1 * dc * coslam));
+		break;
+	case N_POLE:
+	case S_POLE:
+		/* x = B sin(lam), y = -+B cos(lam) */
+		if (P->es) {
+			if ((q = P->mode == N_POLE ? P->qp - q : P->qp + q) < EPS10)
+				return;
+			B = sqrt(q);
+			dB_p = (P->mode == N_POLE ? -ds : ds) / (B + B);
+		} else {
+			if (fabs(lp.phi + P->phi0) < EPS10) return;
+			if (P->mode == N_POLE) {
+				B = 2. * sin(FORTPI - lp.phi * .5);
+				dB_p = - cos(FORTPI - lp.phi * .5);
+			} else {
+				B = 2. * cos(FORTPI - lp.phi * .5);
+				dB_p = sin(FORTPI - lp.phi * .5);
+			}
+		}
+		if (P->mode == N_POLE) {
+			sinlam = -sinlam;
+			coslam = -coslam;
+		}
+		fac->der.x_l = B * cos(lp.lam);
+		fac->der.x_p = - dB_p * sin(lp.lam);
+		fac->der.y_l = B * sinlam;
+		fac->der.y_p = dB_p * coslam;
+		break;
+	}
+	fac->code |= IS_ANAL_XL_YL + IS_ANAL_XP_YP;
+}
 INVERSE(e_inverse); /* ellipsoid */
 	double cCe, sCe, q, rho, ab=0.0;
 
@@ -230,4 +309,5 @@ ENTRY1(laea,apa)
 		P->inv = s_inverse;
 		P->fwd = s_forward;
 	}
+	P->spc = fac;
 ENDENTRY(P)
@@ -58,6 +58,12 @@ SPECIAL(fac) {
 	fac->k = fac->h = P->k0 * P->n * rho /
 		pj_msfn(sin(lp.phi), cos(lp.phi), P->es);
 	fac->conv = - P->n * lp.lam;
+	if (rho != 0.) {
+		fac->der.x_l = P->k0 * P->n * rho * cos(P->n * lp.lam);
+		fac->der.y_l = - P->k0 * P->n * rho * sin(P->n * lp.lam);
+		pj_deriv_conformal(lp.phi, P, &fac->der);
+		fac->code |= IS_ANAL_XL_YL + IS_ANAL_XP_YP;
+	}
 }
 FREEUP; if (P) pj_dalloc(P); }
 ENTRY0(lcc)
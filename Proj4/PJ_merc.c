@@ -24,6 +24,13 @@ INVERSE(s_inverse); /* spheroid */
 	lp.lam = xy.x / P->k0;
 	return (lp);
 }
+SPECIAL(fac) { /* ellipsoid & spheroid */
+	if (fabs(fabs(lp.phi) - HALFPI) <= EPS10) return;
+	fac->der.x_l = P->k0;
+	fac->der.y_l = 0.;
+	pj_deriv_conformal(lp.phi, P, &fac->der);
+	fac->code |= IS_ANAL_XL_YL + IS_ANAL_XP_YP;
+}
 FREEUP; if (P) pj_dalloc(P); }
 ENTRY0(merc)
 	double phits=0.0;
@@ -44,4 +51,5 @@ ENTRY0(merc)
 		P->inv = s_inverse;
 		P->fwd = s_forward;
 	}
+	P->spc = fac;
 ENDENTRY(P)
@@ -165,6 +165,84 @@ INVERSE(s_inverse); /* spheroid */
 	}
 	return (lp);
 }
+SPECIAL(e_fac) { /* ellipsoid */
+	double coslam, sinlam, sinX, cosX, A, D, r, sinphi;
+
+	coslam = cos(lp.lam);
+	sinlam = sin(lp.lam);
+	sinphi = sin(lp.phi);
+	switch (P->mode) {
+	case OBLIQ:
+	case EQUIT:
+		sinX = sin(2. * atan(ssfn_(lp.phi, sinphi, P->e)) - HALFPI);
+		cosX = sqrt(1. - sinX * sinX);
+		if (P->mode == OBLIQ) {
+			if ((D = 1. + P->sinX1 * sinX + P->cosX1 * cosX * coslam)
+				<= EPS10) return;
+			A = P->akm1 / (P->cosX1 * D);
+			r = P->cosX1 * cosX * sinlam / D; /* dA/dlam / A */
+			fac->der.y_l = - A * (r * (P->cosX1 * sinX - P->sinX1 * cosX *
+				coslam) + P->sinX1 * cosX * sinlam);
+		} else {
+			if ((D = 1. + cosX * coslam) <= EPS10) return;
+			A = 2. * P->akm1 / D;
+			r = cosX * sinlam / D;
+			fac->der.y_l = - A * r * sinX;
+		}
+		fac->der.x_l = A * cosX * (r * sinlam + coslam);
+		break;
+	case S_POLE:
+		lp.phi = -lp.phi;
+		sinphi = -sinphi;
+		sinlam = -sinlam;
+	case N_POLE:
+		if (fabs(lp.phi - HALFPI) < EPS10) return;
+		A = P->akm1 * pj_tsfn(lp.phi, sinphi, P->e);
+		fac->der.x_l = A * coslam;
+		fac->der.y_l = - A * sinlam;
+		break;
+	}
+	pj_deriv_conformal(lp.phi, P, &fac->der);
+	fac->code |= IS_ANAL_XL_YL + IS_ANAL_XP_YP;
+}
+SPECIAL(s_fac) { /* spheroid */
+	double  sinphi, cosphi, coslam, sinlam, A, D, r;
+
+	sinphi = sin(lp.phi);
+	cosphi = cos(lp.phi);
+	coslam = cos(lp.lam);
+	sinlam = sin(lp.lam);
+	switch (P->mode) {
+	case EQUIT:
+		if ((D = 1. + cosphi * coslam) <= EPS10) return;
+		A = P->akm1 / D;
+		r = cosphi * sinlam / D; /* dA/dlam / A */
+		fac->der.y_l = - A * r * sinphi;
+		break;
+	case OBLIQ:
+		if ((D = 1. + sinph0 * sinphi + cosph0 * cosphi * coslam) <= EPS10)
+			return;
+		A = P->akm1 / D;
+		r = cosph0 * cosphi * sinlam / D;
+		fac->der.y_l = - A * (r * (cosph0 * sinphi - sinph0 * cosphi * coslam)
+			+ sinph0 * cosphi * sinlam);
+		break;
+	case N_POLE:
+		lp.phi = - lp.phi;
+		sinlam = - sinlam;
+	case S_POLE:
+		if (fabs(lp.phi - HALFPI) < TOL) return;
+		A = P->akm1 * tan(FORTPI + .5 * lp.phi);
+		fac->der.x_l = A * coslam;
+		fac->der.y_l = A * sinlam;
+		pj_deriv_conformal(lp.phi, P, &fac->der);
+		fac->code |= IS_ANAL_XL_YL + IS_ANAL_XP_YP;
+		return;
+	}
+	fac->der.x_l = A * cosphi * (r * sinlam + coslam);
+	pj_deriv_conformal(lp.phi, P, &fac->der);
+	fac->code |= IS_ANAL_XL_YL + IS_ANAL_XP_YP;
+}
 FREEUP; if (P) pj_dalloc(P); }
 	static PJ *
 setup(PJ *P) { /* general initialization */
@@ -205,6 +283,7 @@ setup(PJ *P) { /* general initialization */
 		}
 		P->inv = e_inverse;
 		P->fwd = e_forward;
+		P->spc = e_fac;
 	} else {
 		switch (P->mode) {
 		case OBLIQ:
@@ -222,6 +301,7 @@ setup(PJ *P) { /* general initialization */
 		}
 		P->inv = s_inverse;
 		P->fwd = s_forward;
+		P->spc = s_fac;
 	}
 	return P;
 }
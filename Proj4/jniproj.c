@@ -98,6 +98,334 @@ JNIEXPORT void JNICALL Java_org_proj4_Projections_transform
 	pj_free( dst_pj );
 }
 
+/*!
+ * \brief
+ * number of array elements transformArrays copies in and out per call to
+ * pj_transform(), through buffers on the stack.
+ */
+#define JNI_TRANSFORM_CHUNK 1024
+
+/*!
+ * \brief
+ * a prepared source/destination pair kept alive on the native side
+ * between calls, referenced from Java through an opaque long handle.
+ */
+typedef struct {
+	projPJ src_pj;
+	projPJ dst_pj;
+} JNI_TRANSFORM;
+
+/*!
+ * \brief
+ * prepares a reusable transformation between two projections
+ * 
+ * JNI informations:
+ * Class:     org_proj4_Projections
+ * Method:    createTransform
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)J
+ * 
+ *
+ * \param env - parameter used by jni (see JNI specification)
+ * \param parent - parameter used by jni (see JNI specification)
+ * \param src - definition of the source projection
+ * \param dest - definition of the destination projection
+ *
+ * \return an opaque handle to pass to transformBuffers, transformArrays and
+ * destroyTransform, or 0 if either definition could not be initialized.
+*/
+JNIEXPORT jlong JNICALL Java_org_proj4_Projections_createTransform
+  (JNIEnv * env, jobject parent, jstring src, jstring dest)
+{
+	JNI_TRANSFORM *transform;
+	const char * srcproj_def;
+	const char * destproj_def;
+
+	transform = (JNI_TRANSFORM *) pj_malloc(sizeof(JNI_TRANSFORM));
+	if (transform == NULL)
+		return 0;
+
+	srcproj_def = (*env)->GetStringUTFChars (env, src, 0);
+	destproj_def = (*env)->GetStringUTFChars (env, dest, 0);
+
+	transform->src_pj = pj_init_plus(srcproj_def);
+	transform->dst_pj = pj_init_plus(destproj_def);
+
+	(*env)->ReleaseStringUTFChars (env, src, srcproj_def);
+	(*env)->ReleaseStringUTFChars (env, dest, destproj_def);
+
+	if (transform->src_pj == NULL || transform->dst_pj == NULL)
+	{
+		if (transform->src_pj != NULL)
+			pj_free(transform->src_pj);
+		if (transform->dst_pj != NULL)
+			pj_free(transform->dst_pj);
+		pj_dalloc(transform);
+		return 0;
+	}
+
+	return (jlong) (size_t) transform;
+}
+
+/*!
+ * \brief
+ * releases a transformation created by createTransform
+ * 
+ * JNI informations:
+ * Class:     org_proj4_Projections
+ * Method:    destroyTransform
+ * Signature: (J)V
+ * 
+ *
+ * \param env - parameter used by jni (see JNI specification)
+ * \param parent - parameter used by jni (see JNI specification)
+ * \param handle - handle returned by createTransform, 0 is ignored
+*/
+JNIEXPORT void JNICALL Java_org_proj4_Projections_destroyTransform
+  (JNIEnv * env, jobject parent, jlong handle)
+{
+	JNI_TRANSFORM *transform = (JNI_TRANSFORM *) (size_t) handle;
+
+	if (transform == NULL)
+		return;
+
+	pj_free(transform->src_pj);
+	pj_free(transform->dst_pj);
+	pj_dalloc(transform);
+}
+
+/*!
+ * \brief
+ * checks that a coordinate container holds pcount points at poffset stride
+ */
+static int jni_check_capacity(jlong capacity, jlong pcount, jint poffset)
+{
+	return pcount == 0 || (pcount - 1) * poffset + 1 <= capacity;
+}
+
+/* DoubleBuffer.order() and ByteOrder.nativeOrder(), looked up once by JNI_OnLoad() */
+static jmethodID jni_buffer_order = NULL;
+static jobject jni_native_order = NULL;
+
+/*!
+ * \brief
+ * looks up the byte order method and the native byte order, which
+ * transformBuffers checks every buffer against, once for the library
+ */
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM * vm, void * reserved)
+{
+	JNIEnv *env;
+	jclass buffer_class, order_class;
+	jmethodID native_order;
+	jobject order;
+
+	if ((*vm)->GetEnv(vm, (void **) &env, JNI_VERSION_1_4) != JNI_OK)
+		return JNI_ERR;
+
+	buffer_class = (*env)->FindClass(env, "java/nio/DoubleBuffer");
+	order_class = (*env)->FindClass(env, "java/nio/ByteOrder");
+
+	if (buffer_class != NULL && order_class != NULL)
+	{
+		jni_buffer_order = (*env)->GetMethodID(env, buffer_class, "order", "()Ljava/nio/ByteOrder;");
+		native_order = (*env)->GetStaticMethodID(env, order_class, "nativeOrder", "()Ljava/nio/ByteOrder;");
+
+		if (jni_buffer_order != NULL && native_order != NULL)
+		{
+			order = (*env)->CallStaticObjectMethod(env, order_class, native_order);
+
+			if (order != NULL)
+			{
+				jni_native_order = (*env)->NewGlobalRef(env, order);
+				(*env)->DeleteLocalRef(env, order);
+			}
+		}
+	}
+
+	if (order_class != NULL)
+		(*env)->DeleteLocalRef(env, order_class);
+	if (buffer_class != NULL)
+		(*env)->DeleteLocalRef(env, buffer_class);
+
+	if (jni_buffer_order == NULL || jni_native_order == NULL)
+		return JNI_ERR;
+
+	return JNI_VERSION_1_4;
+}
+
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM * vm, void * reserved)
+{
+	JNIEnv *env;
+
+	if ((*vm)->GetEnv(vm, (void **) &env, JNI_VERSION_1_4) != JNI_OK)
+		return;
+
+	if (jni_native_order != NULL)
+		(*env)->DeleteGlobalRef(env, jni_native_order);
+	jni_native_order = NULL;
+	jni_buffer_order = NULL;
+}
+
+/*!
+ * \brief
+ * checks that a direct buffer is in native byte order, as pj_transform()
+ * reads the doubles at its address as they are
+ */
+static int jni_check_native_order(JNIEnv * env, jobject buffer)
+{
+	jobject buffer_order = (*env)->CallObjectMethod(env, buffer, jni_buffer_order);
+	int result = !(*env)->ExceptionCheck(env) && (*env)->IsSameObject(env, buffer_order, jni_native_order);
+
+	if ((*env)->ExceptionCheck(env))
+		(*env)->ExceptionClear(env);
+
+	if (buffer_order != NULL)
+		(*env)->DeleteLocalRef(env, buffer_order);
+
+	return result;
+}
+
+/*!
+ * \brief
+ * executes reprojection in place on direct NIO buffers, without copying.
+ * The buffers must be in native byte order, as those of
+ * ByteBuffer.allocateDirect(n).order(ByteOrder.nativeOrder()).asDoubleBuffer().
+ * Their positions are ignored: the points are read from and written to
+ * the start of each buffer, the address GetDirectBufferAddress() returns,
+ * so pass slice() of a buffer to transform from its position on.
+ * 
+ * JNI informations:
+ * Class:     org_proj4_Projections
+ * Method:    transformBuffers
+ * Signature: (JLjava/nio/DoubleBuffer;Ljava/nio/DoubleBuffer;Ljava/nio/DoubleBuffer;JI)I
+ * 
+ *
+ * \param env - parameter used by jni (see JNI specification)
+ * \param parent - parameter used by jni (see JNI specification)
+ * \param handle - handle returned by createTransform
+ * \param firstcoord - direct buffer of x coordinates
+ * \param secondcoord - direct buffer of y coordinates
+ * \param values - direct buffer of z coordinates, may be null
+ * \param pcount
+ * \param poffset
+ *
+ * \return the pj_transform() error code, 0 on success.  -1 is returned
+ * if the handle is invalid or a buffer is not direct, too small or not in
+ * native byte order.
+*/
+JNIEXPORT jint JNICALL Java_org_proj4_Projections_transformBuffers
+  (JNIEnv * env, jobject parent, jlong handle, jobject firstcoord, jobject secondcoord, jobject values, jlong pcount, jint poffset)
+{
+	JNI_TRANSFORM *transform = (JNI_TRANSFORM *) (size_t) handle;
+	double *xcoord, *ycoord, *zcoord = NULL;
+
+	if (poffset == 0)
+		poffset = 1;
+
+	if (transform == NULL || pcount < 0 || poffset < 0)
+		return -1;
+
+	xcoord = (double *) (*env)->GetDirectBufferAddress(env, firstcoord);
+	ycoord = (double *) (*env)->GetDirectBufferAddress(env, secondcoord);
+	if (values != NULL)
+		zcoord = (double *) (*env)->GetDirectBufferAddress(env, values);
+
+	if (xcoord == NULL || ycoord == NULL || (values != NULL && zcoord == NULL))
+		return -1;
+
+	if (!jni_check_capacity((*env)->GetDirectBufferCapacity(env, firstcoord), pcount, poffset)
+		|| !jni_check_capacity((*env)->GetDirectBufferCapacity(env, secondcoord), pcount, poffset)
+		|| (values != NULL && !jni_check_capacity((*env)->GetDirectBufferCapacity(env, values), pcount, poffset)))
+		return -1;
+
+	if (!jni_check_native_order(env, firstcoord) || !jni_check_native_order(env, secondcoord)
+		|| (values != NULL && !jni_check_native_order(env, values)))
+		return -1;
+
+	return pj_transform(transform->src_pj, transform->dst_pj, pcount, poffset, xcoord, ycoord, zcoord);
+}
+
+/*!
+ * \brief
+ * executes reprojection in place on Java arrays, copying them in and out
+ * one chunk at a time, so that neither the arrays are pinned nor the
+ * garbage collector is blocked
+ * 
+ * JNI informations:
+ * Class:     org_proj4_Projections
+ * Method:    transformArrays
+ * Signature: (J[D[D[DJI)I
+ * 
+ *
+ * \param env - parameter used by jni (see JNI specification)
+ * \param parent - parameter used by jni (see JNI specification)
+ * \param handle - handle returned by createTransform
+ * \param firstcoord - array of x coordinates
+ * \param secondcoord - array of y coordinates
+ * \param values - array of z coordinates, may be null
+ * \param pcount
+ * \param poffset
+ *
+ * \return the first pj_transform() error code, 0 on success.  -1 is
+ * returned if the handle is invalid or an array is too small.
+*/
+JNIEXPORT jint JNICALL Java_org_proj4_Projections_transformArrays
+  (JNIEnv * env, jobject parent, jlong handle, jdoubleArray firstcoord, jdoubleArray secondcoord, jdoubleArray values, jlong pcount, jint poffset)
+{
+	JNI_TRANSFORM *transform = (JNI_TRANSFORM *) (size_t) handle;
+	jlong first, step;
+	int result = 0;
+
+	if (poffset == 0)
+		poffset = 1;
+
+	if (transform == NULL || pcount < 0 || poffset < 0)
+		return -1;
+
+	if (!jni_check_capacity((*env)->GetArrayLength(env, firstcoord), pcount, poffset)
+		|| !jni_check_capacity((*env)->GetArrayLength(env, secondcoord), pcount, poffset)
+		|| (values != NULL && !jni_check_capacity((*env)->GetArrayLength(env, values), pcount, poffset)))
+		return -1;
+
+	/* as many points as fit in a chunk at poffset stride, at least one */
+	step = poffset >= JNI_TRANSFORM_CHUNK ? 1 : (JNI_TRANSFORM_CHUNK - 1) / poffset + 1;
+
+	for (first = 0; first < pcount; first += step)
+	{
+		jdouble xcoord[JNI_TRANSFORM_CHUNK], ycoord[JNI_TRANSFORM_CHUNK], zcoord[JNI_TRANSFORM_CHUNK];
+		jlong count = pcount - first;
+		jsize start = (jsize) (first * poffset), length;
+		int chunk_result;
+
+		if (count > step)
+			count = step;
+
+		length = (jsize) ((count - 1) * poffset + 1);
+
+		(*env)->GetDoubleArrayRegion(env, firstcoord, start, length, xcoord);
+		(*env)->GetDoubleArrayRegion(env, secondcoord, start, length, ycoord);
+		if (values != NULL)
+			(*env)->GetDoubleArrayRegion(env, values, start, length, zcoord);
+
+		if ((*env)->ExceptionCheck(env))
+			return -1;
+
+		chunk_result = pj_transform(transform->src_pj, transform->dst_pj, count, poffset,
+			xcoord, ycoord, values != NULL ? zcoord : NULL);
+
+		(*env)->SetDoubleArrayRegion(env, firstcoord, start, length, xcoord);
+		(*env)->SetDoubleArrayRegion(env, secondcoord, start, length, ycoord);
+		if (values != NULL)
+			(*env)->SetDoubleArrayRegion(env, values, start, length, zcoord);
+
+		if ((*env)->ExceptionCheck(env))
+			return -1;
+		if (chunk_result != 0 && result == 0)
+			result = chunk_result;
+	}
+
+	return result;
+}
+
 /*!
  * \brief
  * retrieves projection parameters
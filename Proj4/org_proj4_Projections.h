@@ -31,6 +31,38 @@ JNIEXPORT jstring JNICALL Java_org_proj4_Projections_getEllipsInfo
 JNIEXPORT void JNICALL Java_org_proj4_Projections_transform
   (JNIEnv *, jobject, jdoubleArray, jdoubleArray, jdoubleArray, jstring, jstring, jlong, jint);
 
+/*
+ * Class:     org_proj4_Projections
+ * Method:    createTransform
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)J
+ */
+JNIEXPORT jlong JNICALL Java_org_proj4_Projections_createTransform
+  (JNIEnv *, jobject, jstring, jstring);
+
+/*
+ * Class:     org_proj4_Projections
+ * Method:    destroyTransform
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_org_proj4_Projections_destroyTransform
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     org_proj4_Projections
+ * Method:    transformBuffers
+ * Signature: (JLjava/nio/DoubleBuffer;Ljava/nio/DoubleBuffer;Ljava/nio/DoubleBuffer;JI)I
+ */
+JNIEXPORT jint JNICALL Java_org_proj4_Projections_transformBuffers
+  (JNIEnv *, jobject, jlong, jobject, jobject, jobject, jlong, jint);
+
+/*
+ * Class:     org_proj4_Projections
+ * Method:    transformArrays
+ * Signature: (J[D[D[DJI)I
+ */
+JNIEXPORT jint JNICALL Java_org_proj4_Projections_transformArrays
+  (JNIEnv *, jobject, jlong, jdoubleArray, jdoubleArray, jdoubleArray, jlong, jint);
+
 #ifdef __cplusplus
 }
 #endif
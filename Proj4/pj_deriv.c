@@ -31,3 +31,14 @@ pj_deriv(LP lp, double h, PJ *P, struct DERIVS *der) {
 	der->y_l /= h;
 	return 0;
 }
+/* latitude derivatives of a conformal projection from its longitude
+** derivatives, by the Cauchy-Riemann equations in isometric latitude.
+** Signs follow pj_deriv(): x_p and y_l hold -dx/dphi and -dy/dlam. */
+	void
+pj_deriv_conformal(double phi, PJ *P, struct DERIVS *der) {
+	double sinphi = sin(phi), dpsi;
+
+	dpsi = P->one_es / ((1. - P->es * sinphi * sinphi) * cos(phi));
+	der->x_p = - der->y_l * dpsi;
+	der->y_p = der->x_l * dpsi;
+}
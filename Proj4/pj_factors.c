@@ -27,6 +27,7 @@ pj_factors(LP lp, PJ *P, double h, struct FACTORS *fac) {
 		lp.lam -= P->lam0;	/* compute del lp.lam */
 		if (!P->over)
 			lp.lam = adjlon(lp.lam); /* adjust del longitude */
+		fac->code = 0;
 		if (P->spc)	/* get what projection analytic values */
 			P->spc(lp, P, fac);
 		if (((fac->code & (IS_ANAL_XL_YL+IS_ANAL_XP_YP)) !=
@@ -82,3 +83,28 @@ pj_factors(LP lp, PJ *P, double h, struct FACTORS *fac) {
 	}
 	return 0;
 }
+/* scale factors for point_count points stored at point_offset stride in
+** lam[] and phi[] (radians) into facs[0..point_count-1].  Points that
+** fail get h = k = HUGE_VAL.  Returns the number of failed points and
+** leaves pj_errno set from the first of them. */
+	long
+pj_factors_batch(PJ *P, long point_count, int point_offset,
+	double *lam, double *phi, double h, struct FACTORS *facs) {
+	long i, failed = 0;
+	int first_errno = 0;
+	LP lp;
+
+	if (point_offset == 0)
+		point_offset = 1;
+	for (i = 0; i < point_count; ++i) {
+		lp.lam = lam[i * point_offset];
+		lp.phi = phi[i * point_offset];
+		if (lp.lam == HUGE_VAL || pj_factors(lp, P, h, facs + i)) {
+			facs[i].h = facs[i].k = HUGE_VAL;
+			if (!failed++)
+				first_errno = lp.lam == HUGE_VAL || !pj_errno ? -14 : pj_errno;
+		}
+	}
+	pj_errno = first_errno;
+	return failed;
+}
@@ -52,6 +52,14 @@ PJ_CVSID("$Id: pj_transform.c 1504 2009-01-06 02:11:57Z warmerdam $");
 #define Rz_BF (defn->datum_params[5])
 #define M_BF  (defn->datum_params[6])
 
+/*
+** Number of scratch height values kept on the stack by pj_datum_transform()
+** when the caller does not supply a z array.
+*/
+#define PJ_DATUM_BLOCK_SIZE 256
+
+#define CHECK_RETURN {if( pj_errno != 0 && (pj_errno > 0 || transient_error[-pj_errno] == 0) ) return pj_errno;}
+
 /* 
 ** This table is intended to indicate for any given error code in 
 ** the range 0 to -44, whether that error will occur for all locations (ie.
@@ -514,12 +522,64 @@ int pj_geocentric_from_wgs84( PJ *defn,
     return 0;
 }
 
+/************************************************************************/
+/*                        pj_datum_geocentric()                         */
+/*                                                                      */
+/*      Shift geodetic coordinates between two ellipsoids / datums      */
+/*      by way of geocentric coordinates.  The z array is required.     */
+/************************************************************************/
+
+static int pj_datum_geocentric( PJ *srcdefn, PJ *dstdefn,
+                                double src_a, double src_es,
+                                double dst_a, double dst_es,
+                                long point_count, int point_offset,
+                                double *x, double *y, double *z )
+
+{
+/* -------------------------------------------------------------------- */
+/*      Convert to geocentric coordinates.                              */
+/* -------------------------------------------------------------------- */
+    pj_geodetic_to_geocentric( src_a, src_es,
+                               point_count, point_offset, x, y, z );
+    CHECK_RETURN;
+
+/* -------------------------------------------------------------------- */
+/*      Convert between datums.                                         */
+/* -------------------------------------------------------------------- */
+    if( srcdefn->datum_type == PJD_3PARAM 
+        || srcdefn->datum_type == PJD_7PARAM )
+    {
+        pj_geocentric_to_wgs84( srcdefn, point_count, point_offset,x,y,z);
+        CHECK_RETURN;
+    }
+
+    if( dstdefn->datum_type == PJD_3PARAM 
+        || dstdefn->datum_type == PJD_7PARAM )
+    {
+        pj_geocentric_from_wgs84( dstdefn, point_count,point_offset,x,y,z);
+        CHECK_RETURN;
+    }
+
+/* -------------------------------------------------------------------- */
+/*      Convert back to geodetic coordinates.                           */
+/* -------------------------------------------------------------------- */
+    pj_geocentric_to_geodetic( dst_a, dst_es,
+                               point_count, point_offset, x, y, z );
+    CHECK_RETURN;
+
+    return 0;
+}
+
 /************************************************************************/
 /*                         pj_datum_transform()                         */
 /*                                                                      */
 /*      The input should be long/lat/z coordinates in radians in the    */
 /*      source datum, and the output should be long/lat/z               */
 /*      coordinates in radians in the destination datum.                */
+/*                                                                      */
+/*      If z is NULL the points are shifted in blocks through a         */
+/*      fixed size scratch height buffer on the stack, so that 2D       */
+/*      datum shifts never allocate.                                    */
 /************************************************************************/
 
 int pj_datum_transform( PJ *srcdefn, PJ *dstdefn, 
@@ -528,10 +588,12 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
 
 {
     double      src_a, src_es, dst_a, dst_es;
-    int         z_is_temp = FALSE;
 
     pj_errno = 0;
 
+    if( point_offset == 0 )
+        point_offset = 1;
+
 /* -------------------------------------------------------------------- */
 /*      We cannot do any meaningful datum transformation if either      */
 /*      the source or destination are of an unknown datum type          */
@@ -554,22 +616,9 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
     dst_a = dstdefn->a_orig;
     dst_es = dstdefn->es_orig;
 
-/* -------------------------------------------------------------------- */
-/*      Create a temporary Z array if one is not provided.              */
-/* -------------------------------------------------------------------- */
-    if( z == NULL )
-    {
-        int	bytes = sizeof(double) * point_count * point_offset;
-        z = (double *) pj_malloc(bytes);
-        memset( z, 0, bytes );
-        z_is_temp = TRUE;
-    }
-
-#define CHECK_RETURN {if( pj_errno != 0 && (pj_errno > 0 || transient_error[-pj_errno] == 0) ) { if( z_is_temp ) pj_dalloc(z); return pj_errno; }}
-
 /* -------------------------------------------------------------------- */
 /*	If this datum requires grid shifts, then apply it to geodetic   */
-/*      coordinates.                                                    */
+/*      coordinates.  Grid shifts only touch x and y.                   */
 /* -------------------------------------------------------------------- */
     if( srcdefn->datum_type == PJD_GRIDSHIFT )
     {
@@ -596,36 +645,43 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
         || dstdefn->datum_type == PJD_3PARAM 
         || dstdefn->datum_type == PJD_7PARAM)
     {
-/* -------------------------------------------------------------------- */
-/*      Convert to geocentric coordinates.                              */
-/* -------------------------------------------------------------------- */
-        pj_geodetic_to_geocentric( src_a, src_es,
-                                   point_count, point_offset, x, y, z );
-        CHECK_RETURN;
-
-/* -------------------------------------------------------------------- */
-/*      Convert between datums.                                         */
-/* -------------------------------------------------------------------- */
-        if( srcdefn->datum_type == PJD_3PARAM 
-            || srcdefn->datum_type == PJD_7PARAM )
+        if( z != NULL )
         {
-            pj_geocentric_to_wgs84( srcdefn, point_count, point_offset,x,y,z);
-            CHECK_RETURN;
+            if( pj_datum_geocentric( srcdefn, dstdefn,
+                                     src_a, src_es, dst_a, dst_es,
+                                     point_count, point_offset,
+                                     x, y, z ) != 0 )
+                return pj_errno;
         }
-
-        if( dstdefn->datum_type == PJD_3PARAM 
-            || dstdefn->datum_type == PJD_7PARAM )
+        else
         {
-            pj_geocentric_from_wgs84( dstdefn, point_count,point_offset,x,y,z);
-            CHECK_RETURN;
-        }
-
 /* -------------------------------------------------------------------- */
-/*      Convert back to geodetic coordinates.                           */
+/*      No heights were supplied, so process the points in blocks       */
+/*      using a zeroed scratch z buffer.  A block of n points with      */
+/*      stride point_offset touches (n-1)*point_offset+1 slots.         */
 /* -------------------------------------------------------------------- */
-        pj_geocentric_to_geodetic( dst_a, dst_es,
-                                   point_count, point_offset, x, y, z );
-        CHECK_RETURN;
+            double      z_block[PJ_DATUM_BLOCK_SIZE];
+            long        block_count = (PJ_DATUM_BLOCK_SIZE-1) / point_offset + 1;
+            long        first;
+
+            for( first = 0; first < point_count; first += block_count )
+            {
+                long    count = point_count - first;
+                long    io = first * point_offset;
+
+                if( count > block_count )
+                    count = block_count;
+
+                memset( z_block, 0,
+                        sizeof(double) * ((count-1) * point_offset + 1) );
+
+                if( pj_datum_geocentric( srcdefn, dstdefn,
+                                         src_a, src_es, dst_a, dst_es,
+                                         count, point_offset,
+                                         x + io, y + io, z_block ) != 0 )
+                    return pj_errno;
+            }
+        }
     }
 
 /* -------------------------------------------------------------------- */
@@ -638,9 +694,5 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
         CHECK_RETURN;
     }
 
-    if( z_is_temp )
-        pj_dalloc( z );
-
     return 0;
 }
-
@@ -0,0 +1,475 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  PROJ.4
+ * Purpose:  Micro-benchmark of forward and inverse throughput for every
+ *           projection registered in pj_list.h.
+ *
+ ******************************************************************************
+ * Copyright (c) 2012, Route-Me Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include "projects.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "emess.h"
+
+#if !defined(_WIN32) && !defined(__WIN32__)
+#  include <sys/time.h>
+#endif
+
+#define MAX_PARGS 100
+#define MAX_DEFN 2000
+
+/*
+** Longitude / latitude extent, in degrees, of the standardized inputs.
+** The poles and the antimeridian are left out since too many
+** projections are singular there to make the timings comparable.
+*/
+#define BENCH_LAM_MAX 170.0
+#define BENCH_PHI_MAX 80.0
+
+/*
+** Half width, in degrees, of the "local" input set centered on the
+** projection origin, where round trip errors are meaningful for
+** projections that diverge away from their center.
+*/
+#define BENCH_LOCAL_MAX 10.0
+
+static char *usage =
+"%s\nusage: %s [ -n points ] [ -r repeats ] [ -s seed ] [ -o file ]\n"
+"          [ +opts[=arg] ] [ proj_id ... ]\n"
+"\n"
+"Times pj_fwd() and pj_inv() for every projection in pj_list (or only\n"
+"the listed ids) and writes one CSV row per projection and input set.\n";
+
+/*
+** Parameters without which these projections do not initialize, added
+** after the command line ones so that those take precedence.  The
+** values are typical ones for each projection, not defaults.
+*/
+static const struct {
+    const char  *id;
+    const char  *args;
+} bench_required_args[] = {
+    { "aea",     "+lat_1=29.5 +lat_2=45.5" },
+    { "bonne",   "+lat_1=45" },
+    { "chamb",   "+lat_1=10 +lon_1=-10 +lat_2=10 +lon_2=30 +lat_3=50 +lon_3=10" },
+    { "eqdc",    "+lat_1=55 +lat_2=60" },
+    { "euler",   "+lat_1=67 +lat_2=75" },
+    { "geos",    "+h=35785831" },
+    { "gn_sinu", "+m=2 +n=3" },
+    { "imw_p",   "+lat_1=30 +lat_2=-40" },
+    { "lagrng",  "+W=2 +lat_1=30" },
+    { "lcc",     "+lat_1=33 +lat_2=45" },
+    { "lcca",    "+lat_0=35" },
+    { "lsat",    "+lsat=2 +path=2" },
+    { "murd1",   "+lat_1=30 +lat_2=50" },
+    { "murd2",   "+lat_1=30 +lat_2=50" },
+    { "murd3",   "+lat_1=30 +lat_2=50" },
+    { "nsper",   "+h=3000000" },
+    { "ob_tran", "+o_proj=moll +o_lat_p=45 +o_lon_p=-90" },
+    { "oea",     "+m=1 +n=2" },
+    { "omerc",   "+lat_0=40 +lonc=10 +alpha=30" },
+    { "pconic",  "+lat_1=34 +lat_2=40" },
+    { "tissot",  "+lat_1=60 +lat_2=65" },
+    { "tpeqd",   "+lat_1=40 +lon_1=-10 +lat_2=50 +lon_2=20" },
+    { "tpers",   "+h=5500000 +tilt=30 +azi=20" },
+    { "urmfps",  "+n=0.5" },
+    { "vitk1",   "+lat_1=45 +lat_2=55" },
+    { NULL,      NULL }
+};
+
+static unsigned long bench_seed = 1;
+
+/************************************************************************/
+/*                             bench_now()                              */
+/*                                                                      */
+/*      Wall clock in seconds.                                          */
+/************************************************************************/
+
+static double bench_now( void )
+
+{
+#if defined(_WIN32) || defined(__WIN32__)
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+/************************************************************************/
+/*                            bench_random()                            */
+/*                                                                      */
+/*      Portable LCG so that every platform sees the same inputs for    */
+/*      a given seed.  Returns a value in [0,1).                        */
+/************************************************************************/
+
+static double bench_random( void )
+
+{
+    bench_seed = (bench_seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return bench_seed / 2147483648.0;
+}
+
+/************************************************************************/
+/*                          bench_fill_input()                          */
+/************************************************************************/
+
+static void bench_fill_input( PJ *P, const char *kind,
+                              projUV *lp, long count )
+
+{
+    long i;
+
+    if( strcmp( kind, "local" ) == 0 )
+    {
+        for( i = 0; i < count; i++ )
+        {
+            double phi = P->phi0 + (bench_random() * 2 - 1)
+                * BENCH_LOCAL_MAX * DEG_TO_RAD;
+
+            if( phi > BENCH_PHI_MAX * DEG_TO_RAD )
+                phi = BENCH_PHI_MAX * DEG_TO_RAD;
+            else if( phi < -BENCH_PHI_MAX * DEG_TO_RAD )
+                phi = -BENCH_PHI_MAX * DEG_TO_RAD;
+
+            lp[i].u = adjlon( P->lam0 + (bench_random() * 2 - 1)
+                              * BENCH_LOCAL_MAX * DEG_TO_RAD );
+            lp[i].v = phi;
+        }
+    }
+    else if( strcmp( kind, "random" ) == 0 )
+    {
+        for( i = 0; i < count; i++ )
+        {
+            lp[i].u = (bench_random() * 2 - 1) * BENCH_LAM_MAX * DEG_TO_RAD;
+            lp[i].v = (bench_random() * 2 - 1) * BENCH_PHI_MAX * DEG_TO_RAD;
+        }
+    }
+    else /* grid */
+    {
+        long side = (long) ceil( sqrt( (double) count ) );
+
+        if( side < 2 )
+            side = 2;
+
+        for( i = 0; i < count; i++ )
+        {
+            long col = i % side, row = (i / side) % side;
+
+            lp[i].u = (-BENCH_LAM_MAX + 2 * BENCH_LAM_MAX * col / (side-1))
+                * DEG_TO_RAD;
+            lp[i].v = (-BENCH_PHI_MAX + 2 * BENCH_PHI_MAX * row / (side-1))
+                * DEG_TO_RAD;
+        }
+    }
+}
+
+/************************************************************************/
+/*                             bench_run()                              */
+/*                                                                      */
+/*      Time repeats passes of pj_fwd() (or pj_inv()) over the input    */
+/*      and return the best pass in seconds.  The output array holds    */
+/*      the result of the last pass.                                    */
+/************************************************************************/
+
+static double bench_run( PJ *P, int inverse, int repeats,
+                         const projUV *in, projUV *out, long count )
+
+{
+    double best = HUGE_VAL;
+    int    r;
+
+    for( r = 0; r < repeats; r++ )
+    {
+        double start = bench_now(), elapsed;
+        long   i;
+
+        if( inverse )
+            for( i = 0; i < count; i++ )
+                out[i] = pj_inv( in[i], P );
+        else
+            for( i = 0; i < count; i++ )
+                out[i] = pj_fwd( in[i], P );
+
+        elapsed = bench_now() - start;
+        if( elapsed < best )
+            best = elapsed;
+    }
+
+    return best;
+}
+
+/************************************************************************/
+/*                            bench_report()                            */
+/************************************************************************/
+
+static void bench_report( FILE *fp, const char *id, const char *kind,
+                          const char *status, long count,
+                          long fwd_ok, double fwd_time,
+                          long inv_ok, double inv_time,
+                          double max_err, double mean_err )
+
+{
+    fprintf( fp, "%s,%s,%s,%ld", id, kind, status, count );
+
+    if( fwd_time > 0 && fwd_time != HUGE_VAL )
+        fprintf( fp, ",%ld,%.2f,%.0f", fwd_ok,
+                 fwd_time * 1e9 / count, count / fwd_time );
+    else
+        fprintf( fp, ",%ld,,", fwd_ok );
+
+    if( inv_time > 0 && inv_time != HUGE_VAL && inv_ok > 0 )
+        fprintf( fp, ",%ld,%.2f,%.0f,%.6g,%.6g\n", inv_ok,
+                 inv_time * 1e9 / inv_ok, inv_ok / inv_time,
+                 max_err, mean_err );
+    else
+        fprintf( fp, ",%ld,,,,\n", inv_ok );
+}
+
+/************************************************************************/
+/*                          bench_projection()                          */
+/************************************************************************/
+
+static void bench_projection( FILE *fp, struct PJ_LIST *lp,
+                              int pargc, char **pargv,
+                              long count, int repeats,
+                              projUV *lp_in, projUV *xy_out,
+                              projUV *xy_in, projUV *lp_out )
+
+{
+    static const char *kinds[] = { "random", "grid", "local", NULL };
+    char    defn[MAX_DEFN];
+    PJ      *P;
+    int     k, i;
+
+    sprintf( defn, "+proj=%s", lp->id );
+    for( i = 0; i < pargc; i++ )
+    {
+        if( strlen(defn) + strlen(pargv[i]) + 2 >= sizeof(defn) )
+            break;
+        strcat( defn, " " );
+        strcat( defn, pargv[i] );
+    }
+
+    for( i = 0; bench_required_args[i].id != NULL; i++ )
+    {
+        if( strcmp( bench_required_args[i].id, lp->id ) == 0
+            && strlen(defn) + strlen(bench_required_args[i].args) + 2
+               < sizeof(defn) )
+        {
+            strcat( defn, " " );
+            strcat( defn, bench_required_args[i].args );
+        }
+    }
+
+    P = pj_init_plus( defn );
+
+    for( k = 0; kinds[k] != NULL; k++ )
+    {
+        double  fwd_time, inv_time = 0, max_err = 0, sum_err = 0;
+        long    fwd_ok = 0, inv_ok = 0, n;
+
+        if( P == NULL )
+        {
+            bench_report( fp, lp->id, kinds[k], "init-failed", count,
+                          0, 0, 0, 0, 0, 0 );
+            continue;
+        }
+
+        bench_fill_input( P, kinds[k], lp_in, count );
+
+        fwd_time = bench_run( P, 0, repeats, lp_in, xy_out, count );
+
+/* -------------------------------------------------------------------- */
+/*      Only points that projected successfully are fed back            */
+/*      through the inverse.                                            */
+/* -------------------------------------------------------------------- */
+        for( n = 0; n < count; n++ )
+        {
+            if( xy_out[n].u != HUGE_VAL && xy_out[n].v != HUGE_VAL )
+            {
+                lp_out[fwd_ok] = lp_in[n];
+                xy_in[fwd_ok++] = xy_out[n];
+            }
+        }
+
+        if( P->inv == NULL )
+        {
+            bench_report( fp, lp->id, kinds[k], "no-inverse", count,
+                          fwd_ok, fwd_time, 0, 0, 0, 0 );
+            continue;
+        }
+
+        /* lp_out holds the original inputs, keep them in lp_in */
+        memcpy( lp_in, lp_out, sizeof(projUV) * fwd_ok );
+
+        if( fwd_ok > 0 )
+            inv_time = bench_run( P, 1, repeats, xy_in, lp_out, fwd_ok );
+
+/* -------------------------------------------------------------------- */
+/*      Round trip error as a great circle approximation in metres      */
+/*      on the projection ellipsoid.                                    */
+/* -------------------------------------------------------------------- */
+        for( n = 0; n < fwd_ok; n++ )
+        {
+            double dlam, dphi, err;
+
+            if( lp_out[n].u == HUGE_VAL || lp_out[n].v == HUGE_VAL )
+                continue;
+
+            dlam = adjlon( lp_out[n].u - lp_in[n].u ) * cos( lp_in[n].v );
+            dphi = lp_out[n].v - lp_in[n].v;
+            err = sqrt( dlam * dlam + dphi * dphi ) * P->a_orig;
+
+            if( err > max_err )
+                max_err = err;
+            sum_err += err;
+            inv_ok++;
+        }
+
+        bench_report( fp, lp->id, kinds[k], "ok", count,
+                      fwd_ok, fwd_time, inv_ok, inv_time,
+                      max_err, inv_ok > 0 ? sum_err / inv_ok : 0 );
+    }
+
+    if( P != NULL )
+        pj_free( P );
+}
+
+/************************************************************************/
+/*                                main()                                */
+/************************************************************************/
+
+int main( int argc, char **argv )
+
+{
+    char    *pargv[MAX_PARGS], **idv;
+    int     pargc = 0, idc = 0, repeats = 5, i;
+    long    count = 10000;
+    FILE    *fp = stdout;
+    projUV  *lp_in, *xy_out, *xy_in, *lp_out;
+    struct PJ_LIST *lp;
+
+    if( (emess_dat.Prog_name = strrchr(*argv,DIR_CHAR)) != NULL )
+        ++emess_dat.Prog_name;
+    else emess_dat.Prog_name = *argv;
+
+    idv = (char **) malloc( sizeof(char *) * argc );
+
+    for( i = 1; i < argc; i++ )
+    {
+        if( argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0'
+            && i < argc - 1 )
+        {
+            switch( argv[i][1] )
+            {
+              case 'n':
+                count = atol( argv[++i] );
+                break;
+              case 'r':
+                repeats = atoi( argv[++i] );
+                break;
+              case 's':
+                bench_seed = strtoul( argv[++i], NULL, 10 );
+                break;
+              case 'o':
+                if( (fp = fopen( argv[++i], "w" )) == NULL )
+                    emess(3,"unable to open output file %s", argv[i]);
+                break;
+              default:
+                emess(1,"invalid option: -%c", argv[i][1]);
+                break;
+            }
+        }
+        else if( argv[i][0] == '+' )
+        {
+            if( pargc >= MAX_PARGS )
+                emess(1,"overflowed + argument table");
+            pargv[pargc++] = argv[i];
+        }
+        else if( argv[i][0] == '-' )
+        {
+            (void)fprintf(stderr, usage, pj_get_release(),
+                          emess_dat.Prog_name);
+            exit(0);
+        }
+        else
+            idv[idc++] = argv[i];
+    }
+
+    if( count < 1 || repeats < 1 )
+        emess(1,"point count and repeat count must be positive");
+
+    if( pargc == 0 )
+        pargv[pargc++] = "+ellps=WGS84";
+
+    lp_in = (projUV *) malloc( sizeof(projUV) * count );
+    xy_out = (projUV *) malloc( sizeof(projUV) * count );
+    xy_in = (projUV *) malloc( sizeof(projUV) * count );
+    lp_out = (projUV *) malloc( sizeof(projUV) * count );
+    if( lp_in == NULL || xy_out == NULL || xy_in == NULL || lp_out == NULL )
+        emess(3,"out of memory for %ld points", count);
+
+    fprintf( fp, "proj,input,status,points,fwd_ok,fwd_ns_per_point,"
+             "fwd_points_per_sec,inv_ok,inv_ns_per_point,"
+             "inv_points_per_sec,max_roundtrip_m,mean_roundtrip_m\n" );
+
+    for( lp = pj_get_list_ref(); lp->id; ++lp )
+    {
+        unsigned long seed = bench_seed;
+
+        if( idc > 0 )
+        {
+            int j;
+
+            for( j = 0; j < idc; j++ )
+                if( strcmp( idv[j], lp->id ) == 0 )
+                    break;
+            if( j == idc )
+                continue;
+        }
+
+        /* every projection sees the same input sets */
+        bench_projection( fp, lp, pargc, pargv, count, repeats,
+                          lp_in, xy_out, xy_in, lp_out );
+        bench_seed = seed;
+        fflush( fp );
+    }
+
+    if( fp != stdout )
+        fclose( fp );
+
+    free( lp_in );
+    free( xy_out );
+    free( xy_in );
+    free( lp_out );
+    free( idv );
+
+    return 0;
+}
@@ -363,7 +363,10 @@ COMPLEX pj_zpolyd1(COMPLEX, COMPLEX *, int, COMPLEX *);
 FILE *pj_open_lib(char *, char *);
 
 int pj_deriv(LP, double, PJ *, struct DERIVS *);
+void pj_deriv_conformal(double, PJ *, struct DERIVS *);
 int pj_factors(LP, PJ *, double, struct FACTORS *);
+long pj_factors_batch(PJ *, long, int, double *, double *, double,
+                      struct FACTORS *);
 
 struct PW_COEF {/* row coefficient structure */
     int m;		/* number of c coefficients (=0 for none) */
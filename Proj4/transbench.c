@@ -0,0 +1,764 @@
+/******************************************************************************
+ * $Id$
+ *
+ * Project:  PROJ.4
+ * Purpose:  End to end benchmark of pj_transform() pipelines, including
+ *           datum shifts through geocent.c and grid shifts through
+ *           pj_apply_gridshift() on synthetic ctable, NTv1 and NTv2 grids.
+ *
+ ******************************************************************************
+ * Copyright (c) 2012, Route-Me Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include "projects.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "emess.h"
+
+#if defined(_WIN32) || defined(__WIN32__)
+#  define BENCH_NO_THREADS
+#else
+#  include <sys/time.h>
+#  include <pthread.h>
+#endif
+
+#define MAX_BATCHES 32
+#define MAX_DEFN 1000
+
+/*
+** Every scenario draws its inputs from a pool of this many points,
+** cycled into the per-call buffer, so that large batches do not need
+** equally large pools of precomputed inputs.
+*/
+#define POOL_SIZE 65536
+
+/*
+** Extent, in degrees, of the synthetic grid shift files and of the
+** geographic inputs.  The inputs stay a cell inside the grid edges.
+*/
+#define GRID_LAM_MIN -10.0
+#define GRID_PHI_MIN 40.0
+#define GRID_EXTENT  20.0
+#define GRID_STEP    0.1
+
+static char *usage =
+"%s\nusage: %s [ -n points ] [ -b batch[,batch...] ] [ -t threads ]\n"
+"          [ -d grid_dir ] [ -o file ] [ -z ] [ -k ] [ scenario ... ]\n"
+"\n"
+"Times pj_transform() over the scenarios below (default all) for each\n"
+"batch size and for 1,2,4..threads threads, and writes CSV rows.\n"
+"thread_wall_ns_per_point is the wall time one thread takes per point;\n"
+"failed_points is exact only with 1 thread, as pj_errno is shared.\n"
+"Scenarios: latlong-merc utm-latlong 3param 7param ctable ntv1 ntv2\n";
+
+typedef struct {
+    const char  *name;
+    const char  *src;       /* source definition, %s is the grid file */
+    const char  *dst;
+    const char  *grid;      /* "ctable", "ntv1", "ntv2" or NULL */
+} BENCH_SCENARIO;
+
+static BENCH_SCENARIO scenarios[] = {
+    { "latlong-merc",
+      "+proj=latlong +datum=WGS84", "+proj=merc +datum=WGS84", NULL },
+    { "utm-latlong",
+      "+proj=utm +zone=32 +datum=WGS84", "+proj=latlong +datum=WGS84",
+      NULL },
+    { "3param",
+      "+proj=latlong +ellps=intl +towgs84=-87,-98,-121",
+      "+proj=latlong +datum=WGS84", NULL },
+    { "7param",
+      "+proj=latlong +ellps=bessel "
+      "+towgs84=598.1,73.7,418.2,0.202,0.045,-2.455,6.7",
+      "+proj=latlong +datum=WGS84", NULL },
+    { "ctable",
+      "+proj=latlong +ellps=clrk66 +nadgrids=%s",
+      "+proj=latlong +datum=WGS84", "ctable" },
+    { "ntv1",
+      "+proj=latlong +ellps=clrk66 +nadgrids=%s",
+      "+proj=latlong +datum=WGS84", "ntv1" },
+    { "ntv2",
+      "+proj=latlong +ellps=clrk66 +nadgrids=%s",
+      "+proj=latlong +datum=WGS84", "ntv2" },
+    { NULL, NULL, NULL, NULL }
+};
+
+typedef struct {
+    PJ          *src, *dst;
+    const double *pool_x, *pool_y;
+    long        batch, total;
+    int         use_z;
+    double      *x, *y, *z;
+    long        failures;
+} BENCH_JOB;
+
+static unsigned long bench_seed = 1;
+static char grid_files[3][MAX_PATH_FILENAME+1];
+
+/************************************************************************/
+/*                             bench_now()                              */
+/************************************************************************/
+
+static double bench_now( void )
+
+{
+#if defined(_WIN32) || defined(__WIN32__)
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct timeval tv;
+
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+/************************************************************************/
+/*                            bench_random()                            */
+/************************************************************************/
+
+static double bench_random( void )
+
+{
+    bench_seed = (bench_seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return bench_seed / 2147483648.0;
+}
+
+/************************************************************************/
+/*                            bench_shift()                             */
+/*                                                                      */
+/*      Smooth synthetic shift, in arc seconds, at a grid node.         */
+/************************************************************************/
+
+static void bench_shift( int col, int row, double *dlat, double *dlon )
+
+{
+    *dlat = 2.0 + sin( col * 0.05 ) * cos( row * 0.07 );
+    *dlon = -1.5 + cos( col * 0.03 ) * sin( row * 0.04 );
+}
+
+/************************************************************************/
+/*                          bench_put_bytes()                           */
+/*                                                                      */
+/*      Store a value in the requested byte order.                      */
+/************************************************************************/
+
+static void bench_put_bytes( unsigned char *dst, const void *src,
+                             int size, int msb )
+
+{
+    static int  byte_order_test = 1;
+    int         lsb_host = ((unsigned char *) &byte_order_test)[0] == 1;
+    int         i;
+
+    memcpy( dst, src, size );
+    if( lsb_host == msb )
+    {
+        for( i = 0; i < size/2; i++ )
+        {
+            unsigned char t = dst[i];
+            dst[i] = dst[size-i-1];
+            dst[size-i-1] = t;
+        }
+    }
+}
+
+static void bench_record( unsigned char *rec, const char *name )
+
+{
+    memset( rec, ' ', 16 );
+    memcpy( rec, name, strlen(name) );
+}
+
+static void bench_record_d( unsigned char *rec, const char *name,
+                            double value, int msb )
+
+{
+    bench_record( rec, name );
+    bench_put_bytes( rec + 8, &value, 8, msb );
+}
+
+static void bench_record_i( unsigned char *rec, const char *name,
+                            int value, int msb )
+
+{
+    bench_record( rec, name );
+    memset( rec + 8, 0, 8 );
+    bench_put_bytes( rec + 8, &value, 4, msb );
+}
+
+static void bench_record_s( unsigned char *rec, const char *name,
+                            const char *value )
+
+{
+    bench_record( rec, name );
+    memcpy( rec + 8, value, strlen(value) );
+}
+
+/************************************************************************/
+/*                         bench_write_grids()                          */
+/*                                                                      */
+/*      Write the same synthetic shift surface in ctable, NTv1 and      */
+/*      NTv2 layouts as read by nad_init.c and pj_gridinfo.c.           */
+/************************************************************************/
+
+static void bench_write_grids( const char *dir )
+
+{
+    int     cols = (int) (GRID_EXTENT / GRID_STEP + 0.5) + 1;
+    int     rows = cols;
+    int     row, col;
+    FILE    *fp;
+
+    sprintf( grid_files[0], "%s%cbench_ctable.lla", dir, DIR_CHAR );
+    sprintf( grid_files[1], "%s%cbench_ntv1.gsb", dir, DIR_CHAR );
+    sprintf( grid_files[2], "%s%cbench_ntv2.gsb", dir, DIR_CHAR );
+
+/* -------------------------------------------------------------------- */
+/*      ctable: a raw struct CTABLE followed by FLP shifts in radians.  */
+/* -------------------------------------------------------------------- */
+    {
+        struct CTABLE ct;
+        FLP     *cvs;
+
+        memset( &ct, 0, sizeof(ct) );
+        strcpy( ct.id, "transbench synthetic ctable" );
+        ct.ll.u = GRID_LAM_MIN * DEG_TO_RAD;
+        ct.ll.v = GRID_PHI_MIN * DEG_TO_RAD;
+        ct.del.u = GRID_STEP * DEG_TO_RAD;
+        ct.del.v = GRID_STEP * DEG_TO_RAD;
+        ct.lim.lam = cols;
+        ct.lim.phi = rows;
+
+        if( (fp = fopen( grid_files[0], "wb" )) == NULL )
+            emess(3,"unable to write %s", grid_files[0]);
+
+        cvs = (FLP *) malloc( sizeof(FLP) * cols );
+        fwrite( &ct, sizeof(ct), 1, fp );
+        for( row = 0; row < rows; row++ )
+        {
+            for( col = 0; col < cols; col++ )
+            {
+                double dlat, dlon;
+
+                bench_shift( col, row, &dlat, &dlon );
+                cvs[col].lam = (float) (dlon * DEG_TO_RAD / 3600.0);
+                cvs[col].phi = (float) (dlat * DEG_TO_RAD / 3600.0);
+            }
+            fwrite( cvs, sizeof(FLP), cols, fp );
+        }
+        free( cvs );
+        fclose( fp );
+    }
+
+/* -------------------------------------------------------------------- */
+/*      NTv1: big endian, degrees, positive west, rows south to         */
+/*      north with columns stored east to west.                         */
+/* -------------------------------------------------------------------- */
+    {
+        unsigned char header[176], value[16];
+
+        memset( header, ' ', sizeof(header) );
+        bench_record_i( header +   0, "HEADER", 12, 1 );
+        bench_record_d( header +  16, "S LAT", GRID_PHI_MIN, 1 );
+        bench_record_d( header +  32, "N LAT", GRID_PHI_MIN+GRID_EXTENT, 1 );
+        bench_record_d( header +  48, "E LONG",
+                        -(GRID_LAM_MIN+GRID_EXTENT), 1 );
+        bench_record_d( header +  64, "W LONG", -GRID_LAM_MIN, 1 );
+        bench_record_d( header +  80, "N GRID", GRID_STEP, 1 );
+        bench_record_d( header +  96, "W GRID", GRID_STEP, 1 );
+        bench_record_s( header + 112, "TYPE", "SECONDS" );
+        bench_record_s( header + 128, "VERSION", "BENCH" );
+        bench_record_s( header + 144, "TO", "NAD83" );
+        bench_record_s( header + 160, "FROM", "BENCH" );
+
+        if( (fp = fopen( grid_files[1], "wb" )) == NULL )
+            emess(3,"unable to write %s", grid_files[1]);
+
+        fwrite( header, sizeof(header), 1, fp );
+        for( row = 0; row < rows; row++ )
+        {
+            for( col = cols - 1; col >= 0; col-- )
+            {
+                double dlat, dlon;
+
+                bench_shift( col, row, &dlat, &dlon );
+                bench_put_bytes( value, &dlat, 8, 1 );
+                bench_put_bytes( value + 8, &dlon, 8, 1 );
+                fwrite( value, 16, 1, fp );
+            }
+        }
+        fclose( fp );
+    }
+
+/* -------------------------------------------------------------------- */
+/*      NTv2: little endian, arc seconds, positive west, a single       */
+/*      subfile with the same storage order as NTv1.                    */
+/* -------------------------------------------------------------------- */
+    {
+        unsigned char header[176], value[16];
+        float   shift[4];
+
+        memset( header, ' ', sizeof(header) );
+        bench_record_i( header +   0, "NUM_OREC", 11, 0 );
+        bench_record_i( header +  16, "NUM_SREC", 11, 0 );
+        bench_record_i( header +  32, "NUM_FILE", 1, 0 );
+        bench_record_s( header +  48, "GS_TYPE", "SECONDS" );
+        bench_record_s( header +  64, "VERSION", "BENCH" );
+        bench_record_s( header +  80, "SYSTEM_F", "BENCH" );
+        bench_record_s( header +  96, "SYSTEM_T", "WGS84" );
+        bench_record_d( header + 112, "MAJOR_F", 6378206.4, 0 );
+        bench_record_d( header + 128, "MINOR_F", 6356583.8, 0 );
+        bench_record_d( header + 144, "MAJOR_T", 6378137.0, 0 );
+        bench_record_d( header + 160, "MINOR_T", 6356752.314, 0 );
+
+        if( (fp = fopen( grid_files[2], "wb" )) == NULL )
+            emess(3,"unable to write %s", grid_files[2]);
+
+        fwrite( header, sizeof(header), 1, fp );
+
+        memset( header, ' ', sizeof(header) );
+        bench_record_s( header +   0, "SUB_NAME", "BENCH" );
+        bench_record_s( header +  16, "PARENT", "NONE" );
+        bench_record_s( header +  32, "CREATED", "" );
+        bench_record_s( header +  48, "UPDATED", "" );
+        bench_record_d( header +  64, "S_LAT", GRID_PHI_MIN * 3600.0, 0 );
+        bench_record_d( header +  80, "N_LAT",
+                        (GRID_PHI_MIN + GRID_EXTENT) * 3600.0, 0 );
+        bench_record_d( header +  96, "E_LONG",
+                        -(GRID_LAM_MIN + GRID_EXTENT) * 3600.0, 0 );
+        bench_record_d( header + 112, "W_LONG", -GRID_LAM_MIN * 3600.0, 0 );
+        bench_record_d( header + 128, "LAT_INC", GRID_STEP * 3600.0, 0 );
+        bench_record_d( header + 144, "LONG_INC", GRID_STEP * 3600.0, 0 );
+        bench_record_i( header + 160, "GS_COUNT", rows * cols, 0 );
+        fwrite( header, sizeof(header), 1, fp );
+
+        for( row = 0; row < rows; row++ )
+        {
+            for( col = cols - 1; col >= 0; col-- )
+            {
+                double dlat, dlon;
+
+                bench_shift( col, row, &dlat, &dlon );
+                shift[0] = (float) dlat;
+                shift[1] = (float) dlon;
+                shift[2] = shift[3] = 0.0f;
+                bench_put_bytes( value, shift + 0, 4, 0 );
+                bench_put_bytes( value + 4, shift + 1, 4, 0 );
+                bench_put_bytes( value + 8, shift + 2, 4, 0 );
+                bench_put_bytes( value + 12, shift + 3, 4, 0 );
+                fwrite( value, 16, 1, fp );
+            }
+        }
+        fclose( fp );
+    }
+}
+
+/************************************************************************/
+/*                         bench_scenario_pj()                          */
+/************************************************************************/
+
+static int bench_scenario_pj( BENCH_SCENARIO *sc, PJ **src, PJ **dst )
+
+{
+    char defn[MAX_DEFN];
+
+    if( sc->grid != NULL )
+    {
+        const char *file = strcmp(sc->grid,"ctable") == 0 ? grid_files[0]
+            : strcmp(sc->grid,"ntv1") == 0 ? grid_files[1] : grid_files[2];
+
+        sprintf( defn, sc->src, file );
+    }
+    else
+        strcpy( defn, sc->src );
+
+    *src = pj_init_plus( defn );
+    *dst = pj_init_plus( sc->dst );
+
+    if( *src == NULL || *dst == NULL )
+    {
+        if( *src != NULL )
+            pj_free( *src );
+        if( *dst != NULL )
+            pj_free( *dst );
+        return 0;
+    }
+
+    return 1;
+}
+
+/************************************************************************/
+/*                          bench_fill_pool()                           */
+/*                                                                      */
+/*      Random inputs inside the synthetic grid extent, projected       */
+/*      through the source definition when it is not geographic.        */
+/************************************************************************/
+
+static void bench_fill_pool( PJ *src, double *x, double *y )
+
+{
+    long i;
+
+    for( i = 0; i < POOL_SIZE; i++ )
+    {
+        x[i] = (GRID_LAM_MIN + GRID_STEP
+                + bench_random() * (GRID_EXTENT - 2*GRID_STEP)) * DEG_TO_RAD;
+        y[i] = (GRID_PHI_MIN + GRID_STEP
+                + bench_random() * (GRID_EXTENT - 2*GRID_STEP)) * DEG_TO_RAD;
+
+        if( !src->is_latlong )
+        {
+            projUV  lp, xy;
+
+            lp.u = x[i];
+            lp.v = y[i];
+            xy = pj_fwd( lp, src );
+            x[i] = xy.u;
+            y[i] = xy.v;
+        }
+    }
+}
+
+/************************************************************************/
+/*                            bench_worker()                            */
+/*                                                                      */
+/*      Transform job->total points in calls of job->batch points.      */
+/*      Each call refills its buffer from the pool since                */
+/*      pj_transform() works in place; the copy is part of the          */
+/*      measured time but is small next to any transform.               */
+/************************************************************************/
+
+static void *bench_worker( void *arg )
+
+{
+    BENCH_JOB   *job = (BENCH_JOB *) arg;
+    long        done = 0, pool_pos = 0;
+
+    while( done < job->total )
+    {
+        long    count = job->total - done, filled = 0;
+
+        if( count > job->batch )
+            count = job->batch;
+
+        while( filled < count )
+        {
+            long n = count - filled;
+
+            if( n > POOL_SIZE - pool_pos )
+                n = POOL_SIZE - pool_pos;
+
+            memcpy( job->x + filled, job->pool_x + pool_pos,
+                    sizeof(double) * n );
+            memcpy( job->y + filled, job->pool_y + pool_pos,
+                    sizeof(double) * n );
+            if( job->use_z )
+                memset( job->z + filled, 0, sizeof(double) * n );
+
+            filled += n;
+            pool_pos = (pool_pos + n) % POOL_SIZE;
+        }
+
+        /*
+        ** Failed points are counted from the outputs, but pj_transform()
+        ** itself decides between failing the call and marking a point
+        ** HUGE_VAL through the process wide pj_errno, which other threads
+        ** overwrite, so the counts are exact only with 1 thread.
+        */
+        if( pj_transform( job->src, job->dst, count, 1, job->x, job->y,
+                          job->use_z ? job->z : NULL ) != 0 )
+            job->failures += count;
+        else
+        {
+            long i;
+
+            for( i = 0; i < count; i++ )
+                if( job->x[i] == HUGE_VAL )
+                    job->failures++;
+        }
+
+        done += count;
+    }
+
+    return NULL;
+}
+
+/************************************************************************/
+/*                           bench_scenario()                           */
+/************************************************************************/
+
+static void bench_scenario( FILE *fp, BENCH_SCENARIO *sc,
+                            long *batches, int batch_count,
+                            int max_threads, long total, int use_z )
+
+{
+    BENCH_JOB   jobs[64];
+    double      *pool_x, *pool_y;
+    PJ          *src, *dst;
+    int         b, threads, t;
+
+    if( !bench_scenario_pj( sc, &src, &dst ) )
+    {
+        fprintf( fp, "%s,init-failed,,,,,,\n", sc->name );
+        return;
+    }
+
+    pool_x = (double *) malloc( sizeof(double) * POOL_SIZE );
+    pool_y = (double *) malloc( sizeof(double) * POOL_SIZE );
+    if( pool_x == NULL || pool_y == NULL )
+        emess(3,"out of memory for input pool");
+
+    bench_fill_pool( src, pool_x, pool_y );
+
+/* -------------------------------------------------------------------- */
+/*      Every thread gets its own pair of definitions, created up       */
+/*      front since pj_init() is not thread safe.                       */
+/* -------------------------------------------------------------------- */
+    jobs[0].src = src;
+    jobs[0].dst = dst;
+    for( t = 1; t < max_threads; t++ )
+    {
+        if( !bench_scenario_pj( sc, &jobs[t].src, &jobs[t].dst ) )
+            emess(3,"failed to initialize %s for thread %d", sc->name, t);
+    }
+
+    for( b = 0; b < batch_count; b++ )
+    {
+        long batch = batches[b];
+        long per_thread = total > batch ? total : batch;
+
+        for( t = 0; t < max_threads; t++ )
+        {
+            jobs[t].x = (double *) malloc( sizeof(double) * batch );
+            jobs[t].y = (double *) malloc( sizeof(double) * batch );
+            jobs[t].z = use_z ? (double *) malloc(sizeof(double) * batch)
+                : NULL;
+            if( jobs[t].x == NULL || jobs[t].y == NULL
+                || (use_z && jobs[t].z == NULL) )
+                emess(3,"out of memory for batch of %ld points", batch);
+
+            jobs[t].pool_x = pool_x;
+            jobs[t].pool_y = pool_y;
+            jobs[t].batch = batch;
+            jobs[t].total = per_thread;
+            jobs[t].use_z = use_z;
+
+            /* warm up, this also loads any grid shift file */
+            jobs[t].total = batch < POOL_SIZE ? batch : POOL_SIZE;
+            bench_worker( jobs + t );
+            jobs[t].total = per_thread;
+        }
+
+        for( threads = 1; threads <= max_threads; )
+        {
+            double  start, elapsed;
+            long    failures = 0;
+
+            for( t = 0; t < threads; t++ )
+                jobs[t].failures = 0;
+
+            start = bench_now();
+#ifdef BENCH_NO_THREADS
+            bench_worker( jobs );
+#else
+            {
+                pthread_t tids[64];
+
+                for( t = 1; t < threads; t++ )
+                    pthread_create( tids + t, NULL, bench_worker, jobs + t );
+                bench_worker( jobs );
+                for( t = 1; t < threads; t++ )
+                    pthread_join( tids[t], NULL );
+            }
+#endif
+            elapsed = bench_now() - start;
+
+            for( t = 0; t < threads; t++ )
+                failures += jobs[t].failures;
+
+            fprintf( fp, "%s,ok,%ld,%d,%ld,%.6f,%.0f,%.2f,%ld\n",
+                     sc->name, batch, threads, per_thread * threads,
+                     elapsed, per_thread * threads / elapsed,
+                     elapsed * 1e9 / per_thread, failures );
+            fflush( fp );
+
+            if( threads == max_threads )
+                break;
+            threads = threads * 2 > max_threads ? max_threads : threads * 2;
+        }
+
+        for( t = 0; t < max_threads; t++ )
+        {
+            free( jobs[t].x );
+            free( jobs[t].y );
+            if( jobs[t].z != NULL )
+                free( jobs[t].z );
+        }
+    }
+
+    for( t = 0; t < max_threads; t++ )
+    {
+        pj_free( jobs[t].src );
+        pj_free( jobs[t].dst );
+    }
+
+    free( pool_x );
+    free( pool_y );
+}
+
+/************************************************************************/
+/*                                main()                                */
+/************************************************************************/
+
+int main( int argc, char **argv )
+
+{
+    long    batches[MAX_BATCHES], total = 1000000;
+    int     batch_count = 0, max_threads = 1, use_z = 0, keep = 0;
+    int     namec = 0, i;
+    char    **namev;
+    const char *dir = getenv( "TMPDIR" );
+    FILE    *fp = stdout;
+    BENCH_SCENARIO *sc;
+
+    if( (emess_dat.Prog_name = strrchr(*argv,DIR_CHAR)) != NULL )
+        ++emess_dat.Prog_name;
+    else emess_dat.Prog_name = *argv;
+
+    if( dir == NULL )
+        dir = ".";
+
+    namev = (char **) malloc( sizeof(char *) * argc );
+
+    for( i = 1; i < argc; i++ )
+    {
+        const char *arg = argv[i];
+
+        if( arg[0] != '-' )
+        {
+            namev[namec++] = argv[i];
+            continue;
+        }
+
+        switch( arg[1] )
+        {
+          case 'z':
+            use_z = 1;
+            continue;
+          case 'k':
+            keep = 1;
+            continue;
+          case 'n': case 'b': case 't': case 'd': case 'o':
+            if( arg[2] != '\0' || i == argc - 1 )
+                break;
+            arg = argv[++i];
+            switch( argv[i-1][1] )
+            {
+              case 'n':
+                total = atol( arg );
+                break;
+              case 'b':
+                for( batch_count = 0; *arg && batch_count < MAX_BATCHES; )
+                {
+                    char *end;
+
+                    batches[batch_count++] = strtol( arg, &end, 10 );
+                    arg = *end == ',' ? end + 1 : end;
+                }
+                break;
+              case 't':
+                max_threads = atoi( arg );
+                break;
+              case 'd':
+                dir = arg;
+                break;
+              case 'o':
+                if( (fp = fopen( arg, "w" )) == NULL )
+                    emess(3,"unable to open output file %s", arg);
+                break;
+            }
+            continue;
+        }
+
+        (void)fprintf(stderr, usage, pj_get_release(), emess_dat.Prog_name);
+        exit(0);
+    }
+
+    if( batch_count == 0 )
+    {
+        long batch;
+
+        for( batch = 1; batch <= 10000000; batch *= 10 )
+            batches[batch_count++] = batch;
+    }
+
+    for( i = 0; i < batch_count; i++ )
+        if( batches[i] < 1 )
+            emess(1,"batch sizes must be positive");
+
+    if( total < 1 )
+        emess(1,"point count must be positive");
+
+#ifdef BENCH_NO_THREADS
+    max_threads = 1;
+#endif
+    if( max_threads < 1 || max_threads > 64 )
+        emess(1,"thread count must be between 1 and 64");
+
+    bench_write_grids( dir );
+
+    fprintf( fp, "scenario,status,batch,threads,points,seconds,"
+             "points_per_sec,thread_wall_ns_per_point,failed_points\n" );
+
+    for( sc = scenarios; sc->name != NULL; sc++ )
+    {
+        if( namec > 0 )
+        {
+            int j;
+
+            for( j = 0; j < namec; j++ )
+                if( strcmp( namev[j], sc->name ) == 0 )
+                    break;
+            if( j == namec )
+                continue;
+        }
+
+        bench_seed = 1;
+        bench_scenario( fp, sc, batches, batch_count, max_threads,
+                        total, use_z );
+    }
+
+    if( !keep )
+    {
+        for( i = 0; i < 3; i++ )
+            remove( grid_files[i] );
+    }
+
+    if( fp != stdout )
+        fclose( fp );
+
+    free( namev );
+
+    return 0;
+}